@@ -0,0 +1,435 @@
+// RHBulkTransfer.cpp
+//
+// Author: Mike McCauley (mikem@airspayce.com)
+// Copyright (C) 2014 Mike McCauley
+// $Id: RHBulkTransfer.cpp $
+
+#include <RHBulkTransfer.h>
+
+////////////////////////////////////////////////////////////////////
+// Constructors
+RHBulkTransfer::RHBulkTransfer(RHReliableDatagram& manager, uint8_t blockLen)
+    : _manager(manager)
+{
+    _blockLen = blockLen;
+    if (_blockLen > RH_BULK_MAX_BLOCK_LEN)
+	_blockLen = RH_BULK_MAX_BLOCK_LEN;
+    if (_blockLen == 0)
+	_blockLen = 1;
+    _timeout = RH_BULK_DEFAULT_TIMEOUT;
+    _retries = RH_BULK_DEFAULT_RETRIES;
+    _windowSize = RH_BULK_WINDOW;
+    _retransmissions = 0;
+    _offer = NULL;
+    _write = NULL;
+    _arg = NULL;
+    _rxState = ReceiveIdle;
+    _rxFrom = RH_BROADCAST_ADDRESS;
+    _rxTransferId = 0;
+    _rxSize = 0;
+    _rxBlockLen = 0;
+    _rxCount = 0;
+    _rxBase = 0;
+    _rxUpdated = 0;
+    memset(_rxSlotBlock, 0xff, sizeof(_rxSlotBlock));
+}
+
+////////////////////////////////////////////////////////////////////
+void RHBulkTransfer::setTimeout(uint16_t timeout)
+{
+    _timeout = timeout;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHBulkTransfer::setRetries(uint8_t retries)
+{
+    _retries = retries;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHBulkTransfer::setWindowSize(uint8_t windowSize)
+{
+    _windowSize = windowSize;
+    if (_windowSize > RH_BULK_WINDOW)
+	_windowSize = RH_BULK_WINDOW;
+    if (_windowSize == 0)
+	_windowSize = 1;
+}
+
+////////////////////////////////////////////////////////////////////
+uint8_t RHBulkTransfer::blockLength()
+{
+    return _blockLen;
+}
+
+////////////////////////////////////////////////////////////////////
+uint32_t RHBulkTransfer::retransmissions()
+{
+    return _retransmissions;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHBulkTransfer::resetRetransmissions()
+{
+    _retransmissions = 0;
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHBulkTransfer::sendControl(uint8_t* buf, uint8_t len, uint8_t address)
+{
+    _manager.setHeaderFlags(RH_FLAGS_BULK);
+    bool ret = _manager.sendtoWait(buf, len, address);
+    _manager.setHeaderFlags(RH_FLAGS_NONE, RH_FLAGS_BULK);
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////
+// Sender
+uint8_t RHBulkTransfer::send(uint8_t address, uint16_t transferId, uint32_t size, ReadFunction read, void* arg)
+{
+    uint32_t count = (size + _blockLen - 1) / _blockLen;
+    if (count > 0xffff || address == RH_BROADCAST_ADDRESS)
+	return RH_BULK_ERROR_INVALID_LENGTH;
+
+    uint16_t base = 0;
+    uint8_t have[RH_BULK_WINDOW / 8];
+    uint8_t window = _windowSize; // Until the receiver tells us its own
+    _sentEnd = 0;
+    bool started = false; // Have had a STATUS
+    uint8_t tries = 0;
+    while (true)
+    {
+	uint8_t err;
+	if (!started)
+	{
+	    uint8_t offer[8];
+	    offer[0] = RH_BULK_TYPE_OFFER;
+	    offer[1] = transferId >> 8;
+	    offer[2] = transferId;
+	    offer[3] = size >> 24;
+	    offer[4] = size >> 16;
+	    offer[5] = size >> 8;
+	    offer[6] = size;
+	    offer[7] = _blockLen;
+	    err = sendControl(offer, sizeof(offer), address) ? waitStatus(address, transferId, &base, have, &window) : RH_BULK_ERROR_TIMEOUT;
+	}
+	else
+	{
+	    if ((err = sendWindow(address, transferId, size, base, have, window, read, arg)) != RH_BULK_ERROR_NONE)
+	    {
+		sendAbort(address, transferId, err);
+		return err;
+	    }
+	    err = waitStatus(address, transferId, &base, have, &window);
+	}
+	if (err == RH_BULK_ERROR_NONE)
+	{
+	    started = true;
+	    tries = 0;
+	    if (base >= count)
+		return RH_BULK_ERROR_NONE;
+	}
+	else if (err != RH_BULK_ERROR_TIMEOUT)
+	    return err;
+	else if (tries++ >= _retries)
+	    return RH_BULK_ERROR_TIMEOUT;
+	YIELD;
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+uint8_t RHBulkTransfer::sendWindow(uint8_t address, uint16_t transferId, uint32_t size, uint16_t base, const uint8_t* have,
+				   uint8_t window, ReadFunction read, void* arg)
+{
+    uint32_t count = (size + _blockLen - 1) / _blockLen;
+    uint32_t end = base + window;
+    if (end > count)
+	end = count;
+    // The last missing block asks for a STATUS
+    uint16_t last = base;
+    uint8_t i;
+    for (i = 0; base + i < end; i++)
+	if (!(have[i >> 3] & (1 << (i & 7))))
+	    last = base + i;
+
+    for (i = 0; base + i < end; i++)
+    {
+	if (have[i >> 3] & (1 << (i & 7)))
+	    continue; // Receiver already has it
+	uint16_t block = base + i;
+	uint32_t offset = (uint32_t)block * _blockLen;
+	uint8_t len = (size - offset) < _blockLen ? size - offset : _blockLen;
+	if (read(arg, offset, _frame + RH_BULK_DATA_HEADER_LEN, len) != len)
+	    return RH_BULK_ERROR_READ;
+	_frame[0] = (block == last) ? RH_BULK_TYPE_POLL : RH_BULK_TYPE_DATA;
+	_frame[1] = transferId >> 8;
+	_frame[2] = transferId;
+	_frame[3] = block >> 8;
+	_frame[4] = block;
+	_manager.setHeaderFlags(RH_FLAGS_BULK);
+	_manager.sendtoNoAck(_frame, len + RH_BULK_DATA_HEADER_LEN, address);
+	_manager.setHeaderFlags(RH_FLAGS_NONE, RH_FLAGS_BULK);
+	if (block < _sentEnd)
+	    _retransmissions++;
+	else
+	    _sentEnd = block + 1;
+	YIELD;
+    }
+    // The timeout for the STATUS starts when the last block has gone
+    _manager.waitPacketSent();
+    return RH_BULK_ERROR_NONE;
+}
+
+////////////////////////////////////////////////////////////////////
+uint8_t RHBulkTransfer::waitStatus(uint8_t address, uint16_t transferId, uint16_t* base, uint8_t* have, uint8_t* window)
+{
+    unsigned long starttime = millis();
+    int32_t timeLeft;
+    while ((timeLeft = _timeout - (millis() - starttime)) > 0)
+    {
+	uint8_t len = sizeof(_frame);
+	uint8_t from, flags;
+	if (   _manager.recvfromAckTimeout(_frame, &len, timeLeft, &from, NULL, NULL, &flags)
+	    && (flags & RH_FLAGS_BULK)
+	    && from == address
+	    && len >= 3
+	    && ((_frame[1] << 8) | _frame[2]) == transferId)
+	{
+	    // The receiver's window may be smaller or larger than ours, and sets the size of its bitmap
+	    uint8_t bitmapLen = len >= 6 ? (_frame[5] + 7) / 8 : 0;
+	    if (_frame[0] == RH_BULK_TYPE_STATUS && len >= 6 && _frame[5] && len >= 6 + bitmapLen)
+	    {
+		*base = (_frame[3] << 8) | _frame[4];
+		*window = _frame[5] < _windowSize ? _frame[5] : _windowSize;
+		if (bitmapLen > RH_BULK_WINDOW / 8)
+		    bitmapLen = RH_BULK_WINDOW / 8;
+		memset(have, 0, RH_BULK_WINDOW / 8);
+		memcpy(have, _frame + 6, bitmapLen);
+		return RH_BULK_ERROR_NONE;
+	    }
+	    else if (_frame[0] == RH_BULK_TYPE_ABORT && len >= 4)
+		return _frame[3] != RH_BULK_ERROR_NONE ? _frame[3] : RH_BULK_ERROR_ABORTED;
+	}
+	// Else discard it
+	YIELD;
+    }
+    return RH_BULK_ERROR_TIMEOUT;
+}
+
+////////////////////////////////////////////////////////////////////
+// Receiver
+void RHBulkTransfer::setReceiver(OfferFunction offer, WriteFunction write, void* arg)
+{
+    _offer = offer;
+    _write = write;
+    _arg = arg;
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHBulkTransfer::receiving()
+{
+    return _rxState == ReceiveActive;
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHBulkTransfer::recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* from)
+{
+    uint8_t frameLen = sizeof(_frame);
+    uint8_t _from, _flags;
+    while (_manager.recvfromAck(_frame, &frameLen, &_from, NULL, NULL, &_flags))
+    {
+	if (!(_flags & RH_FLAGS_BULK))
+	{
+	    // Not ours
+	    if (*len > frameLen)
+		*len = frameLen;
+	    memcpy(buf, _frame, *len);
+	    if (from) *from = _from;
+	    return true;
+	}
+	handleMessage(_from, frameLen);
+	frameLen = sizeof(_frame);
+    }
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHBulkTransfer::handleMessage(uint8_t from, uint8_t len)
+{
+    if (len < 3)
+	return;
+    uint16_t transferId = (_frame[1] << 8) | _frame[2];
+    switch (_frame[0])
+    {
+	case RH_BULK_TYPE_OFFER:
+	    if (len >= 8)
+		handleOffer(from, transferId);
+	    break;
+
+	case RH_BULK_TYPE_DATA:
+	case RH_BULK_TYPE_POLL:
+	    if (len >= RH_BULK_DATA_HEADER_LEN)
+		handleData(from, transferId, len);
+	    break;
+
+	default:
+	    // STATUS and ABORT are only expected by send()
+	    break;
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+void RHBulkTransfer::handleOffer(uint8_t from, uint16_t transferId)
+{
+    uint32_t size = ((uint32_t)_frame[3] << 24) | ((uint32_t)_frame[4] << 16) | ((uint32_t)_frame[5] << 8) | _frame[6];
+    uint8_t blockLen = _frame[7];
+
+    if (   _rxState != ReceiveIdle
+	&& _rxFrom == from
+	&& _rxTransferId == transferId
+	&& _rxSize == size
+	&& _rxBlockLen == blockLen)
+    {
+	// The sender is resuming the transfer we already have: tell it how far we got
+	_rxUpdated = millis();
+	sendStatus();
+	return;
+    }
+    if (_rxState == ReceiveActive && millis() - _rxUpdated < RH_BULK_SESSION_TIMEOUT)
+    {
+	sendAbort(from, transferId, RH_BULK_ERROR_BUSY);
+	return;
+    }
+    uint32_t count = blockLen ? (size + blockLen - 1) / blockLen : 0;
+    if (blockLen == 0 || blockLen > RH_BULK_MAX_BLOCK_LEN || count > 0xffff)
+    {
+	sendAbort(from, transferId, RH_BULK_ERROR_INVALID_LENGTH);
+	return;
+    }
+    uint32_t offset = 0;
+    if (!_write)
+	offset = RH_BULK_REJECT;
+    else if (_offer)
+	offset = _offer(_arg, from, transferId, size);
+    if (offset == RH_BULK_REJECT)
+    {
+	sendAbort(from, transferId, RH_BULK_ERROR_REJECTED);
+	return;
+    }
+    if (offset > size)
+	offset = size;
+
+    _rxFrom = from;
+    _rxTransferId = transferId;
+    _rxSize = size;
+    _rxBlockLen = blockLen;
+    _rxCount = count;
+    _rxBase = offset / blockLen;
+    _rxUpdated = millis();
+    _rxState = _rxBase < _rxCount ? ReceiveActive : ReceiveComplete;
+    memset(_rxSlotBlock, 0xff, sizeof(_rxSlotBlock));
+    sendStatus();
+}
+
+////////////////////////////////////////////////////////////////////
+void RHBulkTransfer::handleData(uint8_t from, uint16_t transferId, uint8_t len)
+{
+    bool poll = _frame[0] == RH_BULK_TYPE_POLL;
+    if (_rxState == ReceiveIdle || from != _rxFrom || transferId != _rxTransferId)
+    {
+	// We dont know this transfer (any more): stop the sender wasting its time
+	if (poll)
+	    sendAbort(from, transferId, RH_BULK_ERROR_ABORTED);
+	return;
+    }
+    _rxUpdated = millis();
+
+    uint16_t block = (_frame[3] << 8) | _frame[4];
+    uint8_t* data = _frame + RH_BULK_DATA_HEADER_LEN;
+    uint8_t dataLen = len - RH_BULK_DATA_HEADER_LEN;
+    if (   _rxState == ReceiveActive
+	&& block >= _rxBase
+	&& block - _rxBase < RH_BULK_WINDOW
+	&& block < _rxCount
+	&& dataLen == receiveBlockLength(block))
+    {
+	if (block == _rxBase)
+	{
+	    // The next one in order: straight through, followed by any that arrived early
+	    if (!deliver(block, data, dataLen))
+		return;
+	    _rxBase++;
+	    uint8_t slot;
+	    while (_rxBase < _rxCount && _rxSlotBlock[(slot = _rxBase % RH_BULK_WINDOW)] == _rxBase)
+	    {
+		_rxSlotBlock[slot] = 0xffff;
+		if (!deliver(_rxBase, _rxBlocks[slot], receiveBlockLength(_rxBase)))
+		    return;
+		_rxBase++;
+	    }
+	    if (_rxBase >= _rxCount)
+	    {
+		// Tell the sender now, it may be waiting already
+		_rxState = ReceiveComplete;
+		sendStatus();
+		return;
+	    }
+	}
+	else
+	{
+	    uint8_t slot = block % RH_BULK_WINDOW;
+	    memcpy(_rxBlocks[slot], data, dataLen);
+	    _rxSlotBlock[slot] = block;
+	}
+    }
+    // Else its a duplicate or out of the window
+    if (poll)
+	sendStatus();
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHBulkTransfer::deliver(uint16_t block, const uint8_t* buf, uint8_t len)
+{
+    if (_write(_arg, _rxFrom, (uint32_t)block * _rxBlockLen, buf, len))
+	return true;
+    _rxState = ReceiveIdle;
+    sendAbort(_rxFrom, _rxTransferId, RH_BULK_ERROR_ABORTED);
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////
+uint8_t RHBulkTransfer::receiveBlockLength(uint16_t block)
+{
+    uint32_t offset = (uint32_t)block * _rxBlockLen;
+    return (_rxSize - offset) < _rxBlockLen ? _rxSize - offset : _rxBlockLen;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHBulkTransfer::sendStatus()
+{
+    // Advertise our window, which may be smaller than RH_BULK_WINDOW (see setWindowSize())
+    uint8_t status[6 + RH_BULK_WINDOW / 8];
+    uint8_t bitmapLen = (_windowSize + 7) / 8;
+    status[0] = RH_BULK_TYPE_STATUS;
+    status[1] = _rxTransferId >> 8;
+    status[2] = _rxTransferId;
+    status[3] = _rxBase >> 8;
+    status[4] = _rxBase;
+    status[5] = _windowSize;
+    memset(status + 6, 0, bitmapLen);
+    for (uint8_t i = 0; i < _windowSize; i++)
+	if (_rxSlotBlock[(uint16_t)(_rxBase + i) % RH_BULK_WINDOW] == (uint16_t)(_rxBase + i))
+	    status[6 + (i >> 3)] |= 1 << (i & 7);
+    sendControl(status, 6 + bitmapLen, _rxFrom);
+}
+
+////////////////////////////////////////////////////////////////////
+void RHBulkTransfer::sendAbort(uint8_t address, uint16_t transferId, uint8_t reason)
+{
+    uint8_t abort[4];
+    abort[0] = RH_BULK_TYPE_ABORT;
+    abort[1] = transferId >> 8;
+    abort[2] = transferId;
+    abort[3] = reason;
+    sendControl(abort, sizeof(abort), address);
+}
@@ -0,0 +1,379 @@
+// RHBulkTransfer.h
+//
+// Author: Mike McCauley (mikem@airspayce.com)
+// Copyright (C) 2014 Mike McCauley
+// $Id: RHBulkTransfer.h $
+
+#ifndef RHBulkTransfer_h
+#define RHBulkTransfer_h
+
+#include <RHReliableDatagram.h>
+
+// The bulk transfer bit in the FLAGS. All messages sent by RHBulkTransfer have this bit set,
+// so they can be told apart from other messages exchanged through the same manager.
+#define RH_FLAGS_BULK 0x10
+
+// The first octet of each RHBulkTransfer message gives its type
+#define RH_BULK_TYPE_OFFER  'O'
+#define RH_BULK_TYPE_STATUS 'S'
+#define RH_BULK_TYPE_ABORT  'A'
+#define RH_BULK_TYPE_DATA   'D'
+#define RH_BULK_TYPE_POLL   'P'
+
+// The number of octets of header at the start of every data block message: the type,
+// the transfer ID and the block number
+#define RH_BULK_DATA_HEADER_LEN 5
+
+// The largest number of blocks the sender may send ahead of the first block the receiver is missing.
+// The receiver buffers up to this many blocks that arrive out of order, and reports them in a
+// bitmap of up to RH_BULK_WINDOW / 8 octets. Must be a multiple of 8, up to 128. Nodes with different
+// values work together: each transfer uses the smaller window of the sender and the receiver.
+// Can be pre-defined to a different size prior to including this header.
+// Defaults to 8 on AVR and 32 elsewhere.
+#ifndef RH_BULK_WINDOW
+ #ifdef __AVR__
+  #define RH_BULK_WINDOW 8
+ #else
+  #define RH_BULK_WINDOW 32
+ #endif
+#endif
+
+// The largest block RHBulkTransfer can send or receive, in octets.
+// The receive buffer costs RH_BULK_WINDOW * RH_BULK_MAX_BLOCK_LEN octets of SRAM.
+// Can be pre-defined to a different size prior to including this header.
+// Defaults to 32 on AVR and the largest possible elsewhere.
+#ifndef RH_BULK_MAX_BLOCK_LEN
+ #ifdef __AVR__
+  #define RH_BULK_MAX_BLOCK_LEN 32
+ #else
+  #define RH_BULK_MAX_BLOCK_LEN (RH_MAX_MESSAGE_LEN - RH_BULK_DATA_HEADER_LEN)
+ #endif
+#endif
+
+/// The default time in milliseconds that the sender waits for a status report from the receiver
+#define RH_BULK_DEFAULT_TIMEOUT 1000
+
+/// The default number of times the sender tries again when no status report arrives
+#define RH_BULK_DEFAULT_RETRIES 5
+
+/// The time in milliseconds after the last message of an unfinished transfer before the receiver
+/// will accept a transfer from a different sender
+#define RH_BULK_SESSION_TIMEOUT 30000
+
+/// Returned by an OfferFunction to refuse a transfer
+#define RH_BULK_REJECT 0xffffffff
+
+// Error codes
+#define RH_BULK_ERROR_NONE              0
+#define RH_BULK_ERROR_INVALID_LENGTH    1
+#define RH_BULK_ERROR_TIMEOUT           2
+#define RH_BULK_ERROR_REJECTED          3
+#define RH_BULK_ERROR_BUSY              4
+#define RH_BULK_ERROR_ABORTED           5
+#define RH_BULK_ERROR_READ              6
+
+/////////////////////////////////////////////////////////////////////
+/// \class RHBulkTransfer RHBulkTransfer.h <RHBulkTransfer.h>
+/// \brief Streams large objects such as firmware images and logs over RHReliableDatagram
+///
+/// Sending a large object with RHReliableDatagram::sendtoWait() waits for an ACK after every frame, so
+/// the link is idle for most of each round trip. RHBulkTransfer instead sends a window of numbered
+/// blocks back to back with RHReliableDatagram::sendtoNoAck(), and the receiver replies once per window
+/// with a status report listing the blocks it has, so only the missing blocks are sent again
+/// (selective repeat).
+///
+/// The sender's data is read, and the receiver's data is written, a block at a time through
+/// callback functions, so neither needs to hold the whole object in memory: the receiver only buffers
+/// up to RH_BULK_WINDOW blocks that arrive out of order, and calls the WriteFunction for each block in order.
+///
+/// \par Protocol
+///
+/// All messages carry RH_FLAGS_BULK, and start with a type octet and the 16 bit transfer ID chosen by
+/// the sender. Multi-octet fields are sent most significant octet first.
+/// \li OFFER (sent with sendtoWait()): 4 octets of object size, and the block length
+/// \li STATUS (sent with sendtoWait()): 2 octets of the first block the receiver does not have (the base),
+/// 1 octet of the receiver's window W (the number of blocks it can buffer from the base, see setWindowSize()),
+/// followed by a bitmap of (W + 7) / 8 octets: bit i of octet j is set if the receiver has block base + 8 * j + i.
+/// A base equal to the number of blocks means the transfer is complete.
+/// \li ABORT (sent with sendtoWait()): an RH_BULK_ERROR_* code giving the reason
+/// \li DATA or POLL (sent with sendtoNoAck()): 2 octets of block number followed by the block. A POLL is
+/// a data block that also asks for a STATUS.
+///
+/// The sender offers the transfer and waits for a STATUS. It then sends each missing block from the base up to
+/// the smaller of its own window and the receiver's window ahead, sending the last one as a POLL, and waits for the next STATUS. If none arrives,
+/// it sends the missing blocks again (or the OFFER, if there was no STATUS yet), up to the number of retries.
+///
+/// \par Resuming
+///
+/// When an OFFER arrives for a new transfer, the receiver calls its OfferFunction, which can accept it,
+/// refuse it, or return how much of the object it already has (eg from an earlier attempt that was stored
+/// in flash). The receiver then starts from the block containing that offset, and the sender only sends the
+/// rest. If the sender offers the transfer the receiver is already working on (same sender, transfer ID,
+/// size and block length), for example after send() timed out or the sender restarted, the receiver
+/// simply reports how far it has got. So an interrupted transfer is resumed by calling send() again
+/// with the same transfer ID.
+///
+/// \par Usage
+///
+/// The receiver calls setReceiver(), and then calls recvfromAck() frequently instead of the manager's
+/// own recvfromAck(). Other messages are returned by recvfromAck() as usual.
+/// The receiver handles one transfer at a time, and refuses offers from other senders with RH_BULK_ERROR_BUSY
+/// until the current one has been idle for RH_BULK_SESSION_TIMEOUT.
+/// send() blocks until the transfer is complete or fails, and discards any other messages that arrive meanwhile.
+///
+/// \code
+/// RHReliableDatagram manager(driver, MY_ADDRESS);
+/// RHBulkTransfer bulk(manager, driver.maxMessageLength() - RH_BULK_DATA_HEADER_LEN);
+///
+/// // Sender
+/// uint8_t readImage(void* arg, uint32_t offset, uint8_t* buf, uint8_t len)
+/// {
+///     memcpy(buf, image + offset, len);
+///     return len;
+/// }
+/// ...
+/// if (bulk.send(SERVER_ADDRESS, IMAGE_VERSION, sizeof(image), readImage, NULL) == RH_BULK_ERROR_NONE)
+///     ....
+///
+/// // Receiver
+/// bool writeImage(void* arg, uint8_t from, uint32_t offset, const uint8_t* buf, uint8_t len)
+/// {
+///     return writeFlash(offset, buf, len);
+/// }
+/// ...
+/// bulk.setReceiver(NULL, writeImage, NULL);
+/// ...
+/// if (bulk.recvfromAck(buf, &len, &from))
+///     ....
+/// \endcode
+///
+/// RHBulkTransfer needs RH_FLAGS_NO_ACK support in the RHReliableDatagram of both nodes.
+/// It only runs over RHReliableDatagram directly, not RHRouter or RHMesh.
+/// RHBulkTransfer does not call the manager's init(), which should be called before using RHBulkTransfer.
+///
+/// See the example simulator_bulk_transfer.pde
+class RHBulkTransfer
+{
+public:
+    /// Called by send() to get each block of the object to send
+    /// \param[in] arg The arg passed to send()
+    /// \param[in] offset The offset of the block in the object
+    /// \param[in] buf Location to copy the block to
+    /// \param[in] len The number of octets to copy
+    /// \return The number of octets copied. Anything other than len aborts the transfer
+    typedef uint8_t (*ReadFunction)(void* arg, uint32_t offset, uint8_t* buf, uint8_t len);
+
+    /// Called by the receiver when a new transfer is offered
+    /// \param[in] arg The arg passed to setReceiver()
+    /// \param[in] from The address of the sender
+    /// \param[in] transferId The ID of the transfer chosen by the sender
+    /// \param[in] size The size of the object in octets
+    /// \return RH_BULK_REJECT to refuse the transfer, otherwise the number of octets of the object the
+    /// receiver already has. The transfer starts from the beginning of the block containing this offset,
+    /// so some octets before it may be written again.
+    typedef uint32_t (*OfferFunction)(void* arg, uint8_t from, uint16_t transferId, uint32_t size);
+
+    /// Called by the receiver for each block of the object, in order
+    /// \param[in] arg The arg passed to setReceiver()
+    /// \param[in] from The address of the sender
+    /// \param[in] offset The offset of the block in the object
+    /// \param[in] buf The block
+    /// \param[in] len The number of octets in the block
+    /// \return true to continue, false to abort the transfer
+    typedef bool (*WriteFunction)(void* arg, uint8_t from, uint32_t offset, const uint8_t* buf, uint8_t len);
+
+    /// Constructor.
+    /// \param[in] manager The manager to send and receive the messages with
+    /// \param[in] blockLen The number of octets in each block sent. A block and RH_BULK_DATA_HEADER_LEN octets of header
+    /// must fit in one message of the driver. Limited to RH_BULK_MAX_BLOCK_LEN.
+    /// The receiver uses the block length chosen by the sender.
+    RHBulkTransfer(RHReliableDatagram& manager, uint8_t blockLen = RH_BULK_MAX_BLOCK_LEN);
+
+    /// Sets how long send() waits for a status report from the receiver before trying again
+    /// \param[in] timeout The time in milliseconds. Default is RH_BULK_DEFAULT_TIMEOUT
+    void setTimeout(uint16_t timeout);
+
+    /// Sets how many times send() tries again when no status report arrives, before giving up
+    /// \param[in] retries The number of retries. Default is RH_BULK_DEFAULT_RETRIES
+    void setRetries(uint8_t retries);
+
+    /// Sets the window: the number of blocks send() sends ahead of the first block the receiver is missing,
+    /// before waiting for a status report, and the number of blocks the receiver advertises in its status reports.
+    /// The sender uses the smaller of its own window and the receiver's, so a receiver whose driver can only
+    /// queue a few frames can limit all its senders. Values larger than RH_BULK_WINDOW are reduced to RH_BULK_WINDOW.
+    /// \param[in] windowSize The number of blocks. Default is RH_BULK_WINDOW
+    void setWindowSize(uint8_t windowSize);
+
+    /// Returns the number of octets in each block sent
+    /// \return The block length
+    uint8_t blockLength();
+
+    /// Sends an object to the address, blocking until the receiver has all of it or the transfer fails.
+    /// Any other messages received meanwhile are discarded.
+    /// \param[in] address The address of the receiver
+    /// \param[in] transferId Identifies the object. Calling send() again with the same transferId resumes
+    /// an interrupted transfer
+    /// \param[in] size The size of the object in octets. Must be no more than 65535 blocks
+    /// \param[in] read Called to get each block of the object
+    /// \param[in] arg Passed to read
+    /// \return RH_BULK_ERROR_NONE if the receiver has the whole object, or one of the RH_BULK_ERROR_* codes
+    uint8_t send(uint8_t address, uint16_t transferId, uint32_t size, ReadFunction read, void* arg);
+
+    /// Sets the functions the receiver calls to accept transfers and write the data.
+    /// Until this is called, all offers are refused.
+    /// \param[in] offer Called when a new transfer is offered. If NULL, all transfers are accepted from the beginning
+    /// \param[in] write Called for each block
+    /// \param[in] arg Passed to offer and write
+    void setReceiver(OfferFunction offer, WriteFunction write, void* arg);
+
+    /// Receives the messages that have arrived at the manager, handles those belonging to bulk transfers,
+    /// and returns the first other message. Does not block.
+    /// Must be called frequently by the receiver (eg from within loop())
+    /// \param[in] buf Location to copy the message
+    /// \param[in,out] len Pointer to the available space in buf. Set to the actual number of octets copied.
+    /// \param[in] from If present and not NULL, the referenced uint8_t will be set to the address of the sender
+    /// \return true if a message other than a bulk transfer message was copied to buf
+    bool recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* from = NULL);
+
+    /// Tests whether the receiver is in the middle of a transfer
+    /// \return true if a transfer has been accepted and is not yet complete or aborted
+    bool receiving();
+
+    /// Returns the number of blocks the sender has sent more than once,
+    /// since starting or since the last call to resetRetransmissions().
+    /// \return The number of blocks sent again
+    uint32_t retransmissions();
+
+    /// Resets the count of blocks sent again to 0
+    void resetRetransmissions();
+
+protected:
+    /// Sends a control message with RH_FLAGS_BULK, with sendtoWait()
+    /// \param[in] buf The message
+    /// \param[in] len The number of octets in buf
+    /// \param[in] address The address to send it to
+    /// \return true if it was acknowledged
+    bool sendControl(uint8_t* buf, uint8_t len, uint8_t address);
+
+    /// Sends the missing blocks in the window from base, the last one as a POLL
+    /// \param[in] address The address of the receiver
+    /// \param[in] transferId The ID of the transfer
+    /// \param[in] size The size of the object
+    /// \param[in] base The first block the receiver does not have
+    /// \param[in] have The bitmap of the blocks from base that the receiver has
+    /// \param[in] window The number of blocks from base to send
+    /// \param[in] read Called to get each block
+    /// \param[in] arg Passed to read
+    /// \return RH_BULK_ERROR_NONE, or RH_BULK_ERROR_READ if read failed
+    uint8_t sendWindow(uint8_t address, uint16_t transferId, uint32_t size, uint16_t base, const uint8_t* have,
+		       uint8_t window, ReadFunction read, void* arg);
+
+    /// Waits up to the timeout for a STATUS or ABORT from the receiver for the transfer.
+    /// Other messages are discarded
+    /// \param[in] address The address of the receiver
+    /// \param[in] transferId The ID of the transfer
+    /// \param[out] base Set to the first block the receiver does not have
+    /// \param[out] have Set to the bitmap of the blocks from base that the receiver has
+    /// \param[out] window Set to the smaller of our window and the receiver's
+    /// \return RH_BULK_ERROR_NONE if a STATUS arrived, RH_BULK_ERROR_TIMEOUT if nothing did,
+    /// or the reason in an ABORT
+    uint8_t waitStatus(uint8_t address, uint16_t transferId, uint16_t* base, uint8_t* have, uint8_t* window);
+
+    /// Handles a bulk transfer message received in _frame
+    /// \param[in] from The address of the sender
+    /// \param[in] len The number of octets in _frame
+    void handleMessage(uint8_t from, uint8_t len);
+
+    /// Handles an OFFER received in _frame
+    /// \param[in] from The address of the sender
+    /// \param[in] transferId The ID of the transfer
+    void handleOffer(uint8_t from, uint16_t transferId);
+
+    /// Handles a DATA or POLL received in _frame
+    /// \param[in] from The address of the sender
+    /// \param[in] transferId The ID of the transfer
+    /// \param[in] len The number of octets in _frame
+    void handleData(uint8_t from, uint16_t transferId, uint8_t len);
+
+    /// Passes a block to the WriteFunction, and aborts the transfer if it fails
+    /// \param[in] block The block number
+    /// \param[in] buf The block
+    /// \param[in] len The number of octets in the block
+    /// \return true if the block was written
+    bool deliver(uint16_t block, const uint8_t* buf, uint8_t len);
+
+    /// Sends a STATUS for the transfer being received
+    void sendStatus();
+
+    /// Sends an ABORT
+    /// \param[in] address The address to send it to
+    /// \param[in] transferId The ID of the transfer
+    /// \param[in] reason The RH_BULK_ERROR_* code
+    void sendAbort(uint8_t address, uint16_t transferId, uint8_t reason);
+
+    /// Returns the length of a block of the transfer being received
+    /// \param[in] block The block number
+    /// \return The number of octets in the block
+    uint8_t receiveBlockLength(uint16_t block);
+
+private:
+    // Compile time check that RH_BULK_WINDOW is a multiple of 8 up to 128
+    typedef char RHBulkTransfer_window_must_be_a_multiple_of_8[(RH_BULK_WINDOW > 0 && RH_BULK_WINDOW <= 128 && (RH_BULK_WINDOW % 8) == 0) ? 1 : -1];
+
+    /// State of the transfer being received
+    typedef enum
+    {
+	ReceiveIdle = 0,     ///< No transfer, or it was aborted
+	ReceiveActive,       ///< Receiving blocks
+	ReceiveComplete      ///< All the blocks have been written
+    } ReceiveState;
+
+    /// The manager
+    RHReliableDatagram& _manager;
+
+    /// Octets in each block sent
+    uint8_t             _blockLen;
+
+    /// How long to wait for a STATUS in milliseconds
+    uint16_t            _timeout;
+
+    /// How many times to try again
+    uint8_t             _retries;
+
+    /// Number of blocks to send ahead
+    uint8_t             _windowSize;
+
+    /// Count of blocks sent again
+    uint32_t            _retransmissions;
+
+    /// One more than the highest block sent so far by send()
+    uint16_t            _sentEnd;
+
+    /// Receiver callbacks
+    OfferFunction       _offer;
+    WriteFunction       _write;
+    void*               _arg;
+
+    /// The transfer being received
+    ReceiveState        _rxState;
+    uint8_t             _rxFrom;
+    uint16_t            _rxTransferId;
+    uint32_t            _rxSize;
+    uint8_t             _rxBlockLen;
+    uint16_t            _rxCount;      ///< Number of blocks
+    uint16_t            _rxBase;       ///< The next block to write
+    unsigned long       _rxUpdated;    ///< Time the last message of the transfer arrived
+
+    /// Blocks received out of order. Block n is kept in slot n % RH_BULK_WINDOW
+    uint8_t             _rxBlocks[RH_BULK_WINDOW][RH_BULK_MAX_BLOCK_LEN];
+
+    /// The number of the block in each slot, or 0xffff if none
+    uint16_t            _rxSlotBlock[RH_BULK_WINDOW];
+
+    /// A message being sent or received
+    uint8_t             _frame[RH_MAX_MESSAGE_LEN];
+};
+
+/// @example simulator_bulk_transfer.pde
+
+#endif
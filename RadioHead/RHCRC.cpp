@@ -101,4 +101,182 @@ uint8_t RHcrc_ibutton_update(uint8_t crc, uint8_t data)
     return crc;
 }
 
+////////////////////////////////////////////////////////////////////
+// Buffer versions
+#if defined(__AVR__)
+// Nibble tables in program memory: 2 lookups per octet instead of 8 shifts, for 72 bytes of flash.
+// RHcrc_ccitt_update is already branch free and faster than a table on AVR, so is used as is
+#include <avr/pgmspace.h>
 
+PROGMEM static const uint16_t crc16_nibble[16] =
+{
+    0x0000, 0xcc01, 0xd801, 0x1400, 0xf001, 0x3c00, 0x2800, 0xe401,
+    0xa001, 0x6c00, 0x7800, 0xb401, 0x5000, 0x9c01, 0x8801, 0x4400
+};
+
+PROGMEM static const uint16_t xmodem_nibble[16] =
+{
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef
+};
+
+PROGMEM static const uint8_t ibutton_nibble[16] =
+{
+    0x00, 0x9d, 0x23, 0xbe, 0x46, 0xdb, 0x65, 0xf8,
+    0x8c, 0x11, 0xaf, 0x32, 0xca, 0x57, 0xe9, 0x74
+};
+
+uint16_t RHcrc16(const uint8_t* data, size_t len, uint16_t crc)
+{
+    while (len--)
+    {
+	crc ^= *data++;
+	crc = (crc >> 4) ^ pgm_read_word(&crc16_nibble[crc & 0xf]);
+	crc = (crc >> 4) ^ pgm_read_word(&crc16_nibble[crc & 0xf]);
+    }
+    return crc;
+}
+
+uint16_t RHcrc_xmodem(const uint8_t* data, size_t len, uint16_t crc)
+{
+    while (len--)
+    {
+	uint8_t d = *data++;
+	crc = (crc << 4) ^ pgm_read_word(&xmodem_nibble[(crc >> 12) ^ (d >> 4)]);
+	crc = (crc << 4) ^ pgm_read_word(&xmodem_nibble[(crc >> 12) ^ (d & 0xf)]);
+    }
+    return crc;
+}
+
+uint16_t RHcrc_ccitt(const uint8_t* data, size_t len, uint16_t crc)
+{
+    while (len--)
+	crc = RHcrc_ccitt_update(crc, *data++);
+    return crc;
+}
+
+uint8_t RHcrc_ibutton(const uint8_t* data, size_t len, uint8_t crc)
+{
+    while (len--)
+    {
+	crc ^= *data++;
+	crc = (crc >> 4) ^ pgm_read_byte(&ibutton_nibble[crc & 0xf]);
+	crc = (crc >> 4) ^ pgm_read_byte(&ibutton_nibble[crc & 0xf]);
+    }
+    return crc;
+}
+
+#elif (RH_PLATFORM == RH_PLATFORM_UNIX) || (RH_PLATFORM == RH_PLATFORM_RASPI)
+// Hosts have plenty of memory, so use 256 entry tables, and slicing-by-8 for the
+// reflected 16 bit CRCs, processing 8 octets per step. The tables are computed on
+// first use from the _update functions above, so they cannot disagree with them.
+class RHcrcTables
+{
+public:
+    RHcrcTables()
+    {
+	uint16_t b;
+	uint8_t  k;
+	for (b = 0; b < 256; b++)
+	{
+	    crc16[0][b] = RHcrc16_update(0, b);
+	    ccitt[0][b] = RHcrc_ccitt_update(0, b);
+	    xmodem[b]   = RHcrc_xmodem_update(0, b);
+	    ibutton[b]  = RHcrc_ibutton_update(0, b);
+	}
+	// Table k gives the effect of an octet followed by k zero octets
+	for (k = 1; k < 8; k++)
+	{
+	    for (b = 0; b < 256; b++)
+	    {
+		crc16[k][b] = (crc16[k-1][b] >> 8) ^ crc16[0][crc16[k-1][b] & 0xff];
+		ccitt[k][b] = (ccitt[k-1][b] >> 8) ^ ccitt[0][ccitt[k-1][b] & 0xff];
+	    }
+	}
+    }
+
+    uint16_t crc16[8][256];
+    uint16_t ccitt[8][256];
+    uint16_t xmodem[256];
+    uint8_t  ibutton[256];
+};
+
+static const RHcrcTables& crcTables()
+{
+    static const RHcrcTables tables;
+    return tables;
+}
+
+// Slicing-by-8 for a reflected 16 bit CRC
+static uint16_t crcSlice8(const uint16_t (*t)[256], const uint8_t* data, size_t len, uint16_t crc)
+{
+    while (len >= 8)
+    {
+	uint16_t x = crc ^ (data[0] | (data[1] << 8));
+	crc = t[7][x & 0xff] ^ t[6][x >> 8] ^ t[5][data[2]] ^ t[4][data[3]]
+	    ^ t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+	data += 8;
+	len -= 8;
+    }
+    while (len--)
+	crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xff];
+    return crc;
+}
+
+uint16_t RHcrc16(const uint8_t* data, size_t len, uint16_t crc)
+{
+    return crcSlice8(crcTables().crc16, data, len, crc);
+}
+
+uint16_t RHcrc_xmodem(const uint8_t* data, size_t len, uint16_t crc)
+{
+    const uint16_t* t = crcTables().xmodem;
+    while (len--)
+	crc = (crc << 8) ^ t[(crc >> 8) ^ *data++];
+    return crc;
+}
+
+uint16_t RHcrc_ccitt(const uint8_t* data, size_t len, uint16_t crc)
+{
+    return crcSlice8(crcTables().ccitt, data, len, crc);
+}
+
+uint8_t RHcrc_ibutton(const uint8_t* data, size_t len, uint8_t crc)
+{
+    const uint8_t* t = crcTables().ibutton;
+    while (len--)
+	crc = t[crc ^ *data++];
+    return crc;
+}
+
+#else
+// Other processors: no tables, to save flash and RAM
+uint16_t RHcrc16(const uint8_t* data, size_t len, uint16_t crc)
+{
+    while (len--)
+	crc = RHcrc16_update(crc, *data++);
+    return crc;
+}
+
+uint16_t RHcrc_xmodem(const uint8_t* data, size_t len, uint16_t crc)
+{
+    while (len--)
+	crc = RHcrc_xmodem_update(crc, *data++);
+    return crc;
+}
+
+uint16_t RHcrc_ccitt(const uint8_t* data, size_t len, uint16_t crc)
+{
+    while (len--)
+	crc = RHcrc_ccitt_update(crc, *data++);
+    return crc;
+}
+
+uint8_t RHcrc_ibutton(const uint8_t* data, size_t len, uint8_t crc)
+{
+    while (len--)
+	crc = RHcrc_ibutton_update(crc, *data++);
+    return crc;
+}
+
+#endif
@@ -16,4 +16,13 @@ extern uint16_t RHcrc_xmodem_update (uint16_t crc, uint8_t data);
 extern uint16_t RHcrc_ccitt_update (uint16_t crc, uint8_t data);
 extern uint8_t  RHcrc_ibutton_update(uint8_t crc, uint8_t data);
 
+// Buffer versions of the above. Each returns the CRC of len octets at data, starting from crc,
+// exactly as if the corresponding _update function had been called for each octet in turn.
+// On Linux and other hosts they are table driven (slicing-by-8 for the 16 bit reflected CRCs),
+// on AVR they use small nibble tables in PROGMEM. Prefer these whenever the data is in a buffer.
+extern uint16_t RHcrc16(const uint8_t* data, size_t len, uint16_t crc);
+extern uint16_t RHcrc_xmodem(const uint8_t* data, size_t len, uint16_t crc);
+extern uint16_t RHcrc_ccitt(const uint8_t* data, size_t len, uint16_t crc);
+extern uint8_t  RHcrc_ibutton(const uint8_t* data, size_t len, uint8_t crc);
+
 #endif
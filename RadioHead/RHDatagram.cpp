@@ -49,6 +49,24 @@ bool RHDatagram::recvfrom(uint8_t* buf, uint8_t* len, uint8_t* from, uint8_t* to
     return false;
 }
 
+bool RHDatagram::peekfrom(uint8_t** buf, uint8_t* len, uint8_t* from, uint8_t* to, uint8_t* id, uint8_t* flags)
+{
+    if (_driver.peek(buf, len))
+    {
+	if (from)  *from =  headerFrom();
+	if (to)    *to =    headerTo();
+	if (id)    *id =    headerId();
+	if (flags) *flags = headerFlags();
+	return true;
+    }
+    return false;
+}
+
+void RHDatagram::consume()
+{
+    _driver.consume();
+}
+
 bool RHDatagram::available()
 {
     return _driver.available();
@@ -87,6 +87,24 @@ public:
     /// \return true if a valid message was copied to buf
     bool recvfrom(uint8_t* buf, uint8_t* len, uint8_t* from = NULL, uint8_t* to = NULL, uint8_t* id = NULL, uint8_t* flags = NULL);
 
+    /// Zero copy version of recvfrom(). If there is a valid message available, sets *buf to point to it
+    /// in the driver's receive buffer, without copying it, and returns the headers like recvfrom().
+    /// The message stays available until consume() is called. See RHGenericDriver::peek() for
+    /// how long the pointer remains valid.
+    /// \param[out] buf Set to the location of the message
+    /// \param[out] len Set to the length of the message
+    /// \param[in] from If present and not NULL, the referenced uint8_t will be set to the FROM address
+    /// \param[in] to If present and not NULL, the referenced uint8_t will be set to the TO address
+    /// \param[in] id If present and not NULL, the referenced uint8_t will be set to the ID
+    /// \param[in] flags If present and not NULL, the referenced uint8_t will be set to the FLAGS
+    /// \return true if a message is available. false if not, or if the driver does not support
+    /// peek(), in which case recvfrom() must be used instead
+    bool peekfrom(uint8_t** buf, uint8_t* len, uint8_t* from = NULL, uint8_t* to = NULL, uint8_t* id = NULL, uint8_t* flags = NULL);
+
+    /// Discards the message returned by peekfrom(). Virtual so that subclasses that return messages
+    /// from their own buffers can override it
+    virtual void consume();
+
     /// Tests whether a new message is available
     /// from the Driver.
     /// On most drivers, this will also put the Driver into RHModeRx mode until
@@ -0,0 +1,408 @@
+// RHFragmenter.h
+// Author: Mike McCauley (mikem@airspayce.com)
+// Copyright (C) 2014 Mike McCauley
+// $Id: RHFragmenter.h $
+#ifndef RHFragmenter_h
+#define RHFragmenter_h
+
+#include <RHRouter.h>
+
+// The number of octets of fragment header at the start of every frame sent by RHFragmenter:
+// the message ID, the index of the fragment, and the number of fragments in the message
+#define RH_FRAGMENT_HEADER_LEN 3
+
+// The largest application message that RHFragmenter can send and reassemble, in octets.
+// Each slot of the reassembly pool has a buffer of this size.
+// Can be pre-defined to a different size prior to including this header.
+// Defaults to 256 on AVR and 4096 elsewhere.
+#ifndef RH_FRAGMENT_MAX_MESSAGE_LEN
+ #ifdef __AVR__
+  #define RH_FRAGMENT_MAX_MESSAGE_LEN 256
+ #else
+  #define RH_FRAGMENT_MAX_MESSAGE_LEN 4096
+ #endif
+#endif
+
+// The number of messages that can be reassembled at the same time, from the same or different senders.
+// Each one costs about RH_FRAGMENT_MAX_MESSAGE_LEN + 44 octets of SRAM.
+// Can be pre-defined to a different size prior to including this header.
+// Defaults to 1 on AVR and 4 elsewhere.
+#ifndef RH_FRAGMENT_POOL_SIZE
+ #ifdef __AVR__
+  #define RH_FRAGMENT_POOL_SIZE 1
+ #else
+  #define RH_FRAGMENT_POOL_SIZE 4
+ #endif
+#endif
+
+// The default time in milliseconds after the last fragment of a message was received before
+// an incomplete message is discarded
+#define RH_FRAGMENT_DEFAULT_TIMEOUT 10000
+
+/////////////////////////////////////////////////////////////////////
+/// \class RHFragmenter RHFragmenter.h <RHFragmenter.h>
+/// \brief Sends and receives application messages larger than one frame over any of the reliable Managers
+///
+/// The largest message a Manager can carry is limited by the driver: RH_NRF24_MAX_MESSAGE_LEN is 28 octets and
+/// RH_RF22_MAX_MESSAGE_LEN is 50, and RHRouter and RHMesh take a few more octets of each frame for their own headers.
+/// RHFragmenter sits on top of an RHReliableDatagram, RHRouter or RHMesh manager and splits application
+/// messages of up to RH_FRAGMENT_MAX_MESSAGE_LEN octets into fragments, each sent as a separate message
+/// with the manager's sendtoWait(). The receiving RHFragmenter reassembles the fragments and only hands
+/// complete messages to the application.
+///
+/// Every fragment starts with RH_FRAGMENT_HEADER_LEN octets of fragment header:
+/// \code
+/// [message ID] [fragment index] [number of fragments]
+/// \endcode
+/// followed by the data. Every fragment except the last carries exactly fragmentLen octets of the message,
+/// so the receiver can put each fragment in its place in the message as it arrives, in any order.
+/// At most 255 fragments can be sent for one message.
+///
+/// Since each fragment is sent with the manager's sendtoWait(), every fragment is acknowledged (hop by hop
+/// with RHRouter and RHMesh) before the next is sent, so the sender never gets ahead of the network.
+/// If any fragment cannot be delivered, sendtoWait() gives up and returns false, and the receiver
+/// discards what it has of the message after the timeout (see setTimeout()).
+///
+/// Messages being reassembled are kept in a pool of RH_FRAGMENT_POOL_SIZE slots, identified by the
+/// address of the sender and the message ID. If a fragment of a new message arrives when the pool is full,
+/// the slot that was least recently updated is discarded to make room. Discarded incomplete messages are
+/// counted by dropped(). A slot is freed as soon as its message is complete and has been delivered, so a sender
+/// that restarts and reuses the same message ID and number of fragments is not mistaken for a duplicate.
+/// Duplicate fragments are already discarded by the manager, as long as they arrive within its duplicate
+/// detection window (see RHReliableDatagram).
+///
+/// The fragment length must be chosen so that a fragment and its header fits in one message of the manager:
+/// \li RHReliableDatagram: driver.maxMessageLength() - RH_FRAGMENT_HEADER_LEN
+/// \li RHRouter: RH_ROUTER_MAX_MESSAGE_LEN - RH_FRAGMENT_HEADER_LEN, or less with drivers whose
+/// maxMessageLength() is less than RH_MAX_MESSAGE_LEN
+/// \li RHMesh: RH_MESH_MAX_MESSAGE_LEN - RH_FRAGMENT_HEADER_LEN, or less with drivers whose
+/// maxMessageLength() is less than RH_MAX_MESSAGE_LEN
+///
+/// The receiver learns the fragment length from the fragments themselves, so different nodes may use different
+/// fragment lengths. All the messages exchanged through the manager must go through RHFragmenter.
+/// RHFragmenter does not call the manager's init(), which should be called before using RHFragmenter.
+/// \par Example
+///
+/// \code
+/// RH_RF22 driver;
+/// RHMesh manager(driver, MY_ADDRESS);
+/// RHFragmenter<RHMesh> fragmenter(manager, RH_MESH_MAX_MESSAGE_LEN - RH_FRAGMENT_HEADER_LEN);
+/// uint8_t buf[1000];
+/// ...
+/// fragmenter.sendtoWait(buf, sizeof(buf), SERVER_ADDRESS);
+/// ...
+/// uint16_t len = sizeof(buf);
+/// uint8_t from;
+/// if (fragmenter.recvfromAck(buf, &len, &from))
+/// ...
+/// \endcode
+///
+/// See the example simulator_fragmenter.pde
+///
+/// All the storage is inside the object, so RHFragmenter takes about
+/// RH_FRAGMENT_POOL_SIZE * (RH_FRAGMENT_MAX_MESSAGE_LEN + 44) + RH_MAX_MESSAGE_LEN octets of RAM.
+/// \tparam Manager The class of the manager: RHReliableDatagram, RHRouter or RHMesh
+template <class Manager>
+class RHFragmenter
+{
+public:
+    /// Constructor.
+    /// \param[in] manager The manager to send and receive the fragments with
+    /// \param[in] fragmentLen The number of octets of the message to put in each fragment. See above
+    /// for how to choose it. Limited to RH_MAX_MESSAGE_LEN - RH_FRAGMENT_HEADER_LEN
+    RHFragmenter(Manager& manager, uint8_t fragmentLen)
+	: _manager(manager),
+	  _fragmentLen(fragmentLen),
+	  _lastMessageId(0),
+	  _timeout(RH_FRAGMENT_DEFAULT_TIMEOUT),
+	  _dropped(0)
+    {
+	if (_fragmentLen > RH_MAX_MESSAGE_LEN - RH_FRAGMENT_HEADER_LEN)
+	    _fragmentLen = RH_MAX_MESSAGE_LEN - RH_FRAGMENT_HEADER_LEN;
+	if (_fragmentLen == 0)
+	    _fragmentLen = 1;
+	memset(_pool, 0, sizeof(_pool));
+    }
+
+    /// Returns the length of the largest message that can be sent, which depends on the fragment length
+    /// \return The maximum message length in octets
+    uint16_t maxMessageLength() const
+    {
+	uint32_t max = (uint32_t)_fragmentLen * 255;
+	return max < RH_FRAGMENT_MAX_MESSAGE_LEN ? max : RH_FRAGMENT_MAX_MESSAGE_LEN;
+    }
+
+    /// Returns the number of octets of the message sent in each fragment
+    /// \return The fragment length given to the constructor
+    uint8_t fragmentLength() const { return _fragmentLen; }
+
+    /// Sets how long to keep an incomplete message after its last fragment was received,
+    /// before discarding it.
+    /// \param[in] timeout The time in milliseconds. Default is RH_FRAGMENT_DEFAULT_TIMEOUT
+    void setTimeout(uint16_t timeout) { _timeout = timeout; }
+
+    /// Sends the message to the address, in as many fragments as necessary, with the manager's sendtoWait().
+    /// Blocks until every fragment has been acknowledged or one of them could not be delivered.
+    /// \param[in] buf The message to send
+    /// \param[in] len The number of octets in buf. Must not be more than maxMessageLength()
+    /// \param[in] address The address to send the message to
+    /// \return true if every fragment was delivered
+    bool sendtoWait(const uint8_t* buf, uint16_t len, uint8_t address)
+    {
+	if (len > maxMessageLength())
+	    return false;
+	uint8_t count = len ? (len + _fragmentLen - 1) / _fragmentLen : 1;
+	uint8_t id = ++_lastMessageId;
+	for (uint8_t index = 0; index < count; index++)
+	{
+	    uint16_t offset = (uint16_t)index * _fragmentLen;
+	    uint8_t fragLen = (index + 1 < count) ? _fragmentLen : len - offset;
+	    _frame[0] = id;
+	    _frame[1] = index;
+	    _frame[2] = count;
+	    memcpy(_frame + RH_FRAGMENT_HEADER_LEN, buf + offset, fragLen);
+	    if (!succeeded(_manager.sendtoWait(_frame, fragLen + RH_FRAGMENT_HEADER_LEN, address)))
+		return false;
+	}
+	return true;
+    }
+
+    /// Receives the fragments that have arrived at the manager, and returns the first message that is complete.
+    /// Also discards incomplete messages that have timed out. Does not block.
+    /// Must be called frequently (eg from within loop()), so that RHRouter and RHMesh can route
+    /// messages for other nodes.
+    /// \param[in] buf Location to copy the message
+    /// \param[in,out] len Pointer to the available space in buf. Set to the actual number of octets copied.
+    /// If the message is longer, it is truncated.
+    /// \param[in] from If present and not NULL, the referenced uint8_t will be set to the address of the sender
+    /// \return true if a complete message was copied to buf
+    bool recvfromAck(uint8_t* buf, uint16_t* len, uint8_t* from = NULL)
+    {
+	uint8_t frameLen = sizeof(_frame);
+	uint8_t src;
+	while (_manager.recvfromAck(_frame, &frameLen, &src))
+	{
+	    if (receiveFragment(src, frameLen, buf, len, from))
+		return true;
+	    frameLen = sizeof(_frame);
+	}
+	expire();
+	return false;
+    }
+
+    /// Like recvfromAck(), but waits up to timeout milliseconds for a complete message to arrive.
+    /// \param[in] buf Location to copy the message
+    /// \param[in,out] len Pointer to the available space in buf. Set to the actual number of octets copied.
+    /// \param[in] timeout Maximum time to wait in milliseconds
+    /// \param[in] from If present and not NULL, the referenced uint8_t will be set to the address of the sender
+    /// \return true if a complete message was copied to buf
+    bool recvfromAckTimeout(uint8_t* buf, uint16_t* len, uint16_t timeout, uint8_t* from = NULL)
+    {
+	unsigned long starttime = millis();
+	int32_t timeLeft;
+	while ((timeLeft = timeout - (millis() - starttime)) > 0)
+	{
+	    uint8_t frameLen = sizeof(_frame);
+	    uint8_t src;
+	    if (_manager.recvfromAckTimeout(_frame, &frameLen, timeLeft, &src)
+		&& receiveFragment(src, frameLen, buf, len, from))
+		return true;
+	    expire();
+	    YIELD;
+	}
+	return false;
+    }
+
+    /// Returns the number of incomplete messages that have been discarded, because they timed out
+    /// or to make room for other messages, since starting or since the last call to resetDropped().
+    /// \return The number of discarded messages
+    uint32_t dropped() const { return _dropped; }
+
+    /// Resets the count of discarded messages to 0
+    void resetDropped() { _dropped = 0; }
+
+protected:
+    /// Normalises the result of RHReliableDatagram::sendtoWait()
+    /// \param[in] result The result of sendtoWait()
+    /// \return result
+    static bool succeeded(bool result) { return result; }
+
+    /// Normalises the result of RHRouter::sendtoWait() and RHMesh::sendtoWait()
+    /// \param[in] result The error code returned by sendtoWait()
+    /// \return true if the result is RH_ROUTER_ERROR_NONE
+    static bool succeeded(uint8_t result) { return result == RH_ROUTER_ERROR_NONE; }
+
+    /// A message being reassembled
+    typedef struct
+    {
+	bool            used;          ///< The slot holds part or all of a message
+	uint8_t         from;          ///< Address of the sender
+	uint8_t         id;            ///< Message ID
+	uint8_t         count;         ///< Number of fragments in the message
+	uint8_t         received;      ///< Number of different fragments received so far
+	uint8_t         fragLen;       ///< Length of each fragment except the last, or 0 if not yet known
+	uint8_t         lastLen;       ///< Length of the last fragment, if received
+	uint8_t         have[32];      ///< Bitmap of the fragments received so far
+	unsigned long   updated;       ///< Time the last fragment was received, in milliseconds
+	uint8_t         buf[RH_FRAGMENT_MAX_MESSAGE_LEN]; ///< The message
+    } Slot;
+
+    /// Finds the slot for a message, or allocates one. Prefers an unused slot, and otherwise discards
+    /// the least recently updated incomplete message
+    /// \param[in] from Address of the sender
+    /// \param[in] id Message ID
+    /// \param[in] count Number of fragments in the message
+    /// \return The slot
+    Slot* findSlot(uint8_t from, uint8_t id, uint8_t count)
+    {
+	Slot* empty = NULL;
+	Slot* oldest = NULL;
+	for (uint8_t i = 0; i < RH_FRAGMENT_POOL_SIZE; i++)
+	{
+	    Slot* slot = &_pool[i];
+	    if (!slot->used)
+	    {
+		if (!empty)
+		    empty = slot;
+	    }
+	    else if (slot->from == from && slot->id == id && slot->count == count)
+		return slot;
+	    else if (!oldest || (long)(slot->updated - oldest->updated) < 0)
+		oldest = slot;
+	}
+	if (!empty)
+	{
+	    // Make room for the new message
+	    empty = oldest;
+	    _dropped++;
+	}
+	memset(empty, 0, sizeof(Slot) - sizeof(empty->buf));
+	empty->used = true;
+	empty->from = from;
+	empty->id = id;
+	empty->count = count;
+	return empty;
+    }
+
+    /// Puts the fragment in _frame in its slot, and copies out the message if it is now complete
+    /// \param[in] from Address of the sender
+    /// \param[in] frameLen Number of octets in _frame, including the fragment header
+    /// \param[in] buf Location to copy the message
+    /// \param[in,out] len Pointer to the available space in buf. Set to the actual number of octets copied.
+    /// \param[in] source If not NULL, set to the address of the sender
+    /// \return true if the message is complete and has been copied to buf
+    bool receiveFragment(uint8_t from, uint8_t frameLen, uint8_t* buf, uint16_t* len, uint8_t* source)
+    {
+	if (frameLen < RH_FRAGMENT_HEADER_LEN)
+	    return false; // Not a fragment
+	uint8_t id = _frame[0];
+	uint8_t index = _frame[1];
+	uint8_t count = _frame[2];
+	uint8_t dataLen = frameLen - RH_FRAGMENT_HEADER_LEN;
+	uint8_t* data = _frame + RH_FRAGMENT_HEADER_LEN;
+	if (count == 0 || index >= count)
+	    return false; // Not a valid fragment
+	bool last = (index + 1 == count);
+	if (!last && dataLen == 0)
+	    return false;
+
+	Slot* slot = findSlot(from, id, count);
+	slot->updated = millis();
+	if (slot->have[index >> 3] & (1 << (index & 7)))
+	    return false; // Duplicate
+	if (!last)
+	{
+	    if (slot->fragLen == 0)
+	    {
+		// Now we know where everything goes
+		if ((uint32_t)(count - 1) * dataLen + slot->lastLen > RH_FRAGMENT_MAX_MESSAGE_LEN)
+		{
+		    // Too big to reassemble
+		    slot->used = false;
+		    _dropped++;
+		    return false;
+		}
+		slot->fragLen = dataLen;
+		// If the last fragment arrived first, it was put at the end of the buffer
+		if (slot->lastLen)
+		    memmove(slot->buf + (uint16_t)(count - 1) * dataLen,
+			    slot->buf + RH_FRAGMENT_MAX_MESSAGE_LEN - slot->lastLen, slot->lastLen);
+	    }
+	    else if (dataLen != slot->fragLen)
+		return false; // Not from the same message
+	    memcpy(slot->buf + (uint16_t)index * dataLen, data, dataLen);
+	}
+	else
+	{
+	    if (slot->fragLen == 0)
+	    {
+		if ((uint32_t)(count - 1) + dataLen > RH_FRAGMENT_MAX_MESSAGE_LEN)
+		    return false; // Too big to reassemble
+		// Dont know where it goes yet, if there are other fragments. Keep it at the end of the buffer
+		memcpy(slot->buf + (count == 1 ? 0 : RH_FRAGMENT_MAX_MESSAGE_LEN - dataLen), data, dataLen);
+	    }
+	    else
+	    {
+		if ((uint32_t)index * slot->fragLen + dataLen > RH_FRAGMENT_MAX_MESSAGE_LEN)
+		    return false;
+		memcpy(slot->buf + (uint16_t)index * slot->fragLen, data, dataLen);
+	    }
+	    slot->lastLen = dataLen;
+	}
+	slot->have[index >> 3] |= (1 << (index & 7));
+	if (++slot->received < count)
+	    return false;
+
+	// Complete
+	uint16_t messageLen = (uint16_t)(count - 1) * slot->fragLen + slot->lastLen;
+	if (*len > messageLen)
+	    *len = messageLen;
+	memcpy(buf, slot->buf, *len);
+	if (source)
+	    *source = from;
+	// Done with it. The next message with this ID starts afresh
+	slot->used = false;
+	return true;
+    }
+
+    /// Frees the slots of incomplete messages that have not been updated for longer than the timeout,
+    /// counting them as dropped
+    void expire()
+    {
+	unsigned long now = millis();
+	for (uint8_t i = 0; i < RH_FRAGMENT_POOL_SIZE; i++)
+	{
+	    if (_pool[i].used && now - _pool[i].updated > _timeout)
+	    {
+		_pool[i].used = false;
+		_dropped++;
+	    }
+	}
+    }
+
+private:
+    /// The manager that sends and receives the fragments
+    Manager&        _manager;
+
+    /// Octets of the message in every fragment except the last
+    uint8_t         _fragmentLen;
+
+    /// The ID of the last message sent
+    uint8_t         _lastMessageId;
+
+    /// How long to keep incomplete messages in milliseconds
+    uint16_t        _timeout;
+
+    /// Count of incomplete messages discarded
+    uint32_t        _dropped;
+
+    /// A fragment being sent or received, with its header
+    uint8_t         _frame[RH_MAX_MESSAGE_LEN];
+
+    /// The messages being reassembled
+    Slot            _pool[RH_FRAGMENT_POOL_SIZE];
+};
+
+/// @example simulator_fragmenter.pde
+
+#endif
@@ -0,0 +1,127 @@
+// RHFrameQueue.h
+// Author: Mike McCauley (mikem@airspayce.com)
+// Copyright (C) 2014 Mike McCauley
+// $Id: RHFrameQueue.h $
+#ifndef RHFrameQueue_h
+#define RHFrameQueue_h
+
+#include <RadioHead.h>
+
+/////////////////////////////////////////////////////////////////////
+/// \class RHFrameQueue RHFrameQueue.h <RHFrameQueue.h>
+/// \brief Fixed capacity queue of received frames, for drivers to hold several messages until they are collected
+///
+/// Most drivers have a single receive buffer, so once a message has been received any others that
+/// arrive before it is collected by recv() are lost. A driver can instead push each message it receives
+/// into an RHFrameQueue, from its interrupt handler or from its polling code in available(),
+/// and recv() collects them in order.
+///
+/// It is used by RH_RF95 (with RH_RF95_RX_RING_LEN), by RH_RF69, RH_RF22, RH_RF24, RH_CC110, RH_MRF89
+/// and RH_NRF24 (with RH_RF69_RX_QUEUE_LEN etc), by RH_TCP and by RH_Serial (with RH_SERIAL_RX_QUEUE_LEN).
+/// Each driver's interrupt handler (or available(), for the polled RH_NRF24 and RH_Serial) fills in
+/// writeSlot() and calls push() instead of setting its _rxBufValid flag, and keeps the receiver on.
+/// available() then loads the headers of the front() frame and sets _rxBufValid, and recv() pops it.
+///
+/// Each frame holds a received message with its 4 octets of RadioHead headers (TO, FROM, ID, FLAGS)
+/// at the beginning, followed by the payload, together with the RSSI and SNR it was received with
+/// (in the driver's own units). The driver decides which of these it fills in.
+///
+/// The queue is single producer, single consumer: exactly one side (eg an interrupt handler) writes
+/// frames with writeSlot() and push(), and one side (eg recv()) reads them with front() and pop().
+/// The head and tail indexes each count up forever and are each only ever written by one side,
+/// so no locking is needed, even when the producer is an interrupt handler.
+///
+/// All the storage is inside the object, so the queue takes about N * (SIZE + 4) octets of RAM.
+/// \tparam N Number of frames. Must be a power of 2, up to 128
+/// \tparam SIZE Maximum length of a frame including the headers, up to 255
+template <uint8_t N, uint8_t SIZE>
+class RHFrameQueue
+{
+public:
+    /// A received frame
+    typedef struct
+    {
+	uint8_t         len;           ///< Number of octets in data, including the headers
+	int8_t          snr;           ///< Signal to noise ratio, if the driver measures it
+	int16_t         rssi;          ///< RSSI of the frame
+	uint8_t         data[SIZE];    ///< The headers followed by the message
+    } Frame;
+
+    /// Constructor. The queue is empty
+    RHFrameQueue() : _head(0), _tail(0) {}
+
+    /// Returns the number of frames waiting in the queue
+    /// \return The number of frames
+    uint8_t count() const { return _head - _tail; }
+
+    /// Tests whether the queue is empty
+    /// \return true if there are no frames waiting
+    bool empty() const { return _head == _tail; }
+
+    /// Tests whether the queue is full
+    /// \return true if there is no room for another frame
+    bool full() const { return count() >= N; }
+
+    /// Returns the number of frames the queue can hold
+    /// \return N
+    static uint8_t capacity() { return N; }
+
+    /// Producer side. Returns the frame to be filled in with the next message, which is
+    /// not visible to the consumer until push() is called. If push() is not called, the
+    /// same frame is returned next time, so a message can be abandoned (eg if the address
+    /// does not match) by simply not pushing it.
+    /// \return The frame to fill in, or NULL if the queue is full
+    Frame* writeSlot() { return full() ? NULL : &_frames[_head & (N - 1)]; }
+
+    /// Producer side. Adds the frame returned by writeSlot() to the queue
+    void push()
+    {
+	// The frame must be complete before the consumer can see it
+	RH_MEMORY_BARRIER;
+	_head++;
+    }
+
+    /// Consumer side. Returns the oldest frame in the queue, which stays in the queue
+    /// and is not touched by the producer until pop() is called
+    /// \return The oldest frame, or NULL if the queue is empty
+    Frame* front()
+    {
+	if (empty())
+	    return NULL;
+	// Dont look at the frame until we have seen the new head
+	RH_MEMORY_BARRIER;
+	return &_frames[_tail & (N - 1)];
+    }
+
+    /// Consumer side. Removes the oldest frame from the queue. Does nothing if it is empty
+    void pop()
+    {
+	if (empty())
+	    return;
+	// Finished with the frame before the producer can reuse it
+	RH_MEMORY_BARRIER;
+	_tail++;
+    }
+
+    /// Consumer side. Discards all the frames in the queue
+    void clear()
+    {
+	RH_MEMORY_BARRIER;
+	_tail = _head;
+    }
+
+private:
+    // Compile time check that N is a power of 2 up to 128, so the indexes can wrap at 256
+    typedef char RHFrameQueue_N_must_be_a_power_of_2[(N > 0 && N <= 128 && (N & (N - 1)) == 0) ? 1 : -1];
+
+    /// The frames
+    Frame               _frames[N];
+
+    /// Index of the next frame to be pushed. Only written by the producer
+    volatile uint8_t    _head;
+
+    /// Index of the oldest frame. Only written by the consumer
+    volatile uint8_t    _tail;
+};
+
+#endif
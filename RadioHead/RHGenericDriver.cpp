@@ -49,6 +49,39 @@ bool RHGenericDriver::waitAvailableTimeout(uint16_t timeout)
     return false;
 }
 
+uint8_t RHGenericDriver::recvBatch(uint8_t* bufs, uint8_t bufLen, RxInfo* info, uint8_t maxMessages)
+{
+    uint8_t count = 0;
+    while (count < maxMessages && available())
+    {
+	// The headers belong to the message that available() has just found
+	RxInfo* i = &info[count];
+	i->to    = headerTo();
+	i->from  = headerFrom();
+	i->id    = headerId();
+	i->flags = headerFlags();
+	i->rssi  = lastRssi();
+	i->len   = bufLen;
+	if (!recv(bufs + (uint16_t)count * bufLen, &i->len))
+	    break;
+	count++;
+    }
+    return count;
+}
+
+// Default does not support zero copy receive
+bool RHGenericDriver::peek(uint8_t** buf, uint8_t* len)
+{
+    (void)buf; // Not used
+    (void)len; // Not used
+    return false;
+}
+
+void RHGenericDriver::consume()
+{
+    recv(NULL, NULL);
+}
+
 bool RHGenericDriver::waitPacketSent()
 {
     while (_mode == RHModeTx)
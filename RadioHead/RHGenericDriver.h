@@ -7,6 +7,7 @@
 #define RHGenericDriver_h
 
 #include <RadioHead.h>
+#include <RHFrameQueue.h>
 
 // Defines bits of the FLAGS header reserved for use by the RadioHead library and 
 // the flags available for use by applications
@@ -38,6 +39,19 @@
 /// -ID A message ID, distinct (over short time scales) for each message sent by a particilar node
 /// -FLAGS A bitmask of flags. The most significant 4 bits are reserved for use by RadioHead. The least
 /// significant 4 bits are reserved for applications.
+///
+/// \par Receive queues
+///
+/// A driver with a single receive buffer loses any message that arrives before the previous one has
+/// been collected by recv(). Drivers can instead hold several received messages in an RHFrameQueue,
+/// pushing them from their interrupt handler or polling code, and recv() then returns them in order.
+/// recvBatch() collects all the messages waiting (up to a limit) in one call.
+/// RH_RF95, RH_RF69, RH_RF22, RH_RF24, RH_CC110, RH_MRF89 and RH_NRF24 have receive queues of 4 messages
+/// by default, set by RH_RF95_RX_RING_LEN and RH_<driver>_RX_QUEUE_LEN, which cost about 4 times their
+/// maximum message length in SRAM. On AVR, where SRAM is scarce, they default to 0, which gives the
+/// single receive buffer, so messages that arrive before the previous one has been collected are lost.
+/// RH_TCP always has a receive queue, and RH_Serial has one if RH_SERIAL_RX_QUEUE_LEN is not 0
+/// (the default on Unix). The other drivers still have a single receive buffer.
 class RHGenericDriver
 {
 public:
@@ -55,6 +69,17 @@ public:
 	RHModeCad               ///< Transport is in the process of detecting channel activity (if supported)
     } RHMode;
 
+    /// \brief The length, headers and RSSI of a message returned by recvBatch()
+    typedef struct
+    {
+	uint8_t         len;    ///< Number of octets copied to the message buffer
+	uint8_t         to;     ///< TO header
+	uint8_t         from;   ///< FROM header
+	uint8_t         id;     ///< ID header
+	uint8_t         flags;  ///< FLAGS header
+	int16_t         rssi;   ///< RSSI, as returned by lastRssi()
+    } RxInfo;
+
     /// Constructor
     RHGenericDriver();
 
@@ -83,6 +108,40 @@ public:
     /// \return true if a valid message was copied to buf
     virtual bool recv(uint8_t* buf, uint8_t* len) = 0;
 
+    /// Collects several received messages in one call, as if recv() had been called
+    /// for each in turn, and records the headers and RSSI of each. Stops when there are no more messages
+    /// available, or maxMessages have been collected. Drivers with a receive queue (see "Receive queues"
+    /// above for which ones do) may have several messages waiting. With all other drivers this returns at most 1,
+    /// and gains nothing over recv() except the headers and RSSI.
+    /// \param[in] bufs Location to copy the received messages: maxMessages consecutive buffers of bufLen octets each
+    /// \param[in] bufLen The size of each buffer in bufs. Longer messages are truncated
+    /// \param[out] info Array of maxMessages RxInfo, set to the length and headers of each message collected
+    /// \param[in] maxMessages Maximum number of messages to collect
+    /// \return The number of messages collected, 0 if there were none
+    virtual uint8_t recvBatch(uint8_t* bufs, uint8_t bufLen, RxInfo* info, uint8_t maxMessages);
+
+    /// Zero copy receive. If there is a valid message available, sets *buf to point to the message
+    /// inside the driver's own receive buffer, without copying it. The headers are available from
+    /// headerTo() etc as usual. The message stays available until consume() is called. The pointer
+    /// remains valid until consume() is called, and drivers that support this guarantee that neither
+    /// send() nor available() change it, and that nothing received (even by an interrupt handler)
+    /// overwrites it: drivers with a single receive buffer do not turn their receiver on again, and
+    /// drop any message that arrives, until it is consumed, while drivers with a receive queue keep later 
+    /// messages behind it. It must not be used after calling recv() or any of the wait functions, 
+    /// which may collect it. The caller may change the message in place, for example to forward it
+    /// with send() straight from the receive buffer.
+    /// Not all drivers support this. The default implementation returns false, in which
+    /// case recv() must be used instead.
+    /// \param[out] buf Set to the location of the message in the driver's buffer
+    /// \param[out] len Set to the length of the message (Caution, 0 length messages are permitted)
+    /// \return true if a message is available and buf and len have been set. false if no message
+    /// is available, or the driver does not support peek()
+    virtual bool peek(uint8_t** buf, uint8_t* len);
+
+    /// Discards the message returned by peek(), making the next message (if any) available.
+    /// The default implementation discards the available message with recv()
+    virtual void consume();
+
     /// Waits until any previous transmit packet is finished being transmitted with waitPacketSent().
     /// Then optionally waits for Channel Activity Detection (CAD) 
     /// to show the channnel is clear (if the radio supports CAD) by calling waitCAD().
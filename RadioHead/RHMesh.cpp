@@ -13,13 +13,30 @@
 
 #include <RHMesh.h>
 
-uint8_t RHMesh::_tmpMessage[RH_ROUTER_MAX_MESSAGE_LEN];
-
 ////////////////////////////////////////////////////////////////////
 // Constructors
 RHMesh::RHMesh(RHGenericDriver& driver, uint8_t thisAddress) 
     : RHRouter(driver, thisAddress)
 {
+    _routeTimeout = RH_MESH_ROUTE_TIMEOUT;
+    _lastRouteCheck = 0;
+    uint8_t i;
+    for (i = 0; i < RH_MESH_MAX_DISCOVERIES; i++)
+	_discoveries[i].active = false;
+    for (i = 0; i < RH_MESH_REQUEST_CACHE_SIZE; i++)
+	_seenRequests[i].source = RH_BROADCAST_ADDRESS;
+    _nextSeenRequest = 0;
+    _rebroadcastProbability = 100;
+    _rebroadcastMinHops = 1;
+#if RH_MESH_PENDING_SENDS > 0
+    for (i = 0; i < RH_MESH_PENDING_SENDS; i++)
+	_pending[i].active = false;
+    _pendingOrder = 0;
+#endif
+#if RH_MESH_RECEIVE_QUEUE_LEN > 0
+    _receivedHead = 0;
+    _receivedCount = 0;
+#endif
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -33,6 +50,7 @@ uint8_t RHMesh::sendtoWait(uint8_t* buf, uint8_t len, uint8_t address, uint8_t f
     if (len > RH_MESH_MAX_MESSAGE_LEN)
 	return RH_ROUTER_ERROR_INVALID_LENGTH;
 
+    checkRoutes();
     if (address != RH_BROADCAST_ADDRESS)
     {
 	RoutingTableEntry* route = getRouteTo(address);
@@ -48,40 +66,173 @@ uint8_t RHMesh::sendtoWait(uint8_t* buf, uint8_t len, uint8_t address, uint8_t f
 }
 
 ////////////////////////////////////////////////////////////////////
-bool RHMesh::doArp(uint8_t address)
+uint8_t RHMesh::sendtoAsync(uint8_t* buf, uint8_t len, uint8_t address, uint8_t flags, uint8_t* handle)
+{
+    if (len > RH_MESH_MAX_MESSAGE_LEN)
+	return RH_ROUTER_ERROR_INVALID_LENGTH;
+
+    checkRoutes();
+    serviceDiscoveries();
+    if (address != RH_BROADCAST_ADDRESS && !getRouteTo(address))
+    {
+	if (handle)
+	    *handle = RH_RELIABLE_NO_HANDLE;
+#if RH_MESH_PENDING_SENDS > 0
+	// Keep the message until the route has been discovered
+	uint8_t i;
+	for (i = 0; i < RH_MESH_PENDING_SENDS; i++)
+	    if (!_pending[i].active)
+		break;
+	if (i >= RH_MESH_PENDING_SENDS)
+	    return RH_ROUTER_ERROR_BUSY;
+	if (!startDiscovery(address))
+	    return RH_ROUTER_ERROR_NO_ROUTE;
+	PendingSend* p = &_pending[i];
+	MeshApplicationMessage* a = (MeshApplicationMessage*)p->buf;
+	a->header.msgType = RH_MESH_MESSAGE_TYPE_APPLICATION;
+	memcpy(a->data, buf, len);
+	p->len = sizeof(RHMesh::MeshMessageHeader) + len;
+	p->dest = address;
+	p->flags = flags;
+	p->order = _pendingOrder++;
+	p->active = true;
+	return RH_ROUTER_ERROR_NONE;
+#else
+	return RH_ROUTER_ERROR_NO_ROUTE;
+#endif
+    }
+
+    // Contruct an application layer message and send it via that route
+    MeshApplicationMessage* a = (MeshApplicationMessage*)&_tmpMessage;
+    a->header.msgType = RH_MESH_MESSAGE_TYPE_APPLICATION;
+    memcpy(a->data, buf, len);
+    return RHRouter::sendtoAsync(_tmpMessage, sizeof(RHMesh::MeshMessageHeader) + len, address, flags, handle);
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHMesh::sendDiscoveryRequest(uint8_t address)
 {
-    // Need to discover a route
     // Broadcast a route discovery message with nothing in it
-    MeshRouteDiscoveryMessage* p = (MeshRouteDiscoveryMessage*)&_tmpMessage;
+    uint8_t request[sizeof(RHMesh::MeshMessageHeader) + 2];
+    MeshRouteDiscoveryMessage* p = (MeshRouteDiscoveryMessage*)request;
     p->header.msgType = RH_MESH_MESSAGE_TYPE_ROUTE_DISCOVERY_REQUEST;
     p->destlen = 1; 
     p->dest = address; // Who we are looking for
-    uint8_t error = RHRouter::sendtoWait((uint8_t*)p, sizeof(RHMesh::MeshMessageHeader) + 2, RH_BROADCAST_ADDRESS);
-    if (error !=  RH_ROUTER_ERROR_NONE)
+    return RHRouter::sendtoWait(request, sizeof(request), RH_BROADCAST_ADDRESS) == RH_ROUTER_ERROR_NONE;
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHMesh::startDiscovery(uint8_t address)
+{
+    uint8_t i;
+    uint8_t free = RH_MESH_MAX_DISCOVERIES;
+    for (i = 0; i < RH_MESH_MAX_DISCOVERIES; i++)
+    {
+	// serviceDiscoveries() may not have been called since this one timed out
+	if (_discoveries[i].active && millis() - _discoveries[i].started > RH_MESH_ARP_TIMEOUT)
+	    _discoveries[i].active = false;
+	if (!_discoveries[i].active)
+	    free = i;
+	else if (_discoveries[i].dest == address)
+	    return true; // Already in progress
+    }
+    if (free >= RH_MESH_MAX_DISCOVERIES || !sendDiscoveryRequest(address))
+	return false;
+    _discoveries[free].dest = address;
+    _discoveries[free].started = millis();
+    _discoveries[free].active = true;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHMesh::serviceDiscoveries()
+{
+    uint8_t i;
+    for (i = 0; i < RH_MESH_MAX_DISCOVERIES; i++)
+    {
+	Discovery* d = &_discoveries[i];
+	// Finished when the route is known (peekAtMessage() adds it when the response arrives)
+	// or the response is too late
+	if (   d->active
+	    && (   routeAt(findRoute(d->dest))
+		|| millis() - d->started > RH_MESH_ARP_TIMEOUT))
+	    d->active = false;
+    }
+
+#if RH_MESH_PENDING_SENDS > 0
+    // Send queued messages for which there is now a route, in the order they were queued
+    while (1)
+    {
+	uint8_t oldest = RH_MESH_PENDING_SENDS;
+	for (i = 0; i < RH_MESH_PENDING_SENDS; i++)
+	{
+	    PendingSend* p = &_pending[i];
+	    if (!p->active)
+		continue;
+	    if (!routeAt(findRoute(p->dest)))
+	    {
+		// Discard it if route discovery has given up
+		uint8_t j;
+		for (j = 0; j < RH_MESH_MAX_DISCOVERIES; j++)
+		    if (_discoveries[j].active && _discoveries[j].dest == p->dest)
+			break;
+		if (j >= RH_MESH_MAX_DISCOVERIES)
+		    p->active = false;
+	    }
+	    else if (oldest >= RH_MESH_PENDING_SENDS || (int8_t)(p->order - _pending[oldest].order) < 0)
+		oldest = i;
+	}
+	if (oldest >= RH_MESH_PENDING_SENDS)
+	    break;
+	PendingSend* p = &_pending[oldest];
+	if (RHRouter::sendtoAsync(p->buf, p->len, p->dest, p->flags) == RH_ROUTER_ERROR_BUSY)
+	    break; // No room in the window. Try again later
+	p->active = false;
+    }
+#endif
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHMesh::doArp(uint8_t address)
+{
+    // Need to discover a route
+    if (!startDiscovery(address) && !sendDiscoveryRequest(address))
 	return false;
     
     // Wait for a reply, which will be unicast back to us
     // It will contain the complete route to the destination
-    uint8_t messageLen = sizeof(_tmpMessage);
     // FIXME: timeout should be configurable
     unsigned long starttime = millis();
     int32_t timeLeft;
     while ((timeLeft = RH_MESH_ARP_TIMEOUT - (millis() - starttime)) > 0)
     {
-	if (waitAvailableTimeout(timeLeft))
+	// Wake up in time to retransmit any window messages
+	uint16_t waitTime = windowTimeLeft(timeLeft);
+	if (waitTime)
+	    waitAvailableTimeout(waitTime);
+	const uint8_t* message;
+	uint8_t messageLen;
+	uint8_t source, dest, id, flags;
+	if (receiveMessage(&message, &messageLen, &source, &dest, &id, &flags))
 	{
-	    if (RHRouter::recvfromAck(_tmpMessage, &messageLen))
+#if RH_MESH_RECEIVE_QUEUE_LEN > 0
+	    // An application message for our caller. Keep it for recvfromAck() if there is room
+	    if (_receivedCount < RH_MESH_RECEIVE_QUEUE_LEN)
 	    {
-		if (   messageLen > 1
-		       && p->header.msgType == RH_MESH_MESSAGE_TYPE_ROUTE_DISCOVERY_RESPONSE)
-		{
-		    // Got a reply, now add the next hop to the dest to the routing table
-		    // The first hop taken is the first octet
-		    addRouteTo(address, headerFrom());
-		    return true;
-		}
+		ReceivedMessage* r = &_received[(_receivedHead + _receivedCount++) % RH_MESH_RECEIVE_QUEUE_LEN];
+		r->source = source;
+		r->dest = dest;
+		r->id = id;
+		r->flags = flags;
+		r->len = messageLen - sizeof(MeshMessageHeader);
+		memcpy(r->data, ((MeshApplicationMessage*)message)->data, r->len);
 	    }
+#endif
+	    consume();
 	}
+	// peekAtMessage() adds the route when the response arrives
+	if (routeAt(findRoute(address)))
+	    return true;
 	YIELD;
     }
     return false;
@@ -92,6 +243,12 @@ bool RHMesh::doArp(uint8_t address)
 void RHMesh::peekAtMessage(RoutedMessage* message, uint8_t messageLen)
 {
     MeshMessageHeader* m = (MeshMessageHeader*)message->data;
+    // Any unicast routed message confirms the route back to its originator, and its 
+    // end-to-end ID is the originator's latest sequence number
+    if (   message->header.source != _thisAddress
+	&& message->header.dest != RH_BROADCAST_ADDRESS)
+	updateRoute(message->header.source, headerFrom(), message->header.hops + 1, message->header.id);
+
     if (   messageLen > 1 
 	&& m->msgType == RH_MESH_MESSAGE_TYPE_ROUTE_DISCOVERY_RESPONSE)
     {
@@ -99,16 +256,19 @@ void RHMesh::peekAtMessage(RoutedMessage* message, uint8_t messageLen)
 	// being routed back to the originator here. Want to scrape some routing data out of the response
 	// We can find the routes to all the nodes between here and the responding node
 	MeshRouteDiscoveryMessage* d = (MeshRouteDiscoveryMessage*)message->data;
-	addRouteTo(d->dest, headerFrom());
+	updateRoute(d->dest, headerFrom(), message->header.hops + 1, message->header.id);
 	uint8_t numRoutes = messageLen - sizeof(RoutedMessageHeader) - sizeof(MeshMessageHeader) - 2;
 	uint8_t i;
 	// Find us in the list of nodes that were traversed to get to the responding node
 	for (i = 0; i < numRoutes; i++)
 	    if (d->route[i] == _thisAddress)
 		break;
-	i++;
-	while (i++ < numRoutes)
-	    addRouteTo(d->route[i], headerFrom());
+	// If we are the originator we are not in the list, and all the nodes in it are on the way
+	int16_t here = i;
+	if (i == numRoutes && message->header.dest == _thisAddress)
+	    here = -1;
+	for (i = here + 1; i < numRoutes; i++)
+	    updateRoute(d->route[i], headerFrom(), i - here, -1);
     }
     else if (   messageLen > 1 
 	     && m->msgType == RH_MESH_MESSAGE_TYPE_ROUTE_FAILURE)
@@ -127,20 +287,192 @@ uint8_t RHMesh::route(RoutedMessage* message, uint8_t messageLen)
     if (   ret == RH_ROUTER_ERROR_NO_ROUTE
 	|| ret == RH_ROUTER_ERROR_UNABLE_TO_DELIVER)
     {
-	// Cant deliver to the next hop. Delete the route
-	deleteRouteTo(message->header.dest);
+	uint8_t failed = routeFailed(message, from);
 	if (message->header.source != _thisAddress)
+	    ret = failed;
+    }
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////
+// This is called when a message is to be sent to the next hop without waiting
+uint8_t RHMesh::routeAsync(RoutedMessage* message, uint8_t messageLen, uint8_t* handle)
+{
+    uint8_t from = headerFrom();
+    uint8_t ret = RHRouter::routeAsync(message, messageLen, handle);
+    if (ret == RH_ROUTER_ERROR_NO_ROUTE)
+	routeFailed(message, from);
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////
+// This is called when the next hop has acknowledged, or failed to acknowledge, a message from routeAsync()
+void RHMesh::routeComplete(RoutedMessage* message, uint8_t messageLen, bool delivered)
+{
+    (void)messageLen; // Not used
+    if (!delivered)
+	routeFailed(message, RH_BROADCAST_ADDRESS);
+}
+
+////////////////////////////////////////////////////////////////////
+uint8_t RHMesh::routeFailed(RoutedMessage* message, uint8_t from)
+{
+    // message may be _tmpMessage, which is overwritten below, so keep the addresses
+    uint8_t source = message->header.source;
+    uint8_t dest = message->header.dest;
+
+    // Cant deliver to the next hop. Delete the route
+    deleteRouteTo(dest);
+    if (source == _thisAddress)
+	return RH_ROUTER_ERROR_UNABLE_TO_DELIVER;
+
+    // This is being proxied, so tell the originator about it
+    MeshRouteFailureMessage* p = (MeshRouteFailureMessage*)&_tmpMessage;
+    p->header.msgType = RH_MESH_MESSAGE_TYPE_ROUTE_FAILURE;
+    p->dest = dest; // Who you were trying to deliver to
+    // Make sure there is a route back towards whoever sent the original message
+    if (from != RH_BROADCAST_ADDRESS)
+	addRouteTo(source, from);
+    // Dont wait for the ACK unless there is no room in the window
+    uint8_t ret = RHRouter::sendtoAsync((uint8_t*)p, sizeof(RHMesh::MeshMessageHeader) + 1, source);
+    if (ret == RH_ROUTER_ERROR_BUSY)
+	ret = RHRouter::sendtoWait((uint8_t*)p, sizeof(RHMesh::MeshMessageHeader) + 1, source);
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHMesh::updateRoute(uint8_t dest, uint8_t next_hop, uint8_t hops, int16_t seq)
+{
+    if (dest == _thisAddress || dest == RH_BROADCAST_ADDRESS)
+	return false;
+
+    RoutingTableEntry* route = routeAt(findRoute(dest));
+    if (route && route->state == Valid)
+    {
+	bool accept;
+	if (seq >= 0 && route->seq >= 0 && seq != route->seq)
+	    accept = (int8_t)(seq - route->seq) > 0; // Fresher route wins, whatever its length
+	else if (next_hop == route->next_hop)
+	    accept = true; // Confirms the route we have
+	else if (seq < 0 && route->seq >= 0)
+	    accept = hops && hops < route->hops; // Only replace a sequenced route with a shorter one
+	else
+	    accept = !hops || !route->hops || hops <= route->hops; // Prefer the shorter, else the latest
+	if (!accept)
+	    return false;
+	if (next_hop == route->next_hop)
 	{
-	    // This is being proxied, so tell the originator about it
-	    MeshRouteFailureMessage* p = (MeshRouteFailureMessage*)&_tmpMessage;
-	    p->header.msgType = RH_MESH_MESSAGE_TYPE_ROUTE_FAILURE;
-	    p->dest = message->header.dest; // Who you were trying to deliver to
-	    // Make sure there is a route back towards whoever sent the original message
-	    addRouteTo(message->header.source, from);
-	    ret = RHRouter::sendtoWait((uint8_t*)p, sizeof(RHMesh::MeshMessageHeader) + 1, message->header.source);
+	    // Keep what we already know about this route
+	    if (seq < 0)
+		seq = route->seq;
+	    if (!hops)
+		hops = route->hops;
 	}
     }
-    return ret;
+    addRouteTo(dest, next_hop);
+    route = routeAt(findRoute(dest));
+    if (route)
+    {
+	route->hops = hops;
+	route->seq = seq;
+    }
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHMesh::setRouteTimeout(unsigned long timeout)
+{
+    _routeTimeout = timeout;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHMesh::setRebroadcastProbability(uint8_t percent, uint8_t minHops)
+{
+    _rebroadcastProbability = percent;
+    _rebroadcastMinHops = minHops;
+}
+
+////////////////////////////////////////////////////////////////////
+// Subclasses may want to override
+bool RHMesh::shouldRebroadcast(uint8_t numRoutes)
+{
+    if (numRoutes < _rebroadcastMinHops || _rebroadcastProbability >= 100)
+	return true;
+#if (RH_PLATFORM == RH_PLATFORM_RASPI) // use standard library random(), bugs in random(min, max)
+    uint8_t r = random() % 100;
+#else
+    uint8_t r = random(0, 100);
+#endif
+    return r < _rebroadcastProbability;
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHMesh::seenRequest(uint8_t source, uint8_t id, uint8_t* hops)
+{
+    uint8_t i;
+    for (i = 0; i < RH_MESH_REQUEST_CACHE_SIZE; i++)
+    {
+	if (   _seenRequests[i].source == source
+	    && _seenRequests[i].id == id
+	    && millis() - _seenRequests[i].seen < RH_MESH_ARP_TIMEOUT)
+	{
+	    uint8_t fewest = _seenRequests[i].hops;
+	    if (*hops < fewest)
+		_seenRequests[i].hops = *hops;
+	    *hops = fewest;
+	    return true;
+	}
+    }
+
+    // Not seen, remember it in place of the oldest
+    _seenRequests[_nextSeenRequest].source = source;
+    _seenRequests[_nextSeenRequest].id = id;
+    _seenRequests[_nextSeenRequest].hops = *hops;
+    _seenRequests[_nextSeenRequest].seen = millis();
+    if (++_nextSeenRequest >= RH_MESH_REQUEST_CACHE_SIZE)
+	_nextSeenRequest = 0;
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHMesh::checkRoutes()
+{
+    if (!_routeTimeout)
+	return;
+    unsigned long now = millis();
+    if (now - _lastRouteCheck < _routeTimeout / 8)
+	return;
+    _lastRouteCheck = now;
+
+    uint8_t refresh = RH_BROADCAST_ADDRESS;
+    uint16_t i = 0;
+    while (i < RH_ROUTING_TABLE_SIZE)
+    {
+	RoutingTableEntry* route = routeAt(i);
+	if (route->state == Valid)
+	{
+	    unsigned long age = now - route->learned;
+	    if (age >= _routeTimeout)
+	    {
+		// Expired. Deleting it may move another route into this entry, so look at it again
+		deleteRoute(i);
+		continue;
+	    }
+	    // Refresh a route that is still in use before it expires
+	    if (   refresh == RH_BROADCAST_ADDRESS
+		&& age >= _routeTimeout - _routeTimeout / 4
+		&& now - route->lastUsed < _routeTimeout / 4)
+		refresh = route->dest;
+	}
+	i++;
+    }
+
+    if (refresh != RH_BROADCAST_ADDRESS)
+    {
+	// Broadcast a route discovery request, but dont wait for the reply. 
+	// peekAtMessage() will update the route when it arrives
+	sendDiscoveryRequest(refresh);
+    }
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -154,34 +486,83 @@ bool RHMesh::isPhysicalAddress(uint8_t* address, uint8_t addresslen)
 ////////////////////////////////////////////////////////////////////
 bool RHMesh::recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* source, uint8_t* dest, uint8_t* id, uint8_t* flags)
 {     
-    uint8_t tmpMessageLen = sizeof(_tmpMessage);
+    checkRoutes();
+    serviceDiscoveries();
+#if RH_MESH_RECEIVE_QUEUE_LEN > 0
+    // First deliver any messages that arrived while we were discovering a route
+    if (_receivedCount)
+    {
+	ReceivedMessage* r = &_received[_receivedHead];
+	if (source) *source = r->source;
+	if (dest)   *dest   = r->dest;
+	if (id)     *id     = r->id;
+	if (flags)  *flags  = r->flags;
+	if (*len > r->len)
+	    *len = r->len;
+	memcpy(buf, r->data, *len);
+	_receivedHead = (_receivedHead + 1) % RH_MESH_RECEIVE_QUEUE_LEN;
+	_receivedCount--;
+	return true;
+    }
+#endif
+
+    const uint8_t* message;
+    uint8_t messageLen;
     uint8_t _source;
     uint8_t _dest;
     uint8_t _id;
     uint8_t _flags;
-    if (RHRouter::recvfromAck(_tmpMessage, &tmpMessageLen, &_source, &_dest, &_id, &_flags))
+    if (receiveMessage(&message, &messageLen, &_source, &_dest, &_id, &_flags))
     {
-	MeshMessageHeader* p = (MeshMessageHeader*)&_tmpMessage;
+	MeshApplicationMessage* a = (MeshApplicationMessage*)message;
+	// Handle application layer messages, presumably for our caller
+	if (source) *source = _source;
+	if (dest)   *dest   = _dest;
+	if (id)     *id     = _id;
+	if (flags)  *flags  = _flags;
+	uint8_t msgLen = messageLen - sizeof(MeshMessageHeader);
+	if (*len > msgLen)
+	    *len = msgLen;
+	memcpy(buf, a->data, *len);
+	consume();
+	return true;
+    }
+    return false;
+}
 
+////////////////////////////////////////////////////////////////////
+bool RHMesh::receiveMessage(const uint8_t** message, uint8_t* messageLen, uint8_t* source, uint8_t* dest, uint8_t* id, uint8_t* flags)
+{     
+    uint8_t* frame;
+    uint8_t tmpMessageLen;
+    uint8_t _source;
+    uint8_t _dest;
+    uint8_t _id;
+    uint8_t _flags;
+    if (RHRouter::peekfromAck(&frame, &tmpMessageLen, &_source, &_dest, &_id, &_flags))
+    {
 	if (   tmpMessageLen >= 1 
-	    && p->msgType == RH_MESH_MESSAGE_TYPE_APPLICATION)
+	    && ((MeshMessageHeader*)frame)->msgType == RH_MESH_MESSAGE_TYPE_APPLICATION)
 	{
-	    MeshApplicationMessage* a = (MeshApplicationMessage*)p;
-	    // Handle application layer messages, presumably for our caller
-	    if (source) *source = _source;
-	    if (dest)   *dest   = _dest;
-	    if (id)     *id     = _id;
-	    if (flags)  *flags  = _flags;
-	    uint8_t msgLen = tmpMessageLen - sizeof(MeshMessageHeader);
-	    if (*len > msgLen)
-		*len = msgLen;
-	    memcpy(buf, a->data, *len);
-	    
+	    // An application layer message, presumably for our caller, who will consume() it
+	    *message    = frame;
+	    *messageLen = tmpMessageLen;
+	    *source = _source;
+	    *dest   = _dest;
+	    *id     = _id;
+	    *flags  = _flags;
 	    return true;
 	}
-	else if (   _dest == RH_BROADCAST_ADDRESS 
-		 && tmpMessageLen > 1 
-		 && p->msgType == RH_MESH_MESSAGE_TYPE_ROUTE_DISCOVERY_REQUEST)
+
+	// Route discovery messages may be changed and sent on, so work on a copy
+	if (tmpMessageLen > sizeof(_tmpMessage))
+	    tmpMessageLen = sizeof(_tmpMessage);
+	memcpy(_tmpMessage, frame, tmpMessageLen);
+	consume();
+	MeshMessageHeader* p = (MeshMessageHeader*)&_tmpMessage;
+	if (   _dest == RH_BROADCAST_ADDRESS 
+	    && tmpMessageLen > 1 
+	    && p->msgType == RH_MESH_MESSAGE_TYPE_ROUTE_DISCOVERY_REQUEST)
 	{
 	    MeshRouteDiscoveryMessage* d = (MeshRouteDiscoveryMessage*)p;
 	    // Handle Route discovery requests
@@ -198,27 +579,40 @@ bool RHMesh::recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* source, uint8_t* d
 		    return false; // Already been through us. Discard
 	    
 	    // Hasnt been past us yet, record routes back to the earlier nodes
-	    addRouteTo(_source, headerFrom()); // The originator
+	    updateRoute(_source, headerFrom(), numRoutes + 1, _id); // The originator
 	    for (i = 0; i < numRoutes; i++)
-		addRouteTo(d->route[i], headerFrom());
+		updateRoute(d->route[i], headerFrom(), numRoutes - i, -1);
+
+	    // Only rebroadcast the first copy of each request, however many ways it reaches us
+	    uint8_t fewest = numRoutes + 1;
+	    bool seen = seenRequest(_source, _id, &fewest);
+
 	    if (isPhysicalAddress(&d->dest, d->destlen))
 	    {
+		// Answer the first copy, and any later one that came a shorter way, so the originator
+		// can use the route with the fewest hops
+		if (seen && numRoutes + 1 >= fewest)
+		    return false;
 		// This route discovery is for us. Unicast the whole route back to the originator
 		// as a RH_MESH_MESSAGE_TYPE_ROUTE_DISCOVERY_RESPONSE
 		// We are certain to have a route there, because we just got it
 		d->header.msgType = RH_MESH_MESSAGE_TYPE_ROUTE_DISCOVERY_RESPONSE;
-		RHRouter::sendtoWait((uint8_t*)d, tmpMessageLen, _source);
+		// Dont wait for the ACK unless there is no room in the window
+		if (RHRouter::sendtoAsync((uint8_t*)d, tmpMessageLen, _source) == RH_ROUTER_ERROR_BUSY)
+		    RHRouter::sendtoWait((uint8_t*)d, tmpMessageLen, _source);
 	    }
-	    else if (i < _max_hops)
+	    else if (!seen && i < _max_hops && shouldRebroadcast(numRoutes))
 	    {
 		// Its for someone else, rebroadcast it, after adding ourselves to the list
 		d->route[numRoutes] = _thisAddress;
 		tmpMessageLen++;
-		// Have to impersonate the source
+		// Have to impersonate the source, and keep its ID, which is its sequence number
 		// REVISIT: if this fails what can we do?
-		RHRouter::sendtoFromSourceWait(_tmpMessage, tmpMessageLen, RH_BROADCAST_ADDRESS, _source);
+		RHRouter::sendtoFromSourceWait(_tmpMessage, tmpMessageLen, RH_BROADCAST_ADDRESS, _source, _flags, _id);
 	    }
 	}
+	// Maybe this was the route discovery response that queued messages were waiting for
+	serviceDiscoveries();
     }
     return false;
 }
@@ -230,12 +624,13 @@ bool RHMesh::recvfromAckTimeout(uint8_t* buf, uint8_t* len, uint16_t timeout, ui
     int32_t timeLeft;
     while ((timeLeft = timeout - (millis() - starttime)) > 0)
     {
-	if (waitAvailableTimeout(timeLeft))
-	{
-	    if (recvfromAck(buf, len, from, to, id, flags))
-		return true;
-	    YIELD;
-	}
+	// Wake up in time to retransmit any window messages
+	uint16_t waitTime = windowTimeLeft(timeLeft);
+	if (waitTime)
+	    waitAvailableTimeout(waitTime);
+	if (recvfromAck(buf, len, from, to, id, flags))
+	    return true;
+	YIELD;
     }
     return false;
 }
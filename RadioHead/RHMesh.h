@@ -18,6 +18,57 @@
 // Timeout for address resolution in milliecs
 #define RH_MESH_ARP_TIMEOUT 4000
 
+// Default time in milliseconds after which a discovered route expires, unless it is 
+// confirmed or refreshed. See setRouteTimeout()
+#ifndef RH_MESH_ROUTE_TIMEOUT
+ #define RH_MESH_ROUTE_TIMEOUT 300000
+#endif
+
+// The number of route discoveries that can be in progress at once (see sendtoAsync())
+#ifndef RH_MESH_MAX_DISCOVERIES
+ #if defined(__AVR__)
+  #define RH_MESH_MAX_DISCOVERIES 2
+ #else
+  #define RH_MESH_MAX_DISCOVERIES 4
+ #endif
+#endif
+
+// The number of application messages sent by sendtoAsync() that can wait for route discovery.
+// Each one holds a copy of the message, so this costs about 
+// RH_MESH_PENDING_SENDS * (RH_ROUTER_MAX_MESSAGE_LEN + 4) octets of SRAM.
+// Can be pre-defined to a smaller size (to save SRAM) prior to including this header.
+// Defaults to 0 (sendtoAsync() does not discover routes) on AVR processors.
+#ifndef RH_MESH_PENDING_SENDS
+ #if defined(__AVR__)
+  #define RH_MESH_PENDING_SENDS 0
+ #else
+  #define RH_MESH_PENDING_SENDS 4
+ #endif
+#endif
+
+// The number of recent route discovery requests remembered, so that each one is handled only once.
+// Each one costs 7 octets of SRAM.
+#ifndef RH_MESH_REQUEST_CACHE_SIZE
+ #if defined(__AVR__)
+  #define RH_MESH_REQUEST_CACHE_SIZE 4
+ #else
+  #define RH_MESH_REQUEST_CACHE_SIZE 16
+ #endif
+#endif
+
+// The number of application messages for this node that can be kept while sendtoWait() 
+// is discovering a route, to be delivered later by recvfromAck().
+// Each one costs about RH_ROUTER_MAX_MESSAGE_LEN + 5 octets of SRAM.
+// Can be pre-defined to a smaller size (to save SRAM) prior to including this header.
+// Defaults to 0 (messages arriving during route discovery are discarded) on AVR processors.
+#ifndef RH_MESH_RECEIVE_QUEUE_LEN
+ #if defined(__AVR__)
+  #define RH_MESH_RECEIVE_QUEUE_LEN 0
+ #else
+  #define RH_MESH_RECEIVE_QUEUE_LEN 4
+ #endif
+#endif
+
 /////////////////////////////////////////////////////////////////////
 /// \class RHMesh RHMesh.h <RHMesh.h>
 /// \brief RHRouter subclass for sending addressed, optionally acknowledged datagrams
@@ -49,6 +100,12 @@
 /// If a node receives a RH_MESH_MESSAGE_TYPE_ROUTE_DISCOVERY_REQUEST that already has itself 
 /// listed in the visited nodes, it knows it has already seen and rebroadcast this request, 
 /// and threfore ignores it. This prevents broadcast storms.
+/// In a dense mesh the same request can also reach a node by many different paths. Each node 
+/// therefore remembers the SOURCE and end-to-end ID of the last RH_MESH_REQUEST_CACHE_SIZE requests it has seen
+/// (for RH_MESH_ARP_TIMEOUT), and only rebroadcasts the first copy of each request
+/// (although it still learns routes from the other copies). The destination answers the first copy,
+/// and any later copy that arrived over fewer hops than the copies it has already answered.
+/// In very dense meshes, you can further reduce the number of rebroadcasts with setRebroadcastProbability().
 /// When a node receives a RH_MESH_MESSAGE_TYPE_ROUTE_DISCOVERY_REQUEST it can use the list of 
 /// nodes aready visited to deduce routes back towards the originating (requesting node). 
 /// This also means that when the destination node of the request is reached, it (and all 
@@ -66,8 +123,9 @@
 /// the intermediate nodes know how to route to the source and destination nodes and every node along the path.
 ///
 /// Note that there is a race condition here that can effect routing on multipath routes. For example, 
-/// if the route to the destination can traverse several paths, last reply from the destination 
-/// will be the one used.
+/// if the route to the destination can traverse several paths, several replies from the destination 
+/// may arrive, each over fewer hops than the one before. The one with the fewest hops will be used
+/// (see Route Aging and Refresh below).
 ///
 /// \par Route Failure
 ///
@@ -84,6 +142,44 @@
 /// (either because an intermediate node is off the air, or has moved out of range) a new route 
 /// will be established the next time a message is to be sent.
 ///
+/// \par Route Aging and Refresh
+///
+/// Routes learned by RHMesh do not last forever. Each route records when it was learned and is deleted
+/// when it is older than the route timeout (RH_MESH_ROUTE_TIMEOUT, 5 minutes, see setRouteTimeout()),
+/// so routes through nodes that have moved away or gone off the air are eventually forgotten
+/// even if no message fails. Routes are confirmed (and their age reset) whenever a routed message 
+/// from the destination passes through or arrives at this node.
+/// Routes that have been used recently are refreshed before they expire: when a route in use 
+/// reaches 3/4 of the route timeout, RHMesh broadcasts a new RH_MESH_MESSAGE_TYPE_ROUTE_DISCOVERY_REQUEST 
+/// for it, without waiting for the reply, so the route is usually replaced before it expires and 
+/// senders do not have to wait for a new route discovery.
+///
+/// In the manner of AODV, each route also records the number of hops to the destination and the destination's 
+/// sequence number, when known. The sequence number is the end-to-end message ID (see RHRouter) of the 
+/// most recent routed message originated by the destination (such as its route discovery requests and 
+/// responses) that the route was learned from. When a node hears of a new route to a destination
+/// it already has a route to, it prefers the route with the newer sequence number, and, 
+/// for the same sequence number, the route with fewer hops. This prevents stale or longer routes learned 
+/// from slow route discovery replies from replacing fresher ones.
+///
+/// \par Non-blocking Operation
+///
+/// sendtoAsync() sends an application message without waiting for the next hop to acknowledge it. 
+/// Messages being routed through this node are also
+/// forwarded without waiting (see RHRouter). If the next hop never acknowledges a message, the route is deleted
+/// and the originator is informed, just as with sendtoWait(). You must call recvfromAck() frequently
+/// for retransmissions, route discovery and failures to be handled.
+///
+/// If there is no route to the destination, sendtoAsync() keeps the message in a queue of up to 
+/// RH_MESH_PENDING_SENDS messages, broadcasts a route discovery request and returns immediately. 
+/// Up to RH_MESH_MAX_DISCOVERIES destinations can be discovered at once. When the route discovery 
+/// response arrives (during a later call to recvfromAck()), the queued messages for that destination are sent. 
+/// If no response arrives within RH_MESH_ARP_TIMEOUT, they are discarded.
+///
+/// sendtoWait() still waits for the route to be discovered, but while it waits it continues to handle 
+/// route discovery requests and routes messages for other nodes, and keeps up to RH_MESH_RECEIVE_QUEUE_LEN 
+/// application messages for this node so that recvfromAck() can deliver them later.
+///
 /// \par Message Format
 ///
 /// RHMesh uses a number of message formats layered on top of RHRouter:
@@ -108,9 +204,9 @@
 /// (https://lowpowerlab.com/shop/moteinomega) or others.
 ///
 /// \par Performance
-/// This class (in the interests of simple implemtenation and low memory use) does not have
-/// message queueing. This means that only one message at a time can be handled. Message transmission 
-/// failures can have a severe impact on network performance.
+/// This class (in the interests of simple implemtenation and low memory use) has only limited
+/// message queueing (see Non-blocking Operation above), and none at all on AVR processors by default. 
+/// Message transmission failures can have a severe impact on network performance.
 /// If you need high performance mesh networking under all conditions consider XBee or similar.
 class RHMesh : public RHRouter
 {
@@ -174,6 +270,24 @@ public:
     ///           (usually because it dod not acknowledge due to being off the air or out of range
     uint8_t sendtoWait(uint8_t* buf, uint8_t len, uint8_t dest, uint8_t flags = 0);
 
+    /// Sends a message to the destination node without waiting for an acknowledgement from the next hop.
+    /// If there is no route to dest, the message is queued, route discovery is started and the function returns
+    /// without waiting for it. The message will be sent by recvfromAck() when the route is discovered.
+    /// \param [in] buf The application message data
+    /// \param [in] len Number of octets in the application message data. 0 is permitted
+    /// \param [in] dest The destination node address. If the address is RH_BROADCAST_ADDRESS (255)
+    /// the message will be broadcast to all the nearby nodes, but not routed or relayed.
+    /// \param [in] flags Optional flags for use by subclasses or application layer, 
+    ///             delivered end-to-end to the dest address. The receiver can recover the flags with recvFromAck().
+    /// \param [in] handle If present and not NULL, the referenced uint8_t will be set to a handle that can be 
+    ///             passed to sendState(), or RH_RELIABLE_NO_HANDLE if the message is waiting for route discovery
+    /// \return The result code:
+    ///         - RH_ROUTER_ERROR_NONE Message was sent to the next hop, or queued until a route is discovered
+    ///         - RH_ROUTER_ERROR_NO_ROUTE There was no route for dest and route discovery could not be started
+    ///           (always the case if RH_MESH_PENDING_SENDS is 0)
+    ///         - RH_ROUTER_ERROR_BUSY There is no room in the window or the queue for the message
+    uint8_t sendtoAsync(uint8_t* buf, uint8_t len, uint8_t dest, uint8_t flags = 0, uint8_t* handle = NULL);
+
     /// Starts the receiver if it is not running already, processes and possibly routes any received messages
     /// addressed to other nodes
     /// and delivers any messages addressed to this node.
@@ -213,6 +327,23 @@ public:
     /// \return true if a valid message was copied to buf
     bool recvfromAckTimeout(uint8_t* buf, uint8_t* len,  uint16_t timeout, uint8_t* source = NULL, uint8_t* dest = NULL, uint8_t* id = NULL, uint8_t* flags = NULL);
 
+    /// Sets the time after which learned routes expire unless they are confirmed or refreshed.
+    /// Routes in use are refreshed by a new route discovery when they reach 3/4 of this age.
+    /// This applies to all routes in the routing table, including any added with addRouteTo().
+    /// \param [in] timeout The route timeout in milliseconds. 0 means routes never expire 
+    /// and are never refreshed. Defaults to RH_MESH_ROUTE_TIMEOUT.
+    void setRouteTimeout(unsigned long timeout);
+
+    /// Sets the probability that this node will rebroadcast a route discovery request for another node 
+    /// (probabilistic or 'gossip' flooding). In dense meshes, most nodes hear each request from several 
+    /// neighbours, and it is enough for some of them to rebroadcast it. Requests that have been 
+    /// through fewer than minHops nodes are always rebroadcast, so that discoveries do not die out 
+    /// close to the originator.
+    /// \param [in] percent The probability of rebroadcasting, 0 to 100. Defaults to 100 (always rebroadcast).
+    /// \param [in] minHops Requests that have been rebroadcast by fewer than this number of nodes are always
+    /// rebroadcast. Defaults to 1.
+    void setRebroadcastProbability(uint8_t percent, uint8_t minHops = 1);
+
 protected:
 
     /// Internal function that inspects messages being received and adjusts the routing table if necessary.
@@ -228,8 +359,90 @@ protected:
     /// \param [in] messageLen Length of message in octets
     virtual uint8_t route(RoutedMessage* message, uint8_t messageLen);
 
+    /// Internal function that deletes the route and informs the originator if a message
+    /// could not be sent to its next hop without waiting.
+    /// \param [in] message Pointer to the RHRouter message to be sent.
+    /// \param [in] messageLen Length of message in octets
+    /// \param [in] handle If not NULL, the referenced uint8_t will be set to the window handle
+    virtual uint8_t routeAsync(RoutedMessage* message, uint8_t messageLen, uint8_t* handle);
+
+    /// Internal function that deletes the route and informs the originator if a message
+    /// sent by routeAsync() was not acknowledged by its next hop.
+    /// \param [in] message Pointer to the RHRouter message that was sent.
+    /// \param [in] messageLen Length of message in octets
+    /// \param [in] delivered true if the next hop acknowledged the message
+    virtual void routeComplete(RoutedMessage* message, uint8_t messageLen, bool delivered);
+
+    /// Deletes the route to the destination of a message that could not be delivered to its next hop and,
+    /// if the message is being proxied, sends a RH_MESH_MESSAGE_TYPE_ROUTE_FAILURE to its originator
+    /// \param [in] message Pointer to the RHRouter message that could not be delivered.
+    /// \param [in] from The node the message was received from, or RH_BROADCAST_ADDRESS if not known
+    /// \return The result of sending the route failure message, or RH_ROUTER_ERROR_UNABLE_TO_DELIVER
+    uint8_t routeFailed(RoutedMessage* message, uint8_t from);
+
+    /// Adds or updates the route to a destination if it is better than the one we already have.
+    /// A route with a newer sequence number is always preferred. For the same (or unknown) sequence number,
+    /// a route with fewer hops is preferred, and a route through the same next hop confirms the existing route.
+    /// \param [in] dest The destination node address
+    /// \param [in] next_hop The address of the next hop towards dest
+    /// \param [in] hops The number of hops to dest, or 0 if not known
+    /// \param [in] seq The sequence number of dest (its end-to-end message ID), or -1 if not known
+    /// \return true if the route was added or updated
+    bool updateRoute(uint8_t dest, uint8_t next_hop, uint8_t hops, int16_t seq);
+
+    /// Deletes expired routes and starts refreshing routes in use that will soon expire.
+    /// Does nothing unless the route timeout/8 has elapsed since it last ran.
+    /// Called by sendtoWait(), sendtoAsync() and recvfromAck().
+    /// Virtual so subclasses can override.
+    virtual void checkRoutes();
+
+    /// Receives and processes the next message, if any. Handles route discovery requests 
+    /// and routes messages for other nodes.
+    /// Application messages are not copied: the caller must consume() the message when it has finished with it.
+    /// \param [out] message Set to the location of the message (see RHRouter::peekfromAck()), including the MeshMessageHeader
+    /// \param [out] messageLen Set to the length of the message received.
+    /// \param [out] source The SOURCE address of the message
+    /// \param [out] dest The DEST address of the message
+    /// \param [out] id The ID of the message
+    /// \param [out] flags The FLAGS of the message
+    /// \return true if an application message for this node is available at message
+    bool receiveMessage(const uint8_t** message, uint8_t* messageLen, uint8_t* source, uint8_t* dest, uint8_t* id, uint8_t* flags);
+
+    /// Checks whether a route discovery request has been seen recently and records it if not.
+    /// Also records the fewest hops any copy of the request has taken.
+    /// \param [in] source The SOURCE address of the request (the node looking for a route)
+    /// \param [in] id The end-to-end ID of the request
+    /// \param [in,out] hops The number of hops this copy has taken. If the request has been seen,
+    /// set to the fewest hops taken by any earlier copy
+    /// \return true if the request has been seen in the last RH_MESH_ARP_TIMEOUT milliseconds
+    bool seenRequest(uint8_t source, uint8_t id, uint8_t* hops);
+
+    /// Decides whether to rebroadcast a route discovery request for another node.
+    /// The default implementation uses the probability set by setRebroadcastProbability().
+    /// Virtual so subclasses can override, for example to rebroadcast depending on signal strength.
+    /// \param [in] numRoutes The number of nodes the request has already been through
+    /// \return true if the request should be rebroadcast
+    virtual bool shouldRebroadcast(uint8_t numRoutes);
+
+    /// Broadcasts a route discovery request for the given address, without waiting for the response
+    /// \param [in] address The physical address to resolve
+    /// \return true if the request was sent
+    bool sendDiscoveryRequest(uint8_t address);
+
+    /// Starts route discovery for the given address, unless it is already in progress,
+    /// and records it so that queued messages can be sent when the route is found.
+    /// \param [in] address The physical address to resolve
+    /// \return true if discovery for address is in progress
+    bool startDiscovery(uint8_t address);
+
+    /// Finishes route discoveries that have succeeded or timed out, sends queued messages 
+    /// whose route is now known and discards those whose route could not be discovered.
+    /// Called by recvfromAck() and sendtoAsync().
+    void serviceDiscoveries();
+
     /// Try to resolve a route for the given address. Blocks while discovering the route
-    /// which may take up to 4000 msec.
+    /// which may take up to 4000 msec. While waiting, handles other messages, and keeps any application
+    /// messages for this node for recvfromAck().
     /// Virtual so subclasses can override.
     /// \param [in] address The physical address to resolve
     /// \return true if the address was resolved and added to the local routing table
@@ -247,9 +460,88 @@ protected:
     /// \return true if the physical address of this node is identical to address
     virtual bool isPhysicalAddress(uint8_t* address, uint8_t addresslen);
 
-private:
     /// Temporary message buffer
-    static uint8_t _tmpMessage[RH_ROUTER_MAX_MESSAGE_LEN];
+    uint8_t _tmpMessage[RH_ROUTER_MAX_MESSAGE_LEN];
+
+private:
+    /// A route discovery in progress
+    typedef struct
+    {
+	uint8_t       active;  ///< true if this entry is in use
+	uint8_t       dest;    ///< The address being discovered
+	unsigned long started; ///< millis() when the route discovery request was sent
+    } Discovery;
+
+    /// Route discoveries in progress
+    Discovery _discoveries[RH_MESH_MAX_DISCOVERIES];
+
+    /// A route discovery request that has been seen
+    typedef struct
+    {
+	uint8_t       source; ///< SOURCE address of the request, RH_BROADCAST_ADDRESS if not used
+	uint8_t       id;     ///< End-to-end ID of the request
+	uint8_t       hops;   ///< Fewest hops taken by any copy of the request
+	unsigned long seen;   ///< millis() when the request was first seen
+    } SeenRequest;
+
+    /// Recently seen route discovery requests
+    SeenRequest _seenRequests[RH_MESH_REQUEST_CACHE_SIZE];
+
+    /// Index of the next entry in _seenRequests to be used
+    uint8_t _nextSeenRequest;
+
+    /// Percentage probability of rebroadcasting a route discovery request
+    uint8_t _rebroadcastProbability;
+
+    /// Route discovery requests that have been through fewer nodes than this are always rebroadcast
+    uint8_t _rebroadcastMinHops;
+
+#if RH_MESH_PENDING_SENDS > 0
+    /// An application message waiting for route discovery
+    typedef struct
+    {
+	uint8_t active; ///< true if this entry is in use
+	uint8_t order;  ///< Order in which the messages were queued
+	uint8_t dest;   ///< Destination address
+	uint8_t flags;  ///< End-to-end flags
+	uint8_t len;    ///< Length of the RHMesh message in buf
+	uint8_t buf[RH_ROUTER_MAX_MESSAGE_LEN]; ///< The RHMesh message, including the MeshMessageHeader
+    } PendingSend;
+
+    /// Messages waiting for route discovery
+    PendingSend _pending[RH_MESH_PENDING_SENDS];
+
+    /// Order of the next message to be queued
+    uint8_t _pendingOrder;
+#endif
+
+#if RH_MESH_RECEIVE_QUEUE_LEN > 0
+    /// An application message received during doArp()
+    typedef struct
+    {
+	uint8_t source; ///< SOURCE address
+	uint8_t dest;   ///< DEST address
+	uint8_t id;     ///< End-to-end ID
+	uint8_t flags;  ///< End-to-end flags
+	uint8_t len;    ///< Length of data
+	uint8_t data[RH_MESH_MAX_MESSAGE_LEN]; ///< Application payload
+    } ReceivedMessage;
+
+    /// Received application messages waiting to be delivered by recvfromAck()
+    ReceivedMessage _received[RH_MESH_RECEIVE_QUEUE_LEN];
+
+    /// Index of the oldest message in _received
+    uint8_t _receivedHead;
+
+    /// Number of messages in _received
+    uint8_t _receivedCount;
+#endif
+
+    /// Time after which learned routes expire, or 0 for never
+    unsigned long _routeTimeout;
+
+    /// millis() when checkRoutes() last ran
+    unsigned long _lastRouteCheck;
 
 };
 
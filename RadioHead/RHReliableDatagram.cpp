@@ -23,6 +23,27 @@ RHReliableDatagram::RHReliableDatagram(RHGenericDriver& driver, uint8_t thisAddr
     _timeout = RH_DEFAULT_TIMEOUT;
     _retries = RH_DEFAULT_RETRIES;
     memset(_seenIds, 0, sizeof(_seenIds));
+    memset(_seenBits, 0, sizeof(_seenBits));
+#if RH_RELIABLE_SEEN_TIMEOUT
+    memset(_seenTime, 0, sizeof(_seenTime));
+#endif
+#if RH_RELIABLE_SEEN_PEERS < 256
+    _seenNext = 0;
+#endif
+    _windowSize = RH_RELIABLE_WINDOW_SIZE;
+    _windowFailed = false;
+    _adaptiveTimeout = false;
+    _rttNext = 0;
+    _ackDelay = 0;
+    uint8_t i;
+    for (i = 0; i < RH_RELIABLE_RTT_PEERS; i++)
+	_rtt[i].valid = false;
+    for (i = 0; i < RH_RELIABLE_ACK_PEERS; i++)
+	_acks[i].ids = 0;
+#if RH_RELIABLE_WINDOW_SIZE > 0
+    for (i = 0; i < RH_RELIABLE_WINDOW_SIZE; i++)
+	_window[i].state = SendStateIdle;
+#endif
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -52,10 +73,7 @@ bool RHReliableDatagram::sendtoWait(uint8_t* buf, uint8_t len, uint8_t address)
     uint8_t retries = 0;
     while (retries++ <= _retries)
     {
-	setHeaderId(thisSequenceNumber);
-	setHeaderFlags(RH_FLAGS_NONE, RH_FLAGS_ACK); // Clear the ACK flag
-	sendto(buf, len, address);
-	waitPacketSent();
+	sendMessage(buf, len, address, thisSequenceNumber);
 
 	// Never wait for ACKS to broadcasts:
 	if (address == RH_BROADCAST_ADDRESS)
@@ -65,33 +83,48 @@ bool RHReliableDatagram::sendtoWait(uint8_t* buf, uint8_t len, uint8_t address)
 	    _retransmissions++;
 	unsigned long thisSendTime = millis(); // Timeout does not include original transmit time
 
-	// Compute a new timeout, random between _timeout and _timeout*2
-	// This is to prevent collisions on every retransmit
-	// if 2 nodes try to transmit at the same time
-#if (RH_PLATFORM == RH_PLATFORM_RASPI) // use standard library random(), bugs in random(min, max)
-	uint16_t timeout = _timeout + (_timeout * (random() & 0xFF) / 256);
-#else
-	uint16_t timeout = _timeout + (_timeout * random(0, 256) / 256);
-#endif
+	uint16_t timeout = retransmitTimeout(address, retries);
 	int32_t timeLeft;
         while ((timeLeft = timeout - (millis() - thisSendTime)) > 0)
 	{
-	    if (waitAvailableTimeout(timeLeft))
+	    if (waitAvailableTimeout(ackTimeLeft(timeLeft)))
 	    {
+		// A response with our ACK piggybacked on it is left for recvfromAck() to collect
+		if (   (headerFlags() & (RH_FLAGS_ACK | RH_FLAGS_PIGGYBACK)) == RH_FLAGS_PIGGYBACK
+		    && headerFrom() == address
+		    && headerTo() == _thisAddress
+		    && headerId() == thisSequenceNumber)
+		{
+		    if (retries == 1)
+			updateRtt(address, millis() - thisSendTime);
+		    return true;
+		}
 		uint8_t from, to, id, flags;
-		if (recvfrom(0, 0, &from, &to, &id, &flags)) // Discards the message
+		uint8_t ack[RH_RELIABLE_ACK_MAX_LEN];
+		uint8_t ackLen = sizeof(ack);
+		if (recvfrom(ack, &ackLen, &from, &to, &id, &flags)) // Discards the message
 		{
+		    unpackPiggyback(from, to, &id, &flags, ack, ackLen);
 		    // Now have a message: is it our ACK?
 		    if (   from == address 
 			   && to == _thisAddress 
 			   && (flags & RH_FLAGS_ACK) 
-			   && (id == thisSequenceNumber))
+			   && ackIncludes(id, ack, ackLen, thisSequenceNumber))
 		    {
 			// Its the ACK we are waiting for
+			if (retries == 1)
+			    updateRtt(address, millis() - thisSendTime);
+			// It may acknowledge window messages too
+			handleAck(from, id, ack, ackLen);
 			return true;
 		    }
-		    else if (   !(flags & RH_FLAGS_ACK)
-				&& (id == _seenIds[from]))
+		    else if (to == _thisAddress && (flags & RH_FLAGS_ACK))
+		    {
+			// Maybe an ACK for a message in the window
+			handleAck(from, id, ack, ackLen);
+		    }
+		    else if (   !(flags & (RH_FLAGS_ACK | RH_FLAGS_NO_ACK))
+				&& isSeen(from, id))
 		    {
 			// This is a request we have already received. ACK it again
 			acknowledge(id, from);
@@ -100,6 +133,7 @@ bool RHReliableDatagram::sendtoWait(uint8_t* buf, uint8_t len, uint8_t address)
 		}
 	    }
 	    // Not the one we are waiting for, maybe keep waiting until timeout exhausted
+	    sendDelayedAcks(false);
 	    YIELD;
 	}
 	// Timeout exhausted, maybe retry
@@ -110,54 +144,206 @@ bool RHReliableDatagram::sendtoWait(uint8_t* buf, uint8_t len, uint8_t address)
 }
 
 ////////////////////////////////////////////////////////////////////
+bool RHReliableDatagram::sendtoNoAck(uint8_t* buf, uint8_t len, uint8_t address)
+{
+    // Any delayed ACKs go first, as in sendMessage()
+    sendDelayedAcks(true);
+    setHeaderFlags(RH_FLAGS_NO_ACK, RH_FLAGS_ACK | RH_FLAGS_PIGGYBACK);
+    bool ret = sendto(buf, len, address);
+    setHeaderFlags(RH_FLAGS_NONE, RH_FLAGS_NO_ACK);
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////
+int16_t RHReliableDatagram::findSeen(uint8_t from, bool create)
+{
+#if RH_RELIABLE_SEEN_PEERS < 256
+    uint8_t i;
+    for (i = 0; i < RH_RELIABLE_SEEN_PEERS; i++)
+	if (_seenBits[i] && _seenAddress[i] == from)
+	    return i;
+    if (!create)
+	return -1;
+    // Forget the least recently added peer
+    i = _seenNext;
+    _seenNext = (_seenNext + 1) % RH_RELIABLE_SEEN_PEERS;
+    _seenAddress[i] = from;
+    _seenIds[i] = 0;
+    _seenBits[i] = 0;
+    return i;
+#else
+    (void)create; // Not used
+    return from;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHReliableDatagram::isSeen(uint8_t from, uint8_t id)
+{
+    int16_t i = findSeen(from, false);
+    if (i < 0)
+	return false;
+    uint8_t behind = _seenIds[i] - id;
+    return behind < RH_RELIABLE_SEEN_SPAN && (_seenBits[i] & ((SeenBits)1 << behind));
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHReliableDatagram::recordSeen(uint8_t from, uint8_t id)
+{
+    int16_t i = findSeen(from, true);
+#if RH_RELIABLE_SEEN_TIMEOUT
+    // After a long enough silence, this cant be a retransmission, but the peer may have restarted
+    uint32_t now = millis();
+    if (now - _seenTime[i] > RH_RELIABLE_SEEN_TIMEOUT)
+	_seenBits[i] = 0;
+    _seenTime[i] = now;
+#endif
+    uint8_t ahead = id - _seenIds[i];
+    uint8_t behind = _seenIds[i] - id;
+    if (_seenBits[i] == 0 || (ahead > 0 && ahead < 128))
+    {
+	// Newer than anything seen from this peer: slide the window up to it
+	_seenBits[i] = (_seenBits[i] && ahead < RH_RELIABLE_SEEN_WINDOW) ? (_seenBits[i] << ahead) | 1 : 1;
+	_seenIds[i] = id;
+	return true;
+    }
+    if (behind >= RH_RELIABLE_SEEN_SPAN)
+    {
+	// Too old to be a retransmission, so the peer has restarted its sequence numbers
+	_seenBits[i] = 1;
+	_seenIds[i] = id;
+	return true;
+    }
+    SeenBits bit = (SeenBits)1 << behind;
+    if (_seenBits[i] & bit)
+	return false; // Duplicate
+    // An older message that arrived late, or a retransmission whose earlier tries were lost
+    _seenBits[i] |= bit;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHReliableDatagram::acceptMessage(uint8_t from, uint8_t to, uint8_t id, uint8_t flags, const uint8_t* buf, uint8_t len)
+{
+    if ((flags & RH_FLAGS_ACK) && to == _thisAddress)
+    {
+	// Maybe an ACK for a message in the window
+	handleAck(from, id, buf, len);
+    }
+    // Unacknowledged messages are always delivered
+    else if (flags & RH_FLAGS_NO_ACK)
+	return true;
+    // Never ACK an ACK
+    else if (!(flags & RH_FLAGS_ACK))
+    {
+	// Its a normal message not an ACK
+	if (to ==_thisAddress)
+	{
+	    // Its for this node and
+	    // Its not a broadcast, so ACK it
+	    // Acknowledge message with ACK set in flags and ID set to received ID
+	    acknowledge(id, from);
+	}
+	// If we have not seen this message before, then we are interested in it
+	if (recordSeen(from, id))
+	    return true;
+	// Else just re-ack it and wait for a new one
+    }
+    return false;
+}
+
 bool RHReliableDatagram::recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* from, uint8_t* to, uint8_t* id, uint8_t* flags)
 {  
     uint8_t _from;
     uint8_t _to;
     uint8_t _id;
     uint8_t _flags;
+    // Retransmit any window messages that have timed out. This must not happen
+    // while a received message is waiting (shared rx and tx buffer in some drivers),
+    // or after we receive into buf (which subclasses may also use for sending)
+    if (!available())
+    {
+	retransmitWindow();
+	return false;
+    }
+    // A piggybacked ACK puts the message's own ID in its first octet, so that octet is
+    // needed even if the caller does not want the message itself
+    uint8_t octet;
+    uint8_t octetLen = sizeof(octet);
+    uint8_t* rxBuf = buf;
+    uint8_t* rxLen = len;
+    if (   (headerFlags() & (RH_FLAGS_ACK | RH_FLAGS_PIGGYBACK)) == RH_FLAGS_PIGGYBACK
+	&& (!buf || !len || !*len))
+    {
+	rxBuf = &octet;
+	rxLen = &octetLen;
+    }
     // Get the message before its clobbered by the ACK (shared rx and tx buffer in some drivers
-    if (available() && recvfrom(buf, len, &_from, &_to, &_id, &_flags))
+    if (available() && recvfrom(rxBuf, rxLen, &_from, &_to, &_id, &_flags))
     {
-	// Never ACK an ACK
-	if (!(_flags & RH_FLAGS_ACK))
+	if (rxBuf && rxLen && unpackPiggyback(_from, _to, &_id, &_flags, rxBuf, *rxLen))
+	    memmove(rxBuf, rxBuf + 1, --(*rxLen));
+	if (acceptMessage(_from, _to, _id, _flags, rxBuf, rxLen ? *rxLen : 0))
 	{
-	    // Its a normal message not an ACK
-	    if (_to ==_thisAddress)
-	    {
-	        // Its for this node and
-		// Its not a broadcast, so ACK it
-		// Acknowledge message with ACK set in flags and ID set to received ID
-		acknowledge(_id, _from);
-	    }
-	    // If we have not seen this message before, then we are interested in it
-	    if (_id != _seenIds[_from])
-	    {
-		if (from)  *from =  _from;
-		if (to)    *to =    _to;
-		if (id)    *id =    _id;
-		if (flags) *flags = _flags;
-		_seenIds[_from] = _id;
-		return true;
-	    }
-	    // Else just re-ack it and wait for a new one
+	    if (from)  *from =  _from;
+	    if (to)    *to =    _to;
+	    if (id)    *id =    _id;
+	    if (flags) *flags = _flags;
+	    return true;
 	}
+	retransmitWindow();
     }
     // No message for us available
     return false;
 }
 
+bool RHReliableDatagram::peekfromAck(uint8_t** buf, uint8_t* len, uint8_t* from, uint8_t* to, uint8_t* id, uint8_t* flags)
+{  
+    uint8_t _from;
+    uint8_t _to;
+    uint8_t _id;
+    uint8_t _flags;
+    // As for recvfromAck()
+    if (!available())
+    {
+	retransmitWindow();
+	return false;
+    }
+    // Drivers that support peek() do not clobber the message when sending the ACK
+    if (peekfrom(buf, len, &_from, &_to, &_id, &_flags))
+    {
+	if (unpackPiggyback(_from, _to, &_id, &_flags, *buf, *len))
+	{
+	    (*buf)++;
+	    (*len)--;
+	}
+	if (acceptMessage(_from, _to, _id, _flags, *buf, *len))
+	{
+	    if (from)  *from =  _from;
+	    if (to)    *to =    _to;
+	    if (id)    *id =    _id;
+	    if (flags) *flags = _flags;
+	    return true;
+	}
+	consume();
+	retransmitWindow();
+    }
+    // No message for us available, or the driver does not support peek()
+    return false;
+}
+
 bool RHReliableDatagram::recvfromAckTimeout(uint8_t* buf, uint8_t* len, uint16_t timeout, uint8_t* from, uint8_t* to, uint8_t* id, uint8_t* flags)
 {
     unsigned long starttime = millis();
     int32_t timeLeft;
     while ((timeLeft = timeout - (millis() - starttime)) > 0)
     {
-	if (waitAvailableTimeout(timeLeft))
-	{
-	    if (recvfromAck(buf, len, from, to, id, flags))
-		return true;
-	}
+	// Wake up in time to retransmit any window messages
+	uint16_t waitTime = windowTimeLeft(timeLeft);
+	if (waitTime)
+	    waitAvailableTimeout(waitTime);
+	if (recvfromAck(buf, len, from, to, id, flags))
+	    return true;
 	YIELD;
     }
     return false;
@@ -172,18 +358,597 @@ void RHReliableDatagram::resetRetransmissions()
 {
     _retransmissions = 0;
 }
- 
+
+uint16_t RHReliableDatagram::retransmitTimeout(uint8_t address, uint8_t tries)
+{
+#if (RH_PLATFORM == RH_PLATFORM_RASPI) // use standard library random(), bugs in random(min, max)
+    uint32_t r = random() & 0xFF;
+#else
+    uint32_t r = random(0, 256);
+#endif
+    if (!_adaptiveTimeout)
+    {
+	// Compute a new timeout, random between _timeout and _timeout*2
+	// This is to prevent collisions on every retransmit
+	// if 2 nodes try to transmit at the same time
+	return _timeout + (_timeout * r / 256);
+    }
+
+    // Exponential backoff on each retransmission
+    uint32_t timeout = timeoutFor(address);
+    while (--tries > 0 && timeout < RH_RELIABLE_MAX_TIMEOUT)
+	timeout <<= 1;
+    if (timeout > RH_RELIABLE_MAX_TIMEOUT)
+	timeout = RH_RELIABLE_MAX_TIMEOUT;
+    // A little randomness still helps 2 colliding senders get out of step
+    return timeout + (timeout * r / 1024);
+}
+
+////////////////////////////////////////////////////////////////////
+void RHReliableDatagram::setAdaptiveTimeout(bool adaptive)
+{
+    _adaptiveTimeout = adaptive;
+}
+
+////////////////////////////////////////////////////////////////////
+RHReliableDatagram::RttEntry* RHReliableDatagram::findRtt(uint8_t address)
+{
+    uint8_t i;
+    for (i = 0; i < RH_RELIABLE_RTT_PEERS; i++)
+	if (_rtt[i].valid && _rtt[i].address == address)
+	    return &_rtt[i];
+    return NULL;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHReliableDatagram::updateRtt(uint8_t address, unsigned long rtt)
+{
+    if (!_adaptiveTimeout)
+	return;
+    if (rtt > RH_RELIABLE_MAX_TIMEOUT)
+	rtt = RH_RELIABLE_MAX_TIMEOUT;
+
+    RttEntry* e = findRtt(address);
+    if (!e)
+    {
+	// First measurement for this peer, replace the oldest entry
+	e = &_rtt[_rttNext];
+	_rttNext = (_rttNext + 1) % RH_RELIABLE_RTT_PEERS;
+	e->valid = true;
+	e->address = address;
+	e->srtt = rtt << 3;   // SRTT = R
+	e->rttvar = rtt << 1; // RTTVAR = R/2
+	return;
+    }
+    // Jacobson: RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|, SRTT = 7/8 SRTT + 1/8 R
+    // with SRTT scaled by 8 and RTTVAR scaled by 4
+    int32_t delta = (int32_t)rtt - (e->srtt >> 3);
+    e->srtt += delta;
+    if (delta < 0)
+	delta = -delta;
+    e->rttvar += delta - (e->rttvar >> 2);
+}
+
+////////////////////////////////////////////////////////////////////
+uint16_t RHReliableDatagram::rttEstimate(uint8_t address, uint16_t* rttvar)
+{
+    RttEntry* e = findRtt(address);
+    if (rttvar)
+	*rttvar = e ? e->rttvar >> 2 : 0;
+    return e ? e->srtt >> 3 : 0;
+}
+
+////////////////////////////////////////////////////////////////////
+uint16_t RHReliableDatagram::timeoutFor(uint8_t address)
+{
+    RttEntry* e = findRtt(address);
+    if (!_adaptiveTimeout || !e)
+	return _timeout;
+    // RTO = SRTT + 4 * RTTVAR
+    uint32_t rto = (e->srtt >> 3) + e->rttvar;
+    if (rto < RH_RELIABLE_MIN_TIMEOUT)
+	rto = RH_RELIABLE_MIN_TIMEOUT;
+    if (rto > RH_RELIABLE_MAX_TIMEOUT)
+	rto = RH_RELIABLE_MAX_TIMEOUT;
+    return rto;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHReliableDatagram::setAckDelay(uint16_t delay)
+{
+    _ackDelay = delay;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHReliableDatagram::setWindowSize(uint8_t windowSize)
+{
+    if (windowSize > RH_RELIABLE_WINDOW_SIZE)
+	windowSize = RH_RELIABLE_WINDOW_SIZE;
+    _windowSize = windowSize;
+}
+
+////////////////////////////////////////////////////////////////////
+uint8_t RHReliableDatagram::windowPending(uint8_t address)
+{
+    uint8_t count = 0;
+#if RH_RELIABLE_WINDOW_SIZE > 0
+    uint8_t i;
+    for (i = 0; i < RH_RELIABLE_WINDOW_SIZE; i++)
+	if (   _window[i].state == SendStatePending 
+	    && (address == RH_BROADCAST_ADDRESS || _window[i].to == address))
+	    count++;
+#else
+    (void)address; // Not used
+#endif
+    return count;
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHReliableDatagram::sendtoWindow(uint8_t* buf, uint8_t len, uint8_t address)
+{
+#if RH_RELIABLE_WINDOW_SIZE > 0
+    // Broadcasts are not acknowledged, so there is nothing to keep in the window
+    if (address == RH_BROADCAST_ADDRESS || _windowSize == 0)
+	return sendtoWait(buf, len, address);
+
+    // Wait for room in the window to this destination
+    while (!windowOpen(address))
+    {
+	serviceWindow(_timeout);
+	YIELD;
+    }
+    return sendtoAsync(buf, len, address);
+#else
+    bool ret = sendtoWait(buf, len, address);
+    if (!ret)
+	_windowFailed = true;
+    return ret;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHReliableDatagram::flushWindow()
+{
+    while (windowPending())
+    {
+	serviceWindow(_timeout);
+	YIELD;
+    }
+    bool ret = !_windowFailed;
+    _windowFailed = false;
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHReliableDatagram::sendtoAsync(uint8_t* buf, uint8_t len, uint8_t address, uint8_t* handle)
+{
+    if (handle)
+	*handle = RH_RELIABLE_NO_HANDLE;
+
+    // Broadcasts are not acknowledged, so they are complete as soon as they are sent
+    if (address == RH_BROADCAST_ADDRESS)
+	return sendtoWait(buf, len, address);
+
+#if RH_RELIABLE_WINDOW_SIZE > 0
+    if (!windowOpen(address))
+	return false;
+    // Find a slot that is not waiting for an ACK
+    uint8_t i;
+    for (i = 0; i < RH_RELIABLE_WINDOW_SIZE; i++)
+	if (_window[i].state != SendStatePending)
+	    break;
+
+    WindowSlot* slot = &_window[i];
+    slot->state = SendStatePending;
+    slot->to = address;
+    slot->id = ++_lastSequenceNumber;
+    slot->tries = 0;
+    slot->len = len;
+    memcpy(slot->buf, buf, len);
+    transmitSlot(slot);
+    if (handle)
+	*handle = i;
+    return true;
+#else
+    (void)buf; // Not used
+    (void)len; // Not used
+    return false;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////
+RHReliableDatagram::SendState RHReliableDatagram::sendState(uint8_t handle)
+{
+#if RH_RELIABLE_WINDOW_SIZE > 0
+    if (handle < RH_RELIABLE_WINDOW_SIZE)
+	return (SendState)_window[handle].state;
+#else
+    (void)handle; // Not used
+#endif
+    return SendStateIdle;
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHReliableDatagram::poll()
+{
+    if (available())
+    {
+	if (!(headerFlags() & RH_FLAGS_ACK))
+	    return true; // Leave it for recvfromAck()
+	uint8_t from, to, id, flags;
+	uint8_t ack[RH_RELIABLE_ACK_MAX_LEN];
+	uint8_t ackLen = sizeof(ack);
+	if (recvfrom(ack, &ackLen, &from, &to, &id, &flags) && to == _thisAddress) // Discards the message
+	    handleAck(from, id, ack, ackLen);
+    }
+    retransmitWindow();
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////
+// Subclasses may want to override this to be told when window messages complete
+void RHReliableDatagram::sendComplete(uint8_t handle, uint8_t address, bool acked)
+{
+    // Default does nothing
+    (void)handle; // Not used
+    (void)address; // Not used
+    (void)acked; // Not used
+}
+
+////////////////////////////////////////////////////////////////////
+uint8_t* RHReliableDatagram::windowMessage(uint8_t handle, uint8_t* len)
+{
+#if RH_RELIABLE_WINDOW_SIZE > 0
+    if (handle < RH_RELIABLE_WINDOW_SIZE)
+    {
+	if (len)
+	    *len = _window[handle].len;
+	return _window[handle].buf;
+    }
+#else
+    (void)handle; // Not used
+#endif
+    if (len)
+	*len = 0;
+    return NULL;
+}
+
+#if RH_RELIABLE_WINDOW_SIZE > 0
+////////////////////////////////////////////////////////////////////
+void RHReliableDatagram::transmitSlot(WindowSlot* slot)
+{
+    if (slot->tries++ > 0)
+	_retransmissions++;
+    sendMessage(slot->buf, slot->len, slot->to, slot->id);
+    slot->timeout = retransmitTimeout(slot->to, slot->tries);
+    slot->sent = millis(); // Timeout does not include transmit time
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHReliableDatagram::windowOpen(uint8_t address)
+{
+    uint8_t pending = 0;
+    uint8_t total = 0;
+    uint8_t i;
+    for (i = 0; i < RH_RELIABLE_WINDOW_SIZE; i++)
+    {
+	WindowSlot* slot = &_window[i];
+	if (slot->state != SendStatePending)
+	    continue;
+	total++;
+	if (slot->to != address)
+	    continue;
+	pending++;
+	// Keep retransmissions inside the receiver's duplicate detection window
+	if ((uint8_t)(_lastSequenceNumber + 1 - slot->id) >= RH_RELIABLE_WINDOW_SPAN)
+	    return false;
+    }
+    return pending < _windowSize && total < RH_RELIABLE_WINDOW_SIZE;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHReliableDatagram::completeSlot(uint8_t handle, bool acked)
+{
+    // The slot stays pending until the subclass has seen it, so that
+    // a new message sent by sendComplete() can not reuse it
+    if (!acked)
+	_windowFailed = true;
+    sendComplete(handle, _window[handle].to, acked);
+    _window[handle].state = acked ? SendStateAcked : SendStateFailed;
+}
+#endif
+
+////////////////////////////////////////////////////////////////////
+void RHReliableDatagram::handleAck(uint8_t from, uint8_t id, const uint8_t* buf, uint8_t len)
+{
+#if RH_RELIABLE_WINDOW_SIZE > 0
+    uint8_t i;
+    for (i = 0; i < RH_RELIABLE_WINDOW_SIZE; i++)
+    {
+	WindowSlot* slot = &_window[i];
+	if (slot->state == SendStatePending && slot->to == from && ackIncludes(id, buf, len, slot->id))
+	{
+	    if (slot->tries == 1)
+		updateRtt(from, millis() - slot->sent);
+	    completeSlot(i, true);
+	}
+    }
+#else
+    (void)from; // Not used
+    (void)id; // Not used
+    (void)buf; // Not used
+    (void)len; // Not used
+#endif
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHReliableDatagram::ackIncludes(uint8_t ackId, const uint8_t* buf, uint8_t len, uint8_t id)
+{
+    if (id == ackId)
+	return true;
+    if (!buf || len < 2 || buf[0] != RH_RELIABLE_ACK_SELECTIVE)
+	return false;
+    // Bit n of the bitmap acknowledges ID ackId - 1 - n
+    uint8_t n = ackId - id - 1;
+    if (n >= (len - 1) * 8)
+	return false;
+    return buf[1 + n / 8] & (1 << (n % 8));
+}
+
+////////////////////////////////////////////////////////////////////
+void RHReliableDatagram::retransmitWindow()
+{
+    sendDelayedAcks(false);
+#if RH_RELIABLE_WINDOW_SIZE > 0
+    // Retransmit or give up on any messages whose timeout has expired
+    uint8_t i;
+    for (i = 0; i < RH_RELIABLE_WINDOW_SIZE; i++)
+    {
+	WindowSlot* slot = &_window[i];
+	if (slot->state == SendStatePending && (millis() - slot->sent) >= slot->timeout)
+	{
+	    if (slot->tries > _retries)
+		completeSlot(i, false); // Retries exhausted
+	    else
+		transmitSlot(slot);
+	}
+    }
+#endif
+}
+
+////////////////////////////////////////////////////////////////////
+uint16_t RHReliableDatagram::windowTimeLeft(uint16_t timeout)
+{
+    timeout = ackTimeLeft(timeout);
+#if RH_RELIABLE_WINDOW_SIZE > 0
+    // Dont wait longer than the time until the next window timeout
+    unsigned long now = millis();
+    uint8_t i;
+    for (i = 0; i < RH_RELIABLE_WINDOW_SIZE; i++)
+    {
+	if (_window[i].state == SendStatePending)
+	{
+	    int32_t timeLeft = _window[i].timeout - (now - _window[i].sent);
+	    if (timeLeft < 0)
+		timeLeft = 0;
+	    if (timeLeft < timeout)
+		timeout = timeLeft;
+	}
+    }
+#endif
+    return timeout;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHReliableDatagram::serviceWindow(uint16_t timeout)
+{
+    timeout = windowTimeLeft(timeout);
+    if (timeout == 0 ? available() : waitAvailableTimeout(timeout))
+    {
+	uint8_t from, to, id, flags;
+	uint8_t ack[RH_RELIABLE_ACK_MAX_LEN];
+	uint8_t ackLen = sizeof(ack);
+	if (recvfrom(ack, &ackLen, &from, &to, &id, &flags)) // Discards the message
+	{
+	    unpackPiggyback(from, to, &id, &flags, ack, ackLen);
+	    if (to == _thisAddress && (flags & RH_FLAGS_ACK))
+	    {
+		// Maybe an ACK for one of the messages in the window
+		handleAck(from, id, ack, ackLen);
+	    }
+	    else if (   !(flags & (RH_FLAGS_ACK | RH_FLAGS_NO_ACK))
+		     && isSeen(from, id))
+	    {
+		// This is a request we have already received. ACK it again
+		acknowledge(id, from);
+	    }
+	    // Else discard it
+	}
+    }
+    retransmitWindow();
+}
+
+////////////////////////////////////////////////////////////////////
+void RHReliableDatagram::sendMessage(uint8_t* buf, uint8_t len, uint8_t address, uint8_t id)
+{
+    int16_t ackId = -1;
+    if (address != RH_BROADCAST_ADDRESS && len < RH_MAX_MESSAGE_LEN && len < _driver.maxMessageLength())
+	ackId = takeAck(address);
+    // Any other ACKs go first: a half duplex radio sending them after the message
+    // could miss an immediate response to it. And we may be about to block in sendtoWait()
+    sendDelayedAcks(true);
+    if (ackId >= 0)
+    {
+	sendPiggybacked(buf, len, address, id, ackId);
+	return;
+    }
+    setHeaderId(id);
+    setHeaderFlags(RH_FLAGS_NONE, RH_FLAGS_ACK | RH_FLAGS_PIGGYBACK); // Clear the ACK flags
+    sendto(buf, len, address);
+    waitPacketSent();
+}
+
+////////////////////////////////////////////////////////////////////
+void RHReliableDatagram::sendPiggybacked(uint8_t* buf, uint8_t len, uint8_t address, uint8_t id, uint8_t ackId)
+{
+    // The ID header carries the ACK, and the first octet the ID of this message
+    uint8_t message[RH_MAX_MESSAGE_LEN];
+    message[0] = id;
+    memcpy(message + 1, buf, len);
+    setHeaderId(ackId);
+    setHeaderFlags(RH_FLAGS_PIGGYBACK, RH_FLAGS_ACK);
+    sendto(message, len + 1, address);
+    waitPacketSent();
+    setHeaderFlags(RH_FLAGS_NONE, RH_FLAGS_PIGGYBACK);
+}
+
+////////////////////////////////////////////////////////////////////
+uint8_t RHReliableDatagram::unpackPiggyback(uint8_t from, uint8_t to, uint8_t* id, uint8_t* flags, const uint8_t* buf, uint8_t len)
+{
+    if ((*flags & (RH_FLAGS_ACK | RH_FLAGS_PIGGYBACK)) != RH_FLAGS_PIGGYBACK || len < 1)
+	return 0;
+    // Maybe an ACK for a message in the window
+    if (to == _thisAddress)
+	handleAck(from, *id, NULL, 0);
+    *id = buf[0];
+    *flags &= ~RH_FLAGS_PIGGYBACK;
+    return 1;
+}
+
+////////////////////////////////////////////////////////////////////
+int16_t RHReliableDatagram::takeAck(uint8_t address)
+{
+    uint8_t i;
+    for (i = 0; i < RH_RELIABLE_ACK_PEERS; i++)
+    {
+	if (_acks[i].ids == 1 && _acks[i].address == address)
+	{
+	    _acks[i].ids = 0;
+	    return _acks[i].id;
+	}
+    }
+    return -1;
+}
+
+////////////////////////////////////////////////////////////////////
 void RHReliableDatagram::acknowledge(uint8_t id, uint8_t from)
+{
+    if (_ackDelay == 0)
+    {
+	sendAck(from, id, 1);
+	return;
+    }
+
+    // Combine it with any ACKs already waiting for this peer
+    AckEntry* e = NULL;
+    AckEntry* oldest = NULL;
+    unsigned long now = millis();
+    uint8_t i;
+    for (i = 0; i < RH_RELIABLE_ACK_PEERS; i++)
+    {
+	if (!_acks[i].ids)
+	{
+	    if (!e)
+		e = &_acks[i]; // A free entry, in case this peer has none
+	    continue;
+	}
+	if (_acks[i].address == from)
+	{
+	    AckEntry* a = &_acks[i];
+	    uint8_t ahead = id - a->id;
+	    uint8_t behind = a->id - id;
+	    if (ahead == 0)
+		return; // Already waiting
+	    if (ahead < RH_RELIABLE_SEEN_WINDOW && (a->ids >> (RH_RELIABLE_SEEN_WINDOW - ahead)) == 0)
+	    {
+		a->ids = (a->ids << ahead) | 1;
+		a->id = id;
+		return;
+	    }
+	    if (behind < RH_RELIABLE_SEEN_WINDOW)
+	    {
+		a->ids |= (SeenBits)1 << behind;
+		return;
+	    }
+	    // Too far apart to share an ACK
+	    e = a;
+	    break;
+	}
+	if (!oldest || (now - _acks[i].since) > (now - oldest->since))
+	    oldest = &_acks[i];
+    }
+    if (!e)
+	e = oldest; // No room, send the longest waiting ACKs now
+    if (e->ids)
+    {
+	SeenBits ids = e->ids;
+	e->ids = 0;
+	sendAck(e->address, e->id, ids);
+    }
+    e->address = from;
+    e->id = id;
+    e->ids = 1;
+    e->since = millis();
+}
+
+////////////////////////////////////////////////////////////////////
+void RHReliableDatagram::sendDelayedAcks(bool all)
+{
+    uint8_t i;
+    for (i = 0; i < RH_RELIABLE_ACK_PEERS; i++)
+    {
+	AckEntry* e = &_acks[i];
+	if (e->ids && (all || (millis() - e->since) >= _ackDelay))
+	{
+	    SeenBits ids = e->ids;
+	    e->ids = 0;
+	    sendAck(e->address, e->id, ids);
+	}
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+uint16_t RHReliableDatagram::ackTimeLeft(uint16_t timeout)
+{
+    unsigned long now = millis();
+    uint8_t i;
+    for (i = 0; i < RH_RELIABLE_ACK_PEERS; i++)
+    {
+	if (_acks[i].ids)
+	{
+	    int32_t timeLeft = _ackDelay - (now - _acks[i].since);
+	    if (timeLeft < 0)
+		timeLeft = 0;
+	    if (timeLeft < timeout)
+		timeout = timeLeft;
+	}
+    }
+    return timeout;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHReliableDatagram::sendAck(uint8_t to, uint8_t id, SeenBits ids)
 {
     setHeaderId(id);
-    setHeaderFlags(RH_FLAGS_ACK);
+    setHeaderFlags(RH_FLAGS_ACK, RH_FLAGS_PIGGYBACK);
     // We would prefer to send a zero length ACK,
     // but if an RH_RF22 receives a 0 length message with a CRC error, it will never receive
     // a 0 length message again, until its reset, which makes everything hang :-(
-    // So we send an ACK of 1 octet
+    // So we send an ACK of at least 1 octet
     // REVISIT: should we send the RSSI for the information of the sender?
-    uint8_t ack = '!';
-    sendto(&ack, sizeof(ack), from); 
+    uint8_t ack[RH_RELIABLE_ACK_MAX_LEN];
+    uint8_t len = 1;
+    ack[0] = '!';
+    ids >>= 1; // Now bit n is ID id - 1 - n
+    if (ids)
+    {
+	ack[0] = RH_RELIABLE_ACK_SELECTIVE;
+	while (ids)
+	{
+	    ack[len++] = ids & 0xff;
+	    ids >>= 8;
+	}
+    }
+    sendto(ack, len, to); 
     waitPacketSent();
 }
-
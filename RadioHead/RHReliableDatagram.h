@@ -14,12 +14,123 @@
 // for application layer use.
 #define RH_FLAGS_ACK 0x80
 
+// The piggybacked ACK bit in the FLAGS. A message with this bit set (and RH_FLAGS_ACK clear) is a normal
+// message that also acknowledges the message from its destination whose ID is in the ID header.
+// Its own ID is in the first octet of the payload, before the application data.
+#define RH_FLAGS_PIGGYBACK 0x40
+
+// The unacknowledged bit in the FLAGS. A message with this bit set was sent with sendtoNoAck(): it is
+// delivered by recvfromAck() without being acknowledged or checked for duplicates.
+#define RH_FLAGS_NO_ACK 0x20
+
+// The first octet of the payload of a selective ACK. The remaining octets are a bitmap of
+// the earlier IDs that are also acknowledged: bit i of octet j acknowledges ID (id - 1 - (8 * j + i)),
+// where id is the ID in the header of the ACK. Plain ACKs have a payload of a single '!'.
+#define RH_RELIABLE_ACK_SELECTIVE '+'
+
 /// the default retry timeout in milliseconds
 #define RH_DEFAULT_TIMEOUT 200
 
 /// The default number of retries
 #define RH_DEFAULT_RETRIES 3
 
+/// Returned by sendtoAsync() in place of a handle when there is no window message to track
+#define RH_RELIABLE_NO_HANDLE 0xff
+
+/// Bounds on the adaptive retransmit timeout in milliseconds (see setAdaptiveTimeout())
+#define RH_RELIABLE_MIN_TIMEOUT 5
+#define RH_RELIABLE_MAX_TIMEOUT 8000
+
+// The number of peers for which RHReliableDatagram keeps round trip time estimates
+// when adaptive timeouts are enabled. The least recently added peer is forgotten first.
+#ifndef RH_RELIABLE_RTT_PEERS
+ #if defined(__AVR__)
+  #define RH_RELIABLE_RTT_PEERS 4
+ #else
+  #define RH_RELIABLE_RTT_PEERS 16
+ #endif
+#endif
+
+// The number of unacknowledged messages that can be in flight at once with sendtoWindow().
+// Each window slot holds a copy of the message for retransmission, so this costs
+// about RH_RELIABLE_WINDOW_SIZE * (RH_MAX_MESSAGE_LEN + 12) octets of SRAM.
+// Can be pre-defined to a smaller size (to save SRAM) prior to including this header.
+// Defaults to 0 (no window, sendtoWindow() is stop-and-wait) on AVR processors.
+#ifndef RH_RELIABLE_WINDOW_SIZE
+ #if defined(__AVR__)
+  #define RH_RELIABLE_WINDOW_SIZE 0
+ #else
+  #define RH_RELIABLE_WINDOW_SIZE 4
+ #endif
+#endif
+
+// The number of recent message IDs from each peer that are remembered for duplicate detection.
+// Must be 8, 16, 32 or 64. A message whose ID is within this many of the newest ID seen from
+// its sender is recognised as a duplicate if it has been received before, even if
+// other messages have arrived from that sender since.
+#ifndef RH_RELIABLE_SEEN_WINDOW
+ #if defined(__AVR__)
+  #define RH_RELIABLE_SEEN_WINDOW 16
+ #else
+  #define RH_RELIABLE_SEEN_WINDOW 32
+ #endif
+#endif
+
+// The longest ACK payload: RH_RELIABLE_ACK_SELECTIVE followed by a bitmap of up to 
+// RH_RELIABLE_SEEN_WINDOW - 1 earlier IDs
+#define RH_RELIABLE_ACK_MAX_LEN (1 + RH_RELIABLE_SEEN_WINDOW / 8)
+
+// The number of peers for which recent message IDs are remembered for duplicate detection.
+// 256 gives every address its own entry. Fewer saves SRAM (each entry costs 
+// 2 + RH_RELIABLE_SEEN_WINDOW / 8 octets, and 4 more with RH_RELIABLE_SEEN_TIMEOUT), and the least 
+// recently added peer is forgotten first.
+#ifndef RH_RELIABLE_SEEN_PEERS
+ #if defined(__AVR__)
+  #define RH_RELIABLE_SEEN_PEERS 16
+ #else
+  #define RH_RELIABLE_SEEN_PEERS 256
+ #endif
+#endif
+
+// Time in milliseconds after which the duplicate detection window of a peer that has sent nothing
+// is forgotten, so that a peer that has restarted its sequence numbers is not taken to be
+// retransmitting. Must be longer than the longest time that a sender keeps retransmitting a message
+// (its timeout multiplied by its retries) when all its tries but the last are lost. 0 disables it.
+// CAUTION: a peer that restarts sooner than this, after sending fewer than RH_RELIABLE_WINDOW_SPAN
+// messages, reuses IDs that are still in its window. Those of its new messages whose IDs it had
+// already used are acknowledged but discarded as duplicates, until its IDs pass the newest one it sent
+// before restarting. A peer that had sent more is recognised as having restarted (see RH_RELIABLE_SEEN_SPAN).
+#ifndef RH_RELIABLE_SEEN_TIMEOUT
+ #define RH_RELIABLE_SEEN_TIMEOUT 10000
+#endif
+
+// sendtoWindow() and sendtoAsync() do not start a new message to a destination while an earlier message 
+// to it, still waiting for an ACK, is this many or more IDs older. Otherwise a retransmission of that
+// message could fall outside the receiver's duplicate detection window, and be delivered twice.
+// Should not be more than the RH_RELIABLE_SEEN_WINDOW of any receiver, and should be the same on all nodes.
+#ifndef RH_RELIABLE_WINDOW_SPAN
+ #define RH_RELIABLE_WINDOW_SPAN 16
+#endif
+
+// A message this many or more IDs behind the newest seen from its sender cannot be a retransmission,
+// since no sender has an unacknowledged message more than RH_RELIABLE_WINDOW_SPAN - 1 IDs older than
+// its newest. So it means the sender has restarted its sequence numbers, and its window is reset.
+#if RH_RELIABLE_WINDOW_SPAN < RH_RELIABLE_SEEN_WINDOW
+ #define RH_RELIABLE_SEEN_SPAN RH_RELIABLE_WINDOW_SPAN
+#else
+ #define RH_RELIABLE_SEEN_SPAN RH_RELIABLE_SEEN_WINDOW
+#endif
+
+// The number of peers that can have delayed ACKs waiting to be sent at once (see setAckDelay()).
+// When there are more, the oldest waiting ACK is sent early.
+#ifndef RH_RELIABLE_ACK_PEERS
+ #if defined(__AVR__)
+  #define RH_RELIABLE_ACK_PEERS 2
+ #else
+  #define RH_RELIABLE_ACK_PEERS 4
+ #endif
+#endif
+
 /////////////////////////////////////////////////////////////////////
 /// \class RHReliableDatagram RHReliableDatagram.h <RHReliableDatagram.h>
 /// \brief RHDatagram subclass for sending addressed, acknowledged, retransmitted datagrams.
@@ -69,6 +180,106 @@
 /// retransmit strategy and configuration lest they hang for a long time
 /// trying to reply to clients that are unreachable.
 ///
+/// \par Adaptive Timeouts
+///
+/// By default every retransmission waits the same fixed timeout (see setTimeout()). If you call 
+/// setAdaptiveTimeout(true), RHReliableDatagram instead measures the round trip time to each peer
+/// (from the end of transmission of a message to the arrival of its ACK) and keeps a smoothed 
+/// round trip time and round trip time variation for each of the last RH_RELIABLE_RTT_PEERS peers, 
+/// in the manner of Jacobson's algorithm for TCP. The timeout for a peer is then 
+/// SRTT + 4 * RTTVAR, bounded by RH_RELIABLE_MIN_TIMEOUT and RH_RELIABLE_MAX_TIMEOUT. 
+/// Following Karn's algorithm, ACKs for retransmitted messages are not used as samples, 
+/// because they cant be matched to a particular transmission. Each retransmission 
+/// doubles the previous timeout (exponential backoff). The configured timeout is used for
+/// peers with no estimate yet. You can read the current estimates with rttEstimate() and timeoutFor().
+///
+/// \par Windowed Sending
+///
+/// As an alternative to the stop-and-wait sendtoWait(), sendtoWindow() keeps up to
+/// RH_RELIABLE_WINDOW_SIZE (by default 4) unacknowledged messages in flight to each destination.
+/// Each message gets its own ID, and acknowledgements are matched to the outstanding messages
+/// by ID, so that only messages whose ACK has not arrived before their timeout are retransmitted.
+/// sendtoWindow() only blocks when the window to that destination is full. Call flushWindow()
+/// to wait until all outstanding messages have been acknowledged or have exhausted their retries.
+/// The over-the-air format is identical to sendtoWait(), so windowed senders can talk to any
+/// RHReliableDatagram receiver.
+/// Each window slot keeps a copy of the message, and the window is disabled by default on AVR processors
+/// to save SRAM (see RH_RELIABLE_WINDOW_SIZE).
+///
+/// \par Duplicate Detection
+///
+/// When an ACK is lost, the sender retransmits a message that has already been received. 
+/// RHReliableDatagram remembers which of the last RH_RELIABLE_SEEN_WINDOW (by default 32, 
+/// 16 on AVR) message IDs it has received from each peer, so a retransmission is acknowledged again
+/// but not delivered twice, even when it arrives after newer messages from the same sender, 
+/// as happens with windowed senders. A message whose ID is RH_RELIABLE_WINDOW_SPAN (by default 16) or more
+/// behind the newest seen from its sender cannot be a retransmission, so it is taken to mean that the sender
+/// has restarted: the window is reset and the message is accepted. On AVR processors only the last 
+/// RH_RELIABLE_SEEN_PEERS (by default 16) peers are remembered, to save SRAM.
+/// A sender that restarts starts its IDs again from 1. If it had sent fewer than RH_RELIABLE_WINDOW_SPAN
+/// messages, these are still inside the window of IDs remembered for it, and its first messages would then
+/// be acknowledged but discarded as duplicates.
+/// So the window of a peer that has been quiet for RH_RELIABLE_SEEN_TIMEOUT (by default 10 seconds)
+/// is forgotten. The trade-off is that a sender that restarts sooner than that, after sending only a few
+/// messages, may still lose its first few messages, while a retransmission that arrives more than RH_RELIABLE_SEEN_TIMEOUT after 
+/// the last message from its sender is delivered twice. So RH_RELIABLE_SEEN_TIMEOUT must be longer 
+/// than the time senders spend retransmitting (see setTimeout() and setRetries()).
+///
+/// \par Selective and Delayed ACKs
+///
+/// By default every message is acknowledged as soon as it is received, with its own ACK. On half duplex
+/// radios each ACK costs a transmit turnaround and a preamble, so when a sender has several messages in 
+/// flight (see sendtoWindow()) you can call setAckDelay() on the receiver to let it wait a little before
+/// acknowledging. All the messages received from the same sender during the delay are then acknowledged by
+/// a single selective ACK, whose ID is the newest of them, and whose payload is RH_RELIABLE_ACK_SELECTIVE followed by
+/// a bitmap of the others (up to RH_RELIABLE_SEEN_WINDOW - 1 IDs earlier). 
+/// Senders of any version recognise the ACK for the newest message. Older versions ignore the bitmap,
+/// and retransmit the other messages, which are then acknowledged again. The delay is bounded: a delayed
+/// ACK is sent when the delay expires, provided recvfromAck() or poll() is called frequently, and before 
+/// this node blocks in sendtoWait().
+///
+/// If this node sends a message to a peer while an ACK for that peer is waiting, the ACK is piggybacked
+/// on the message instead of being sent separately: the message is sent with RH_FLAGS_PIGGYBACK, 
+/// the acknowledged ID in the ID header, and its own ID as an extra first octet of the payload. 
+/// So with request/response traffic and an ACK delay longer than the time to prepare the response,
+/// the response carries the ACK for the request, saving an entire frame exchange for each transaction.
+/// A requester waiting in sendtoWait() recognises a piggybacked ACK from the headers alone,
+/// and leaves the response to be collected by recvfromAck() as usual.
+/// Only a single ACK can be piggybacked: if several are waiting for the peer, they are sent
+/// in a separate selective ACK. All nodes must support piggybacked ACKs if any of them sets an ACK delay.
+///
+/// \par Unacknowledged Messages
+///
+/// sendtoNoAck() sends a single message with RH_FLAGS_NO_ACK and returns without waiting. The receiver
+/// delivers it with recvfromAck() like any other message, but does not acknowledge it or check it for
+/// duplicates, so it may be lost or delivered more than once. This is for protocols that do their
+/// own recovery for many messages at once, such as RHBulkTransfer, where an ACK for every message would
+/// cost more than the occasional retransmission.
+///
+/// \par Non-blocking Operation
+///
+/// sendtoAsync() transmits a message into the window and returns immediately without waiting
+/// for the ACK, giving a handle that can be passed to sendState() to check on its progress. 
+/// The window is serviced (ACKs matched and timed out messages retransmitted) whenever 
+/// recvfromAck() or poll() is called, so an event driven application can keep receiving while
+/// its messages are waiting for ACKs, provided it calls one of them frequently, eg:
+/// \code
+/// void loop()
+/// {
+///     if (manager.poll())
+///     {
+///         // A message is waiting, collect it
+///         uint8_t len = sizeof(buf);
+///         if (manager.recvfromAck(buf, &len, &from))
+///             ....
+///     }
+///     if (manager.sendState(handle) == RHReliableDatagram::SendStateAcked)
+///         ....
+/// }
+/// \endcode
+/// Subclasses can override sendComplete() to be told when each window message is acknowledged 
+/// or fails.
+///
 /// Caution: if you have a radio network with a mixture of slow and fast
 /// processors and ReliableDatagrams, you may be affected by race conditions
 /// where the fast processor acknowledges a message before the sender is ready
@@ -78,6 +289,17 @@
 class RHReliableDatagram : public RHDatagram
 {
 public:
+    /// \brief Defines the states of a message sent with sendtoAsync()
+    ///
+    /// These are the values returned by sendState()
+    typedef enum
+    {
+	SendStateIdle = 0,      ///< No message has been sent with this handle
+	SendStatePending,       ///< Waiting for an ACK
+	SendStateAcked,         ///< The message was acknowledged
+	SendStateFailed         ///< The retries were exhausted without an ACK
+    } SendState;
+
     /// Constructor. 
     /// \param[in] driver The RadioHead driver to use to transport messages.
     /// \param[in] thisAddress The address to assign to this node. Defaults to 0
@@ -119,6 +341,14 @@ public:
     /// \return true if the message was transmitted and an acknowledgement was received.
     bool sendtoWait(uint8_t* buf, uint8_t len, uint8_t address);
 
+    /// Sends the message to the specified address with RH_FLAGS_NO_ACK set, and returns without waiting
+    /// for it to be sent. The receiver does not acknowledge it or detect duplicates.
+    /// \param[in] buf Pointer to the binary message to send
+    /// \param[in] len Number of octets to send
+    /// \param[in] address The address to send the message to.
+    /// \return true if the message was accepted for transmission by the driver
+    bool sendtoNoAck(uint8_t* buf, uint8_t len, uint8_t address);
+
     /// If there is a valid message available for this node, send an acknowledgement to the SRC
     /// address (blocking until this is complete), then copy the message to buf and return true
     /// else return false. 
@@ -139,6 +369,21 @@ public:
     /// \return true if a valid message was copied to buf
     bool recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* from = NULL, uint8_t* to = NULL, uint8_t* id = NULL, uint8_t* flags = NULL);
 
+    /// Zero copy version of recvfromAck(). Handles ACKs, duplicates and acknowledgements exactly like
+    /// recvfromAck(), but instead of copying a new message for this node into a buffer, sets *buf to point to it
+    /// in the driver's receive buffer. The message must be discarded with consume() when it is no
+    /// longer needed, and before anything else is sent or received.
+    /// See RHGenericDriver::peek() for how long the pointer remains valid.
+    /// \param[out] buf Set to the location of the message
+    /// \param[out] len Set to the length of the message
+    /// \param[in] from If present and not NULL, the referenced uint8_t will be set to the SRC address
+    /// \param[in] to If present and not NULL, the referenced uint8_t will be set to the DEST address
+    /// \param[in] id If present and not NULL, the referenced uint8_t will be set to the ID
+    /// \param[in] flags If present and not NULL, the referenced uint8_t will be set to the FLAGS
+    /// \return true if a new message is available. false if not, or if the driver does not support
+    /// peek(), in which case recvfromAck() must be used instead
+    bool peekfromAck(uint8_t** buf, uint8_t* len, uint8_t* from = NULL, uint8_t* to = NULL, uint8_t* id = NULL, uint8_t* flags = NULL);
+
     /// Similar to recvfromAck(), this will block until either a valid message available for this node
     /// or the timeout expires. Starts the receiver automatically.
     /// You should be sure to call this function frequently enough to not miss any messages
@@ -163,17 +408,267 @@ public:
     /// to 0. 
     void resetRetransmissions(); 
 
+    /// Enables or disables adaptive retransmit timeouts based on the measured round trip time
+    /// to each peer. Disabled by default. When disabled, every (re)transmission uses a timeout 
+    /// randomly varied between timeout and timeout*2, as set by setTimeout().
+    /// \param[in] adaptive true to enable adaptive timeouts
+    void setAdaptiveTimeout(bool adaptive);
+
+    /// Returns the current smoothed round trip time estimate for a peer.
+    /// Estimates are only kept while adaptive timeouts are enabled.
+    /// \param[in] address The address of the peer
+    /// \param[in] rttvar If present and not NULL, the referenced uint16_t will be set to the 
+    /// round trip time variation in milliseconds
+    /// \return The smoothed round trip time in milliseconds, or 0 if there is no estimate for the peer
+    uint16_t rttEstimate(uint8_t address, uint16_t* rttvar = NULL);
+
+    /// Returns the retransmit timeout that will be used for the first transmission of 
+    /// the next message to a peer, before randomisation.
+    /// \param[in] address The address of the peer
+    /// \return The timeout in milliseconds
+    uint16_t timeoutFor(uint8_t address);
+
+    /// Sets how long ACKs may be delayed, so that several messages from the same sender can be acknowledged
+    /// by a single selective ACK. Defaults to 0 at construction time: every message is acknowledged 
+    /// immediately with its own ACK. The delay adds to the round trip time seen by senders, so it must be
+    /// well below their retransmit timeout (see setTimeout()), and is best used with senders that use
+    /// sendtoWindow() or sendtoAsync(). Delayed ACKs can only be sent while the application is calling this manager
+    /// (eg recvfromAck(), poll() or sendtoWait()), so do not set an ACK delay if the application sleeps 
+    /// (eg with delay()) after receiving a message.
+    /// \param[in] delay The longest time to delay an ACK in milliseconds
+    void setAckDelay(uint16_t delay);
+
+    /// Sets the maximum number of unacknowledged messages sendtoWindow() will keep in flight to
+    /// any one destination. Defaults to RH_RELIABLE_WINDOW_SIZE at construction time. Values larger
+    /// than RH_RELIABLE_WINDOW_SIZE are reduced to RH_RELIABLE_WINDOW_SIZE.
+    /// \param[in] windowSize The new maximum number of messages in flight per destination.
+    void setWindowSize(uint8_t windowSize);
+
+    /// Sends the message and returns without waiting for the acknowledgement, provided there
+    /// are fewer than windowSize() unacknowledged messages outstanding to the destination.
+    /// If the window to the destination is full, blocks (processing ACKs and retransmitting 
+    /// as necessary) until a slot becomes free. 
+    /// Outstanding messages are retransmitted after their timeout, up to retries() times, just like
+    /// sendtoWait(). Any received message other than an ACK for an outstanding message 
+    /// is discarded while waiting.
+    /// Broadcasts are never acknowledged and are sent immediately, as with sendtoWait().
+    /// If RH_RELIABLE_WINDOW_SIZE is 0, this is the same as sendtoWait().
+    /// \param[in] buf Pointer to the binary message to send
+    /// \param[in] len Number of octets to send
+    /// \param[in] address The address to send the message to.
+    /// \return true if the message was accepted and transmitted (or, without a window, was acknowledged).
+    bool sendtoWindow(uint8_t* buf, uint8_t len, uint8_t address);
+
+    /// Blocks until every message sent by sendtoWindow() has been acknowledged or has exhausted its retries.
+    /// \return true if every message sent by sendtoWindow() since the last call to flushWindow() 
+    /// was acknowledged, false if any of them failed.
+    bool flushWindow();
+
+    /// Sends the message into the window without waiting for an acknowledgement, and without blocking
+    /// if the window is full. The message will be retransmitted by later calls to recvfromAck() or poll() 
+    /// until it is acknowledged or its retries are exhausted. 
+    /// Broadcasts are sent immediately and are complete as soon as they are sent.
+    /// \param[in] buf Pointer to the binary message to send
+    /// \param[in] len Number of octets to send
+    /// \param[in] address The address to send the message to.
+    /// \param[in] handle If present and not NULL, the referenced uint8_t will be set to a handle that can be 
+    /// passed to sendState(), or to RH_RELIABLE_NO_HANDLE for broadcasts.
+    /// \return true if the message was transmitted. false if the window to the destination is full (see
+    /// also RH_RELIABLE_WINDOW_SPAN), or
+    /// if RH_RELIABLE_WINDOW_SIZE is 0.
+    bool sendtoAsync(uint8_t* buf, uint8_t len, uint8_t address, uint8_t* handle = NULL);
+
+    /// Returns the state of a message sent with sendtoAsync() or sendtoWindow().
+    /// Handles are reused once their message has completed, so the state of a completed message 
+    /// is only available until the next message is sent.
+    /// \param[in] handle The handle returned by sendtoAsync()
+    /// \return The state of the message, one of SendState
+    SendState sendState(uint8_t handle);
+
+    /// Services the window without blocking: processes an ACK if one has been received, and
+    /// retransmits (or fails) any window messages whose timeout has expired.
+    /// Messages other than ACKs are left to be collected by recvfromAck(), and no
+    /// retransmissions occur until they have been collected.
+    /// Call this frequently in your main loop when using sendtoAsync().
+    /// \return true if there is a message waiting to be collected by recvfromAck().
+    bool poll();
+
+    /// Returns the number of messages sent with sendtoWindow() that are still waiting for an ACK
+    /// \param[in] address The destination address to count. RH_BROADCAST_ADDRESS counts all destinations.
+    /// \return The number of unacknowledged messages in flight
+    uint8_t windowPending(uint8_t address = RH_BROADCAST_ADDRESS);
+
 protected:
     /// Send an ACK for the message id to the given from address
-    /// Blocks until the ACK has been sent
+    /// Blocks until the ACK has been sent. If an ACK delay has been set with setAckDelay(), the ACK is 
+    /// instead queued to be combined with ACKs for later messages from the same address, and sent later by
+    /// sendDelayedAcks().
     void acknowledge(uint8_t id, uint8_t from);
 
+    /// Sends a message with the given ID, piggybacking a delayed ACK for the destination on it if one is waiting.
+    /// Any other delayed ACKs are sent first. Blocks until the message has been sent
+    /// \param[in] buf Pointer to the message to send
+    /// \param[in] len Number of octets to send
+    /// \param[in] address The address to send the message to
+    /// \param[in] id The ID of the message
+    void sendMessage(uint8_t* buf, uint8_t len, uint8_t address, uint8_t id);
+
+    /// Processes a piggybacked ACK, if a received message has one. The ID and FLAGS are
+    /// changed to those of the message itself.
+    /// \param[in] from The FROM header
+    /// \param[in] to The TO header
+    /// \param[in,out] id The ID header. Set to the ID of the message
+    /// \param[in,out] flags The FLAGS header. RH_FLAGS_PIGGYBACK is cleared
+    /// \param[in] buf The payload of the message
+    /// \param[in] len The length of the payload in buf
+    /// \return The number of octets at the start of the payload that are not part of the message: 1 if there
+    /// was a piggybacked ACK, else 0
+    uint8_t unpackPiggyback(uint8_t from, uint8_t to, uint8_t* id, uint8_t* flags, const uint8_t* buf, uint8_t len);
+
+    /// Sends delayed ACKs queued by acknowledge().
+    /// \param[in] all true to send all of them, false to send only those whose delay has expired
+    void sendDelayedAcks(bool all);
+
+    /// Returns how long it is possible to wait without delaying a queued ACK beyond the ACK delay
+    /// \param[in] timeout The longest wait desired in milliseconds
+    /// \return timeout, or the number of milliseconds until the next delayed ACK is due if that is sooner
+    uint16_t ackTimeLeft(uint16_t timeout);
+
     /// Checks whether the message currently in the Rx buffer is a new message, not previously received
     /// based on the from address and the sequence.  If it is new, it is acknowledged and returns true
     /// \return true if there is a message received and it is a new message
     bool haveNewMessage();
 
+    /// Processes the headers of a received message: completes window messages acknowledged by an ACK,
+    /// acknowledges messages addressed to this node, and detects duplicates.
+    /// \param[in] from The FROM header
+    /// \param[in] to The TO header
+    /// \param[in] id The ID header
+    /// \param[in] flags The FLAGS header
+    /// \param[in] buf The payload of the message, which is only examined if it is an ACK. May be NULL
+    /// \param[in] len The length of the payload in buf
+    /// \return true if it is a new message (not an ACK) that the caller is interested in
+    bool acceptMessage(uint8_t from, uint8_t to, uint8_t id, uint8_t flags, const uint8_t* buf, uint8_t len);
+
+    /// Computes the timeout to use for the next (re)transmission of a message.
+    /// Randomly varied between _timeout and _timeout*2 to prevent collisions on every retransmit
+    /// if 2 nodes try to transmit at the same time. With adaptive timeouts, it is based on 
+    /// timeoutFor(address), doubled for each previous transmission and randomly increased by up to 25%.
+    /// \param[in] address The address the message is being sent to
+    /// \param[in] tries The number of times the message has been transmitted, including this time
+    /// \return The timeout in milliseconds
+    uint16_t retransmitTimeout(uint8_t address, uint8_t tries);
+
+    /// Updates the round trip time estimate for a peer with a new measurement.
+    /// Does nothing unless adaptive timeouts are enabled
+    /// \param[in] address The address of the peer
+    /// \param[in] rtt The measured round trip time in milliseconds
+    void updateRtt(uint8_t address, unsigned long rtt);
+
+    /// Called when a message sent with sendtoAsync() or sendtoWindow() is acknowledged or fails.
+    /// Subclasses may override this to be told about completed messages. The default does nothing.
+    /// The message is still available from windowMessage() during the call.
+    /// \param[in] handle The handle of the message
+    /// \param[in] address The address the message was sent to
+    /// \param[in] acked true if the message was acknowledged, false if the retries were exhausted
+    virtual void sendComplete(uint8_t handle, uint8_t address, bool acked);
+
+    /// Returns the message held in the window for a handle
+    /// \param[in] handle The handle returned by sendtoAsync()
+    /// \param[in] len If not NULL, the referenced uint8_t will be set to the length of the message
+    /// \return Pointer to the message, or NULL if there is no window
+    uint8_t* windowMessage(uint8_t handle, uint8_t* len);
+
+    /// Completes the window messages that are acknowledged by an ACK from the given address
+    /// \param[in] from The address the ACK came from
+    /// \param[in] id The ID in the ACK
+    /// \param[in] buf The payload of the ACK. May be NULL
+    /// \param[in] len The length of the payload in buf
+    void handleAck(uint8_t from, uint8_t id, const uint8_t* buf, uint8_t len);
+
+    /// Tests whether an ACK acknowledges a message
+    /// \param[in] ackId The ID in the ACK
+    /// \param[in] buf The payload of the ACK. May be NULL
+    /// \param[in] len The length of the payload in buf
+    /// \param[in] id The ID of the message
+    /// \return true if the ACK is for id, or is a selective ACK that includes id
+    static bool ackIncludes(uint8_t ackId, const uint8_t* buf, uint8_t len, uint8_t id);
+
+    /// Sends any delayed ACKs that are due, and retransmits, or fails if the retries are exhausted, any window messages 
+    /// whose timeout has expired. Does not block, apart from transmitting.
+    void retransmitWindow();
+
+    /// Returns how long it is possible to wait without delaying a retransmission from the window,
+    /// or a delayed ACK
+    /// \param[in] timeout The longest wait desired in milliseconds
+    /// \return timeout, or the number of milliseconds until the next window timeout or delayed ACK if that is sooner
+    uint16_t windowTimeLeft(uint16_t timeout);
+
+    /// Waits up to timeout milliseconds for ACKs to messages in the window, and retransmits (or fails)
+    /// any window messages whose timeout has expired. Any other message received is discarded, 
+    /// after re-acknowledging it if it is a duplicate.
+    /// \param[in] timeout Maximum time to wait in milliseconds
+    void serviceWindow(uint16_t timeout);
+
 private:
+    /// \brief Round trip time estimate for a peer
+    typedef struct
+    {
+	bool          valid;     ///< true if this entry holds an estimate
+	uint8_t       address;   ///< Address of the peer
+	uint16_t      srtt;      ///< Smoothed round trip time in units of 1/8 ms
+	uint16_t      rttvar;    ///< Round trip time variation in units of 1/4 ms
+    } RttEntry;
+
+    /// Finds the RTT estimate for a peer
+    /// \return pointer to the RttEntry for address, or NULL if there is none
+    RttEntry* findRtt(uint8_t address);
+
+    /// Whether adaptive timeouts are enabled
+    bool            _adaptiveTimeout;
+
+    /// Round trip time estimates for the most recent peers
+    RttEntry        _rtt[RH_RELIABLE_RTT_PEERS];
+
+    /// Index of the next _rtt entry to replace
+    uint8_t         _rttNext;
+
+#if RH_RELIABLE_WINDOW_SIZE > 0
+    /// \brief An unacknowledged message sent by sendtoWindow()
+    typedef struct
+    {
+	uint8_t       state;     ///< State of this slot, one of SendState
+	uint8_t       to;        ///< Destination address
+	uint8_t       id;        ///< ID the message was sent with
+	uint8_t       tries;     ///< Number of times the message has been transmitted
+	uint8_t       len;       ///< Length of the message in buf
+	uint16_t      timeout;   ///< Timeout for the latest transmission
+	unsigned long sent;      ///< Time the latest transmission finished
+	uint8_t       buf[RH_MAX_MESSAGE_LEN]; ///< Copy of the message for retransmission
+    } WindowSlot;
+
+    /// (Re)transmits the message in a window slot and restarts its timeout
+    void transmitSlot(WindowSlot* slot);
+
+    /// Tests whether a new window message can be sent to a destination
+    /// \param[in] address The destination address
+    /// \return true if there is a free slot, fewer than windowSize() messages are pending to address, and
+    /// none of them is RH_RELIABLE_WINDOW_SPAN or more IDs older than the next ID
+    bool windowOpen(uint8_t address);
+
+    /// Marks a window message as acknowledged or failed, and calls sendComplete()
+    void completeSlot(uint8_t handle, bool acked);
+
+    /// The window of unacknowledged messages
+    WindowSlot      _window[RH_RELIABLE_WINDOW_SIZE];
+#endif
+
+    /// Maximum number of messages in flight per destination
+    uint8_t _windowSize;
+
+    /// true if a sendtoWindow() message failed since the last flushWindow()
+    bool _windowFailed;
+
     /// Count of retransmissions we have had to send
     uint32_t _retransmissions;
 
@@ -189,11 +684,93 @@ private:
     /// Defaults to 3
     uint8_t _retries;
 
-    /// Array of the last seen sequence number indexed by node address that sent it
+    /// Bitmap of recently seen IDs from one peer, one bit per ID in the duplicate detection window
+#if RH_RELIABLE_SEEN_WINDOW == 8
+    typedef uint8_t SeenBits;
+#elif RH_RELIABLE_SEEN_WINDOW == 16
+    typedef uint16_t SeenBits;
+#elif RH_RELIABLE_SEEN_WINDOW == 32
+    typedef uint32_t SeenBits;
+#elif RH_RELIABLE_SEEN_WINDOW == 64
+    typedef uint64_t SeenBits;
+#else
+ #error RH_RELIABLE_SEEN_WINDOW must be 8, 16, 32 or 64
+#endif
+
+    /// Finds the duplicate detection entry for a peer
+    /// \param[in] from The address of the peer
+    /// \param[in] create If true and there is no entry for from, replace the least recently added one
+    /// \return Index of the entry in _seenIds and _seenBits, or -1 if there is none
+    int16_t findSeen(uint8_t from, bool create);
+
+    /// Tests whether a message has already been received
+    /// \param[in] from The address the message came from
+    /// \param[in] id The ID of the message
+    /// \return true if id is in the duplicate detection window for from, and has been received
+    bool isSeen(uint8_t from, uint8_t id);
+
+    /// Records a message as received, unless it is a duplicate
+    /// \param[in] from The address the message came from
+    /// \param[in] id The ID of the message
+    /// \return true if the message is new, false if it is a duplicate
+    bool recordSeen(uint8_t from, uint8_t id);
+
+    /// The newest sequence number seen from each peer
     /// It is used for duplicate detection. Duplicated messages are re-acknowledged when received 
     /// (this is generally due to lost ACKs, causing the sender to retransmit, even though we have already
     /// received that message)
-    uint8_t _seenIds[256];
+    uint8_t _seenIds[RH_RELIABLE_SEEN_PEERS];
+
+    /// For each peer, bit n is set if the sequence number n before _seenIds has been seen.
+    /// All 0 if nothing has been seen from that peer.
+    SeenBits _seenBits[RH_RELIABLE_SEEN_PEERS];
+
+#if RH_RELIABLE_SEEN_TIMEOUT
+    /// The time in milliseconds when each peer's entry was last updated
+    uint32_t _seenTime[RH_RELIABLE_SEEN_PEERS];
+#endif
+
+#if RH_RELIABLE_SEEN_PEERS < 256
+    /// The address of the peer for each entry in _seenIds and _seenBits
+    uint8_t _seenAddress[RH_RELIABLE_SEEN_PEERS];
+
+    /// Index of the next _seenIds entry to replace
+    uint8_t _seenNext;
+#endif
+
+    /// \brief ACKs waiting to be sent to a peer
+    typedef struct
+    {
+	uint8_t       address;   ///< Address of the peer
+	uint8_t       id;        ///< Newest ID to acknowledge
+	SeenBits      ids;       ///< Bit n is set to acknowledge ID id-n. 0 if this entry is not in use
+	unsigned long since;     ///< Time the oldest of these ACKs was queued
+    } AckEntry;
+
+    /// Removes a single delayed ACK waiting for a peer, so it can be piggybacked
+    /// \param[in] address The address of the peer
+    /// \return The ID to acknowledge, or -1 if there is not exactly one ACK waiting for address
+    int16_t takeAck(uint8_t address);
+
+    /// Sends a message with a piggybacked ACK
+    /// \param[in] buf Pointer to the message to send
+    /// \param[in] len Number of octets to send. Must be less than RH_MAX_MESSAGE_LEN
+    /// \param[in] address The address to send the message to
+    /// \param[in] id The ID of the message
+    /// \param[in] ackId The ID to acknowledge
+    void sendPiggybacked(uint8_t* buf, uint8_t len, uint8_t address, uint8_t id, uint8_t ackId);
+
+    /// Sends an ACK, selective if more than one ID is to be acknowledged
+    /// \param[in] to The address to send the ACK to
+    /// \param[in] id The newest ID to acknowledge
+    /// \param[in] ids Bit n is set to acknowledge ID id-n
+    void sendAck(uint8_t to, uint8_t id, SeenBits ids);
+
+    /// Longest time to delay an ACK in milliseconds
+    uint16_t        _ackDelay;
+
+    /// Delayed ACKs waiting to be sent
+    AckEntry        _acks[RH_RELIABLE_ACK_PEERS];
 };
 
 /// @example rf22_reliable_datagram_client.pde
@@ -13,12 +13,11 @@
 
 #include <RHRouter.h>
 
-RHRouter::RoutedMessage RHRouter::_tmpMessage;
-
 ////////////////////////////////////////////////////////////////////
 // Constructors
 RHRouter::RHRouter(RHGenericDriver& driver, uint8_t thisAddress) 
-    : RHReliableDatagram(driver, thisAddress)
+    : RHReliableDatagram(driver, thisAddress),
+      _peeked(false)
 {
     _max_hops = RH_DEFAULT_MAX_HOPS;
     clearRoutingTable();
@@ -41,75 +40,111 @@ void RHRouter::setMaxHops(uint8_t max_hops)
 }
 
 ////////////////////////////////////////////////////////////////////
-void RHRouter::addRouteTo(uint8_t dest, uint8_t next_hop, uint8_t state)
+// The routing table is indexed by destination address, using open addressing with linear probing.
+// Every valid or discovering route is in the run of occupied entries that starts at its home index
+// dest % RH_ROUTING_TABLE_SIZE.
+uint16_t RHRouter::findRoute(uint8_t dest)
 {
-    uint8_t i;
-
-    // First look for an existing entry we can update
-    for (i = 0; i < RH_ROUTING_TABLE_SIZE; i++)
+    uint16_t i = dest % RH_ROUTING_TABLE_SIZE;
+    uint16_t n;
+    for (n = 0; n < RH_ROUTING_TABLE_SIZE; n++)
     {
+	if (_routes[i].state == Invalid)
+	    break; // End of the run, not present
 	if (_routes[i].dest == dest)
-	{
-	    _routes[i].dest = dest;
-	    _routes[i].next_hop = next_hop;
-	    _routes[i].state = state;
-	    return;
-	}
+	    return i;
+	if (++i >= RH_ROUTING_TABLE_SIZE)
+	    i = 0;
     }
+    return RH_ROUTING_TABLE_SIZE;
+}
 
-    // Look for an invalid entry we can use
-    for (i = 0; i < RH_ROUTING_TABLE_SIZE; i++)
-    {
-	if (_routes[i].state == Invalid)
-	{
-	    _routes[i].dest = dest;
-	    _routes[i].next_hop = next_hop;
-	    _routes[i].state = state;
-	    return;
-	}
-    }
+////////////////////////////////////////////////////////////////////
+void RHRouter::addRouteTo(uint8_t dest, uint8_t next_hop, uint8_t state)
+{
+    uint16_t i = findRoute(dest);
 
-    // Need to make room for a new one
-    retireOldestRoute();
-    // Should be an invalid slot now
-    for (i = 0; i < RH_ROUTING_TABLE_SIZE; i++)
+    if (i == RH_ROUTING_TABLE_SIZE)
     {
-	if (_routes[i].state == Invalid)
+	// Look for the first invalid entry from the home index
+	uint16_t n;
+	i = dest % RH_ROUTING_TABLE_SIZE;
+	for (n = 0; n < RH_ROUTING_TABLE_SIZE && _routes[i].state != Invalid; n++)
+	    if (++i >= RH_ROUTING_TABLE_SIZE)
+		i = 0;
+	if (n == RH_ROUTING_TABLE_SIZE)
 	{
-	    _routes[i].dest = dest;
-	    _routes[i].next_hop = next_hop;
-	    _routes[i].state = state;
+	    // Table is full. Need to make room for a new one, and try again
+	    retireOldestRoute();
+	    i = dest % RH_ROUTING_TABLE_SIZE;
+	    for (n = 0; n < RH_ROUTING_TABLE_SIZE && _routes[i].state != Invalid; n++)
+		if (++i >= RH_ROUTING_TABLE_SIZE)
+		    i = 0;
+	    if (n == RH_ROUTING_TABLE_SIZE)
+		return; // retireOldestRoute() was overridden and did not make room
 	}
     }
+    _routes[i].dest = dest;
+    _routes[i].next_hop = next_hop;
+    _routes[i].state = state;
+    _routes[i].hops = 0;
+    _routes[i].seq = -1;
+    _routes[i].learned = _routes[i].lastUsed = millis();
 }
 
 ////////////////////////////////////////////////////////////////////
 RHRouter::RoutingTableEntry* RHRouter::getRouteTo(uint8_t dest)
 {
-    uint8_t i;
-    for (i = 0; i < RH_ROUTING_TABLE_SIZE; i++)
-	if (_routes[i].dest == dest && _routes[i].state != Invalid)
-	    return &_routes[i];
-    return NULL;
+    uint16_t i = findRoute(dest);
+    if (i == RH_ROUTING_TABLE_SIZE)
+	return NULL;
+    _routes[i].lastUsed = millis();
+    return &_routes[i];
+}
+
+////////////////////////////////////////////////////////////////////
+RHRouter::RoutingTableEntry* RHRouter::routeAt(uint16_t index)
+{
+    if (index >= RH_ROUTING_TABLE_SIZE)
+	return NULL;
+    return &_routes[index];
 }
 
 ////////////////////////////////////////////////////////////////////
 void RHRouter::deleteRoute(uint8_t index)
 {
-    // Delete a route by copying following routes on top of it
-    memcpy(&_routes[index], &_routes[index+1], 
-	   sizeof(RoutingTableEntry) * (RH_ROUTING_TABLE_SIZE - index - 1));
-    _routes[RH_ROUTING_TABLE_SIZE - 1].state = Invalid;
+    // Backward shift deletion: move any following entries in this run that could not
+    // be put in their home index into the hole, so lookups still find them
+    uint16_t hole = index;
+    uint16_t i = index;
+    while (1)
+    {
+	if (++i >= RH_ROUTING_TABLE_SIZE)
+	    i = 0;
+	if (i == hole || _routes[i].state == Invalid)
+	    break;
+	uint16_t home = _routes[i].dest % RH_ROUTING_TABLE_SIZE;
+	// Can move it if its home is not cyclically within (hole, i]
+	if (   (hole <= i && (home <= hole || home > i))
+	    || (hole > i && (home <= hole && home > i)))
+	{
+	    _routes[hole] = _routes[i];
+	    hole = i;
+	}
+    }
+    _routes[hole].state = Invalid;
 }
 
 ////////////////////////////////////////////////////////////////////
 void RHRouter::printRoutingTable()
 {
 #ifdef RH_HAVE_SERIAL
-    uint8_t i;
+    uint16_t i;
     for (i = 0; i < RH_ROUTING_TABLE_SIZE; i++)
     {
-	Serial.print(i, DEC);
+	if (_routes[i].state == Invalid)
+	    continue;
+	Serial.print((unsigned int)i, DEC);
 	Serial.print(" Dest: ");
 	Serial.print(_routes[i].dest, DEC);
 	Serial.print(" Next Hop: ");
@@ -123,29 +158,37 @@ void RHRouter::printRoutingTable()
 ////////////////////////////////////////////////////////////////////
 bool RHRouter::deleteRouteTo(uint8_t dest)
 {
-    uint8_t i;
-    for (i = 0; i < RH_ROUTING_TABLE_SIZE; i++)
-    {
-	if (_routes[i].dest == dest)
-	{
-	    deleteRoute(i);
-	    return true;
-	}
-    }
-    return false;
+    uint16_t i = findRoute(dest);
+    if (i == RH_ROUTING_TABLE_SIZE)
+	return false;
+    deleteRoute(i);
+    return true;
 }
 
 ////////////////////////////////////////////////////////////////////
 void RHRouter::retireOldestRoute()
 {
-    // We just obliterate the first in the table and clear the last
-    deleteRoute(0);
+    // Retire the least recently used route
+    unsigned long now = millis();
+    unsigned long oldestAge = 0;
+    uint16_t oldest = RH_ROUTING_TABLE_SIZE;
+    uint16_t i;
+    for (i = 0; i < RH_ROUTING_TABLE_SIZE; i++)
+    {
+	if (_routes[i].state != Invalid && (oldest == RH_ROUTING_TABLE_SIZE || now - _routes[i].lastUsed > oldestAge))
+	{
+	    oldest = i;
+	    oldestAge = now - _routes[i].lastUsed;
+	}
+    }
+    if (oldest != RH_ROUTING_TABLE_SIZE)
+	deleteRoute(oldest);
 }
 
 ////////////////////////////////////////////////////////////////////
 void RHRouter::clearRoutingTable()
 {
-    uint8_t i;
+    uint16_t i;
     for (i = 0; i < RH_ROUTING_TABLE_SIZE; i++)
 	_routes[i].state = Invalid;
 }
@@ -159,6 +202,12 @@ uint8_t RHRouter::sendtoWait(uint8_t* buf, uint8_t len, uint8_t dest, uint8_t fl
 ////////////////////////////////////////////////////////////////////
 // Waits for delivery to the next hop (but not for delivery to the final destination)
 uint8_t RHRouter::sendtoFromSourceWait(uint8_t* buf, uint8_t len, uint8_t dest, uint8_t source, uint8_t flags)
+{
+    return sendtoFromSourceWait(buf, len, dest, source, flags, _lastE2ESequenceNumber++);
+}
+
+////////////////////////////////////////////////////////////////////
+uint8_t RHRouter::sendtoFromSourceWait(uint8_t* buf, uint8_t len, uint8_t dest, uint8_t source, uint8_t flags, uint8_t id)
 {
     if (((uint16_t)len + sizeof(RoutedMessageHeader)) > _driver.maxMessageLength())
 	return RH_ROUTER_ERROR_INVALID_LENGTH;
@@ -167,7 +216,7 @@ uint8_t RHRouter::sendtoFromSourceWait(uint8_t* buf, uint8_t len, uint8_t dest,
     _tmpMessage.header.source = source;
     _tmpMessage.header.dest = dest;
     _tmpMessage.header.hops = 0;
-    _tmpMessage.header.id = _lastE2ESequenceNumber++;
+    _tmpMessage.header.id = id;
     _tmpMessage.header.flags = flags;
     memcpy(_tmpMessage.data, buf, len);
 
@@ -193,6 +242,62 @@ uint8_t RHRouter::route(RoutedMessage* message, uint8_t messageLen)
     return RH_ROUTER_ERROR_NONE;
 }
 
+////////////////////////////////////////////////////////////////////
+uint8_t RHRouter::sendtoAsync(uint8_t* buf, uint8_t len, uint8_t dest, uint8_t flags, uint8_t* handle)
+{
+    if (((uint16_t)len + sizeof(RoutedMessageHeader)) > _driver.maxMessageLength())
+	return RH_ROUTER_ERROR_INVALID_LENGTH;
+
+    // Construct a RH RouterMessage message
+    _tmpMessage.header.source = _thisAddress;
+    _tmpMessage.header.dest = dest;
+    _tmpMessage.header.hops = 0;
+    _tmpMessage.header.id = _lastE2ESequenceNumber++;
+    _tmpMessage.header.flags = flags;
+    memcpy(_tmpMessage.data, buf, len);
+
+    return routeAsync(&_tmpMessage, sizeof(RoutedMessageHeader)+len, handle);
+}
+
+////////////////////////////////////////////////////////////////////
+uint8_t RHRouter::routeAsync(RoutedMessage* message, uint8_t messageLen, uint8_t* handle)
+{
+    // See if we have a route:
+    uint8_t next_hop = RH_BROADCAST_ADDRESS;
+    if (message->header.dest != RH_BROADCAST_ADDRESS)
+    {
+	RoutingTableEntry* route = getRouteTo(message->header.dest);
+	if (!route)
+	    return RH_ROUTER_ERROR_NO_ROUTE;
+	next_hop = route->next_hop;
+    }
+
+    if (!RHReliableDatagram::sendtoAsync((uint8_t*)message, messageLen, next_hop, handle))
+	return RH_ROUTER_ERROR_BUSY;
+
+    return RH_ROUTER_ERROR_NONE;
+}
+
+////////////////////////////////////////////////////////////////////
+// Subclasses may want to override this to hear about delivery failures
+void RHRouter::routeComplete(RoutedMessage* message, uint8_t messageLen, bool delivered)
+{
+    // Default does nothing
+    (void)message; // Not used
+    (void)messageLen; // Not used
+    (void)delivered; // Not used
+}
+
+////////////////////////////////////////////////////////////////////
+void RHRouter::sendComplete(uint8_t handle, uint8_t address, bool acked)
+{
+    (void)address; // Not used
+    uint8_t messageLen;
+    RoutedMessage* message = (RoutedMessage*)windowMessage(handle, &messageLen);
+    if (message)
+	routeComplete(message, messageLen, acked);
+}
+
 ////////////////////////////////////////////////////////////////////
 // Subclasses may want to override this to peek at messages going past
 void RHRouter::peekAtMessage(RoutedMessage* message, uint8_t messageLen)
@@ -205,90 +310,149 @@ void RHRouter::peekAtMessage(RoutedMessage* message, uint8_t messageLen)
 ////////////////////////////////////////////////////////////////////
 bool RHRouter::recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* source, uint8_t* dest, uint8_t* id, uint8_t* flags)
 {  
-    uint8_t tmpMessageLen = sizeof(_tmpMessage);
+    uint8_t*       message;
+    uint8_t        messageLen;
+    if (peekfromAck(&message, &messageLen, source, dest, id, flags))
+    {
+	if (*len > messageLen)
+	    *len = messageLen;
+	memcpy(buf, message, *len);
+	consume();
+	return true; // Its for you!
+    }
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHRouter::peekfromAck(uint8_t** buf, uint8_t* len, uint8_t* source, uint8_t* dest, uint8_t* id, uint8_t* flags)
+{  
+    uint8_t* frame;
+    RoutedMessage* message;
+    uint8_t messageLen;
     uint8_t _from;
     uint8_t _to;
     uint8_t _id;
     uint8_t _flags;
-    if (RHReliableDatagram::recvfromAck((uint8_t*)&_tmpMessage, &tmpMessageLen, &_from, &_to, &_id, &_flags))
+    // Look at the message in the driver's buffer if we can, else get a copy of it.
+    // peekAtMessage() only reads it, and only forwarding changes it (the hop count, in place)
+    if (RHReliableDatagram::peekfromAck(&frame, &messageLen, &_from, &_to, &_id, &_flags))
     {
-	// Here we simulate networks with limited visibility between nodes
-	// so we can test routing
+	message = (RoutedMessage*)frame;
+	_peeked = true;
+    }
+    else
+    {
+	messageLen = sizeof(_tmpMessage);
+	if (!RHReliableDatagram::recvfromAck((uint8_t*)&_tmpMessage, &messageLen, &_from, &_to, &_id, &_flags))
+	    return false;
+	message = &_tmpMessage;
+	_peeked = false;
+    }
+
+    // Here we simulate networks with limited visibility between nodes
+    // so we can test routing
 #ifdef RH_TEST_NETWORK
-	if (
+    if (
 #if RH_TEST_NETWORK==1
-	    // This network looks like 1-2-3-4
-	       (_thisAddress == 1 && _from == 2)
-	    || (_thisAddress == 2 && (_from == 1 || _from == 3))
-	    || (_thisAddress == 3 && (_from == 2 || _from == 4))
-	    || (_thisAddress == 4 && _from == 3)
+	// This network looks like 1-2-3-4
+	   (_thisAddress == 1 && _from == 2)
+	|| (_thisAddress == 2 && (_from == 1 || _from == 3))
+	|| (_thisAddress == 3 && (_from == 2 || _from == 4))
+	|| (_thisAddress == 4 && _from == 3)
 	    
 #elif RH_TEST_NETWORK==2
-	       // This network looks like 1-2-4
-	       //                         | | |
-	       //                         --3--
-	       (_thisAddress == 1 && (_from == 2 || _from == 3))
-	    ||  _thisAddress == 2
-	    ||  _thisAddress == 3
-	    || (_thisAddress == 4 && (_from == 2 || _from == 3))
+	   // This network looks like 1-2-4
+	   //                         | | |
+	   //                         --3--
+	   (_thisAddress == 1 && (_from == 2 || _from == 3))
+	||  _thisAddress == 2
+	||  _thisAddress == 3
+	|| (_thisAddress == 4 && (_from == 2 || _from == 3))
 
 #elif RH_TEST_NETWORK==3
-	       // This network looks like 1-2-4
-	       //                         |   |
-	       //                         --3--
-	       (_thisAddress == 1 && (_from == 2 || _from == 3))
-	    || (_thisAddress == 2 && (_from == 1 || _from == 4))
-	    || (_thisAddress == 3 && (_from == 1 || _from == 4))
-	    || (_thisAddress == 4 && (_from == 2 || _from == 3))
+	   // This network looks like 1-2-4
+	   //                         |   |
+	   //                         --3--
+	   (_thisAddress == 1 && (_from == 2 || _from == 3))
+	|| (_thisAddress == 2 && (_from == 1 || _from == 4))
+	|| (_thisAddress == 3 && (_from == 1 || _from == 4))
+	|| (_thisAddress == 4 && (_from == 2 || _from == 3))
 
 #elif RH_TEST_NETWORK==4
-	       // This network looks like 1-2-3
-	       //                           |
-	       //                           4
-	       (_thisAddress == 1 && _from == 2)
-	    ||  _thisAddress == 2
-	    || (_thisAddress == 3 && _from == 2)
-	    || (_thisAddress == 4 && _from == 2)
+	   // This network looks like 1-2-3
+	   //                           |
+	   //                           4
+	   (_thisAddress == 1 && _from == 2)
+	||  _thisAddress == 2
+	|| (_thisAddress == 3 && _from == 2)
+	|| (_thisAddress == 4 && _from == 2)
 
 #endif
 )
-	{
-	    // OK
-	}
-	else
-	{
-	    return false; // Pretend we got nothing
-	}
+    {
+	// OK
+    }
+    else
+    {
+	consume();
+	return false; // Pretend we got nothing
+    }
 #endif
 
-	peekAtMessage(&_tmpMessage, tmpMessageLen);
-	// See if its for us or has to be routed
-	if (_tmpMessage.header.dest == _thisAddress || _tmpMessage.header.dest == RH_BROADCAST_ADDRESS)
-	{
-	    // Deliver it here
-	    if (source) *source  = _tmpMessage.header.source;
-	    if (dest)   *dest    = _tmpMessage.header.dest;
-	    if (id)     *id      = _tmpMessage.header.id;
-	    if (flags)  *flags   = _tmpMessage.header.flags;
-	    uint8_t msgLen = tmpMessageLen - sizeof(RoutedMessageHeader);
-	    if (*len > msgLen)
-		*len = msgLen;
-	    memcpy(buf, _tmpMessage.data, *len);
-	    return true; // Its for you!
-	}
-	else if (   _tmpMessage.header.dest != RH_BROADCAST_ADDRESS
-		 && _tmpMessage.header.hops++ < _max_hops)
+    peekAtMessage(message, messageLen);
+    // See if its for us or has to be routed
+    if (message->header.dest == _thisAddress || message->header.dest == RH_BROADCAST_ADDRESS)
+    {
+	// Deliver it here
+	if (source) *source  = message->header.source;
+	if (dest)   *dest    = message->header.dest;
+	if (id)     *id      = message->header.id;
+	if (flags)  *flags   = message->header.flags;
+	*buf = message->data;
+	*len = messageLen - sizeof(RoutedMessageHeader);
+	return true; // Its for you! The caller will consume() it
+    }
+    else if (   message->header.dest != RH_BROADCAST_ADDRESS
+	     && message->header.hops < _max_hops)
+    {
+	// Maybe it has to be routed to the next hop
+	message->header.hops++;
+	// REVISIT: if it fails due to no route or unable to deliver to the next hop, 
+	// tell the originator. BUT HOW?
+	// Fast path: if the message is still in the driver's buffer and we know where to send it,
+	// forward it from there without waiting for the ACK. routeAsync() then only takes the copy
+	// it needs for retransmissions and sends it, and does not receive anything. Nothing the driver
+	// receives meanwhile overwrites the message (see RHGenericDriver::peek()).
+	// Without a route, subclasses may send and receive other messages, so use the slow path
+	bool fast = _peeked && getRouteTo(message->header.dest);
+	if (fast && routeAsync(message, messageLen, NULL) != RH_ROUTER_ERROR_BUSY)
 	{
-	    // Maybe it has to be routed to the next hop
-	    // REVISIT: if it fails due to no route or unable to deliver to the next hop, 
-	    // tell the originator. BUT HOW?
-	    route(&_tmpMessage, tmpMessageLen);
+	    consume();
+	    return false;
 	}
-	// Discard it and maybe wait for another
+	// Slow path: finish with the driver's buffer before anything that might receive
+	if (_peeked)
+	    memcpy(&_tmpMessage, message, messageLen);
+	consume();
+	// Dont wait for the next hop to ACK unless there is no room in the window
+	if (fast || routeAsync(&_tmpMessage, messageLen, NULL) == RH_ROUTER_ERROR_BUSY)
+	    route(&_tmpMessage, messageLen);
+	return false;
     }
+    // Discard it and maybe wait for another
+    consume();
     return false;
 }
 
+////////////////////////////////////////////////////////////////////
+void RHRouter::consume()
+{
+    // A copy in _tmpMessage has already been taken from the driver
+    if (_peeked)
+	RHReliableDatagram::consume();
+    _peeked = false;
+}
+
 ////////////////////////////////////////////////////////////////////
 bool RHRouter::recvfromAckTimeout(uint8_t* buf, uint8_t* len, uint16_t timeout, uint8_t* source, uint8_t* dest, uint8_t* id, uint8_t* flags)
 {  
@@ -296,11 +460,12 @@ bool RHRouter::recvfromAckTimeout(uint8_t* buf, uint8_t* len, uint16_t timeout,
     int32_t timeLeft;
     while ((timeLeft = timeout - (millis() - starttime)) > 0)
     {
-	if (waitAvailableTimeout(timeLeft))
-	{
-	    if (recvfromAck(buf, len, source, dest, id, flags))
-		return true;
-	}
+	// Wake up in time to retransmit any window messages
+	uint16_t waitTime = windowTimeLeft(timeLeft);
+	if (waitTime)
+	    waitAvailableTimeout(waitTime);
+	if (recvfromAck(buf, len, source, dest, id, flags))
+	    return true;
 	YIELD;
     }
     return false;
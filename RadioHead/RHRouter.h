@@ -12,8 +12,18 @@
 // Default max number of hops we will route
 #define RH_DEFAULT_MAX_HOPS 30
 
-// The default size of the routing table we keep
-#define RH_ROUTING_TABLE_SIZE 10
+// The size of the routing table we keep. The table is indexed by destination address
+// (open addressing with linear probing), so with 256 entries it is a direct map and lookups never probe.
+// Each entry costs about 16 octets of SRAM.
+// Can be pre-defined to a different size prior to including this header.
+// Defaults to 10 on microcontrollers and 256 (one entry for every address) on Linux and other hosts.
+#ifndef RH_ROUTING_TABLE_SIZE
+ #if (RH_PLATFORM == RH_PLATFORM_UNIX)
+  #define RH_ROUTING_TABLE_SIZE 256
+ #else
+  #define RH_ROUTING_TABLE_SIZE 10
+ #endif
+#endif
 
 // Error codes
 #define RH_ROUTER_ERROR_NONE              0
@@ -22,6 +32,7 @@
 #define RH_ROUTER_ERROR_TIMEOUT           3
 #define RH_ROUTER_ERROR_NO_REPLY          4
 #define RH_ROUTER_ERROR_UNABLE_TO_DELIVER 5
+#define RH_ROUTER_ERROR_BUSY              6
 
 // This size of RH_ROUTER_MAX_MESSAGE_LEN is OK for Arduino Mega, but too big for
 // Duemilanove. Size of 50 works with the sample router programs on Duemilanove.
@@ -90,9 +101,12 @@
 /// You can also use addRouteTo() to change a route and 
 /// deleteRouteTo() to delete a route at run time. Youcan also clear the entire routing table
 ///
-/// The Routing Table has limited capacity for entries (defined by RH_ROUTING_TABLE_SIZE, which is 10)
-/// if more than RH_ROUTING_TABLE_SIZE are added, the oldest (first) one will be removed by calling 
-/// retireOldestRoute()
+/// The Routing Table has limited capacity for entries (defined by RH_ROUTING_TABLE_SIZE, which is 10
+/// on microcontrollers and 256 on Linux). If more than RH_ROUTING_TABLE_SIZE are added, the least 
+/// recently used one will be removed by calling retireOldestRoute(). 
+/// The table is a hash table indexed by destination address, so looking up the route 
+/// for each routed message takes constant time, even in large networks. On a 256 entry table 
+/// every possible address has its own entry, and routes are never retired.
 ///
 /// \par Message Format
 ///
@@ -116,6 +130,19 @@
 /// message header too. These are used only for hop-to-hop, and in general will be different to 
 /// the ones at the RHRouter level.
 ///
+/// \par Non-blocking Operation
+///
+/// sendtoAsync() sends a message to the next hop without waiting for the next hop to acknowledge it
+/// (see RHReliableDatagram::sendtoAsync()). Messages being routed through this node to other nodes 
+/// are also forwarded to their next hop without waiting, provided there is room in the RHReliableDatagram 
+/// window, so a busy relay node can keep receiving and forwarding while earlier messages are waiting 
+/// for ACKs. Subclasses are told about delivery to the next hop by routeComplete().
+/// If there is no window (see RH_RELIABLE_WINDOW_SIZE) or it is full, messages are forwarded 
+/// with the blocking route() as before.
+/// If the driver supports RHGenericDriver::peek() and the route to the destination is known, a message 
+/// being forwarded is not copied out of the driver's receive buffer: its hop count is updated in place
+/// and it is handed from there to the window, which keeps the one copy needed for retransmissions.
+///
 /// \par Testing
 ///
 /// Bench testing of such networks is notoriously difficult, especially simulating limited radio 
@@ -165,6 +192,10 @@ public:
 	uint8_t      dest;      ///< Destination node address
 	uint8_t      next_hop;  ///< Send via this next hop address
 	uint8_t      state;     ///< State of this route, one of RouteState
+	unsigned long lastUsed; ///< millis() when this route was last added, updated or looked up
+	unsigned long learned;  ///< millis() when this route was last added or updated
+	uint8_t      hops;      ///< Number of hops to dest, or 0 if not known. Maintained by subclasses such as RHMesh
+	int16_t      seq;       ///< Sequence number of dest when this route was learned, or -1 if not known. Maintained by subclasses such as RHMesh
     } RoutingTableEntry;
 
     /// Constructor. 
@@ -185,15 +216,16 @@ public:
     void setMaxHops(uint8_t max_hops);
 
     /// Adds a route to the local routing table, or updates it if already present.
-    /// If there is not enough room the oldest (first) route will be deleted by calling retireOldestRoute().
+    /// If there is not enough room the least recently used route will be deleted by calling retireOldestRoute().
     /// \param [in] dest The destination node address. RH_BROADCAST_ADDRESS is permitted.
     /// \param [in] next_hop The address of the next hop to send messages destined for dest
     /// \param [in] state The satte of the route. Defaults to Valid
     void addRouteTo(uint8_t dest, uint8_t next_hop, uint8_t state = Valid);
 
-    /// Finds and returns a RoutingTableEntry for the given destination node
+    /// Finds and returns a RoutingTableEntry for the given destination node,
+    /// and marks it as recently used
     /// \param [in] dest The desired destination node address.
-    /// \return pointer to a RoutingTableEntry for dest
+    /// \return pointer to a RoutingTableEntry for dest, or NULL if there is no valid route
     RoutingTableEntry* getRouteTo(uint8_t dest);
 
     /// Deletes from the local routing table any route for the destination node.
@@ -201,7 +233,7 @@ public:
     /// \return true if the route was present
     bool deleteRouteTo(uint8_t dest);
 
-    /// Deletes the oldest (first) route from the 
+    /// Deletes the least recently used route from the 
     /// local routing table
     void retireOldestRoute();
 
@@ -209,7 +241,7 @@ public:
     /// local routing table
     void clearRoutingTable();
 
-    /// If RH_HAVE_SERIAL is defined, this will print out the contents of the local 
+    /// If RH_HAVE_SERIAL is defined, this will print out the valid and discovering entries in the local 
     /// routing table using Serial
     void printRoutingTable();
 
@@ -247,6 +279,23 @@ public:
     ///           (usually because it dod not acknowledge due to being off the air or out of range
     uint8_t sendtoFromSourceWait(uint8_t* buf, uint8_t len, uint8_t dest, uint8_t source, uint8_t flags = 0);
 
+    /// Sends a message to the destination node without waiting for an acknowledgement from the next hop.
+    /// Similar to sendtoWait() but uses RHReliableDatagram::sendtoAsync(), so the message
+    /// is retransmitted to the next hop by later calls to recvfromAck() or poll() until it is acknowledged
+    /// or the retries are exhausted.
+    /// \param [in] buf The application message data
+    /// \param [in] len Number of octets in the application message data. 0 is permitted
+    /// \param [in] dest The destination node address
+    /// \param [in] flags Optional flags for use by subclasses or application layer, 
+    ///             delivered end-to-end to the dest address. The receiver can recover the flags with recvFromAck().
+    /// \param [in] handle If present and not NULL, the referenced uint8_t will be set to a handle that can be 
+    ///             passed to sendState()
+    /// \return The result code:
+    ///         - RH_ROUTER_ERROR_NONE Message was sent to the next hop 
+    ///         - RH_ROUTER_ERROR_NO_ROUTE There was no route for dest in the local routing table
+    ///         - RH_ROUTER_ERROR_BUSY There is no room in the window for the message
+    uint8_t sendtoAsync(uint8_t* buf, uint8_t len, uint8_t dest, uint8_t flags = 0, uint8_t* handle = NULL);
+
     /// Starts the receiver if it is not running already.
     /// If there is a valid message available for this node (or RH_BROADCAST_ADDRESS), 
     /// send an acknowledgement to the last hop
@@ -269,6 +318,24 @@ public:
     /// \return true if a valid message was recvived for this node copied to buf
     bool recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* source = NULL, uint8_t* dest = NULL, uint8_t* id = NULL, uint8_t* flags = NULL);
 
+    /// Zero copy version of recvfromAck(). Routes messages for other nodes exactly like recvfromAck(),
+    /// but instead of copying a message for this node into a buffer, sets *buf to point to the
+    /// message (after the RHRouter header). If the driver supports RHGenericDriver::peek(), this is in
+    /// the driver's own receive buffer, otherwise in a buffer inside this RHRouter.
+    /// The message must be discarded with consume() when it is no longer needed, and before anything
+    /// else is sent or received.
+    /// \param[out] buf Set to the location of the message
+    /// \param[out] len Set to the length of the message
+    /// \param[in] source If present and not NULL, the referenced uint8_t will be set to the SOURCE address
+    /// \param[in] dest If present and not NULL, the referenced uint8_t will be set to the DEST address
+    /// \param[in] id If present and not NULL, the referenced uint8_t will be set to the ID
+    /// \param[in] flags If present and not NULL, the referenced uint8_t will be set to the FLAGS
+    /// \return true if a message for this node is available
+    bool peekfromAck(uint8_t** buf, uint8_t* len, uint8_t* source = NULL, uint8_t* dest = NULL, uint8_t* id = NULL, uint8_t* flags = NULL);
+
+    /// Discards the message returned by peekfromAck()
+    virtual void consume();
+
     /// Starts the receiver if it is not running already.
     /// Similar to recvfromAck(), this will block until either a valid message available for this node
     /// or the timeout expires. 
@@ -299,10 +366,54 @@ protected:
     /// \param [in] messageLen Length of message in octets
     virtual uint8_t route(RoutedMessage* message, uint8_t messageLen);
 
-    /// Deletes a specific rout entry from therouting table
+    /// Finds the next-hop route and sends the message via RHReliableDatagram::sendtoAsync(),
+    /// without waiting for the ACK from the next hop.
+    /// This is virtual, which lets subclasses override or intercept the routeAsync() function.
+    /// Called by sendtoAsync() and when forwarding messages to other nodes.
+    /// \param [in] message Pointer to the RHRouter message to be sent.
+    /// \param [in] messageLen Length of message in octets
+    /// \param [in] handle If not NULL, the referenced uint8_t will be set to the window handle
+    /// \return RH_ROUTER_ERROR_NONE, RH_ROUTER_ERROR_NO_ROUTE or RH_ROUTER_ERROR_BUSY
+    virtual uint8_t routeAsync(RoutedMessage* message, uint8_t messageLen, uint8_t* handle);
+
+    /// Called when a message sent by routeAsync() has been acknowledged by the next hop, or 
+    /// could not be delivered to the next hop. Subclasses may override to handle delivery failures.
+    /// The default does nothing.
+    /// \param [in] message Pointer to the RHRouter message that was sent.
+    /// \param [in] messageLen Length of message in octets
+    /// \param [in] delivered true if the next hop acknowledged the message
+    virtual void routeComplete(RoutedMessage* message, uint8_t messageLen, bool delivered);
+
+    /// Overrides RHReliableDatagram::sendComplete() to call routeComplete()
+    virtual void sendComplete(uint8_t handle, uint8_t address, bool acked);
+
+    /// Deletes a specific rout entry from therouting table, moving any following entries
+    /// that were displaced by it back towards their home positions
     /// \param [in] index The 0 based index of the routing table entry to delete
     void deleteRoute(uint8_t index);
 
+    /// Returns a routing table entry by index, without marking it as recently used.
+    /// The entry may be Invalid. Used by subclasses to inspect or age the whole table.
+    /// \param [in] index The 0 based index of the routing table entry
+    /// \return pointer to the RoutingTableEntry, or NULL if index is out of range
+    RoutingTableEntry* routeAt(uint16_t index);
+
+    /// Similar to sendtoFromSourceWait() above, but also spoofs the end-to-end message ID, 
+    /// so the ID set by the originating node is preserved when a message is relayed.
+    /// \param [in] buf The application message data.
+    /// \param [in] len Number of octets in the application message data. 0 is permitted.
+    /// \param [in] dest The destination node address.
+    /// \param [in] source The (fake) originating node address.
+    /// \param [in] flags Flags to be delivered end-to-end to the dest address.
+    /// \param [in] id The end-to-end message ID
+    /// \return The result code, as for sendtoWait()
+    uint8_t sendtoFromSourceWait(uint8_t* buf, uint8_t len, uint8_t dest, uint8_t source, uint8_t flags, uint8_t id);
+
+    /// Finds the index of the routing table entry for a destination
+    /// \param [in] dest The destination node address
+    /// \return The 0 based index of the entry for dest, or RH_ROUTING_TABLE_SIZE if there is none
+    uint16_t findRoute(uint8_t dest);
+
     /// The last end-to-end sequence number to be used
     /// Defaults to 0
     uint8_t _lastE2ESequenceNumber;
@@ -314,7 +425,10 @@ protected:
 private:
 
     /// Temporary mesage buffer
-    static RoutedMessage _tmpMessage;
+    RoutedMessage        _tmpMessage;
+
+    /// True if the message returned by peekfromAck() is still in the driver's buffer
+    bool                 _peeked;
 
     /// Local routing table
     RoutingTableEntry    _routes[RH_ROUTING_TABLE_SIZE];
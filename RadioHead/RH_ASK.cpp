@@ -491,22 +491,22 @@ bool RH_ASK::send(const uint8_t* data, uint8_t len)
     if (!waitCAD()) 
 	return false;  // Check channel activity
 
+    // The FCS covers the byte count, headers and user data
+    uint8_t headers[RH_ASK_HEADER_LEN + 1] = { count, _txHeaderTo, _txHeaderFrom, _txHeaderId, _txHeaderFlags };
+    crc = RHcrc_ccitt(headers, sizeof(headers), crc);
+    crc = RHcrc_ccitt(data, len, crc);
+
     // Encode the message length
-    crc = RHcrc_ccitt_update(crc, count);
     p[index++] = symbols[count >> 4];
     p[index++] = symbols[count & 0xf];
 
     // Encode the headers
-    crc = RHcrc_ccitt_update(crc, _txHeaderTo);
     p[index++] = symbols[_txHeaderTo >> 4];
     p[index++] = symbols[_txHeaderTo & 0xf];
-    crc = RHcrc_ccitt_update(crc, _txHeaderFrom);
     p[index++] = symbols[_txHeaderFrom >> 4];
     p[index++] = symbols[_txHeaderFrom & 0xf];
-    crc = RHcrc_ccitt_update(crc, _txHeaderId);
     p[index++] = symbols[_txHeaderId >> 4];
     p[index++] = symbols[_txHeaderId & 0xf];
-    crc = RHcrc_ccitt_update(crc, _txHeaderFlags);
     p[index++] = symbols[_txHeaderFlags >> 4];
     p[index++] = symbols[_txHeaderFlags & 0xf];
 
@@ -514,7 +514,6 @@ bool RH_ASK::send(const uint8_t* data, uint8_t len)
     // 2 6-bit symbols, high nybble first, low nybble second
     for (i = 0; i < len; i++)
     {
-	crc = RHcrc_ccitt_update(crc, data[i]);
 	p[index++] = symbols[data[i] >> 4];
 	p[index++] = symbols[data[i] & 0xf];
     }
@@ -705,10 +704,8 @@ uint8_t INTERRUPT_ATTR RH_ASK::symbol_6to4(uint8_t symbol)
 // since it is slow
 void RH_ASK::validateRxBuf()
 {
-    uint16_t crc = 0xffff;
     // The CRC covers the byte count, headers and user data
-    for (uint8_t i = 0; i < _rxBufLen; i++)
-	crc = RHcrc_ccitt_update(crc, _rxBuf[i]);
+    uint16_t crc = RHcrc_ccitt(_rxBuf, _rxBufLen, 0xffff);
     if (crc != 0xf0b8) // CRC when buffer and expected CRC are CRC'd
     {
 	// Reject and drop the message
@@ -165,10 +165,19 @@ void RH_CC110::handleInterrupt()
 
 	uint8_t raw_rssi = spiBurstReadRegister(RH_CC110_REG_34_RSSI); // Was set when sync word was detected
 	// Conversion of RSSI value to received power level in dBm per TI section 5.18.2
+	int16_t rssi;
 	if (raw_rssi >= 128) 
-	    _lastRssi = (((int16_t)raw_rssi - 256) / 2) - 74;
+	    rssi = (((int16_t)raw_rssi - 256) / 2) - 74;
 	else 
-	    _lastRssi = ((int16_t)raw_rssi / 2) - 74;
+	    rssi = ((int16_t)raw_rssi / 2) - 74;
+#if RH_CC110_RX_QUEUE_LEN > 0
+	// The RSSI goes with the message in the queue
+	RxQueue::Frame* frame = _rxQueue.writeSlot();
+	if (frame)
+	    frame->rssi = rssi;
+#else
+	_lastRssi = rssi;
+#endif
 
 	_bufLen = spiReadRegister(RH_CC110_REG_3F_FIFO);
 	if (_bufLen < 4)
@@ -181,8 +190,10 @@ void RH_CC110::handleInterrupt()
 	spiBurstRead(RH_CC110_REG_3F_FIFO | RH_CC110_SPI_BURST_MASK | RH_CC110_SPI_READ_MASK, _buf, _bufLen);
 	// All good so far. See if its for us
 	validateRxBuf(); 
+#if RH_CC110_RX_QUEUE_LEN == 0
 	if (_rxBufValid)
 	    setModeIdle(); // Done
+#endif
     }
 }
 
@@ -246,6 +257,74 @@ bool RH_CC110::printRegisters()
     return true;
 }
 
+#if RH_CC110_RX_QUEUE_LEN > 0
+// Check whether the latest received message is complete and for us, and if so queue it
+void RH_CC110::validateRxBuf()
+{
+    RxQueue::Frame* frame = _rxQueue.writeSlot();
+    if (   _bufLen >= RH_CC110_HEADER_LEN
+	&& (_promiscuous || _buf[0] == _thisAddress || _buf[0] == RH_BROADCAST_ADDRESS))
+    {
+	// Its for us
+	if (frame && _bufLen <= sizeof(frame->data))
+	{
+	    memcpy(frame->data, _buf, _bufLen);
+	    frame->len = _bufLen;
+	    _rxGood++;
+	    _rxQueue.push();
+	}
+	else
+	    _rxBad++; // Queue is full or message is too long, drop it
+    }
+    _bufLen = 0;
+}
+
+bool RH_CC110::available()
+{
+    if (_mode == RHModeTx)
+	return false;
+    setModeRx(); // Make sure we are receiving
+    if (!_rxBufValid)
+    {
+	RxQueue::Frame* frame = _rxQueue.front();
+	if (!frame)
+	    return false;
+	_rxHeaderTo    = frame->data[0];
+	_rxHeaderFrom  = frame->data[1];
+	_rxHeaderId    = frame->data[2];
+	_rxHeaderFlags = frame->data[3];
+	_lastRssi      = frame->rssi;
+	_rxBufValid = true;
+    }
+    return true;
+}
+
+// Only clears the partial message being received. Messages in the queue are kept until recv()
+void RH_CC110::clearRxBuf()
+{
+    ATOMIC_BLOCK_START;
+    _bufLen = 0;
+    ATOMIC_BLOCK_END;
+}
+
+bool RH_CC110::recv(uint8_t* buf, uint8_t* len)
+{
+    if (!available())
+	return false;
+
+    RxQueue::Frame* frame = _rxQueue.front();
+    if (buf && len)
+    {
+	// Skip the 4 headers that are at the beginning of the frame
+	if (*len > frame->len - RH_CC110_HEADER_LEN)
+	    *len = frame->len - RH_CC110_HEADER_LEN;
+	memcpy(buf, frame->data + RH_CC110_HEADER_LEN, *len);
+    }
+    _rxQueue.pop();
+    _rxBufValid = false;
+    return true;
+}
+#else
 // Check whether the latest received message is complete and uncorrupted
 void RH_CC110::validateRxBuf()
 {
@@ -301,6 +380,7 @@ bool RH_CC110::recv(uint8_t* buf, uint8_t* len)
 
     return true;
 }
+#endif
 
 bool RH_CC110::send(const uint8_t* data, uint8_t len)
 {
@@ -38,6 +38,24 @@
  #define RH_CC110_MAX_MESSAGE_LEN (RH_CC110_MAX_PAYLOAD_LEN - RH_CC110_HEADER_LEN - 1)
 #endif
 
+// Number of received messages that can be held by the driver until they are collected by recv().
+// 0 means a single buffer: the receiver is turned off as soon as a message is received,
+// and any other messages sent before recv() is called are missed.
+// Otherwise it must be a power of 2, and the receiver stays on to catch back to back messages
+// in an RHFrameQueue of RH_CC110_RX_QUEUE_LEN buffers, each with its own RSSI. Each buffer takes
+// about RH_CC110_MAX_MESSAGE_LEN + 8 octets of SRAM, so the default of 4 takes about 270 octets.
+// The default on AVR, where SRAM is scarce, is 0
+#ifndef RH_CC110_RX_QUEUE_LEN
+ #if defined(__AVR__)
+  #define RH_CC110_RX_QUEUE_LEN 0
+ #else
+  #define RH_CC110_RX_QUEUE_LEN 4
+ #endif
+#endif
+#if (RH_CC110_RX_QUEUE_LEN & (RH_CC110_RX_QUEUE_LEN - 1)) || RH_CC110_RX_QUEUE_LEN > 128
+ #error RH_CC110_RX_QUEUE_LEN must be 0 or a power of 2 up to 128
+#endif
+
 #define RH_CC110_SPI_READ_MASK  0x80
 #define RH_CC110_SPI_BURST_MASK 0x40
 
@@ -837,7 +855,7 @@ protected:
     uint8_t  spiBurstWriteRegister(uint8_t reg, const uint8_t* src, uint8_t len);
     
     /// Examine the receive buffer to determine whether the message is for this node
-    /// Sets _rxBufValid.
+    /// Sets _rxBufValid, or adds it to _rxQueue if RH_CC110_RX_QUEUE_LEN is not 0.
     void validateRxBuf();
 
     /// Clear our local receive buffer
@@ -877,7 +895,14 @@ private:
     /// The receiver/transmitter buffer
     uint8_t             _buf[RH_CC110_MAX_PAYLOAD_LEN];
 
-    /// True when there is a valid message in the buffer
+#if RH_CC110_RX_QUEUE_LEN > 0
+    /// Queue of received messages with their headers, each with its RSSI. Filled by the
+    /// interrupt handler from _buf and emptied by recv()
+    typedef RHFrameQueue<RH_CC110_RX_QUEUE_LEN, RH_CC110_HEADER_LEN + RH_CC110_MAX_MESSAGE_LEN> RxQueue;
+    RxQueue             _rxQueue;
+#endif
+
+    /// True when there is a valid message in the buffer (or at the front of _rxQueue)
     volatile bool       _rxBufValid;
 
     /// True if crystal oscillator is 26 MHz, not 26MHz.
@@ -210,7 +210,14 @@ void RH_MRF89::handleInterrupt()
 
 	// REVISIT: Capture last rssi from RSTSREG
 	// based roughly on Figure 3-9
+#if RH_MRF89_RX_QUEUE_LEN > 0
+	// The RSSI goes with the message in the queue
+	RxQueue::Frame* frame = _rxQueue.writeSlot();
+	if (frame)
+	    frame->rssi = (spiReadRegister(RH_MRF89_REG_14_RSTSREG) >> 1) - 120;
+#else
 	_lastRssi = (spiReadRegister(RH_MRF89_REG_14_RSTSREG) >> 1) - 120;
+#endif
 
 	_bufLen = spiReadData();
 	if (_bufLen < 4)
@@ -230,8 +237,10 @@ void RH_MRF89::handleInterrupt()
 
 	// All good. See if its for us
 	validateRxBuf(); 
+#if RH_MRF89_RX_QUEUE_LEN == 0
 	if (_rxBufValid)
 	    setModeIdle(); // Got one 
+#endif
     }
 }
 
@@ -360,6 +369,45 @@ void RH_MRF89::setTxPower(uint8_t power)
     spiWriteRegister(RH_MRF89_REG_1A_TXCONREG, txconreg);
 }
 
+#if RH_MRF89_RX_QUEUE_LEN > 0
+bool RH_MRF89::available()
+{
+    if (_mode == RHModeTx)
+	return false;
+    setModeRx();
+    if (!_rxBufValid)
+    {
+	RxQueue::Frame* frame = _rxQueue.front();
+	if (!frame)
+	    return false;
+	_rxHeaderTo    = frame->data[0];
+	_rxHeaderFrom  = frame->data[1];
+	_rxHeaderId    = frame->data[2];
+	_rxHeaderFlags = frame->data[3];
+	_lastRssi      = frame->rssi;
+	_rxBufValid = true;
+    }
+    return true;
+}
+
+bool RH_MRF89::recv(uint8_t* buf, uint8_t* len)
+{
+    if (!available())
+	return false;
+
+    RxQueue::Frame* frame = _rxQueue.front();
+    if (buf && len)
+    {
+	// Skip the 4 headers that are at the beginning of the frame
+	if (*len > frame->len - RH_MRF89_HEADER_LEN)
+	    *len = frame->len - RH_MRF89_HEADER_LEN;
+	memcpy(buf, frame->data + RH_MRF89_HEADER_LEN, *len);
+    }
+    _rxQueue.pop();
+    _rxBufValid = false;
+    return true;
+}
+#else
 bool RH_MRF89::available()
 {
     if (_mode == RHModeTx)
@@ -387,6 +435,7 @@ bool RH_MRF89::recv(uint8_t* buf, uint8_t* len)
 
     return true;
 }
+#endif
 
 bool RH_MRF89::send(const uint8_t* data, uint8_t len)
 {
@@ -417,6 +466,36 @@ uint8_t RH_MRF89::maxMessageLength()
     return RH_MRF89_MAX_MESSAGE_LEN;
 }
 
+#if RH_MRF89_RX_QUEUE_LEN > 0
+// Check whether the latest received message is complete and for us, and if so queue it
+void RH_MRF89::validateRxBuf()
+{
+    RxQueue::Frame* frame = _rxQueue.writeSlot();
+    if (   _bufLen >= RH_MRF89_HEADER_LEN
+	&& (_promiscuous || _buf[0] == _thisAddress || _buf[0] == RH_BROADCAST_ADDRESS))
+    {
+	// Its for us
+	if (frame && _bufLen <= sizeof(frame->data))
+	{
+	    memcpy(frame->data, _buf, _bufLen);
+	    frame->len = _bufLen;
+	    _rxGood++;
+	    _rxQueue.push();
+	}
+	else
+	    _rxBad++; // Queue is full or message is too long, drop it
+    }
+    _bufLen = 0;
+}
+
+// Only clears the partial message being received. Messages in the queue are kept until recv()
+void RH_MRF89::clearRxBuf()
+{
+    ATOMIC_BLOCK_START;
+    _bufLen = 0;
+    ATOMIC_BLOCK_END;
+}
+#else
 // Check whether the latest received message is complete and uncorrupted
 void RH_MRF89::validateRxBuf()
 {
@@ -443,6 +522,7 @@ void RH_MRF89::clearRxBuf()
     _bufLen = 0;
     ATOMIC_BLOCK_END;
 }
+#endif
 
 bool RH_MRF89::verifyPLLLock()
 {
@@ -37,6 +37,24 @@
  #define RH_MRF89_MAX_MESSAGE_LEN (RH_MRF89_MAX_PAYLOAD_LEN - RH_MRF89_HEADER_LEN)
 #endif
 
+// Number of received messages that can be held by the driver until they are collected by recv().
+// 0 means a single buffer: the receiver is turned off as soon as a message is received,
+// and any other messages sent before recv() is called are missed.
+// Otherwise it must be a power of 2, and the receiver stays on to catch back to back messages
+// in an RHFrameQueue of RH_MRF89_RX_QUEUE_LEN buffers, each with its own RSSI. Each buffer takes
+// about RH_MRF89_MAX_MESSAGE_LEN + 8 octets of SRAM, so the default of 4 takes about 270 octets.
+// The default on AVR, where SRAM is scarce, is 0
+#ifndef RH_MRF89_RX_QUEUE_LEN
+ #if defined(__AVR__)
+  #define RH_MRF89_RX_QUEUE_LEN 0
+ #else
+  #define RH_MRF89_RX_QUEUE_LEN 4
+ #endif
+#endif
+#if (RH_MRF89_RX_QUEUE_LEN & (RH_MRF89_RX_QUEUE_LEN - 1)) || RH_MRF89_RX_QUEUE_LEN > 128
+ #error RH_MRF89_RX_QUEUE_LEN must be 0 or a power of 2 up to 128
+#endif
+
 // Bits that must be set to do a SPI read
 #define RH_MRF89_SPI_READ_MASK              0x40
 
@@ -575,7 +593,8 @@ protected:
     /// This needs to be called if the frequency is changed
     bool    verifyPLLLock();
 
-    /// Examine the revceive buffer to determine whether the message is for this node
+    /// Examine the revceive buffer to determine whether the message is for this node.
+    /// Sets _rxBufValid, or adds it to _rxQueue if RH_MRF89_RX_QUEUE_LEN is not 0.
     void validateRxBuf();
 
     /// Clear our local receive buffer
@@ -617,7 +636,14 @@ private:
     /// The receiver/transmitter buffer
     uint8_t             _buf[RH_MRF89_MAX_PAYLOAD_LEN];
 
-    /// True when there is a valid message in the buffer
+#if RH_MRF89_RX_QUEUE_LEN > 0
+    /// Queue of received messages with their headers, each with its RSSI. Filled by the
+    /// interrupt handler from _buf and emptied by recv()
+    typedef RHFrameQueue<RH_MRF89_RX_QUEUE_LEN, RH_MRF89_HEADER_LEN + RH_MRF89_MAX_MESSAGE_LEN> RxQueue;
+    RxQueue             _rxQueue;
+#endif
+
+    /// True when there is a valid message in the buffer (or at the front of _rxQueue)
     volatile bool       _rxBufValid;
 
 };
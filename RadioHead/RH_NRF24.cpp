@@ -291,6 +291,74 @@ void RH_NRF24::validateRxBuf()
     }
 }
 
+#if RH_NRF24_RX_QUEUE_LEN > 0
+bool RH_NRF24::available()
+{
+    if (_mode == RHModeTx)
+	return false;
+    setModeRx();
+    // Move everything in the RX FIFO into the queue. Anything that does not fit
+    // stays in the RX FIFO until there is room
+    while (!(spiReadRegister(RH_NRF24_REG_17_FIFO_STATUS) & RH_NRF24_RX_EMPTY))
+    {
+	RxQueue::Frame* frame = _rxQueue.writeSlot();
+	if (!frame)
+	    break;
+	// Manual says that messages > 32 octets should be discarded
+	uint8_t len = spiRead(RH_NRF24_COMMAND_R_RX_PL_WID);
+	if (len > 32)
+	{
+	    flushRx();
+	    break;
+	}
+	// Clear read interrupt
+	spiWriteRegister(RH_NRF24_REG_07_STATUS, RH_NRF24_RX_DR);
+	spiBurstRead(RH_NRF24_COMMAND_R_RX_PAYLOAD, frame->data, len);
+	frame->len = len;
+	if (   len >= RH_NRF24_HEADER_LEN
+	    && (_promiscuous || frame->data[0] == _thisAddress || frame->data[0] == RH_BROADCAST_ADDRESS))
+	{
+	    _rxGood++;
+	    _rxQueue.push();
+	}
+    }
+    if (!_rxBufValid)
+    {
+	RxQueue::Frame* frame = _rxQueue.front();
+	if (!frame)
+	    return false;
+	_rxHeaderTo    = frame->data[0];
+	_rxHeaderFrom  = frame->data[1];
+	_rxHeaderId    = frame->data[2];
+	_rxHeaderFlags = frame->data[3];
+	_rxBufValid = true;
+    }
+    return true;
+}
+
+bool RH_NRF24::recv(uint8_t* buf, uint8_t* len)
+{
+    if (!available())
+	return false;
+    RxQueue::Frame* frame = _rxQueue.front();
+    if (buf && len)
+    {
+	// Skip the 4 headers that are at the beginning of the frame
+	if (*len > frame->len-RH_NRF24_HEADER_LEN)
+	    *len = frame->len-RH_NRF24_HEADER_LEN;
+	memcpy(buf, frame->data+RH_NRF24_HEADER_LEN, *len);
+    }
+    _rxQueue.pop();
+    _rxBufValid = false;
+    return true;
+}
+
+// Only clears the single buffer, which is used for transmitting. Messages in the queue are kept until recv()
+void RH_NRF24::clearRxBuf()
+{
+    _bufLen = 0;
+}
+#else
 bool RH_NRF24::available()
 {
     if (!_rxBufValid)
@@ -342,6 +410,7 @@ bool RH_NRF24::recv(uint8_t* buf, uint8_t* len)
     clearRxBuf(); // This message accepted and cleared
     return true;
 }
+#endif
 
 uint8_t RH_NRF24::maxMessageLength()
 {
@@ -22,6 +22,25 @@
 // the supported message lengths in the nRF24
 #define RH_NRF24_MAX_MESSAGE_LEN (RH_NRF24_MAX_PAYLOAD_LEN-RH_NRF24_HEADER_LEN)
 
+// Number of received messages that can be held by the driver until they are collected by recv(),
+// in addition to the 3 in the nRF24's own RX FIFO.
+// 0 means a single buffer: the receiver is turned off as soon as a message is received,
+// and any other messages sent before recv() is called are missed.
+// Otherwise it must be a power of 2, and the receiver stays on to catch back to back messages:
+// available() moves them from the RX FIFO into an RHFrameQueue of RH_NRF24_RX_QUEUE_LEN buffers.
+// Each buffer takes about RH_NRF24_MAX_PAYLOAD_LEN + 4 octets of SRAM, so the default of 4 takes about
+// 150 octets. The default on AVR, where SRAM is scarce, is 0
+#ifndef RH_NRF24_RX_QUEUE_LEN
+ #if defined(__AVR__)
+  #define RH_NRF24_RX_QUEUE_LEN 0
+ #else
+  #define RH_NRF24_RX_QUEUE_LEN 4
+ #endif
+#endif
+#if (RH_NRF24_RX_QUEUE_LEN & (RH_NRF24_RX_QUEUE_LEN - 1)) || RH_NRF24_RX_QUEUE_LEN > 128
+ #error RH_NRF24_RX_QUEUE_LEN must be 0 or a power of 2 up to 128
+#endif
+
 // SPI Command names
 #define RH_NRF24_COMMAND_R_REGISTER                        0x00
 #define RH_NRF24_COMMAND_W_REGISTER                        0x20
@@ -626,7 +645,14 @@ private:
     /// The receiver/transmitter buffer
     uint8_t             _buf[RH_NRF24_MAX_PAYLOAD_LEN];
 
-    /// True when there is a valid message in the buffer
+#if RH_NRF24_RX_QUEUE_LEN > 0
+    /// Queue of received messages with their headers. Filled from the RX FIFO
+    /// by available() and emptied by recv()
+    typedef RHFrameQueue<RH_NRF24_RX_QUEUE_LEN, RH_NRF24_MAX_PAYLOAD_LEN> RxQueue;
+    RxQueue             _rxQueue;
+#endif
+
+    /// True when there is a valid message in the buffer (or at the front of _rxQueue)
     bool                _rxBufValid;
 };
 
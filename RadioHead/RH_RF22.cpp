@@ -272,6 +272,26 @@ void RH_RF22::handleInterrupt()
 	}
 
 	spiBurstRead(RH_RF22_REG_7F_FIFO_ACCESS, _buf + _bufLen, len - _bufLen);
+#if RH_RF22_RX_QUEUE_LEN > 0
+	// Queue it with its headers, and keep receiving
+	RxQueue::Frame* frame = _rxQueue.writeSlot();
+	if (frame)
+	{
+	    frame->data[0] = spiRead(RH_RF22_REG_47_RECEIVED_HEADER3);
+	    frame->data[1] = spiRead(RH_RF22_REG_48_RECEIVED_HEADER2);
+	    frame->data[2] = spiRead(RH_RF22_REG_49_RECEIVED_HEADER1);
+	    frame->data[3] = spiRead(RH_RF22_REG_4A_RECEIVED_HEADER0);
+	    memcpy(frame->data + RH_RF22_HEADER_LEN, _buf, len);
+	    frame->len = RH_RF22_HEADER_LEN + len;
+	    _rxGood++;
+	    _rxQueue.push();
+	}
+	else
+	    _rxBad++; // Queue is full, drop it
+	clearRxBuf();
+	_mode = RHModeIdle;
+	setModeRx();
+#else
 	_rxHeaderTo = spiRead(RH_RF22_REG_47_RECEIVED_HEADER3);
 	_rxHeaderFrom = spiRead(RH_RF22_REG_48_RECEIVED_HEADER2);
 	_rxHeaderId = spiRead(RH_RF22_REG_49_RECEIVED_HEADER1);
@@ -280,6 +300,7 @@ void RH_RF22::handleInterrupt()
 	_bufLen = len;
 	_mode = RHModeIdle;
 	_rxBufValid = true;
+#endif
     }
     if (_lastInterruptFlags[0] & RH_RF22_ICRCERROR)
     {
@@ -293,7 +314,14 @@ void RH_RF22::handleInterrupt()
     if (_lastInterruptFlags[1] & RH_RF22_IPREAVAL)
     {
 //	Serial.println("IPREAVAL");  
+#if RH_RF22_RX_QUEUE_LEN > 0
+	// The RSSI goes with the message in the queue
+	RxQueue::Frame* frame = _rxQueue.writeSlot();
+	if (frame)
+	    frame->rssi = (int8_t)(-120 + ((spiRead(RH_RF22_REG_26_RSSI) / 2)));
+#else
 	_lastRssi = (int8_t)(-120 + ((spiRead(RH_RF22_REG_26_RSSI) / 2)));
+#endif
 	_lastPreambleTime = millis();
 	resetRxFifo();
 	clearRxBuf();
@@ -527,6 +555,52 @@ void RH_RF22::setSyncWords(const uint8_t* syncWords, uint8_t len)
     spiBurstWrite(RH_RF22_REG_36_SYNC_WORD3, syncWords, len);
 }
 
+#if RH_RF22_RX_QUEUE_LEN > 0
+// Only clears the partial message being received. Messages in the queue are kept until recv()
+void RH_RF22::clearRxBuf()
+{
+    ATOMIC_BLOCK_START;
+    _bufLen = 0;
+    ATOMIC_BLOCK_END;
+}
+
+bool RH_RF22::available()
+{
+    if (_mode == RHModeTx)
+	return false;
+    setModeRx(); // Make sure we are receiving
+    if (!_rxBufValid)
+    {
+	RxQueue::Frame* frame = _rxQueue.front();
+	if (!frame)
+	    return false;
+	_rxHeaderTo    = frame->data[0];
+	_rxHeaderFrom  = frame->data[1];
+	_rxHeaderId    = frame->data[2];
+	_rxHeaderFlags = frame->data[3];
+	_lastRssi      = frame->rssi;
+	_rxBufValid = true;
+    }
+    return true;
+}
+
+bool RH_RF22::recv(uint8_t* buf, uint8_t* len)
+{
+    if (!available())
+	return false;
+
+    RxQueue::Frame* frame = _rxQueue.front();
+    if (buf && len)
+    {
+	if (*len > frame->len - RH_RF22_HEADER_LEN)
+	    *len = frame->len - RH_RF22_HEADER_LEN;
+	memcpy(buf, frame->data + RH_RF22_HEADER_LEN, *len);
+    }
+    _rxQueue.pop();
+    _rxBufValid = false;
+    return true;
+}
+#else
 void RH_RF22::clearRxBuf()
 {
     ATOMIC_BLOCK_START;
@@ -563,6 +637,7 @@ bool RH_RF22::recv(uint8_t* buf, uint8_t* len)
 //    printBuffer("recv:", buf, *len);
     return true;
 }
+#endif
 
 void RH_RF22::clearTxBuf()
 {
@@ -670,7 +745,9 @@ void RH_RF22::resetRxFifo()
 {
     spiWrite(RH_RF22_REG_08_OPERATING_MODE2, RH_RF22_FFCLRRX);
     spiWrite(RH_RF22_REG_08_OPERATING_MODE2, 0);
+#if RH_RF22_RX_QUEUE_LEN == 0
     _rxBufValid = false;
+#endif
 }
 
 // CLear the TX FIFO
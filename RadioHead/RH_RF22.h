@@ -28,6 +28,31 @@
 #define RH_RF22_MAX_MESSAGE_LEN 50
 #endif
 
+// The length of the headers we add.
+// The headers are sent and received in the RF22's own header registers, not in the payload
+#define RH_RF22_HEADER_LEN 4
+
+// Number of received messages that can be held by the driver until they are collected by recv().
+// 0 means a single buffer: the receiver is turned off as soon as a message is received,
+// and any other messages sent before recv() is called are missed.
+// Otherwise it must be a power of 2, and the receiver stays on to catch back to back messages
+// in an RHFrameQueue of RH_RF22_RX_QUEUE_LEN buffers, each with its own RSSI. Each buffer takes
+// about RH_RF22_MAX_MESSAGE_LEN + 8 octets of SRAM, so the default of 4 takes about 230 octets.
+// The default on AVR, where SRAM is scarce, is 0
+#ifndef RH_RF22_RX_QUEUE_LEN
+ #if defined(__AVR__)
+  #define RH_RF22_RX_QUEUE_LEN 0
+ #else
+  #define RH_RF22_RX_QUEUE_LEN 4
+ #endif
+#endif
+#if (RH_RF22_RX_QUEUE_LEN & (RH_RF22_RX_QUEUE_LEN - 1)) || RH_RF22_RX_QUEUE_LEN > 128
+ #error RH_RF22_RX_QUEUE_LEN must be 0 or a power of 2 up to 128
+#endif
+#if RH_RF22_RX_QUEUE_LEN > 0 && RH_RF22_MAX_MESSAGE_LEN > 251
+ #error RH_RF22_MAX_MESSAGE_LEN must be 251 or less when RH_RF22_RX_QUEUE_LEN is not 0
+#endif
+
 // Max number of octets the RF22 Rx and Tx FIFOs can hold
 #define RH_RF22_FIFO_SIZE 64
 
@@ -1305,7 +1330,14 @@ protected:
     /// The receiver buffer
     uint8_t             _buf[RH_RF22_MAX_MESSAGE_LEN];
 
-    /// True when there is a valid message in the Rx buffer
+#if RH_RF22_RX_QUEUE_LEN > 0
+    /// Queue of received messages with their headers, each with its RSSI. Filled by the
+    /// interrupt handler from _buf and emptied by recv()
+    typedef RHFrameQueue<RH_RF22_RX_QUEUE_LEN, RH_RF22_HEADER_LEN + RH_RF22_MAX_MESSAGE_LEN> RxQueue;
+    RxQueue             _rxQueue;
+#endif
+
+    /// True when there is a valid message in the Rx buffer (or at the front of _rxQueue)
     volatile bool       _rxBufValid;
 
     /// Index into TX buffer of the next to send chunk
@@ -205,7 +205,14 @@ void RH_RF24::handleInterrupt()
 	    // Get the RSSI, configured to latch at sync detect in radio_config
 	    uint8_t modem_status[6];
 	    command(RH_RF24_CMD_GET_MODEM_STATUS, NULL, 0, modem_status, sizeof(modem_status));
+#if RH_RF24_RX_QUEUE_LEN > 0
+	    // The RSSI goes with the message in the queue
+	    RxQueue::Frame* frame = _rxQueue.writeSlot();
+	    if (frame)
+		frame->rssi = modem_status[3];
+#else
 	    _lastRssi = modem_status[3];
+#endif
 	    _lastPreambleTime = millis();
 	    
 	    // Save it in our buffer
@@ -214,6 +221,10 @@ void RH_RF24::handleInterrupt()
 	    validateRxBuf();
 	    // Radio will have transitioned automatically to the _idleMode
 	    _mode = RHModeIdle;
+#if RH_RF24_RX_QUEUE_LEN > 0
+	    // Keep receiving while the message waits in the queue
+	    setModeRx();
+#endif
 	}
 	if (status[2] & RH_RF24_INT_STATUS_TX_FIFO_ALMOST_EMPTY)
 	{
@@ -228,6 +239,28 @@ void RH_RF24::handleInterrupt()
     }
 }
 
+#if RH_RF24_RX_QUEUE_LEN > 0
+// Check whether the latest received message is complete and for us, and if so queue it
+void RH_RF24::validateRxBuf()
+{
+    RxQueue::Frame* frame = _rxQueue.writeSlot();
+    if (   _bufLen >= RH_RF24_HEADER_LEN
+	&& (_promiscuous || _buf[0] == _thisAddress || _buf[0] == RH_BROADCAST_ADDRESS))
+    {
+	// Its for us
+	if (frame && _bufLen <= sizeof(frame->data))
+	{
+	    memcpy(frame->data, _buf, _bufLen);
+	    frame->len = _bufLen;
+	    _rxGood++;
+	    _rxQueue.push();
+	}
+	else
+	    _rxBad++; // Queue is full or message is too long, drop it
+    }
+    clearBuffer();
+}
+#else
 // Check whether the latest received message is complete and uncorrupted
 void RH_RF24::validateRxBuf()
 {
@@ -248,6 +281,7 @@ void RH_RF24::validateRxBuf()
 	}
     }
 }
+#endif
 
 bool RH_RF24::clearRxFifo()
 {
@@ -259,7 +293,9 @@ void RH_RF24::clearBuffer()
 {
     _bufLen = 0;
     _txBufSentIndex = 0;
+#if RH_RF24_RX_QUEUE_LEN == 0
     _rxBufValid = false;
+#endif
 }
 
 // These are low level functions that call the interrupt handler for the correct
@@ -281,6 +317,44 @@ void RH_RF24::isr2()
 	_deviceForInterrupt[2]->handleInterrupt();
 }
 
+#if RH_RF24_RX_QUEUE_LEN > 0
+bool RH_RF24::available()
+{
+    if (_mode == RHModeTx)
+	return false;
+    setModeRx(); // Make sure we are receiving
+    if (!_rxBufValid)
+    {
+	RxQueue::Frame* frame = _rxQueue.front();
+	if (!frame)
+	    return false;
+	_rxHeaderTo    = frame->data[0];
+	_rxHeaderFrom  = frame->data[1];
+	_rxHeaderId    = frame->data[2];
+	_rxHeaderFlags = frame->data[3];
+	_lastRssi      = frame->rssi;
+	_rxBufValid = true;
+    }
+    return true;
+}
+
+bool RH_RF24::recv(uint8_t* buf, uint8_t* len)
+{
+    if (!available())
+	return false;
+
+    RxQueue::Frame* frame = _rxQueue.front();
+    if (buf && len)
+    {
+	if (*len > frame->len - RH_RF24_HEADER_LEN)
+	    *len = frame->len - RH_RF24_HEADER_LEN;
+	memcpy(buf, frame->data + RH_RF24_HEADER_LEN, *len);
+    }
+    _rxQueue.pop();
+    _rxBufValid = false;
+    return true;
+}
+#else
 bool RH_RF24::available()
 {
     if (_mode == RHModeTx)
@@ -306,6 +380,7 @@ bool RH_RF24::recv(uint8_t* buf, uint8_t* len)
     clearBuffer(); // Got the most recent message
     return true;
 }
+#endif
 
 bool RH_RF24::send(const uint8_t* data, uint8_t len)
 {
@@ -42,6 +42,25 @@
 #define RH_RF24_MAX_MESSAGE_LEN (RH_RF24_MAX_PAYLOAD_LEN - RH_RF24_HEADER_LEN - 1)
 #endif
 
+// Number of received messages that can be held by the driver until they are collected by recv().
+// 0 means a single buffer: the receiver is turned off as soon as a message is received,
+// and any other messages sent before recv() is called are missed.
+// Otherwise it must be a power of 2, and the receiver stays on to catch back to back messages
+// in an RHFrameQueue of RH_RF24_RX_QUEUE_LEN buffers, each with its own RSSI. Each buffer takes
+// about RH_RF24_MAX_MESSAGE_LEN + 8 octets of SRAM, so the default of 4 takes about 1030 octets.
+// Define a smaller RH_RF24_MAX_MESSAGE_LEN to reduce it.
+// The default on AVR, where SRAM is scarce, is 0
+#ifndef RH_RF24_RX_QUEUE_LEN
+ #if defined(__AVR__)
+  #define RH_RF24_RX_QUEUE_LEN 0
+ #else
+  #define RH_RF24_RX_QUEUE_LEN 4
+ #endif
+#endif
+#if (RH_RF24_RX_QUEUE_LEN & (RH_RF24_RX_QUEUE_LEN - 1)) || RH_RF24_RX_QUEUE_LEN > 128
+ #error RH_RF24_RX_QUEUE_LEN must be 0 or a power of 2 up to 128
+#endif
+
 // Max number of times we will try to read CTS from the radio
 #define RH_RF24_CTS_RETRIES 2500
 
@@ -1087,7 +1106,7 @@ protected:
 
     /// Checks the contents of the RX buffer.
     /// If it contans a valid message adressed to this node
-    /// sets _rxBufValid.
+    /// sets _rxBufValid, or adds it to _rxQueue if RH_RF24_RX_QUEUE_LEN is not 0.
     void           validateRxBuf();
 
     /// Cycles the Shutdown pin to force the cradio chip to reset
@@ -1144,7 +1163,14 @@ private:
     /// Array of octets of the last received message or the next to transmit message
     uint8_t             _buf[RH_RF24_MAX_PAYLOAD_LEN];
 
-    /// True when there is a valid message in the Rx buffer
+#if RH_RF24_RX_QUEUE_LEN > 0
+    /// Queue of received messages with their headers, each with its RSSI. Filled by the
+    /// interrupt handler from _buf and emptied by recv()
+    typedef RHFrameQueue<RH_RF24_RX_QUEUE_LEN, RH_RF24_HEADER_LEN + RH_RF24_MAX_MESSAGE_LEN> RxQueue;
+    RxQueue             _rxQueue;
+#endif
+
+    /// True when there is a valid message in the Rx buffer (or at the front of _rxQueue)
     volatile bool       _rxBufValid;
 
     /// Index into TX buffer of the next to send chunk
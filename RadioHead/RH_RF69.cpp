@@ -210,7 +210,26 @@ void RH_RF69::handleInterrupt()
     }
     // Must look for PAYLOADREADY, not CRCOK, since only PAYLOADREADY occurs _after_ AES decryption
     // has been done
+#if RH_RF69_RX_QUEUE_LEN > 0
     if (_mode == RHModeRx && (irqflags2 & RH_RF69_IRQFLAGS2_PAYLOADREADY))
+    {
+	// A complete message has been received with good CRC. Queue it, and keep receiving
+	RxQueue::Frame* frame = _rxQueue.writeSlot();
+	if (frame)
+	    frame->rssi = -((int8_t)(spiRead(RH_RF69_REG_24_RSSIVALUE) >> 1));
+	_lastPreambleTime = millis();
+
+	setModeIdle();
+	readFifo();
+	setModeRx(); // Clears FIFO
+    }
+#else
+    if (_mode == RHModeRx && (irqflags2 & RH_RF69_IRQFLAGS2_PAYLOADREADY) && _rxBufValid)
+    {
+	// The last message has not been collected, and may be held by peek(). Drop this one
+	setModeIdle(); // Clears FIFO
+    }
+    else if (_mode == RHModeRx && (irqflags2 & RH_RF69_IRQFLAGS2_PAYLOADREADY))
     {
 	// A complete message has been received with good CRC
 	_lastRssi = -((int8_t)(spiRead(RH_RF69_REG_24_RSSIVALUE) >> 1));
@@ -221,6 +240,7 @@ void RH_RF69::handleInterrupt()
 	readFifo();
 //	Serial.println("PAYLOADREADY");
     }
+#endif
 }
 
 // Low level function reads the FIFO and checks the address
@@ -234,6 +254,30 @@ void RH_RF69::readFifo()
     _spi.beginTransaction();
     _spi.transfer(RH_RF69_REG_00_FIFO); // Send the start address with the write mask off
     uint8_t payloadlen = _spi.transfer(0); // First byte is payload len (counting the headers)
+#if RH_RF69_RX_QUEUE_LEN > 0
+    // The interrupt handler has already put the RSSI in this frame
+    RxQueue::Frame* frame = _rxQueue.writeSlot();
+    if (!frame)
+    {
+	_rxBad++; // Queue is full. Drop it
+    }
+    else if (payloadlen <= RH_RF69_HEADER_LEN + RH_RF69_MAX_MESSAGE_LEN &&
+	     payloadlen >= RH_RF69_HEADER_LEN)
+    {
+	frame->data[0] = _spi.transfer(0);
+	// Check addressing
+	if (_promiscuous ||
+	    frame->data[0] == _thisAddress ||
+	    frame->data[0] == RH_BROADCAST_ADDRESS)
+	{
+	    // Get the rest of the headers and the payload
+	    for (frame->len = 1; frame->len < payloadlen; frame->len++)
+		frame->data[frame->len] = _spi.transfer(0);
+	    _rxGood++;
+	    _rxQueue.push();
+	}
+    }
+#else
     if (payloadlen <= RH_RF69_MAX_ENCRYPTABLE_PAYLOAD_LEN &&
 	payloadlen >= RH_RF69_HEADER_LEN)
     {
@@ -254,6 +298,7 @@ void RH_RF69::readFifo()
 	    _rxBufValid = true;
 	}
     }
+#endif
     digitalWrite(_slaveSelectPin, HIGH);
     _spi.endTransaction();
     ATOMIC_BLOCK_END;
@@ -484,11 +529,72 @@ void RH_RF69::setEncryptionKey(uint8_t* key)
     }
 }
 
+#if RH_RF69_RX_QUEUE_LEN > 0
+bool RH_RF69::available()
+{
+    if (_mode == RHModeTx)
+	return false;
+    setModeRx(); // The receiver stays on while messages wait in the queue
+    if (!_rxBufValid)
+    {
+	// The interrupt handler has already checked the address. Make the oldest message the current one
+	RxQueue::Frame* frame = _rxQueue.front();
+	if (frame)
+	{
+	    _rxHeaderTo    = frame->data[0];
+	    _rxHeaderFrom  = frame->data[1];
+	    _rxHeaderId    = frame->data[2];
+	    _rxHeaderFlags = frame->data[3];
+	    _lastRssi      = frame->rssi;
+	    _rxBufValid = true;
+	}
+    }
+    return _rxBufValid;
+}
+
+bool RH_RF69::recv(uint8_t* buf, uint8_t* len)
+{
+    if (!available())
+	return false;
+
+    if (buf && len)
+    {
+	// The interrupt handler does not touch this frame until it is popped, so no need to lock
+	RxQueue::Frame* frame = _rxQueue.front();
+	if (*len > frame->len - RH_RF69_HEADER_LEN)
+	    *len = frame->len - RH_RF69_HEADER_LEN;
+	memcpy(buf, frame->data + RH_RF69_HEADER_LEN, *len);
+    }
+    consume(); // Got the oldest message
+    return true;
+}
+
+bool RH_RF69::peek(uint8_t** buf, uint8_t* len)
+{
+    if (!available())
+	return false;
+    // The interrupt handler does not touch this frame until consume()
+    RxQueue::Frame* frame = _rxQueue.front();
+    *buf = frame->data + RH_RF69_HEADER_LEN;
+    *len = frame->len - RH_RF69_HEADER_LEN;
+    return true;
+}
+
+void RH_RF69::consume()
+{
+    if (_rxBufValid)
+	_rxQueue.pop();
+    _rxBufValid = false;
+}
+
+#else
 bool RH_RF69::available()
 {
     if (_mode == RHModeTx)
 	return false;
-    setModeRx(); // Make sure we are receiving
+    // Make sure we are receiving, unless there is a message that has not been collected yet
+    if (!_rxBufValid)
+	setModeRx();
     return _rxBufValid;
 }
 
@@ -510,6 +616,22 @@ bool RH_RF69::recv(uint8_t* buf, uint8_t* len)
     return true;
 }
 
+bool RH_RF69::peek(uint8_t** buf, uint8_t* len)
+{
+    if (!available())
+	return false;
+    // available() leaves the receiver idle and the interrupt handler leaves _buf alone until consume()
+    *buf = _buf;
+    *len = _bufLen;
+    return true;
+}
+
+void RH_RF69::consume()
+{
+    _rxBufValid = false;
+}
+#endif
+
 bool RH_RF69::send(const uint8_t* data, uint8_t len)
 {
     if (len > RH_RF69_MAX_MESSAGE_LEN)
@@ -45,6 +45,24 @@
 #define RH_RF69_MAX_MESSAGE_LEN (RH_RF69_MAX_ENCRYPTABLE_PAYLOAD_LEN - RH_RF69_HEADER_LEN)
 #endif
 
+// Number of received messages that can be held by the driver until they are collected by recv().
+// 0 means a single buffer: the receiver is turned off as soon as a message is received,
+// and any other messages sent before recv() is called are missed.
+// Otherwise it must be a power of 2, and the receiver stays on to catch back to back messages
+// in an RHFrameQueue of RH_RF69_RX_QUEUE_LEN buffers, each with its own RSSI. Each buffer takes
+// about RH_RF69_MAX_MESSAGE_LEN + 8 octets of SRAM, so the default of 4 takes about 270 octets.
+// The default on AVR, where SRAM is scarce, is 0
+#ifndef RH_RF69_RX_QUEUE_LEN
+ #if defined(__AVR__)
+  #define RH_RF69_RX_QUEUE_LEN 0
+ #else
+  #define RH_RF69_RX_QUEUE_LEN 4
+ #endif
+#endif
+#if (RH_RF69_RX_QUEUE_LEN & (RH_RF69_RX_QUEUE_LEN - 1)) || RH_RF69_RX_QUEUE_LEN > 128
+ #error RH_RF69_RX_QUEUE_LEN must be 0 or a power of 2 up to 128
+#endif
+
 // Keep track of the mode the RF69 is in
 #define RH_RF69_MODE_IDLE         0
 #define RH_RF69_MODE_RX           1
@@ -846,6 +864,17 @@ public:
     /// \return true if a valid message was copied to buf
     bool        recv(uint8_t* buf, uint8_t* len);
 
+    /// Zero copy receive. If there is a valid message available, sets *buf to point to it
+    /// in the driver's receive buffer without copying it, until consume() is called.
+    /// See RHGenericDriver::peek()
+    /// \param[out] buf Set to the location of the message
+    /// \param[out] len Set to the length of the message
+    /// \return true if a valid message is available
+    bool        peek(uint8_t** buf, uint8_t* len);
+
+    /// Discards the message returned by peek()
+    void        consume();
+
     /// Waits until any previous transmit packet is finished being transmitted with waitPacketSent().
     /// Then loads a message into the transmitter and starts the transmitter. Note that a message length
     /// of 0 is NOT permitted. 
@@ -965,13 +994,20 @@ protected:
     /// The selected output power in dBm
     int8_t              _power;
 
+#if RH_RF69_RX_QUEUE_LEN > 0
+    /// Queue of received messages, each with its RSSI. Filled by the interrupt handler
+    /// and emptied by recv()
+    typedef RHFrameQueue<RH_RF69_RX_QUEUE_LEN, RH_RF69_HEADER_LEN + RH_RF69_MAX_MESSAGE_LEN> RxQueue;
+    RxQueue             _rxQueue;
+#else
     /// The message length in _buf
     volatile uint8_t    _bufLen;
 
     /// Array of octets of teh last received message or the next to transmit message
     uint8_t             _buf[RH_RF69_MAX_MESSAGE_LEN];
+#endif
 
-    /// True when there is a valid message in the Rx buffer
+    /// True when there is a valid message in the Rx buffer (or at the front of _rxQueue)
     volatile bool    _rxBufValid;
 
     /// Time in millis since the last preamble was received (and the last time the RSSI was measured)
@@ -134,34 +134,57 @@ void RH_RF95::handleInterrupt()
 	// Have received a packet
 	uint8_t len = spiRead(RH_RF95_REG_13_RX_NB_BYTES);
 
-	// Reset the fifo read ptr to the beginning of the packet
-	spiWrite(RH_RF95_REG_0D_FIFO_ADDR_PTR, spiRead(RH_RF95_REG_10_FIFO_RX_CURRENT_ADDR));
-	spiBurstRead(RH_RF95_REG_00_FIFO, _buf, len);
-	_bufLen = len;
-	spiWrite(RH_RF95_REG_12_IRQ_FLAGS, 0xff); // Clear all IRQ flags
-
-	// Remember the last signal to noise ratio, LORA mode
-	// Per page 111, SX1276/77/78/79 datasheet
-	_lastSNR = (int8_t)spiRead(RH_RF95_REG_19_PKT_SNR_VALUE) / 4;
-
-	// Remember the RSSI of this packet, LORA mode
-	// this is according to the doc, but is it really correct?
-	// weakest receiveable signals are reported RSSI at about -66
-	_lastRssi = spiRead(RH_RF95_REG_1A_PKT_RSSI_VALUE);
-	// Adjust the RSSI, datasheet page 87
-	if (_lastSNR < 0)
-	    _lastRssi = _lastRssi + _lastSNR;
+#if RH_RF95_RX_RING_LEN > 0
+	RxRing::Frame* frame = _rxRing.writeSlot();
+	if (   !frame
+	    || len < RH_RF95_HEADER_LEN
+#if (RH_RF95_HEADER_LEN + RH_RF95_MAX_MESSAGE_LEN) < RH_RF95_MAX_PAYLOAD_LEN
+	    || len > sizeof(frame->data)
+#endif
+	    )
+	{
+	    _rxBad++; // Ring is full, or bad length. Drop it
+	}
 	else
-	    _lastRssi = (int)_lastRssi * 16 / 15;
-	if (_usingHFport)
-	    _lastRssi -= 157;
+	{
+	    // Reset the fifo read ptr to the beginning of the packet
+	    spiWrite(RH_RF95_REG_0D_FIFO_ADDR_PTR, spiRead(RH_RF95_REG_10_FIFO_RX_CURRENT_ADDR));
+	    spiBurstRead(RH_RF95_REG_00_FIFO, frame->data, len);
+	    frame->len = len;
+	    readPacketSignal(&frame->rssi, &frame->snr);
+	    if (_promiscuous ||
+		frame->data[0] == _thisAddress ||
+		frame->data[0] == RH_BROADCAST_ADDRESS)
+	    {
+		_rxGood++;
+		_rxRing.push();
+	    }
+	}
+	// Stay in RX mode to catch the next one
+#else
+	if (_rxBufValid)
+	{
+	    // The last message has not been collected, and may be held by peek(). Drop this one
+	    setModeIdle();
+	}
 	else
-	    _lastRssi -= 164;
+	{
+	    // Reset the fifo read ptr to the beginning of the packet
+	    spiWrite(RH_RF95_REG_0D_FIFO_ADDR_PTR, spiRead(RH_RF95_REG_10_FIFO_RX_CURRENT_ADDR));
+	    spiBurstRead(RH_RF95_REG_00_FIFO, _buf, len);
+	    _bufLen = len;
+	    spiWrite(RH_RF95_REG_12_IRQ_FLAGS, 0xff); // Clear all IRQ flags
+
+	    int16_t rssi;
+	    readPacketSignal(&rssi, &_lastSNR);
+	    _lastRssi = rssi;
 	    
-	// We have received a message.
-	validateRxBuf(); 
-	if (_rxBufValid)
-	    setModeIdle(); // Got one 
+	    // We have received a message.
+	    validateRxBuf(); 
+	    if (_rxBufValid)
+		setModeIdle(); // Got one 
+	}
+#endif
     }
     else if (_mode == RHModeTx && irq_flags & RH_RF95_TX_DONE)
     {
@@ -179,6 +202,27 @@ void RH_RF95::handleInterrupt()
     spiWrite(RH_RF95_REG_12_IRQ_FLAGS, 0xff); // Clear all IRQ flags
 }
 
+void RH_RF95::readPacketSignal(int16_t* rssi, int8_t* snr)
+{
+    // Remember the last signal to noise ratio, LORA mode
+    // Per page 111, SX1276/77/78/79 datasheet
+    *snr = (int8_t)spiRead(RH_RF95_REG_19_PKT_SNR_VALUE) / 4;
+
+    // Remember the RSSI of this packet, LORA mode
+    // this is according to the doc, but is it really correct?
+    // weakest receiveable signals are reported RSSI at about -66
+    *rssi = spiRead(RH_RF95_REG_1A_PKT_RSSI_VALUE);
+    // Adjust the RSSI, datasheet page 87
+    if (*snr < 0)
+	*rssi = *rssi + *snr;
+    else
+	*rssi = (int)*rssi * 16 / 15;
+    if (_usingHFport)
+	*rssi -= 157;
+    else
+	*rssi -= 164;
+}
+
 // These are low level functions that call the interrupt handler for the correct
 // instance of RH_RF95.
 // 3 interrupts allows us to have 3 different devices
@@ -198,6 +242,70 @@ void RH_RF95::isr2()
 	_deviceForInterrupt[2]->handleInterrupt();
 }
 
+#if RH_RF95_RX_RING_LEN > 0
+// The interrupt handler has already checked the address of every message in the ring.
+// Make the oldest one the current message
+void RH_RF95::validateRxBuf()
+{
+    if (_rxBufValid)
+	return;
+    RxRing::Frame* frame = _rxRing.front();
+    if (!frame)
+	return;
+    _rxHeaderTo    = frame->data[0];
+    _rxHeaderFrom  = frame->data[1];
+    _rxHeaderId    = frame->data[2];
+    _rxHeaderFlags = frame->data[3];
+    _lastRssi      = frame->rssi;
+    _lastSNR       = frame->snr;
+    _rxBufValid = true;
+}
+
+bool RH_RF95::available()
+{
+    if (_mode == RHModeTx)
+	return false;
+    setModeRx();
+    validateRxBuf();
+    return _rxBufValid;
+}
+
+void RH_RF95::clearRxBuf()
+{
+    if (_rxBufValid)
+	_rxRing.pop();
+    _rxBufValid = false;
+}
+
+bool RH_RF95::recv(uint8_t* buf, uint8_t* len)
+{
+    if (!available())
+	return false;
+    if (buf && len)
+    {
+	// The interrupt handler does not touch this frame until clearRxBuf(), so no need to lock
+	RxRing::Frame* frame = _rxRing.front();
+	// Skip the 4 headers that are at the beginning of the frame
+	if (*len > frame->len-RH_RF95_HEADER_LEN)
+	    *len = frame->len-RH_RF95_HEADER_LEN;
+	memcpy(buf, frame->data+RH_RF95_HEADER_LEN, *len);
+    }
+    clearRxBuf(); // This message accepted and cleared
+    return true;
+}
+
+bool RH_RF95::peek(uint8_t** buf, uint8_t* len)
+{
+    if (!available())
+	return false;
+    // The interrupt handler does not touch this frame until consume()
+    RxRing::Frame* frame = _rxRing.front();
+    *buf = frame->data+RH_RF95_HEADER_LEN;
+    *len = frame->len-RH_RF95_HEADER_LEN;
+    return true;
+}
+
+#else
 // Check whether the latest received message is complete and uncorrupted
 void RH_RF95::validateRxBuf()
 {
@@ -221,7 +329,9 @@ bool RH_RF95::available()
 {
     if (_mode == RHModeTx)
 	return false;
-    setModeRx();
+    // Dont receive over a message that has not been collected yet
+    if (!_rxBufValid)
+	setModeRx();
     return _rxBufValid; // Will be set by the interrupt handler when a good message is received
 }
 
@@ -250,6 +360,22 @@ bool RH_RF95::recv(uint8_t* buf, uint8_t* len)
     return true;
 }
 
+bool RH_RF95::peek(uint8_t** buf, uint8_t* len)
+{
+    if (!available())
+	return false;
+    // available() leaves the receiver idle and the interrupt handler leaves _buf alone until consume()
+    *buf = _buf+RH_RF95_HEADER_LEN;
+    *len = _bufLen-RH_RF95_HEADER_LEN;
+    return true;
+}
+#endif
+
+void RH_RF95::consume()
+{
+    clearRxBuf();
+}
+
 bool RH_RF95::send(const uint8_t* data, uint8_t len)
 {
     if (len > RH_RF95_MAX_MESSAGE_LEN)
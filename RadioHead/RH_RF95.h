@@ -36,6 +36,25 @@
  #define RH_RF95_MAX_MESSAGE_LEN (RH_RF95_MAX_PAYLOAD_LEN - RH_RF95_HEADER_LEN)
 #endif
 
+// Number of received messages that can be held by the driver until they are collected by recv().
+// 0 means a single buffer: the receiver is turned off as soon as a message is received,
+// and any other messages sent before recv() is called are missed.
+// Otherwise it must be a power of 2, and the receiver stays on to catch back to back messages
+// in an RHFrameQueue of RH_RF95_RX_RING_LEN buffers, each with its own RSSI and SNR. Each buffer takes
+// about RH_RF95_MAX_MESSAGE_LEN + 8 octets of SRAM, so the default of 4 takes about 1050 octets.
+// Define a smaller RH_RF95_MAX_MESSAGE_LEN to reduce it.
+// The default on AVR, where SRAM is scarce, is 0
+#ifndef RH_RF95_RX_RING_LEN
+ #if defined(__AVR__)
+  #define RH_RF95_RX_RING_LEN 0
+ #else
+  #define RH_RF95_RX_RING_LEN 4
+ #endif
+#endif
+#if (RH_RF95_RX_RING_LEN & (RH_RF95_RX_RING_LEN - 1)) || RH_RF95_RX_RING_LEN > 128
+ #error RH_RF95_RX_RING_LEN must be 0 or a power of 2 up to 128
+#endif
+
 // The crystal oscillator frequency of the module
 #define RH_RF95_FXOSC 32000000.0
 
@@ -659,6 +678,17 @@ public:
     /// \return true if a valid message was copied to buf
     virtual bool    recv(uint8_t* buf, uint8_t* len);
 
+    /// Zero copy receive. If there is a valid message available, sets *buf to point to it
+    /// in the driver's receive buffer without copying it, until consume() is called.
+    /// See RHGenericDriver::peek()
+    /// \param[out] buf Set to the location of the message
+    /// \param[out] len Set to the length of the message
+    /// \return true if a valid message is available
+    virtual bool    peek(uint8_t** buf, uint8_t* len);
+
+    /// Discards the message returned by peek()
+    virtual void    consume();
+
     /// Waits until any previous transmit packet is finished being transmitted with waitPacketSent().
     /// Then optionally waits for Channel Activity Detection (CAD) 
     /// to show the channnel is clear (if the radio supports CAD) by calling waitCAD().
@@ -763,7 +793,8 @@ public:
     int frequencyError();
 
     /// Returns the Signal-to-noise ratio (SNR) of the last received message, as measured
-    /// by the receiver.
+    /// by the receiver. If RH_RF95_RX_RING_LEN is greater than 0, this is the SNR of the
+    /// message most recently reported by available(), as is lastRssi().
     /// \return SNR of the last received message in dB
     int lastSNR();
 
@@ -779,6 +810,11 @@ protected:
     /// Clear our local receive buffer
     void clearRxBuf();
 
+    /// Reads the RSSI and SNR of the packet just received from the radio
+    /// \param[out] rssi The RSSI in dBm
+    /// \param[out] snr The SNR in dB
+    void readPacketSignal(int16_t* rssi, int8_t* snr);
+
 private:
     /// Low level interrupt service routine for device connected to interrupt 0
     static void         isr0();
@@ -802,13 +838,20 @@ private:
     /// else 0xff
     uint8_t             _myInterruptIndex;
 
+#if RH_RF95_RX_RING_LEN > 0
+    /// Ring of received messages, each with its RSSI and SNR. Filled by the interrupt handler
+    /// and emptied by recv()
+    typedef RHFrameQueue<RH_RF95_RX_RING_LEN, RH_RF95_HEADER_LEN + RH_RF95_MAX_MESSAGE_LEN> RxRing;
+    RxRing              _rxRing;
+#else
     /// Number of octets in the buffer
     volatile uint8_t    _bufLen;
     
     /// The receiver/transmitter buffer
     uint8_t             _buf[RH_RF95_MAX_PAYLOAD_LEN];
+#endif
 
-    /// True when there is a valid message in the buffer
+    /// True when there is a valid message in the buffer (or at the front of _rxRing)
     volatile bool       _rxBufValid;
 
     // True if we are using the HF port (779.0 MHz and above)
@@ -13,8 +13,12 @@
 RH_Serial::RH_Serial(HardwareSerial& serial)
     :
     _serial(serial),
-    _rxState(RxStateInitialising)
+    _rxState(RxStateInitialising),
+    _rxBufValid(false)
 {
+#if RH_SERIAL_TX_QUEUE_LEN
+    _txQueueLen = 0;
+#endif
 }
 
 HardwareSerial& RH_Serial::serial()
@@ -33,8 +37,31 @@ bool RH_Serial::init()
 // Call this often
 bool RH_Serial::available()
 {
-    while (!_rxBufValid &&_serial.available())
+#if (RH_PLATFORM == RH_PLATFORM_UNIX)
+    // Unix version driver in RHutil/HardwareSerial buffers input, so process it a chunk at a time
+    const uint8_t* data;
+    size_t         len;
+    while (!rxBufFull() && (len = _serial.peekBuffer(&data)) > 0)
+	_serial.consume(handleRx(data, len));
+#else
+    while (!rxBufFull() && _serial.available())
 	handleRx(_serial.read());
+#endif
+#if RH_SERIAL_RX_QUEUE_LEN
+    if (!_rxBufValid)
+    {
+	// Make the oldest queued message the available one
+	RxQueue::Frame* frame = _rxQueue.front();
+	if (frame)
+	{
+	    _rxHeaderTo    = frame->data[0];
+	    _rxHeaderFrom  = frame->data[1];
+	    _rxHeaderId    = frame->data[2];
+	    _rxHeaderFlags = frame->data[3];
+	    _rxBufValid = true;
+	}
+    }
+#endif
     return _rxBufValid;
 }
 
@@ -83,7 +110,7 @@ void  RH_Serial::handleRx(uint8_t ch)
 	{
 	    if (ch == STX)
 	    {
-		clearRxBuf();
+		resetRxBuf();
 		_rxState = RxStateData;
 	    }
 	    else
@@ -139,13 +166,53 @@ void  RH_Serial::handleRx(uint8_t ch)
     }
 }
 
+size_t RH_Serial::handleRx(const uint8_t* data, size_t len)
+{
+    size_t i = 0;
+    while (i < len && !rxBufFull())
+    {
+	if (_rxState == RxStateData)
+	{
+	    // Fast path: everything up to the next DLE is ordinary data
+	    size_t run = 0;
+	    while (i + run < len && data[i + run] != DLE)
+		run++;
+	    appendRxBuf(data + i, run);
+	    i += run;
+	    if (i >= len)
+		break;
+	}
+	handleRx(data[i++]);
+    }
+    return i;
+}
+
 void RH_Serial::clearRxBuf()
 {
+#if RH_SERIAL_RX_QUEUE_LEN
+    if (_rxBufValid)
+	_rxQueue.pop();
+#else
+    resetRxBuf();
+#endif
     _rxBufValid = false;
+}
+
+void RH_Serial::resetRxBuf()
+{
     _rxFcs = 0xffff;
     _rxBufLen = 0;
 }
 
+bool RH_Serial::rxBufFull()
+{
+#if RH_SERIAL_RX_QUEUE_LEN
+    return _rxQueue.full();
+#else
+    return _rxBufValid;
+#endif
+}
+
 void RH_Serial::appendRxBuf(uint8_t ch)
 {
     if (_rxBufLen < RH_SERIAL_MAX_PAYLOAD_LEN)
@@ -158,6 +225,16 @@ void RH_Serial::appendRxBuf(uint8_t ch)
     // causing the message to be dropped when the FCS is received
 }
 
+void RH_Serial::appendRxBuf(const uint8_t* data, size_t len)
+{
+    // As above, anything that does not fit is not recorded
+    if (len > (size_t)(RH_SERIAL_MAX_PAYLOAD_LEN - _rxBufLen))
+	len = RH_SERIAL_MAX_PAYLOAD_LEN - _rxBufLen;
+    memcpy(_rxBuf + _rxBufLen, data, len);
+    _rxBufLen += len;
+    _rxFcs = RHcrc_ccitt(data, len, _rxFcs);
+}
+
 // Check whether the latest received message is complete and uncorrupted
 void RH_Serial::validateRxBuf()
 {
@@ -167,6 +244,23 @@ void RH_Serial::validateRxBuf()
 	return;
     }
 
+#if RH_SERIAL_RX_QUEUE_LEN
+    // Queue it, headers and all. The headers are extracted when it reaches the front
+    RxQueue::Frame* frame = _rxQueue.writeSlot();
+    if (   frame
+	&& _rxBufLen >= RH_SERIAL_HEADER_LEN
+	&& (_promiscuous ||
+	    _rxBuf[0] == _thisAddress ||
+	    _rxBuf[0] == RH_BROADCAST_ADDRESS))
+    {
+	memcpy(frame->data, _rxBuf, _rxBufLen);
+	frame->len  = _rxBufLen;
+	frame->rssi = 0;
+	frame->snr  = 0;
+	_rxQueue.push();
+	_rxGood++;
+    }
+#else
     // Extract the 4 headers
     _rxHeaderTo    = _rxBuf[0];
     _rxHeaderFrom  = _rxBuf[1];
@@ -179,32 +273,70 @@ void RH_Serial::validateRxBuf()
 	_rxGood++;
 	_rxBufValid = true;
     }
+#endif
 }
 
 bool RH_Serial::recv(uint8_t* buf, uint8_t* len)
 {
-    if (!available())
+    uint8_t*       message;
+    uint8_t        messageLen;
+    if (!peek(&message, &messageLen))
 	return false;
     if (buf && len)
     {
-	// Skip the 4 headers that are at the beginning of the rxBuf
-	if (*len > _rxBufLen-RH_SERIAL_HEADER_LEN)
-	    *len = _rxBufLen-RH_SERIAL_HEADER_LEN;
-	memcpy(buf, _rxBuf+RH_SERIAL_HEADER_LEN, *len);
+	if (*len > messageLen)
+	    *len = messageLen;
+	memcpy(buf, message, *len);
     }
     clearRxBuf(); // This message accepted and cleared
     return true;
 }
 
+bool RH_Serial::peek(uint8_t** buf, uint8_t* len)
+{
+    if (!available())
+	return false;
+    // No more characters are decoded into this message until it is cleared
+#if RH_SERIAL_RX_QUEUE_LEN
+    RxQueue::Frame* frame = _rxQueue.front();
+    uint8_t*        rxBuf = frame->data;
+    uint8_t         rxBufLen = frame->len;
+#else
+    uint8_t*        rxBuf = _rxBuf;
+    uint8_t         rxBufLen = _rxBufLen;
+#endif
+    // Skip the 4 headers that are at the beginning of the rxBuf
+    *buf = rxBuf+RH_SERIAL_HEADER_LEN;
+    *len = rxBufLen-RH_SERIAL_HEADER_LEN;
+    return true;
+}
+
+void RH_Serial::consume()
+{
+    clearRxBuf();
+}
+
 // Caution: this may block
 bool RH_Serial::send(const uint8_t* data, uint8_t len)
 {
     if (len > RH_SERIAL_MAX_MESSAGE_LEN)
 	return false;
 
+#if RH_SERIAL_TX_QUEUE_LEN
+    // Send it along with anything already queued, to preserve the order
+    if (_txQueueLen)
+	return queueMessage(data, len) && sendQueued();
+#endif
+
     if (!waitCAD()) 
 	return false;  // Check channel activity
 
+#if (RH_PLATFORM == RH_PLATFORM_UNIX)
+    uint8_t frame[RH_SERIAL_MAX_FRAME_LEN];
+    uint8_t frameLen = buildFrame(frame, data, len);
+    return _serial.write(frame, frameLen) == frameLen;
+#else
+    // No room on the stack for a whole frame on small processors, so send it as we go
     _txFcs = 0xffff;    // Initial value
     _serial.write(DLE); // Not in FCS
     _serial.write(STX); // Not in FCS
@@ -226,8 +358,90 @@ bool RH_Serial::send(const uint8_t* data, uint8_t len)
     _serial.write((_txFcs >> 8) & 0xff);
     _serial.write(_txFcs & 0xff);
     return true;
+#endif
+}
+
+bool RH_Serial::queueMessage(const uint8_t* data, uint8_t len)
+{
+#if RH_SERIAL_TX_QUEUE_LEN
+    if (len > RH_SERIAL_MAX_MESSAGE_LEN)
+	return false;
+    if (_txQueueLen >= RH_SERIAL_TX_QUEUE_LEN && !sendQueued())
+	return false;
+    _txQueueFrameLen[_txQueueLen] = buildFrame(_txQueue[_txQueueLen], data, len);
+    _txQueueLen++;
+    return true;
+#else
+    return send(data, len);
+#endif
+}
+
+bool RH_Serial::sendQueued()
+{
+#if RH_SERIAL_TX_QUEUE_LEN
+    if (_txQueueLen == 0)
+	return true;
+    if (!waitCAD()) 
+	return false;  // Check channel activity. The messages stay queued
+
+    struct iovec iov[RH_SERIAL_TX_QUEUE_LEN];
+    size_t       total = 0;
+    for (uint8_t i = 0; i < _txQueueLen; i++)
+    {
+	iov[i].iov_base = _txQueue[i];
+	iov[i].iov_len  = _txQueueFrameLen[i];
+	total += _txQueueFrameLen[i];
+    }
+    size_t sent = _serial.writev(iov, _txQueueLen);
+    _txQueueLen = 0;
+    return sent == total;
+#else
+    return true;
+#endif
 }
 
+#if (RH_PLATFORM == RH_PLATFORM_UNIX)
+uint8_t RH_Serial::buildFrame(uint8_t* frame, const uint8_t* data, uint8_t len)
+{
+    uint8_t  headers[RH_SERIAL_HEADER_LEN] = { _txHeaderTo, _txHeaderFrom, _txHeaderId, _txHeaderFlags };
+    uint8_t* p = frame;
+    uint16_t fcs = 0xffff; // Initial value
+
+    *p++ = DLE; // Not in FCS
+    *p++ = STX; // Not in FCS
+
+    // First the 4 headers, then the payload, with DLE stuffing
+    // Copy whole runs of octets up to and including each DLE, then add the stuffed DLE
+    for (uint8_t part = 0; part < 2; part++)
+    {
+	const uint8_t* src    = part ? data : headers;
+	uint8_t        srcLen = part ? len : sizeof(headers);
+	fcs = RHcrc_ccitt(src, srcLen, fcs);
+	while (srcLen)
+	{
+	    const uint8_t* dle = (const uint8_t*)memchr(src, DLE, srcLen);
+	    uint8_t run = dle ? (dle - src) + 1 : srcLen;
+	    memcpy(p, src, run);
+	    p += run;
+	    if (dle)
+		*p++ = DLE; // Not in FCS
+	    src    += run;
+	    srcLen -= run;
+	}
+    }
+
+    // End of message
+    *p++ = DLE;
+    fcs = RHcrc_ccitt_update(fcs, DLE);
+    *p++ = ETX;
+    fcs = RHcrc_ccitt_update(fcs, ETX);
+
+    // Now the calculated FCS for this message
+    *p++ = (fcs >> 8) & 0xff;
+    *p++ = fcs & 0xff;
+    return p - frame;
+}
+#else
 void  RH_Serial::txData(uint8_t ch)
 {
     if (ch == DLE)    // DLE stuffing required?
@@ -235,6 +449,7 @@ void  RH_Serial::txData(uint8_t ch)
     _serial.write(ch);
     _txFcs = RHcrc_ccitt_update(_txFcs, ch);
 }
+#endif
 
 uint8_t RH_Serial::maxMessageLength()
 {
@@ -33,6 +33,35 @@
 #define RH_SERIAL_MAX_MESSAGE_LEN (RH_SERIAL_MAX_PAYLOAD_LEN - RH_SERIAL_HEADER_LEN)
 #endif
 
+// The longest possible frame on the wire: DLE STX, the headers and payload with every octet DLE stuffed,
+// DLE ETX and the 2 octet FCS
+#define RH_SERIAL_MAX_FRAME_LEN (2 + (2 * RH_SERIAL_MAX_PAYLOAD_LEN) + 2 + 2)
+
+// Number of messages that can be queued by queueMessage() to be sent together by sendQueued().
+// Only supported on Unix, where all the queued messages are sent with a single writev().
+// Each queued message takes RH_SERIAL_MAX_FRAME_LEN octets of RAM
+#if (RH_PLATFORM == RH_PLATFORM_UNIX)
+ #ifndef RH_SERIAL_TX_QUEUE_LEN
+  #define RH_SERIAL_TX_QUEUE_LEN 8
+ #endif
+#else
+ #undef RH_SERIAL_TX_QUEUE_LEN
+ #define RH_SERIAL_TX_QUEUE_LEN 0
+#endif
+
+// Number of received messages that can be held by the driver until they are collected by recv().
+// 0 (the default except on Unix) means a single buffer: no more characters are read from the serial
+// port until the message has been collected. Otherwise must be a power of 2, and available() reads
+// and decodes everything waiting until the queue is full.
+// Each queued message takes about RH_SERIAL_MAX_PAYLOAD_LEN + 4 octets of RAM
+#ifndef RH_SERIAL_RX_QUEUE_LEN
+ #if (RH_PLATFORM == RH_PLATFORM_UNIX)
+  #define RH_SERIAL_RX_QUEUE_LEN 8
+ #else
+  #define RH_SERIAL_RX_QUEUE_LEN 0
+ #endif
+#endif
+
 #if (RH_PLATFORM == RH_PLATFORM_STM32F2)
  #define HardwareSerial USARTSerial
 #endif
@@ -181,14 +210,43 @@ public:
     /// \return true if a valid message was copied to buf
     virtual bool recv(uint8_t* buf, uint8_t* len);
 
+    /// Zero copy receive. If there is a valid message available, sets *buf to point to it
+    /// in the driver's receive buffer without copying it, until consume() is called.
+    /// See RHGenericDriver::peek()
+    /// \param[out] buf Set to the location of the message
+    /// \param[out] len Set to the length of the message
+    /// \return true if a valid message is available
+    virtual bool peek(uint8_t** buf, uint8_t* len);
+
+    /// Discards the message returned by peek()
+    virtual void consume();
+
     /// Waits until any previous transmit packet is finished being transmitted with waitPacketSent().
     /// Then loads a message into the transmitter and starts the transmitter. Note that a message length
     /// of 0 is NOT permitted. 
+    /// On Unix, the whole frame is built in a buffer and sent to the serial port with a single write,
+    /// together with any messages already queued by queueMessage(). On other platforms, where RAM is
+    /// scarcer, the frame is written an octet at a time as it is DLE stuffed, so it needs no buffer.
     /// \param[in] data Array of data to be sent
     /// \param[in] len Number of bytes of data to send (> 0)
     /// \return true if the message length was valid and it was correctly queued for transmit
     virtual bool send(const uint8_t* data, uint8_t len);
 
+    /// Frames a message with the current headers and adds it to the transmit queue, to be sent
+    /// together with the other queued messages by the next call to sendQueued() or send().
+    /// This lets a program that sends bursts of messages, such as a gateway, send each burst to
+    /// the serial port with one system call. If the queue is full, the queued messages are sent first.
+    /// If RH_SERIAL_TX_QUEUE_LEN is 0 (the default except on Unix), the message is sent immediately.
+    /// \param[in] data Array of data to be sent
+    /// \param[in] len Number of bytes of data to send (> 0)
+    /// \return true if the message length was valid and it was queued or sent
+    bool queueMessage(const uint8_t* data, uint8_t len);
+
+    /// Sends all the messages queued by queueMessage(), in order. On Unix they are
+    /// sent with a single writev().
+    /// \return true if the queue was empty or all the queued messages were sent
+    bool sendQueued();
+
     /// Returns the maximum message length 
     /// available in this Driver.
     /// \return The maximum legal message length
@@ -212,19 +270,51 @@ protected:
     /// the receiver state machine
     void  handleRx(uint8_t ch);
 
-    /// Empties the Rx buffer
+    /// Handle a chunk of characters received from the serial port. Runs the same
+    /// state machine as handleRx(uint8_t), but copies runs of ordinary data characters
+    /// into the Rx buffer in one go. Stops when there is no room for another complete valid message
+    /// (see rxBufFull()), so that any following characters can be processed after the waiting
+    /// messages have been collected.
+    /// \param[in] data The received characters
+    /// \param[in] len The number of received characters
+    /// \return The number of characters processed
+    size_t handleRx(const uint8_t* data, size_t len);
+
+    /// Discards the available message
     void  clearRxBuf();
 
+    /// Empties the Rx buffer ready to receive the characters of a new message
+    void  resetRxBuf();
+
+    /// Tests whether there is room for another received message. While there is not, no more
+    /// characters are read from the serial port
+    /// \return true if the receive queue (or the single Rx buffer) is full
+    bool  rxBufFull();
+
     /// Adds a charater to the Rx buffer
     void  appendRxBuf(uint8_t ch);
 
+    /// Adds several unescaped data characters to the Rx buffer
+    void  appendRxBuf(const uint8_t* data, size_t len);
+
     /// Checks whether the Rx buffer contains valid data that is complete and uncorrupted
-    /// Check the FCS, the TO address, and extracts the headers
+    /// Check the FCS, the TO address, and extracts the headers. If RH_SERIAL_RX_QUEUE_LEN is not 0,
+    /// the message is added to the receive queue
     void  validateRxBuf();
 
+#if (RH_PLATFORM == RH_PLATFORM_UNIX)
+    /// Builds a complete frame for transmission: DLE STX, the current headers and the message
+    /// with DLE stuffing, DLE ETX and the FCS.
+    /// \param[out] frame Where to build the frame. Must have room for RH_SERIAL_MAX_FRAME_LEN octets
+    /// \param[in] data The message payload
+    /// \param[in] len Length of the payload. Must not be more than RH_SERIAL_MAX_MESSAGE_LEN
+    /// \return The length of the frame
+    uint8_t buildFrame(uint8_t* frame, const uint8_t* data, uint8_t len);
+#else
     /// Sends a single data octet to the serial port.
     /// Implements DLE stuffing and keeps track of the senders FCS
     void  txData(uint8_t ch);
+#endif
 
     /// Reference to the HardwareSerial port we will use
     HardwareSerial& _serial;
@@ -238,17 +328,37 @@ protected:
     /// The received FCS at the end of the current message
     uint16_t        _rxRecdFcs; 
 
+#if (RH_PLATFORM != RH_PLATFORM_UNIX)
+    /// FCS for transmitted data
+    uint16_t        _txFcs;
+#endif
+
     /// The Rx buffer
     uint8_t         _rxBuf[RH_SERIAL_MAX_PAYLOAD_LEN];
 
     /// Current length of data in the Rx buffer
     uint8_t         _rxBufLen;
 
-    /// True if the data in the Rx buffer is value and uncorrupted and complete message is available for collection
+    /// True if the data in the Rx buffer (or at the front of _rxQueue) is value and uncorrupted and
+    /// complete message is available for collection
     bool            _rxBufValid;
 
-    /// FCS for transmitted data
-    uint16_t        _txFcs;
+#if RH_SERIAL_RX_QUEUE_LEN
+    /// Valid messages, with their headers, waiting to be collected by recv()
+    typedef RHFrameQueue<RH_SERIAL_RX_QUEUE_LEN, RH_SERIAL_MAX_PAYLOAD_LEN> RxQueue;
+    RxQueue         _rxQueue;
+#endif
+
+#if RH_SERIAL_TX_QUEUE_LEN
+    /// Frames queued by queueMessage()
+    uint8_t         _txQueue[RH_SERIAL_TX_QUEUE_LEN][RH_SERIAL_MAX_FRAME_LEN];
+
+    /// Length of each queued frame
+    uint8_t         _txQueueFrameLen[RH_SERIAL_TX_QUEUE_LEN];
+
+    /// Number of queued frames
+    uint8_t         _txQueueLen;
+#endif
 };
 
 /// @example serial_reliable_datagram_client.pde
@@ -0,0 +1,276 @@
+// RH_SimChannel.cpp
+//
+// Copyright (C) 2014 Mike McCauley
+// $Id: RH_SimChannel.cpp $
+
+#include <RadioHead.h>
+
+// This can only build on Linux and compatible systems
+#if (RH_PLATFORM == RH_PLATFORM_UNIX)
+
+#include <RH_SimChannel.h>
+
+RH_SimChannel::RH_SimChannel(RHSimMedium& medium)
+    : _medium(medium),
+      _attached(false),
+      _txStart(0),
+      _txEnd(0),
+      _rxBufLen(0),
+      _rxBufValid(false)
+{
+    for (uint8_t i = 0; i < RH_SIM_CHANNEL_RX_QUEUE_LEN; i++)
+	_rx[i].used = false;
+}
+
+RH_SimChannel::~RH_SimChannel()
+{
+    if (_attached)
+	_medium.detach(this);
+}
+
+bool RH_SimChannel::init()
+{
+    if (!RHGenericDriver::init())
+	return false;
+    if (!_attached)
+	_attached = _medium.attach(this);
+    if (!_attached)
+	return false;
+    _mode = RHModeIdle;
+    return true;
+}
+
+RHSimMedium& RH_SimChannel::medium()
+{
+    return _medium;
+}
+
+void RH_SimChannel::updateMode()
+{
+    if (_mode == RHModeTx && _medium.now() >= _txEnd)
+	_mode = RHModeIdle;
+}
+
+////////////////////////////////////////////////////////////////////
+void RH_SimChannel::collide(uint8_t index)
+{
+    if (!_rx[index].collided)
+    {
+	_rx[index].collided = true;
+	_medium._collisions++;
+    }
+}
+
+uint8_t RH_SimChannel::freeSlot()
+{
+    uint64_t now = _medium.now();
+    uint8_t  i, oldest = RH_SIM_CHANNEL_RX_QUEUE_LEN;
+    for (i = 0; i < RH_SIM_CHANNEL_RX_QUEUE_LEN; i++)
+    {
+	if (!_rx[i].used)
+	    return i;
+	if (_rx[i].end <= now && (oldest >= RH_SIM_CHANNEL_RX_QUEUE_LEN || _rx[i].end < _rx[oldest].end))
+	    oldest = i;
+    }
+    // Full. Nobody has called available() for a while, so overwrite the oldest message
+    // that has finished arriving, like an overrun receiver FIFO, rather than miss the new one
+    if (oldest < RH_SIM_CHANNEL_RX_QUEUE_LEN)
+    {
+	_rx[oldest].used = false;
+	_rxBad++;
+    }
+    return oldest;
+}
+
+void RH_SimChannel::receive(uint64_t start, uint64_t end, const uint8_t* headers, const uint8_t* data, uint8_t len, bool lost)
+{
+    uint8_t i, slot = freeSlot();
+    if (slot >= RH_SIM_CHANNEL_RX_QUEUE_LEN)
+    {
+	_rxBad++; // RH_SIM_CHANNEL_RX_QUEUE_LEN messages all arriving at once
+	return;
+    }
+    _rx[slot].used     = true;
+    _rx[slot].collided = false;
+    _rx[slot].lost     = lost;
+    _rx[slot].start    = start;
+    _rx[slot].end      = end;
+    memcpy(_rx[slot].headers, headers, RH_SIM_MEDIUM_HEADER_LEN);
+    _rx[slot].len      = len;
+    memcpy(_rx[slot].data, data, len);
+
+    for (i = 0; i < RH_SIM_CHANNEL_RX_QUEUE_LEN; i++)
+    {
+	if (i != slot && _rx[i].used && start < _rx[i].end && _rx[i].start < end)
+	{
+	    // Overlaps a message that is already arriving: neither can be received
+	    collide(i);
+	    collide(slot);
+	}
+    }
+    // We cant hear anything while we are transmitting
+    if (start < _txEnd && _txStart < end)
+	collide(slot);
+}
+
+uint64_t RH_SimChannel::nextEventTime()
+{
+    uint64_t now = _medium.now();
+    uint64_t next = RH_SIM_MEDIUM_NO_EVENT;
+    if (_mode == RHModeTx && _txEnd > now)
+	next = _txEnd;
+    for (uint8_t i = 0; i < RH_SIM_CHANNEL_RX_QUEUE_LEN; i++)
+    {
+	if (!_rx[i].used)
+	    continue;
+	// The start matters to anyone waiting for channel activity
+	if (_rx[i].start > now && _rx[i].start < next)
+	    next = _rx[i].start;
+	if (_rx[i].end > now && _rx[i].end < next)
+	    next = _rx[i].end;
+    }
+    return next;
+}
+
+bool RH_SimChannel::isChannelActive()
+{
+    uint64_t now = _medium.now();
+    _cad = false;
+    for (uint8_t i = 0; i < RH_SIM_CHANNEL_RX_QUEUE_LEN; i++)
+	if (_rx[i].used && _rx[i].start <= now && now < _rx[i].end)
+	    _cad = true;
+    return _cad;
+}
+
+void RH_SimChannel::checkRx()
+{
+    uint64_t now = _medium.now();
+    while (!_rxBufValid)
+    {
+	// Find the earliest message that has completely arrived
+	uint8_t i, earliest = RH_SIM_CHANNEL_RX_QUEUE_LEN;
+	for (i = 0; i < RH_SIM_CHANNEL_RX_QUEUE_LEN; i++)
+	    if (_rx[i].used && _rx[i].end <= now
+		&& (earliest >= RH_SIM_CHANNEL_RX_QUEUE_LEN || _rx[i].end < _rx[earliest].end))
+		earliest = i;
+	if (earliest >= RH_SIM_CHANNEL_RX_QUEUE_LEN)
+	    return; // Nothing more has arrived yet
+
+	Reception* r = &_rx[earliest];
+	r->used = false;
+	if (r->collided || r->lost)
+	{
+	    _rxBad++;
+	    continue;
+	}
+	_rxHeaderTo    = r->headers[0];
+	_rxHeaderFrom  = r->headers[1];
+	_rxHeaderId    = r->headers[2];
+	_rxHeaderFlags = r->headers[3];
+	if (_promiscuous ||
+	    _rxHeaderTo == _thisAddress ||
+	    _rxHeaderTo == RH_BROADCAST_ADDRESS)
+	{
+	    memcpy(_rxBuf, r->data, r->len);
+	    _rxBufLen = r->len;
+	    _rxGood++;
+	    _rxBufValid = true;
+	}
+    }
+}
+
+bool RH_SimChannel::available()
+{
+    if (!_attached)
+	return false;
+    updateMode();
+    checkRx();
+    return _rxBufValid;
+}
+
+bool RH_SimChannel::recv(uint8_t* buf, uint8_t* len)
+{
+    if (!available())
+	return false;
+
+    if (buf && len)
+    {
+	if (*len > _rxBufLen)
+	    *len = _rxBufLen;
+	memcpy(buf, _rxBuf, *len);
+    }
+    _rxBufValid = false;
+    return true;
+}
+
+bool RH_SimChannel::peek(uint8_t** buf, uint8_t* len)
+{
+    if (!available())
+	return false;
+    *buf = _rxBuf;
+    *len = _rxBufLen;
+    return true;
+}
+
+void RH_SimChannel::consume()
+{
+    _rxBufValid = false;
+}
+
+bool RH_SimChannel::send(const uint8_t* data, uint8_t len)
+{
+    if (!_attached || len > RH_SIM_CHANNEL_MAX_MESSAGE_LEN)
+	return false;
+
+    waitPacketSent(); // Make sure we dont interrupt an outgoing message
+    if (!waitCAD())
+	return false;
+
+    uint8_t headers[RH_SIM_MEDIUM_HEADER_LEN];
+    headers[0] = _txHeaderTo;
+    headers[1] = _txHeaderFrom;
+    headers[2] = _txHeaderId;
+    headers[3] = _txHeaderFlags;
+
+    // The radio stops receiving now, and the message goes on the air after the turnaround time
+    uint64_t now = _medium.now();
+    uint64_t start = now + _medium.turnaround();
+    uint64_t end = start + _medium.airtime(len);
+    // Transmitting ruins anything we are receiving at the same time
+    for (uint8_t i = 0; i < RH_SIM_CHANNEL_RX_QUEUE_LEN; i++)
+	if (_rx[i].used && now < _rx[i].end && _rx[i].start < end)
+	    collide(i);
+    _txStart = now;
+    _txEnd = end;
+    _medium.transmit(this, start, end, headers, data, len);
+    _mode = RHModeTx;
+    _txGood++;
+    return true;
+}
+
+uint8_t RH_SimChannel::maxMessageLength()
+{
+    return RH_SIM_CHANNEL_MAX_MESSAGE_LEN;
+}
+
+bool RH_SimChannel::waitPacketSent()
+{
+    // Let the other nodes run until the message is off the air
+    if (_mode == RHModeTx)
+	_medium.waitUntil(_txEnd);
+    updateMode();
+    return true;
+}
+
+bool RH_SimChannel::waitPacketSent(uint16_t timeout)
+{
+    if (_mode == RHModeTx)
+    {
+	uint64_t until = _medium.now() + (uint64_t)timeout * 1000;
+	_medium.waitUntil(until < _txEnd ? until : _txEnd);
+    }
+    updateMode();
+    return _mode != RHModeTx;
+}
+
+#endif
@@ -0,0 +1,227 @@
+// RH_SimChannel.h
+// Author: Mike McCauley (mikem@airspayce.com)
+// Copyright (C) 2014 Mike McCauley
+// $Id: RH_SimChannel.h $
+#ifndef RH_SimChannel_h
+#define RH_SimChannel_h
+
+#include <RHGenericDriver.h>
+
+#if (RH_PLATFORM == RH_PLATFORM_UNIX)
+
+#include <RHSimMedium.h>
+
+// Maximum payload length, including the headers, same as RH_TCP
+#define RH_SIM_CHANNEL_MAX_PAYLOAD_LEN 255
+
+// Maximum message length that can be sent, not including the headers
+#define RH_SIM_CHANNEL_MAX_MESSAGE_LEN (RH_SIM_CHANNEL_MAX_PAYLOAD_LEN - RH_SIM_MEDIUM_HEADER_LEN)
+
+// Maximum number of messages that can be arriving at or waiting in one node at the same time.
+// When there are more, the oldest waiting message is dropped and counted in rxBad()
+#ifndef RH_SIM_CHANNEL_RX_QUEUE_LEN
+ #define RH_SIM_CHANNEL_RX_QUEUE_LEN 8
+#endif
+
+/////////////////////////////////////////////////////////////////////
+/// \class RH_SimChannel RH_SimChannel.h <RH_SimChannel.h>
+/// \brief Driver to send and receive unaddressed, unreliable datagrams through a simulated radio
+/// medium within a single process.
+///
+/// \par Overview
+///
+/// This class is intended to support the testing of RadioHead manager classes with many nodes on a
+/// Linux host. It is an in-process alternative to RH_TCP and tools/etherSimulator.pl: instead of
+/// connecting to a server over a socket, each RH_SimChannel is attached to an RHSimMedium shared by
+/// all the simulated nodes. The medium runs on a virtual clock, and models the probability of
+/// delivery over each link, the airtime of each message and collisions between messages. Many
+/// nodes (each with its own driver and manager instances) can be run in one process, much faster
+/// than real time, and with repeatable results. See RHSimMedium for details of the medium.
+///
+/// As with the radio drivers, send() first waits for any previous message from this node to finish
+/// transmission (see waitPacketSent()), then hands the message to the medium, which starts transmission
+/// after the medium's turnaround time (see RHSimMedium::setTurnaround()). The driver is in RHModeTx,
+/// and cannot receive, until the virtual clock reaches the end of the transmission.
+///
+/// Every message sent is heard by all the nodes within range of the sender (those with a
+/// probability of delivery greater than 0.0, see RHSimMedium). A message is available at a
+/// receiving node once the virtual clock has reached the end of its transmission, unless:
+/// \li it was lost on the link
+/// \li it overlapped in time with another message heard by the same node, even one that was itself lost
+/// \li the receiving node was transmitting at any time while it arrived (the radio is half duplex)
+///
+/// and these are counted in rxBad(). Each node can hold RH_SIM_CHANNEL_RX_QUEUE_LEN messages that
+/// are arriving or have arrived but not yet been received with recv(). If more arrive, the oldest
+/// message that has arrived is discarded and counted in rxBad().
+///
+/// isChannelActive() reports whether any message is arriving at the node, so Channel Activity
+/// Detection and the backoff in waitCAD() can be used with setCADTimeout(), as with RH_RF95.
+///
+/// Like other drivers, the node address used to filter incoming messages is set with setThisAddress().
+/// The same address is used to look up the link probabilities in the medium.
+///
+/// \par Example
+///
+/// \code
+/// RHSimMedium medium;
+/// RH_SimChannel driver1(medium);
+/// RH_SimChannel driver2(medium);
+/// RHDatagram node1(driver1, 1);
+/// RHDatagram node2(driver2, 2);
+/// node1.init();
+/// node2.init();
+/// node1.sendto(data, sizeof(data), 2);
+/// while (!node2.available())
+///     medium.advance(1000);
+/// \endcode
+///
+/// See the example simulator_sim_channel.pde
+class RH_SimChannel : public RHGenericDriver
+{
+public:
+    /// Constructor
+    /// \param[in] medium The simulated medium this driver sends and receives through.
+    /// The medium must outlive the driver
+    RH_SimChannel(RHSimMedium& medium);
+
+    /// Destructor. Detaches this driver from the medium
+    ~RH_SimChannel();
+
+    /// Attaches the driver to the medium
+    /// \return true if initialisation succeeded, false if the medium already has RH_SIM_MEDIUM_MAX_NODES nodes
+    virtual bool init();
+
+    /// Tests whether a new message is available from the medium, taking into account the
+    /// current virtual time.
+    /// \return true if a new, complete, error-free uncollected message is available to be retreived by recv()
+    virtual bool available();
+
+    /// If there is a valid message available, copy it to buf and return true
+    /// else return false.
+    /// If a message is copied, *len is set to the length (Caution, 0 length messages are permitted).
+    /// \param[in] buf Location to copy the received message
+    /// \param[in,out] len Pointer to available space in buf. Set to the actual number of octets copied.
+    /// \return true if a valid message was copied to buf
+    virtual bool recv(uint8_t* buf, uint8_t* len);
+
+    /// Zero copy receive. If there is a valid message available, sets *buf to point to it
+    /// in the driver's receive buffer without copying it, until consume() is called.
+    /// See RHGenericDriver::peek()
+    /// \param[out] buf Set to the location of the message
+    /// \param[out] len Set to the length of the message
+    /// \return true if a valid message is available
+    virtual bool peek(uint8_t** buf, uint8_t* len);
+
+    /// Discards the message returned by peek()
+    virtual void consume();
+
+    /// Hands a message to the medium for transmission to all the other attached nodes.
+    /// Calls waitPacketSent() first, so waits for any previous message to finish transmission,
+    /// then waitCAD(). The message goes on the air after the medium's turnaround time
+    /// (see RHSimMedium::setTurnaround()). The node cannot receive from the moment send() is called,
+    /// through the turnaround time, until the transmission ends, and any message it was
+    /// receiving at that time is lost.
+    /// \param[in] data Array of data to be sent
+    /// \param[in] len Number of bytes of data to send
+    /// \return true if the message length was valid and it was handed to the medium
+    virtual bool send(const uint8_t* data, uint8_t len);
+
+    /// Returns the maximum message length
+    /// available in this Driver.
+    /// \return The maximum legal message length
+    virtual uint8_t maxMessageLength();
+
+    /// Waits until the last message sent by send() has finished transmission, with RHSimMedium::waitUntil().
+    /// On the harness or a virtual simulator clock, the other nodes run in the meantime. On the medium's own
+    /// clock, which only moves when the program calls advance(), this moves the clock to the end of the transmission.
+    /// \return true
+    virtual bool waitPacketSent();
+
+    /// Waits until the last message sent by send() has finished transmission, or the timeout expires, 
+    /// as for waitPacketSent()
+    /// \param[in] timeout Maximum time to wait in milliseconds
+    /// \return true if the message has finished transmission
+    virtual bool waitPacketSent(uint16_t timeout);
+
+    /// Channel Activity Detection. Reports whether any message from a node in range is
+    /// arriving at the current virtual time, whether or not it can be received
+    /// \return true if the channel is in use
+    virtual bool isChannelActive();
+
+    /// Returns the medium this driver is attached to
+    /// \return The medium
+    RHSimMedium& medium();
+
+protected:
+    friend class RHSimMedium;
+
+    /// Called by the medium when a message from a node in range reaches this one.
+    /// Records the reception, and marks it and any other reception it overlaps as collided.
+    /// It is also collided if it overlaps our own transmission.
+    /// \param[in] start Virtual time at which the message starts arriving
+    /// \param[in] end Virtual time at which the message has completely arrived
+    /// \param[in] headers The 4 octets of TO, FROM, ID and FLAGS
+    /// \param[in] data The message payload
+    /// \param[in] len Length of the payload
+    /// \param[in] lost true if the message was lost on the link. It still occupies the channel
+    virtual void receive(uint64_t start, uint64_t end, const uint8_t* headers, const uint8_t* data, uint8_t len, bool lost);
+
+    /// Returns the virtual time of the next event at this node: the end of the
+    /// current transmission, or the start or end of a reception still in progress
+    /// \return The time in microseconds, or RH_SIM_MEDIUM_NO_EVENT
+    uint64_t nextEventTime();
+
+private:
+    /// Checks whether the current transmission has finished
+    void updateMode();
+
+    /// Finds a free slot in _rx, discarding the oldest message that has already
+    /// arrived if necessary
+    /// \return The index of the slot, or RH_SIM_CHANNEL_RX_QUEUE_LEN if all the slots are still arriving
+    uint8_t freeSlot();
+
+    /// Marks a reception as collided, and counts it in the medium
+    /// \param[in] index Index of the reception in _rx
+    void collide(uint8_t index);
+
+    /// Moves the earliest completed reception into _rxBuf, if there is one
+    /// and there is not already a message waiting there
+    void checkRx();
+
+    /// A message arriving at or received by this node
+    typedef struct
+    {
+	bool     used;
+	bool     collided;                                ///< Overlapped another message or our transmission
+	bool     lost;                                    ///< Lost on the link
+	uint64_t start;                                   ///< Virtual time the message starts arriving
+	uint64_t end;                                     ///< Virtual time the message has completely arrived
+	uint8_t  headers[RH_SIM_MEDIUM_HEADER_LEN];
+	uint8_t  len;
+	uint8_t  data[RH_SIM_CHANNEL_MAX_MESSAGE_LEN];
+    } Reception;
+
+    /// The medium we are attached to
+    RHSimMedium&    _medium;
+
+    /// Whether init() has attached us to the medium
+    bool            _attached;
+
+    /// Virtual times at which the last message we sent starts and finishes transmission
+    uint64_t        _txStart;
+    uint64_t        _txEnd;
+
+    /// Messages arriving or waiting to be received
+    Reception       _rx[RH_SIM_CHANNEL_RX_QUEUE_LEN];
+
+    /// The message that has been received and is available
+    uint8_t         _rxBuf[RH_SIM_CHANNEL_MAX_MESSAGE_LEN];
+    uint8_t         _rxBufLen;
+    bool            _rxBufValid;
+};
+
+/// @example simulator_sim_channel.pde
+
+#endif
+
+#endif
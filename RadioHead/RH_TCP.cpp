@@ -21,11 +21,17 @@
 
 RH_TCP::RH_TCP(const char* server)
     : _server(server),
-      _rxBufLen(0),
-      _rxBufValid(false),
-      _socket(-1)
+      _socket(-1),
+      _socketBufLen(0),
+      _rxBufValid(false)
 {
 }
+
+RH_TCP::~RH_TCP()
+{
+    if (_socket >= 0)
+	close(_socket);
+}
     
 bool RH_TCP::init()
 {   
@@ -107,87 +113,100 @@ bool RH_TCP::connectToServer()
 
 void RH_TCP::clearRxBuf()
 {
+    if (_rxBufValid)
+	_rxQueue.pop();
     _rxBufValid = false;
-    _rxBufLen = 0;
 }
 
 void RH_TCP::checkForEvents()
 {
-    #define RH_TCP_SOCKETBUF_LEN 500
-    static uint8_t socketBuf[RH_TCP_SOCKETBUF_LEN]; // Room for several messages
-    static uint16_t socketBufLen = 0;
-
     // Read at most the amount of space we have left in the buffer
-    ssize_t count = read(_socket, socketBuf + socketBufLen, sizeof(socketBuf) - socketBufLen);
-    if (count < 0)
+    // If the buffer is already full, just try to parse what we have
+    if (_socketBufLen < sizeof(_socketBuf))
     {
-	if (errno != EAGAIN)
+	ssize_t count = read(_socket, _socketBuf + _socketBufLen, sizeof(_socketBuf) - _socketBufLen);
+	if (count < 0)
+	{
+	    if (errno != EAGAIN)
+	    {
+		fprintf(stderr,"RH_TCP::checkForEvents read error: %s\n", strerror(errno));
+		exit(1);
+	    }
+	}
+	else if (count == 0)
 	{
-	    fprintf(stderr,"RH_TCP::checkForEvents read error: %s\n", strerror(errno));
+	    // End of file
+	    fprintf(stderr,"RH_TCP::checkForEvents unexpected end of file on read\n");
 	    exit(1);
 	}
+	else
+	    _socketBufLen += count;
     }
-    else if (count == 0)
-    {
-	// End of file
-	fprintf(stderr,"RH_TCP::checkForEvents unexpected end of file on read\n");
-	exit(1);
-    }
-    else
+
+    // Extract messages until the receive queue is full. Any further messages
+    // stay in _socketBuf until there is room for them, so
+    // bursts from the server are not lost
+    while (_socketBufLen >= 5 && !_rxQueue.full())
     {
-	socketBufLen += count;
-	while (socketBufLen >= 5)
+	RHTcpTypeMessage* message = ((RHTcpTypeMessage*)_socketBuf);
+	uint32_t len = ntohl(message->length);
+	uint32_t messageLen = len + sizeof(message->length);
+	if (len > sizeof(_socketBuf) - sizeof(message->length))
 	{
-	    RHTcpTypeMessage* message = ((RHTcpTypeMessage*)socketBuf);
-	    uint32_t len = ntohl(message->length);
-	    uint32_t messageLen = len + sizeof(message->length);
-	    if (len > sizeof(socketBuf) - sizeof(message->length))
-	    {
-		// Bogus length
-		fprintf(stderr, "RH_TCP::checkForEvents read ridiculous length: %d. Corrupt message stream? Aborting\n", len);
-		exit(1);
-	    }
-	    if (socketBufLen >= len + sizeof(message->length))
+	    // Bogus length
+	    fprintf(stderr, "RH_TCP::checkForEvents read ridiculous length: %d. Corrupt message stream? Aborting\n", len);
+	    exit(1);
+	}
+	if (_socketBufLen < messageLen)
+	    break; // Incomplete message, wait for the rest of it
+
+	// Got at least all of this message
+	if (message->type == RH_TCP_MESSAGE_TYPE_PACKET && len >= 5)
+	{
+	    // REVISIT: need to check if we are actually receiving?
+	    // Its a new packet, extract the headers and payload
+	    RHTcpPacket* packet = ((RHTcpPacket*)_socketBuf);
+	    uint32_t payloadLen = len - 5;
+	    if (   payloadLen <= RH_TCP_MAX_MESSAGE_LEN
+		&& (_promiscuous ||
+		    packet->to == _thisAddress ||
+		    packet->to == RH_BROADCAST_ADDRESS))
 	    {
-		// Got at least all of this message
-		if (message->type == RH_TCP_MESSAGE_TYPE_PACKET && len >= 5)
-		{
-		    // REVISIT: need to check if we are actually receiving?
-		    // Its a new packet, extract the headers and payload
-		    RHTcpPacket* packet = ((RHTcpPacket*)socketBuf);
-		    _rxHeaderTo    = packet->to;
-		    _rxHeaderFrom  = packet->from;
-		    _rxHeaderId    = packet->id;
-		    _rxHeaderFlags = packet->flags;
-		    uint32_t payloadLen = len - 5;
-		    if (payloadLen <= sizeof(_rxBuf))
-		    {
-			// Enough room in our receiver buffer
-			memcpy(_rxBuf, packet->payload, payloadLen);
-			_rxBufLen = payloadLen;
-			_rxBufFull = true;
-		    }
-		}
-		// check for other message types here
-		// Now remove the used message by copying the trailing bytes (maybe start of a new message?)
-		// to the top of the buffer
-		memcpy(socketBuf, socketBuf + messageLen, sizeof(socketBuf) - messageLen);
-		socketBufLen -= messageLen;
+		// Queue it with its headers, like a radio would receive it
+		RxQueue::Frame* frame = _rxQueue.writeSlot();
+		frame->data[0] = packet->to;
+		frame->data[1] = packet->from;
+		frame->data[2] = packet->id;
+		frame->data[3] = packet->flags;
+		memcpy(frame->data + RH_TCP_HEADER_LEN, packet->payload, payloadLen);
+		frame->len  = RH_TCP_HEADER_LEN + payloadLen;
+		frame->rssi = 0;
+		frame->snr  = 0;
+		_rxQueue.push();
+		_rxGood++;
 	    }
 	}
+	// check for other message types here
+	// Now remove the used message by copying the trailing bytes (maybe start of a new message?)
+	// to the top of the buffer
+	memmove(_socketBuf, _socketBuf + messageLen, _socketBufLen - messageLen);
+	_socketBufLen -= messageLen;
     }
 }
 
 void RH_TCP::validateRxBuf()
 {
-    // The headers have already been extracted
-    if (_promiscuous ||
-	_rxHeaderTo == _thisAddress ||
-	_rxHeaderTo == RH_BROADCAST_ADDRESS)
-    {
-	_rxGood++;
-	_rxBufValid = true;
-    }
+    if (_rxBufValid)
+	return;
+    // The address has already been checked by checkForEvents()
+    RxQueue::Frame* frame = _rxQueue.front();
+    if (!frame)
+	return;
+    _rxHeaderTo    = frame->data[0];
+    _rxHeaderFrom  = frame->data[1];
+    _rxHeaderId    = frame->data[2];
+    _rxHeaderFlags = frame->data[3];
+    _rxBufValid = true;
 }
 
 bool RH_TCP::available()
@@ -195,11 +214,7 @@ bool RH_TCP::available()
     if (_socket < 0)
 	return false;
     checkForEvents();
-    if (_rxBufFull)
-    {
-	validateRxBuf();
-	_rxBufFull= false;
-    }
+    validateRxBuf();
     return _rxBufValid;
 }
 
@@ -216,6 +231,11 @@ bool RH_TCP::waitAvailableTimeout(uint16_t timeout)
     fd_set         input;
     int            result;
 
+    // There may already be a complete packet waiting in our socket buffer,
+    // in which case select() would not see it
+    if (available())
+	return true;
+
     FD_ZERO(&input);
     FD_SET(_socket, &input);
     max_fd = _socket + 1;
@@ -244,14 +264,31 @@ bool RH_TCP::recv(uint8_t* buf, uint8_t* len)
 
     if (buf && len)
     {
-	if (*len > _rxBufLen)
-	    *len = _rxBufLen;
-	memcpy(buf, _rxBuf, *len);
+	// Skip the headers at the beginning of the frame
+	RxQueue::Frame* frame = _rxQueue.front();
+	if (*len > frame->len - RH_TCP_HEADER_LEN)
+	    *len = frame->len - RH_TCP_HEADER_LEN;
+	memcpy(buf, frame->data + RH_TCP_HEADER_LEN, *len);
     }
     clearRxBuf();
     return true;
 }
 
+bool RH_TCP::peek(uint8_t** buf, uint8_t* len)
+{
+    if (!available())
+	return false;
+    RxQueue::Frame* frame = _rxQueue.front();
+    *buf = frame->data + RH_TCP_HEADER_LEN;
+    *len = frame->len - RH_TCP_HEADER_LEN;
+    return true;
+}
+
+void RH_TCP::consume()
+{
+    clearRxBuf();
+}
+
 bool RH_TCP::send(const uint8_t* data, uint8_t len)
 {
     if (!waitCAD()) 
@@ -267,6 +304,11 @@ uint8_t RH_TCP::maxMessageLength()
     return RH_TCP_MAX_MESSAGE_LEN;
 }
 
+int RH_TCP::fd()
+{
+    return _socket;
+}
+
 void RH_TCP::setThisAddress(uint8_t address)
 {
     RHGenericDriver::setThisAddress(address);
@@ -290,14 +332,14 @@ bool RH_TCP::sendPacket(const uint8_t* data, uint8_t len)
     if (_socket < 0)
 	return false;
     RHTcpPacket m;
-    m.length = htonl(len + 4);
+    m.length = htonl(len + 5);
     m.type  = RH_TCP_MESSAGE_TYPE_PACKET;
     m.to    = _txHeaderTo;
     m.from  = _txHeaderFrom;
     m.id    = _txHeaderId;
     m.flags = _txHeaderFlags;
     memcpy(m.payload, data, len);
-    ssize_t sent = write(_socket, &m, len + 8);
+    ssize_t sent = write(_socket, &m, len + 9);
     return sent > 0;
 }
 
@@ -8,6 +8,19 @@
 #include <RHGenericDriver.h>
 #include <RHTcpProtocol.h>
 
+// Size of the buffer used to accumulate RHTcpProtocol messages read from the server socket.
+// Must be big enough to hold at least one complete maximum length RHTcpPacket
+#ifndef RH_TCP_SOCKETBUF_LEN
+ #define RH_TCP_SOCKETBUF_LEN 500
+#endif
+
+// Number of received packets that can be held by the driver until they are collected by recv().
+// Must be a power of 2. While the queue is full, further packets wait in the socket buffer
+// and the socket
+#ifndef RH_TCP_RX_QUEUE_LEN
+ #define RH_TCP_RX_QUEUE_LEN 8
+#endif
+
 /////////////////////////////////////////////////////////////////////
 /// \class RH_TCP RH_TCP.h <RH_TCP.h>
 /// \brief Driver to send and receive unaddressed, unreliable datagrams via sockets on a Linux simulator
@@ -74,6 +87,10 @@ public:
     /// port name or port number.
     RH_TCP(const char* server = "localhost:4000");
 
+    /// Destructor. Closes the connection to the ether simulator server, if any.
+    /// Virtual so that a driver allocated with new can be deleted safely
+    virtual ~RH_TCP();
+
     /// Initialise the Driver transport hardware and software.
     /// Make sure the Driver is properly configured before calling init().
     /// \return true if initialisation succeeded.
@@ -109,6 +126,17 @@ public:
     /// \return true if a valid message was copied to buf
     virtual bool recv(uint8_t* buf, uint8_t* len);
 
+    /// Zero copy receive. If there is a valid message available, sets *buf to point to it
+    /// in the driver's receive buffer without copying it, until consume() is called.
+    /// See RHGenericDriver::peek()
+    /// \param[out] buf Set to the location of the message
+    /// \param[out] len Set to the length of the message
+    /// \return true if a valid message is available
+    virtual bool peek(uint8_t** buf, uint8_t* len);
+
+    /// Discards the message returned by peek()
+    virtual void consume();
+
     /// Waits until any previous transmit packet is finished being transmitted with waitPacketSent().
     /// Then loads a message into the transmitter and starts the transmitter. Note that a message length
     /// of 0 is NOT permitted. If the message is too long for the underlying radio technology, send() will
@@ -134,6 +162,16 @@ public:
     /// \param[in] address The address of this node.
     void setThisAddress(uint8_t address);
 
+    /// Returns the file descriptor of the socket connected to the ether simulator server,
+    /// or -1 if not connected. This allows a program to wait for incoming messages on many
+    /// RH_TCP instances at once with select(), poll() or epoll (see RHReactor).
+    /// When the descriptor becomes readable, call available() and recv() until available()
+    /// returns false: several messages may arrive in one read, and any that are not
+    /// consumed are held in the driver, where the descriptor will no longer signal them.
+    /// You must not read from the descriptor yourself.
+    /// \return The socket file descriptor
+    int fd();
+
 protected:
 
 private:
@@ -167,18 +205,20 @@ private:
     /// The TCP socket used to communicate with the message server
     int         _socket;
 
-    /// Buffer to receive RHTcpProtocol messages
-    uint8_t     _rxBuf[RH_TCP_MAX_PAYLOAD_LEN + 5];
-    uint16_t    _rxBufLen;
+    /// Buffer to accumulate bytes read from _socket until there is a complete message
+    uint8_t     _socketBuf[RH_TCP_SOCKETBUF_LEN];
+    uint16_t    _socketBufLen;
+
+    /// Packets addressed to us, with their headers, waiting to be collected by recv()
+    typedef RHFrameQueue<RH_TCP_RX_QUEUE_LEN, RH_TCP_HEADER_LEN + RH_TCP_MAX_MESSAGE_LEN> RxQueue;
+    RxQueue     _rxQueue;
+
+    /// True if the packet at the front of _rxQueue is available and its headers have been extracted
     bool        _rxBufValid;
 
-    /// Check whether the latest received message is complete and uncorrupted
+    /// Makes the oldest queued packet the available one, if there is not one already
     void            validateRxBuf();
 
-    // Used in the interrupt handlers
-    /// Buf is filled but not validated
-    volatile bool   _rxBufFull;
-
 };
 
 /// @example simulator_reliable_datagram_client.pde
@@ -18,7 +18,9 @@
 
 HardwareSerial::HardwareSerial(const char* deviceName)
     : _deviceName(deviceName),
-      _device(-1)
+      _device(-1),
+      _rxHead(0),
+      _rxTail(0)
 {
     // Override device name from environment
     char* e = getenv("RH_HARDWARESERIAL_DEVICE_NAME");
@@ -44,33 +46,75 @@ void HardwareSerial::flush()
 
 int HardwareSerial::peek(void)
 {
-    printf("HardwareSerial::peek not implemented\n");
-    return 0;
+    const uint8_t* data;
+    if (peekBuffer(&data) == 0)
+	return -1;
+    return *data;
 }
 
 int HardwareSerial::available()
 {
-    int bytes;
+    return fillBuffer();
+}
 
-    if (ioctl(_device, FIONREAD, &bytes) != 0)
+int HardwareSerial::read()
+{
+    if (_rxHead == _rxTail)
     {
-	fprintf(stderr, "HardwareSerial::available ioctl failed: %s\n", strerror(errno));
-	return 0;
+	// Nothing buffered, block until there is at least one character and take
+	// whatever else is there in the same read
+	ssize_t result = ::read(_device, _rxBuf, sizeof(_rxBuf));
+	if (result < 1)
+	{
+	    fprintf(stderr, "HardwareSerial::read read failed: %s\n", strerror(errno));
+	    return 0;
+	}
+	_rxHead = 0;
+	_rxTail = result;
     }
-    return bytes;
+//    printf("got: %02x\n", _rxBuf[_rxHead]);
+    return _rxBuf[_rxHead++];
 }
 
-int HardwareSerial::read()
+size_t HardwareSerial::peekBuffer(const uint8_t** data)
 {
-    uint8_t data;
-    ssize_t result = ::read(_device, &data, 1);
-    if (result != 1)
+    size_t len = fillBuffer();
+    *data = _rxBuf + _rxHead;
+    return len;
+}
+
+void HardwareSerial::consume(size_t len)
+{
+    if (len > _rxTail - _rxHead)
+	len = _rxTail - _rxHead;
+    _rxHead += len;
+}
+
+size_t HardwareSerial::fillBuffer()
+{
+    if (_rxHead < _rxTail)
+	return _rxTail - _rxHead; // Still have some
+
+    _rxHead = _rxTail = 0;
+    int bytes;
+    if (ioctl(_device, FIONREAD, &bytes) != 0)
+    {
+	fprintf(stderr, "HardwareSerial::available ioctl failed: %s\n", strerror(errno));
+	return 0;
+    }
+    if (bytes <= 0)
+	return 0;
+    if ((size_t)bytes > sizeof(_rxBuf))
+	bytes = sizeof(_rxBuf);
+    // Wont block, since we know there are at least this many characters ready
+    ssize_t result = ::read(_device, _rxBuf, bytes);
+    if (result < 0)
     {
 	fprintf(stderr, "HardwareSerial::read read failed: %s\n", strerror(errno));
 	return 0;
     }
-//    printf("got: %02x\n", data);
-    return data;
+    _rxTail = result;
+    return _rxTail;
 }
 
 size_t HardwareSerial::write(uint8_t ch)
@@ -85,6 +129,62 @@ size_t HardwareSerial::write(uint8_t ch)
     return 1; // OK
 }
 
+size_t HardwareSerial::write(const uint8_t* buf, size_t len)
+{
+    size_t sent = 0;
+    // Writes to a serial port can be partial, so carry on from where it stopped
+    while (sent < len)
+    {
+	ssize_t result = ::write(_device, buf + sent, len - sent);
+	if (result < 0)
+	{
+	    if (errno == EINTR)
+		continue;
+	    fprintf(stderr, "HardwareSerial::write failed: %s\n", strerror(errno));
+	    break;
+	}
+	sent += result;
+    }
+    return sent;
+}
+
+size_t HardwareSerial::writev(const struct iovec* iov, int iovcnt)
+{
+    ssize_t result;
+    do
+	result = ::writev(_device, iov, iovcnt);
+    while (result < 0 && errno == EINTR);
+    if (result < 0)
+    {
+	fprintf(stderr, "HardwareSerial::writev failed: %s\n", strerror(errno));
+	return 0;
+    }
+
+    // If the write was partial, send the rest of the buffers one at a time
+    size_t sent = result;
+    size_t done = result; // Bytes sent from the buffers not yet passed over
+    for (int i = 0; i < iovcnt; i++)
+    {
+	size_t len = iov[i].iov_len;
+	if (done >= len)
+	{
+	    done -= len;
+	    continue;
+	}
+	size_t rest = write((const uint8_t*)iov[i].iov_base + done, len - done);
+	sent += rest;
+	if (rest != len - done)
+	    break; // Error
+	done = 0;
+    }
+    return sent;
+}
+
+int HardwareSerial::fd()
+{
+    return _device;
+}
+
 bool HardwareSerial::openDevice()
 {
     if (_device == -1)
@@ -107,6 +207,7 @@ bool HardwareSerial::closeDevice()
     if (_device != -1)
 	close(_device);
     _device = -1;
+    _rxHead = _rxTail = 0; // Discard anything buffered
     return true;
 }
 
@@ -222,6 +323,10 @@ bool HardwareSerial::waitAvailableTimeout(uint16_t timeout)
     fd_set         input;
     int            result;
 
+    // select() cant see characters we have already read into our buffer
+    if (_rxHead < _rxTail)
+	return true;
+
     FD_ZERO(&input);
     FD_SET(_device, &input);
     max_fd = _device + 1;
@@ -6,6 +6,14 @@
 #define HardwareSerial_h
 
 #include <stdio.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+// Size of the internal receive buffer. Received characters are read from the device
+// in chunks of up to this many bytes, rather than with one system call per character
+#ifndef RH_HARDWARESERIAL_RX_BUF_LEN
+ #define RH_HARDWARESERIAL_RX_BUF_LEN 1024
+#endif
 
 /////////////////////////////////////////////////////////////////////
 /// \class HardwareSerial HardwareSerial.h <RHutil/HardwareSerial.h>
@@ -16,6 +24,10 @@
 /// We implement just enough to provide the services RadioHead needs.
 /// Additional methods not present on Arduino are also provided for waiting for characters.
 ///
+/// Received characters are read from the device in chunks into an internal buffer, so that
+/// reading a burst of characters costs a couple of system calls, not several per character.
+/// peekBuffer() and consume() give direct access to the buffered characters.
+///
 /// The device port is configured for 8 bits, no parity, 1 stop bit and full raw transparency, so it can be used
 /// to send and receive any 8 bit character. A limited range of baud rates is supported.
 ///
@@ -53,20 +65,35 @@ public:
     /// Blocks until any data yet to be transmtted is sent.
     void flush();
 
-    /// Peek at the nex available character without consuming it.
-    /// CAUTION: Not implemented.
+    /// Peek at the next available character without consuming it.
+    /// \return The next available character, or -1 if none is available
     int peek(void);
 
     /// Returns the number of bytes immediately available to be read from the
-    /// device.
+    /// device. If there are characters in the internal buffer, returns the number buffered
+    /// without making any system calls.
     /// \return 0 if none available else the number of characters available for immediate reading
     int available();
 
     /// Read and return the next available character.
-    /// If no character is available prints a message to stderr and returns 0;
+    /// Blocks if no character is available.
+    /// If the read fails prints a message to stderr and returns 0;
     /// \return The next available character
     int read();
 
+    /// Gives direct access to the received characters in the internal buffer, without copying them.
+    /// If the buffer is empty, reads all the characters immediately available from the device into it
+    /// (up to RH_HARDWARESERIAL_RX_BUF_LEN). Does not block.
+    /// The characters remain in the buffer until they are removed with consume().
+    /// \param[out] data Set to point to the first buffered character
+    /// \return The number of buffered characters at *data. 0 if none are available.
+    size_t peekBuffer(const uint8_t** data);
+
+    /// Removes characters from the front of the internal buffer, typically after they
+    /// have been processed via peekBuffer().
+    /// \param[in] len The number of characters to remove
+    void consume(size_t len);
+
     /// Transmit a single character oin the serial port.
     /// Returns immediately.
     /// IO errors are repored by printing aa message to stderr.
@@ -74,6 +101,22 @@ public:
     /// \return 1 if successful else 0
     size_t write(uint8_t ch);
 
+    /// Transmit several characters on the serial port, with a single system call if possible.
+    /// Blocks until they have all been handed to the device.
+    /// IO errors are repored by printing aa message to stderr.
+    /// \param[in] buf The characters to send
+    /// \param[in] len The number of characters to send
+    /// \return The number of characters sent, which is less than len only on error
+    size_t write(const uint8_t* buf, size_t len);
+
+    /// Transmit the contents of several buffers on the serial port, with a single system call if possible.
+    /// Blocks until they have all been handed to the device.
+    /// IO errors are repored by printing aa message to stderr.
+    /// \param[in] iov Array of buffers to send, in order
+    /// \param[in] iovcnt Number of buffers in iov
+    /// \return The total number of characters sent, which is less than the sum of the buffer lengths only on error
+    size_t writev(const struct iovec* iov, int iovcnt);
+
     // These are not usually in HardwareSerial but we 
     // need them in a Unix environment
 
@@ -86,15 +129,32 @@ public:
     /// \return true if a message is available as reported by available()
     bool waitAvailableTimeout(uint16_t timeout);
 
+    /// Returns the file descriptor of the open port, or -1 if the port is not open.
+    /// This allows a program to wait for input on many ports at once
+    /// with select(), poll() or epoll (see RHReactor).
+    /// \return The device file descriptor
+    int fd();
+
 protected:
     bool openDevice();
     bool closeDevice();
     bool setBaud(int baud);
 
+    /// If the internal buffer is empty, reads all the characters immediately available from the device
+    /// into it, without blocking
+    /// \return The number of characters buffered
+    size_t fillBuffer();
+
 private:
     const char* _deviceName;
     int         _device; // file desriptor
     int         _baud;
+
+    /// Internal receive buffer. Characters _rxBuf[_rxHead] to _rxBuf[_rxTail - 1] have
+    /// been read from the device but not yet consumed
+    uint8_t     _rxBuf[RH_HARDWARESERIAL_RX_BUF_LEN];
+    size_t      _rxHead;
+    size_t      _rxTail;
 };
 
 #endif
@@ -0,0 +1,221 @@
+// RHReactor.cpp
+//
+// Copyright (C) 2014 Mike McCauley
+// $Id: RHReactor.cpp $
+
+#include <RadioHead.h>
+
+// This can only build on Linux, which has epoll
+#if (RH_PLATFORM == RH_PLATFORM_UNIX) && defined(__linux__)
+
+#include <RHReactor.h>
+#include <RH_TCP.h>
+#include <RH_Serial.h>
+#include <HardwareSerial.h>
+#include <errno.h>
+#include <unistd.h>
+
+RHReactor::RHReactor()
+    : _epollFd(-1),
+      _stopped(false)
+{
+    for (uint16_t i = 0; i < RH_REACTOR_MAX_SOURCES; i++)
+	_sources[i].fd = -1;
+}
+
+RHReactor::~RHReactor()
+{
+    if (_epollFd >= 0)
+	close(_epollFd);
+}
+
+bool RHReactor::init()
+{
+    if (_epollFd >= 0)
+	return true; // Already done
+    _epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (_epollFd < 0)
+    {
+	fprintf(stderr, "RHReactor::init epoll_create1 failed: %s\n", strerror(errno));
+	return false;
+    }
+    return true;
+}
+
+int RHReactor::fd()
+{
+    return _epollFd;
+}
+
+////////////////////////////////////////////////////////////////////
+uint16_t RHReactor::findFd(int fd)
+{
+    uint16_t i;
+    for (i = 0; i < RH_REACTOR_MAX_SOURCES; i++)
+	if (_sources[i].fd >= 0 && _sources[i].fd == fd)
+	    break;
+    return i;
+}
+
+bool RHReactor::addSource(int fd, uint32_t events, FdHandler fdHandler, RHGenericDriver* driver,
+			  MessageHandler messageHandler, void* arg)
+{
+    if (_epollFd < 0 || fd < 0 || findFd(fd) < RH_REACTOR_MAX_SOURCES)
+	return false;
+    uint16_t i;
+    for (i = 0; i < RH_REACTOR_MAX_SOURCES; i++)
+	if (_sources[i].fd < 0)
+	    break;
+    if (i >= RH_REACTOR_MAX_SOURCES)
+	return false; // No room
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    // Look up the source by fd rather than by index, so that an event that was already returned by
+    // epoll_wait for a source removed by an earlier handler is never delivered to a new one in its slot
+    event.data.fd = fd;
+    if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &event) != 0)
+    {
+	fprintf(stderr, "RHReactor::addSource epoll_ctl failed: %s\n", strerror(errno));
+	return false;
+    }
+    _sources[i].fd             = fd;
+    _sources[i].fdHandler      = fdHandler;
+    _sources[i].driver         = driver;
+    _sources[i].messageHandler = messageHandler;
+    _sources[i].arg            = arg;
+    // The driver may already have read in messages before it was registered
+    _sources[i].pending        = driver != NULL;
+    return true;
+}
+
+bool RHReactor::addFd(int fd, FdHandler handler, void* arg, uint32_t events)
+{
+    if (!handler)
+	return false;
+    return addSource(fd, events, handler, NULL, NULL, arg);
+}
+
+bool RHReactor::removeFd(int fd)
+{
+    uint16_t i = findFd(fd);
+    if (i >= RH_REACTOR_MAX_SOURCES)
+	return false;
+    // This fails harmlessly if the caller has already closed fd
+    epoll_ctl(_epollFd, EPOLL_CTL_DEL, fd, NULL);
+    _sources[i].fd = -1;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHReactor::addDriver(RHGenericDriver& driver, int fd, MessageHandler handler, void* arg)
+{
+    if (!handler)
+	return false;
+    return addSource(fd, EPOLLIN, NULL, &driver, handler, arg);
+}
+
+bool RHReactor::addDriver(RH_TCP& driver, MessageHandler handler, void* arg)
+{
+    return addDriver(driver, driver.fd(), handler, arg);
+}
+
+bool RHReactor::addDriver(RH_Serial& driver, MessageHandler handler, void* arg)
+{
+    return addDriver(driver, driver.serial().fd(), handler, arg);
+}
+
+bool RHReactor::removeDriver(RHGenericDriver& driver)
+{
+    for (uint16_t i = 0; i < RH_REACTOR_MAX_SOURCES; i++)
+	if (_sources[i].fd >= 0 && _sources[i].driver == &driver)
+	    return removeFd(_sources[i].fd);
+    return false;
+}
+
+void RHReactor::checkDriver(RHGenericDriver& driver)
+{
+    for (uint16_t i = 0; i < RH_REACTOR_MAX_SOURCES; i++)
+	if (_sources[i].fd >= 0 && _sources[i].driver == &driver)
+	    _sources[i].pending = true;
+}
+
+////////////////////////////////////////////////////////////////////
+int RHReactor::serviceDriver(uint16_t index)
+{
+    int              fd     = _sources[index].fd;
+    RHGenericDriver* driver = _sources[index].driver;
+    int              calls  = 0;
+
+    _sources[index].pending = false;
+    while (calls < RH_REACTOR_MAX_BATCH && driver->available())
+    {
+	_sources[index].messageHandler(*driver, _sources[index].arg);
+	calls++;
+	if (_sources[index].fd != fd || _sources[index].driver != driver)
+	    return calls; // Handler removed this driver
+    }
+    // If we stopped because of the batch limit, come back next time without waiting
+    if (calls >= RH_REACTOR_MAX_BATCH)
+	_sources[index].pending = true;
+    return calls;
+}
+
+int RHReactor::runOnce(int timeout)
+{
+    if (_epollFd < 0)
+	return -1;
+
+    uint16_t i;
+    // epoll cannot tell us about messages the drivers have already read in, so dont wait if there are any
+    for (i = 0; i < RH_REACTOR_MAX_SOURCES; i++)
+	if (_sources[i].fd >= 0 && _sources[i].pending)
+	    timeout = 0;
+
+    struct epoll_event events[RH_REACTOR_MAX_SOURCES];
+    int ready = epoll_wait(_epollFd, events, RH_REACTOR_MAX_SOURCES, timeout);
+    if (ready < 0)
+    {
+	if (errno == EINTR)
+	    return 0;
+	fprintf(stderr, "RHReactor::runOnce epoll_wait failed: %s\n", strerror(errno));
+	return -1;
+    }
+
+    int calls = 0;
+    for (int e = 0; e < ready; e++)
+    {
+	i = findFd(events[e].data.fd);
+	if (i >= RH_REACTOR_MAX_SOURCES)
+	    continue; // Removed by an earlier handler
+	if (_sources[i].driver)
+	    _sources[i].pending = true; // Serviced below
+	else
+	{
+	    _sources[i].fdHandler(_sources[i].fd, events[e].events, _sources[i].arg);
+	    calls++;
+	}
+    }
+
+    // Now deliver messages from all the drivers that were readable or already had messages
+    for (i = 0; i < RH_REACTOR_MAX_SOURCES; i++)
+	if (_sources[i].fd >= 0 && _sources[i].driver && _sources[i].pending)
+	    calls += serviceDriver(i);
+    return calls;
+}
+
+void RHReactor::run()
+{
+    _stopped = false;
+    while (!_stopped)
+	if (runOnce(-1) < 0)
+	    break;
+}
+
+void RHReactor::stop()
+{
+    _stopped = true;
+}
+
+#endif
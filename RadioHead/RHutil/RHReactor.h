@@ -0,0 +1,195 @@
+// RHReactor.h
+// Author: Mike McCauley (mikem@airspayce.com)
+// Copyright (C) 2014 Mike McCauley
+// $Id: RHReactor.h $
+#ifndef RHReactor_h
+#define RHReactor_h
+
+#include <RadioHead.h>
+
+// This can only build on Linux, which has epoll
+#if (RH_PLATFORM == RH_PLATFORM_UNIX) && defined(__linux__)
+
+#include <RHGenericDriver.h>
+#include <sys/epoll.h>
+
+// Maximum number of file descriptors and drivers that can be registered with one RHReactor
+#ifndef RH_REACTOR_MAX_SOURCES
+ #define RH_REACTOR_MAX_SOURCES 64
+#endif
+
+// Maximum number of messages delivered from one driver each time it is serviced by runOnce().
+// Any more are delivered on the next call to runOnce(), so one busy radio cannot starve the others
+#ifndef RH_REACTOR_MAX_BATCH
+ #define RH_REACTOR_MAX_BATCH 16
+#endif
+
+class RH_TCP;
+class RH_Serial;
+
+/////////////////////////////////////////////////////////////////////
+/// \class RHReactor RHReactor.h <RHutil/RHReactor.h>
+/// \brief Event loop that serves many RadioHead drivers from a single thread on Linux
+///
+/// This class lets one thread multiplex many RH_TCP and RH_Serial driver instances (and any
+/// other file descriptors the program is interested in) on a single epoll descriptor, instead of
+/// polling each driver's available() in turn. It is intended for gateway programs on Linux hosts
+/// that connect many radios (or simulated radios) together.
+///
+/// Each registered driver has a MessageHandler callback, which is called whenever the driver has a
+/// message available. The handler must consume the message with recv() (or a manager's recvfrom()
+/// etc), otherwise the reactor will stop delivering for that driver after RH_REACTOR_MAX_BATCH calls.
+/// Plain file descriptors have an FdHandler callback, which is called with the epoll events
+/// reported for the descriptor.
+///
+/// Drivers may hold complete messages in their own buffers, where epoll cannot see them
+/// (for example when several messages arrive from the ether simulator in one read). The reactor
+/// keeps track of drivers that still have messages after being serviced, and services them again on
+/// the next call to runOnce() without waiting. If your program calls available() on a registered
+/// driver outside a handler (for example via a manager's sendtoWait(), which waits for an ACK), call
+/// checkDriver() afterwards so that any message it read in is not left undelivered.
+///
+/// Callbacks may register and remove sources, including the one currently being serviced.
+///
+/// \par Example
+///
+/// \code
+/// RHReactor reactor;
+/// reactor.init();
+/// reactor.addDriver(driver1, handleMessage, &driver2);
+/// reactor.addDriver(driver2, handleMessage, &driver1);
+/// while (1)
+///     reactor.runOnce(1000);
+/// \endcode
+///
+/// See the example simulator_reactor_gateway.pde
+class RHReactor
+{
+public:
+    /// Callback for a plain file descriptor
+    /// \param[in] fd The file descriptor that is ready
+    /// \param[in] events The epoll events reported for the descriptor (EPOLLIN, EPOLLOUT etc)
+    /// \param[in] arg The arg passed to addFd()
+    typedef void (*FdHandler)(int fd, uint32_t events, void* arg);
+
+    /// Callback for a driver that has a message available
+    /// \param[in] driver The driver that has a message available. The handler should recv() it
+    /// \param[in] arg The arg passed to addDriver()
+    typedef void (*MessageHandler)(RHGenericDriver& driver, void* arg);
+
+    /// Constructor. You must call init() before registering any sources.
+    RHReactor();
+
+    /// Destructor. Closes the epoll descriptor, but not any of the registered ones
+    ~RHReactor();
+
+    /// Creates the epoll descriptor
+    /// \return true if successful
+    bool init();
+
+    /// Returns the epoll file descriptor, so that this reactor can itself be
+    /// nested in another event loop.
+    /// \return The epoll file descriptor, or -1 if not initialised
+    int fd();
+
+    /// Registers a plain file descriptor
+    /// \param[in] fd The file descriptor to watch
+    /// \param[in] handler Function to call when the descriptor is ready
+    /// \param[in] arg Passed to the handler
+    /// \param[in] events The epoll events of interest
+    /// \return true if successful, false if fd is already registered, there is no room or epoll_ctl failed
+    bool addFd(int fd, FdHandler handler, void* arg = NULL, uint32_t events = EPOLLIN);
+
+    /// Deregisters a file descriptor registered with addFd() or addDriver()
+    /// \param[in] fd The file descriptor to remove
+    /// \return true if it was registered
+    bool removeFd(int fd);
+
+    /// Registers a driver that receives through the given file descriptor
+    /// \param[in] driver The driver to watch. It must already have been successfully initialised.
+    /// \param[in] fd The file descriptor that becomes readable when the driver has new data
+    /// \param[in] handler Function to call when the driver has a message available
+    /// \param[in] arg Passed to the handler
+    /// \return true if successful
+    bool addDriver(RHGenericDriver& driver, int fd, MessageHandler handler, void* arg = NULL);
+
+    /// Registers an RH_TCP driver, using its socket
+    /// \param[in] driver The driver to watch. It must already have been successfully initialised.
+    /// \param[in] handler Function to call when the driver has a message available
+    /// \param[in] arg Passed to the handler
+    /// \return true if successful
+    bool addDriver(RH_TCP& driver, MessageHandler handler, void* arg = NULL);
+
+    /// Registers an RH_Serial driver, using its serial port
+    /// \param[in] driver The driver to watch. It must already have been successfully initialised.
+    /// \param[in] handler Function to call when the driver has a message available
+    /// \param[in] arg Passed to the handler
+    /// \return true if successful
+    bool addDriver(RH_Serial& driver, MessageHandler handler, void* arg = NULL);
+
+    /// Deregisters a driver
+    /// \param[in] driver The driver to remove
+    /// \return true if it was registered
+    bool removeDriver(RHGenericDriver& driver);
+
+    /// Requests that the driver be checked for available messages on the next call to runOnce(),
+    /// even if its file descriptor is not readable. Call this after calling available()
+    /// on a registered driver outside a MessageHandler.
+    /// \param[in] driver The driver to check
+    void checkDriver(RHGenericDriver& driver);
+
+    /// Waits for at most timeout milliseconds for any registered source to become ready, and
+    /// calls the handlers of all ready sources. Does not wait at all if a driver is known
+    /// to have messages still available.
+    /// \param[in] timeout Maximum time to wait in milliseconds. -1 means wait forever
+    /// \return The number of handler calls made, or -1 on error
+    int runOnce(int timeout = -1);
+
+    /// Calls runOnce() until stop() is called (usually from within a handler)
+    void run();
+
+    /// Causes run() to return after the current call to runOnce()
+    void stop();
+
+protected:
+    /// Calls the driver's handler for each available message, at most RH_REACTOR_MAX_BATCH times,
+    /// and notes whether there are still messages available
+    /// \param[in] index Index of the source in _sources
+    /// \return The number of handler calls made
+    int serviceDriver(uint16_t index);
+
+private:
+    /// Finds a registered source by file descriptor
+    /// \return Its index in _sources, or RH_REACTOR_MAX_SOURCES if not registered
+    uint16_t findFd(int fd);
+
+    /// Registers a source in _sources and with epoll
+    bool addSource(int fd, uint32_t events, FdHandler fdHandler, RHGenericDriver* driver,
+		   MessageHandler messageHandler, void* arg);
+
+    /// A registered file descriptor or driver
+    typedef struct
+    {
+	int              fd;             ///< -1 if this slot is free
+	FdHandler        fdHandler;      ///< For plain descriptors
+	RHGenericDriver* driver;         ///< NULL for plain descriptors
+	MessageHandler   messageHandler; ///< For drivers
+	void*            arg;            ///< Passed to the handler
+	bool             pending;        ///< Driver may have messages that epoll will not report
+    } Source;
+
+    /// The epoll descriptor
+    int               _epollFd;
+
+    /// Registered sources
+    Source            _sources[RH_REACTOR_MAX_SOURCES];
+
+    /// Set by stop() to make run() return
+    bool              _stopped;
+};
+
+/// @example simulator_reactor_gateway.pde
+
+#endif
+
+#endif
@@ -0,0 +1,135 @@
+// RHSimClock.cpp
+//
+// Copyright (C) 2014 Mike McCauley
+// $Id: RHSimClock.cpp $
+
+#include <RadioHead.h>
+
+#if (RH_PLATFORM == RH_PLATFORM_UNIX)
+
+#include <RHSimClock.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+RHSimClock::RHSimClock()
+    : _numEventSources(0)
+{
+}
+
+RHSimClock::~RHSimClock()
+{
+}
+
+void RHSimClock::yield()
+{
+}
+
+bool RHSimClock::advanceTo(uint64_t time)
+{
+    (void)time; // Not used
+    return false;
+}
+
+bool RHSimClock::addEventSource(NextEventFn fn, void* arg)
+{
+    if (_numEventSources >= RH_SIM_CLOCK_MAX_EVENT_SOURCES)
+	return false;
+    _eventSources[_numEventSources].fn  = fn;
+    _eventSources[_numEventSources].arg = arg;
+    _numEventSources++;
+    return true;
+}
+
+void RHSimClock::removeEventSource(NextEventFn fn, void* arg)
+{
+    for (uint8_t i = 0; i < _numEventSources; i++)
+    {
+	if (_eventSources[i].fn == fn && _eventSources[i].arg == arg)
+	{
+	    _eventSources[i] = _eventSources[--_numEventSources];
+	    return;
+	}
+    }
+}
+
+uint64_t RHSimClock::nextEventTime()
+{
+    uint64_t next = RH_SIM_CLOCK_NO_EVENT;
+    for (uint8_t i = 0; i < _numEventSources; i++)
+    {
+	uint64_t t = _eventSources[i].fn(_eventSources[i].arg);
+	if (t < next)
+	    next = t;
+    }
+    return next;
+}
+
+////////////////////////////////////////////////////////////////////
+RHSimRealClock::RHSimRealClock()
+    : _start(timeInMicros())
+{
+}
+
+uint64_t RHSimRealClock::timeInMicros()
+{
+    struct timeval te;
+    gettimeofday(&te, NULL);
+    return te.tv_sec * 1000000ULL + te.tv_usec;
+}
+
+uint64_t RHSimRealClock::micros()
+{
+    return timeInMicros() - _start;
+}
+
+void RHSimRealClock::delay(uint64_t us)
+{
+    usleep(us);
+}
+
+////////////////////////////////////////////////////////////////////
+RHSimVirtualClock::RHSimVirtualClock()
+    : _now(0),
+      _quantum(RH_SIM_CLOCK_DEFAULT_QUANTUM)
+{
+}
+
+uint64_t RHSimVirtualClock::micros()
+{
+    return _now;
+}
+
+void RHSimVirtualClock::delay(uint64_t us)
+{
+    _now += us;
+}
+
+void RHSimVirtualClock::yield()
+{
+    uint64_t next = _now + _quantum;
+    uint64_t event = nextEventTime();
+    // Events in the past or now have already been seen by whoever is waiting
+    if (event > _now && event < next)
+	next = event;
+    _now = next;
+}
+
+bool RHSimVirtualClock::advanceTo(uint64_t time)
+{
+    if (time > _now)
+	_now = time;
+    return true;
+}
+
+void RHSimVirtualClock::advance(uint64_t us)
+{
+    _now += us;
+}
+
+void RHSimVirtualClock::setQuantum(uint32_t us)
+{
+    if (us)
+	_quantum = us;
+}
+
+#endif
@@ -0,0 +1,191 @@
+// RHSimClock.h
+// Author: Mike McCauley (mikem@airspayce.com)
+// Copyright (C) 2014 Mike McCauley
+// $Id: RHSimClock.h $
+#ifndef RHSimClock_h
+#define RHSimClock_h
+
+#include <RadioHead.h>
+
+#if (RH_PLATFORM == RH_PLATFORM_UNIX)
+
+// Maximum number of event sources that can be registered with one RHSimClock
+#ifndef RH_SIM_CLOCK_MAX_EVENT_SOURCES
+ #define RH_SIM_CLOCK_MAX_EVENT_SOURCES 8
+#endif
+
+// Default amount of virtual time in microseconds that passes each time a program
+// yields to an RHSimVirtualClock while it waits for something
+#ifndef RH_SIM_CLOCK_DEFAULT_QUANTUM
+ #define RH_SIM_CLOCK_DEFAULT_QUANTUM 1000
+#endif
+
+// Value returned by an event source when it has no events pending
+#define RH_SIM_CLOCK_NO_EVENT 0xffffffffffffffffULL
+
+/////////////////////////////////////////////////////////////////////
+/// \class RHSimClock RHSimClock.h <RHutil/RHSimClock.h>
+/// \brief Abstract base class for the clocks that drive simulated sketches on Linux
+///
+/// In the simulator build (tools/simBuild), millis(), delay() and the YIELD in every RadioHead
+/// wait loop are implemented by the current simulator clock, which can be changed with
+/// setSimulatorClock(). The default is an RHSimRealClock, which runs in real time as before.
+/// A sketch that only talks to simulated radios (see RH_SimChannel) can install an
+/// RHSimVirtualClock instead, so that timeouts, retransmissions, route discovery and
+/// CAD backoff take no real time at all:
+/// \code
+/// RHSimVirtualClock clock;
+/// void setup()
+/// {
+///    setSimulatorClock(&clock);
+///    medium.setClock(clock);
+///    ...
+/// \endcode
+///
+/// Objects that know when something will next happen in simulated time (such as RHSimMedium)
+/// can register themselves as event sources, so that a virtual clock can jump straight to the
+/// next event instead of creeping towards it.
+class RHSimClock
+{
+public:
+    /// Callback that reports the time of the next event of an event source
+    /// \param[in] arg The arg passed to addEventSource()
+    /// \return The time of the next event in microseconds, or RH_SIM_CLOCK_NO_EVENT
+    typedef uint64_t (*NextEventFn)(void* arg);
+
+    /// Constructor
+    RHSimClock();
+
+    /// Destructor
+    virtual ~RHSimClock();
+
+    /// Returns the current time on this clock
+    /// \return The time in microseconds since the clock was created
+    virtual uint64_t micros() = 0;
+
+    /// Waits until the given amount of time has passed on this clock
+    /// \param[in] us The time to wait in microseconds
+    virtual void     delay(uint64_t us) = 0;
+
+    /// Called by the YIELD in every RadioHead wait loop, and after every call to the sketch's loop().
+    /// Lets time pass on clocks that do not move by themselves. This default does nothing.
+    virtual void     yield();
+
+    /// Moves the clock forward to the given time, if the clock can be moved.
+    /// This default does nothing, and is suitable for clocks that move by themselves.
+    /// \param[in] time The new time in microseconds
+    /// \return true if the clock can be moved
+    virtual bool     advanceTo(uint64_t time);
+
+    /// Registers an event source
+    /// \param[in] fn Function to call to find the time of the next event from the source
+    /// \param[in] arg Passed to fn
+    /// \return true if successful, false if there is no room
+    bool             addEventSource(NextEventFn fn, void* arg);
+
+    /// Deregisters an event source
+    /// \param[in] fn The fn passed to addEventSource()
+    /// \param[in] arg The arg passed to addEventSource()
+    void             removeEventSource(NextEventFn fn, void* arg);
+
+    /// Returns the time of the earliest event reported by any of the registered event sources
+    /// \return The time in microseconds, or RH_SIM_CLOCK_NO_EVENT if there are no events pending
+    uint64_t         nextEventTime();
+
+private:
+    /// A registered event source
+    typedef struct
+    {
+	NextEventFn fn;
+	void*       arg;
+    } EventSource;
+
+    /// The registered event sources
+    EventSource     _eventSources[RH_SIM_CLOCK_MAX_EVENT_SOURCES];
+    uint8_t         _numEventSources;
+};
+
+/////////////////////////////////////////////////////////////////////
+/// \class RHSimRealClock RHSimClock.h <RHutil/RHSimClock.h>
+/// \brief Simulator clock that runs in real time
+///
+/// micros() is the time since the clock was created, and delay() sleeps.
+/// This is the default simulator clock, and the one to use with RH_TCP and tools/etherSimulator.pl
+class RHSimRealClock : public RHSimClock
+{
+public:
+    /// Constructor. The clock starts at 0
+    RHSimRealClock();
+
+    /// Returns the real time since the clock was created
+    /// \return The time in microseconds
+    virtual uint64_t micros();
+
+    /// Sleeps for the given time
+    /// \param[in] us The time to sleep in microseconds
+    virtual void     delay(uint64_t us);
+
+private:
+    /// Returns the time since some arbitrary start point in microseconds
+    static uint64_t  timeInMicros();
+
+    /// timeInMicros() when the clock was created
+    uint64_t         _start;
+};
+
+/////////////////////////////////////////////////////////////////////
+/// \class RHSimVirtualClock RHSimClock.h <RHutil/RHSimClock.h>
+/// \brief Discrete event simulator clock that only moves when the program is waiting
+///
+/// The time on this clock does not move while the program is busy. It jumps forward
+/// instantly whenever the program waits:
+/// \li delay() moves the clock forward by the requested time
+/// \li yield() (called by the YIELD in every RadioHead wait loop, and after each call to loop())
+/// moves the clock forward to the next event reported by the registered event sources,
+/// or by the quantum (default RH_SIM_CLOCK_DEFAULT_QUANTUM microseconds), whichever is sooner.
+/// The quantum lets timeouts measured with millis() expire in a bounded number of calls to yield().
+///
+/// So a program that spends most of its time waiting for timeouts or for simulated messages runs
+/// many times faster than real time, and always does exactly the same thing.
+/// The clock can also be moved by the program with advance() and advanceTo().
+class RHSimVirtualClock : public RHSimClock
+{
+public:
+    /// Constructor. The clock starts at 0
+    RHSimVirtualClock();
+
+    /// Returns the current virtual time
+    /// \return The time in microseconds
+    virtual uint64_t micros();
+
+    /// Moves the clock forward by the given time, without actually waiting
+    /// \param[in] us The time to wait in microseconds
+    virtual void     delay(uint64_t us);
+
+    /// Moves the clock forward to the next event, or by the quantum, whichever is sooner
+    virtual void     yield();
+
+    /// Moves the clock forward to the given time. Does nothing if it is already at or past that time
+    /// \param[in] time The new time in microseconds
+    /// \return true
+    virtual bool     advanceTo(uint64_t time);
+
+    /// Moves the clock forward
+    /// \param[in] us The number of microseconds to move forward by
+    void             advance(uint64_t us);
+
+    /// Sets the maximum amount of time that passes on each call to yield()
+    /// \param[in] us The quantum in microseconds. Must be > 0
+    void             setQuantum(uint32_t us);
+
+protected:
+    /// Current virtual time in microseconds
+    uint64_t         _now;
+
+    /// Maximum amount of time that passes on each call to yield()
+    uint32_t         _quantum;
+};
+
+#endif
+
+#endif
@@ -0,0 +1,164 @@
+// RHSimHarness.cpp
+//
+// Copyright (C) 2014 Mike McCauley
+// $Id: RHSimHarness.cpp $
+
+#include <RadioHead.h>
+
+#if (RH_PLATFORM == RH_PLATFORM_UNIX)
+
+#include <RHSimHarness.h>
+
+RHSimHarness* RHSimHarness::_running = NULL;
+
+RHSimHarness::RHSimHarness()
+    : _numNodes(0),
+      _current(-1),
+      _settingUp(0),
+      _stopped(false)
+{
+}
+
+RHSimHarness::~RHSimHarness()
+{
+    for (uint16_t i = 0; i < _numNodes; i++)
+    {
+	free(_nodes[i]->stack);
+	free(_nodes[i]);
+    }
+}
+
+int16_t RHSimHarness::addNode(NodeFunction setup, NodeFunction loop, void* arg, size_t stackSize)
+{
+    if (_numNodes >= RH_SIM_HARNESS_MAX_NODES || !loop)
+	return -1;
+    Node* node = (Node*)calloc(1, sizeof(Node));
+    if (!node)
+	return -1;
+    node->stack = (uint8_t*)malloc(stackSize);
+    if (!node->stack || getcontext(&node->context) != 0)
+    {
+	free(node->stack);
+	free(node);
+	return -1;
+    }
+    node->setup = setup;
+    node->loop  = loop;
+    node->arg   = arg;
+    node->context.uc_stack.ss_sp   = node->stack;
+    node->context.uc_stack.ss_size = stackSize;
+    node->context.uc_link          = &_scheduler;
+    makecontext(&node->context, nodeMain, 0);
+    // wake is 0, so the node runs as soon as the harness does
+    _nodes[_numNodes] = node;
+    _settingUp++;
+    return _numNodes++;
+}
+
+uint16_t RHSimHarness::numNodes()
+{
+    return _numNodes;
+}
+
+int16_t RHSimHarness::currentNode()
+{
+    return _current;
+}
+
+void RHSimHarness::stop()
+{
+    _stopped = true;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHSimHarness::nodeMain()
+{
+    // Only one harness can be running nodes at a time
+    RHSimHarness* harness = _running;
+    Node*         node    = harness->_nodes[harness->_current];
+    if (node->setup)
+	node->setup(node->arg);
+    // Nodes that have not been set up yet cant hear anything we send
+    harness->_settingUp--;
+    while (harness->_settingUp)
+	harness->yield();
+    while (1)
+    {
+	node->loop(node->arg);
+	// Returning from loop() is the node's way of waiting for something to happen
+	harness->yield();
+    }
+}
+
+void RHSimHarness::wait(uint64_t wake, bool polling)
+{
+    Node* node = _nodes[_current];
+    node->wake    = wake;
+    node->polling = polling;
+    node->since   = _now;
+    swapcontext(&node->context, &_scheduler);
+}
+
+void RHSimHarness::yield()
+{
+    if (_current < 0)
+	RHSimVirtualClock::yield();
+    else
+	wait(_now + _quantum, true);
+}
+
+void RHSimHarness::delay(uint64_t us)
+{
+    if (_current < 0)
+	RHSimVirtualClock::delay(us);
+    else if (us == 0)
+	yield();
+    else
+	wait(_now + us, false);
+}
+
+bool RHSimHarness::run(uint64_t duration)
+{
+    if (_current >= 0)
+	return false; // Called by a node
+
+    uint64_t until = _now + duration;
+    _running = this;
+    _stopped = false;
+    while (1)
+    {
+	// Run every node that can continue at this time, in order, each until it waits again
+	bool anyPolling = false;
+	for (uint16_t i = 0; i < _numNodes && !_stopped; i++)
+	{
+	    Node* node = _nodes[i];
+	    if (node->wake <= _now || (node->polling && _now > node->since))
+	    {
+		_current = i;
+		swapcontext(&_scheduler, &node->context);
+		_current = -1;
+	    }
+	    if (node->polling)
+		anyPolling = true;
+	}
+	if (_stopped || _now >= until)
+	    break;
+
+	// Every node is waiting: move to the earliest time any of them can continue
+	uint64_t next = until;
+	for (uint16_t i = 0; i < _numNodes; i++)
+	    if (_nodes[i]->wake < next)
+		next = _nodes[i]->wake;
+	if (anyPolling)
+	{
+	    uint64_t event = nextEventTime();
+	    if (event > _now && event < next)
+		next = event;
+	}
+	_now = next;
+    }
+    _running = NULL;
+    return !_stopped;
+}
+
+#endif
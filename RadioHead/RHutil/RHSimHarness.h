@@ -0,0 +1,168 @@
+// RHSimHarness.h
+// Author: Mike McCauley (mikem@airspayce.com)
+// Copyright (C) 2014 Mike McCauley
+// $Id: RHSimHarness.h $
+#ifndef RHSimHarness_h
+#define RHSimHarness_h
+
+#include <RadioHead.h>
+
+#if (RH_PLATFORM == RH_PLATFORM_UNIX)
+
+#include <RHSimClock.h>
+#include <ucontext.h>
+
+// Maximum number of nodes that can be run by one RHSimHarness
+#ifndef RH_SIM_HARNESS_MAX_NODES
+ #define RH_SIM_HARNESS_MAX_NODES 256
+#endif
+
+// Default size of the stack given to each node, in octets
+#ifndef RH_SIM_HARNESS_STACK_SIZE
+ #define RH_SIM_HARNESS_STACK_SIZE 65536
+#endif
+
+/////////////////////////////////////////////////////////////////////
+/// \class RHSimHarness RHSimHarness.h <RHutil/RHSimHarness.h>
+/// \brief Runs many simulated nodes, each with its own setup and loop functions, in one process
+///
+/// Normally each simulated sketch built with tools/simBuild runs in its own process, with one
+/// global setup() and loop(). RHSimHarness instead lets a single sketch create many independent
+/// node contexts, each typically with its own RH_SimChannel driver and manager, and its own
+/// setup and loop functions that are called exactly like an Arduino sketch's, with a pointer
+/// to the node's own data.
+///
+/// Each node runs on its own stack as a coroutine. The harness is itself an RHSimVirtualClock, and
+/// when installed as the simulator clock with setSimulatorClock(), every YIELD in a RadioHead wait
+/// loop, every delay() and every return from a node's loop function switches to the next node.
+/// Nodes therefore run one at a time, in a fixed order, and only while the others are waiting,
+/// so the managers need no locking, and a scenario with a given random seed always gives the
+/// same results. No node's loop function is called until every node's setup function has returned,
+/// so every node's driver is attached to the medium before the first message is sent.
+///
+/// Virtual time stands still while any node can run. Once every node is waiting, the clock moves
+/// forward to the earliest of:
+/// \li the end of the earliest delay()
+/// \li the next event reported by the clock's event sources (such as an RHSimMedium on this clock)
+/// \li the quantum (see setQuantum()) after the last time any node yielded while polling
+///
+/// So blocking manager calls such as RHReliableDatagram::sendtoWait() and RHMesh::recvfromAckTimeout()
+/// can be used in the node loop functions as in any other sketch, and a whole network runs
+/// many times faster than real time.
+///
+/// \par Example
+///
+/// \code
+/// RHSimHarness harness;
+/// RHSimMedium  medium;
+///
+/// void setup()
+/// {
+///    setSimulatorClock(&harness);
+///    medium.setClock(harness);
+///    for (uint8_t i = 0; i < NUM_NODES; i++)
+///       harness.addNode(nodeSetup, nodeLoop, &nodes[i]);
+///    harness.run(60000000); // 60 seconds of virtual time
+///    ...
+/// \endcode
+///
+/// Random numbers used by the managers (eg for retransmission timeouts) come from random(), which the
+/// simulator seeds from the process ID. Call srandom() with a fixed seed for repeatable results.
+///
+/// See the example simulator_sim_harness.pde
+class RHSimHarness : public RHSimVirtualClock
+{
+public:
+    /// Type of the node setup and loop functions
+    /// \param[in] arg The arg passed to addNode()
+    typedef void (*NodeFunction)(void* arg);
+
+    /// Constructor
+    RHSimHarness();
+
+    /// Destructor. Frees the node stacks
+    ~RHSimHarness();
+
+    /// Adds a node. The node's setup function is called the first time the node runs.
+    /// Once every node's setup function has returned, its loop function is called repeatedly.
+    /// \param[in] setup Function to call once. May be NULL
+    /// \param[in] loop Function to call repeatedly
+    /// \param[in] arg Passed to the setup and loop functions. Usually points to the node's driver, manager etc
+    /// \param[in] stackSize The size of the node's stack in octets
+    /// \return The index of the new node, or -1 if there is no room or no memory
+    int16_t addNode(NodeFunction setup, NodeFunction loop, void* arg, size_t stackSize = RH_SIM_HARNESS_STACK_SIZE);
+
+    /// Runs the nodes until the virtual clock reaches the given time, or stop() is called.
+    /// Must not be called by a node.
+    /// \param[in] duration How long to run for, in microseconds of virtual time
+    /// \return true if it ran for the whole duration, false if stopped
+    bool run(uint64_t duration);
+
+    /// Causes run() to return as soon as the node that calls it waits
+    void stop();
+
+    /// Returns the index of the node that is running
+    /// \return The index returned by addNode(), or -1 if no node is running
+    int16_t currentNode();
+
+    /// Returns the number of nodes added
+    /// \return The number of nodes
+    uint16_t numNodes();
+
+    /// When called by a node, lets the other nodes run and then continues after at least
+    /// the quantum or until the next event, whichever is sooner. Otherwise behaves like RHSimVirtualClock::yield()
+    virtual void yield();
+
+    /// When called by a node, lets the other nodes run and then continues after the given time.
+    /// Otherwise behaves like RHSimVirtualClock::delay()
+    /// \param[in] us The time to wait in microseconds
+    virtual void delay(uint64_t us);
+
+protected:
+    /// Switches from the running node back to the scheduler in run(), until the virtual time reaches wake
+    /// \param[in] wake The time at which the node wants to continue
+    /// \param[in] polling true if the node should also continue at the next event
+    void wait(uint64_t wake, bool polling);
+
+private:
+    /// Entry point of each node's coroutine
+    static void nodeMain();
+
+    /// The state of a node
+    typedef struct
+    {
+	NodeFunction    setup;
+	NodeFunction    loop;
+	void*           arg;
+	ucontext_t      context;
+	uint8_t*        stack;
+	uint64_t        wake;     ///< Continue at or after this time
+	uint64_t        since;    ///< Time at which a polling node started waiting
+	bool            polling;  ///< Also continue as soon as time has moved on
+    } Node;
+
+    /// The nodes
+    Node*           _nodes[RH_SIM_HARNESS_MAX_NODES];
+    uint16_t        _numNodes;
+
+    /// Index of the running node, or -1
+    int16_t         _current;
+
+    /// Number of nodes whose setup function has not returned yet
+    uint16_t        _settingUp;
+
+    /// Context of the scheduler in run()
+    ucontext_t      _scheduler;
+
+    /// Set by stop()
+    bool            _stopped;
+
+    /// The harness whose nodes are running, for nodeMain()
+    static RHSimHarness* _running;
+};
+
+/// @example simulator_sim_harness.pde
+
+#endif
+
+#endif
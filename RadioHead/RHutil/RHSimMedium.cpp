@@ -0,0 +1,226 @@
+// RHSimMedium.cpp
+//
+// Copyright (C) 2014 Mike McCauley
+// $Id: RHSimMedium.cpp $
+
+#include <RadioHead.h>
+
+#if (RH_PLATFORM == RH_PLATFORM_UNIX)
+
+#include <RHSimMedium.h>
+#include <RH_SimChannel.h>
+#include <errno.h>
+
+RHSimMedium::RHSimMedium()
+    : _numNodes(0),
+      _bitRate(RH_SIM_MEDIUM_DEFAULT_BITRATE),
+      _turnaround(RH_SIM_MEDIUM_DEFAULT_TURNAROUND),
+      _clock(&_ownClock)
+{
+    // Same as etherSimulator.pl: links that are not configured always deliver
+    for (uint16_t from = 0; from < 256; from++)
+	for (uint16_t to = 0; to < 256; to++)
+	    _probability[from][to] = 1.0;
+    setSeed(1);
+    resetStats();
+    _clock->addEventSource(nextEventFn, this);
+}
+
+RHSimMedium::~RHSimMedium()
+{
+    _clock->removeEventSource(nextEventFn, this);
+}
+
+void RHSimMedium::setClock(RHSimClock& clock)
+{
+    _clock->removeEventSource(nextEventFn, this);
+    _clock = &clock;
+    _clock->addEventSource(nextEventFn, this);
+}
+
+bool RHSimMedium::loadConfig(const char* filename)
+{
+    FILE* config = fopen(filename, "r");
+    if (!config)
+    {
+	fprintf(stderr, "RHSimMedium::loadConfig could not open config file %s: %s\n", filename, strerror(errno));
+	return false;
+    }
+    char line[200];
+    while (fgets(line, sizeof(line), config))
+    {
+	// probability:nodea:nodeb:probability
+	unsigned int nodea, nodeb;
+	float        probability;
+	if (   sscanf(line, "probability:%u:%u:%f", &nodea, &nodeb, &probability) == 3
+	    && nodea < 256 && nodeb < 256)
+	    setProbability(nodea, nodeb, probability);
+    }
+    fclose(config);
+    return true;
+}
+
+void RHSimMedium::setProbability(uint8_t from, uint8_t to, float probability, bool bidirectional)
+{
+    _probability[from][to] = probability;
+    if (bidirectional)
+	_probability[to][from] = probability;
+}
+
+float RHSimMedium::probability(uint8_t from, uint8_t to)
+{
+    return _probability[from][to];
+}
+
+void RHSimMedium::setBitRate(uint32_t bitRate)
+{
+    if (bitRate)
+	_bitRate = bitRate;
+}
+
+void RHSimMedium::setTurnaround(uint32_t us)
+{
+    _turnaround = us;
+}
+
+uint32_t RHSimMedium::turnaround()
+{
+    return _turnaround;
+}
+
+void RHSimMedium::setSeed(uint64_t seed)
+{
+    // xorshift must not be seeded with 0
+    _random = seed ? seed : 0x9e3779b97f4a7c15ULL;
+}
+
+uint32_t RHSimMedium::lost()
+{
+    return _lost;
+}
+
+uint32_t RHSimMedium::transmitted()
+{
+    return _transmitted;
+}
+
+uint32_t RHSimMedium::collisions()
+{
+    return _collisions;
+}
+
+uint64_t RHSimMedium::airtimeUsed()
+{
+    return _airtimeUsed;
+}
+
+void RHSimMedium::resetStats()
+{
+    _lost        = 0;
+    _transmitted = 0;
+    _collisions  = 0;
+    _airtimeUsed = 0;
+}
+
+////////////////////////////////////////////////////////////////////
+uint64_t RHSimMedium::now()
+{
+    return _clock->micros();
+}
+
+void RHSimMedium::advance(uint64_t us)
+{
+    _clock->advanceTo(_clock->micros() + us);
+}
+
+void RHSimMedium::advanceTo(uint64_t time)
+{
+    _clock->advanceTo(time);
+}
+
+void RHSimMedium::waitUntil(uint64_t time)
+{
+    uint64_t now = _clock->micros();
+    if (time > now)
+	_clock->delay(time - now);
+}
+
+uint64_t RHSimMedium::nextEventTime()
+{
+    uint64_t next = RH_SIM_MEDIUM_NO_EVENT;
+    for (uint16_t i = 0; i < _numNodes; i++)
+    {
+	uint64_t t = _nodes[i]->nextEventTime();
+	if (t < next)
+	    next = t;
+    }
+    return next;
+}
+
+uint64_t RHSimMedium::nextEventFn(void* arg)
+{
+    return ((RHSimMedium*)arg)->nextEventTime();
+}
+
+uint32_t RHSimMedium::airtime(uint8_t len)
+{
+    return ((uint64_t)(RH_SIM_MEDIUM_HEADER_LEN + len) * 8 * 1000000) / _bitRate;
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHSimMedium::attach(RH_SimChannel* node)
+{
+    if (_numNodes >= RH_SIM_MEDIUM_MAX_NODES)
+	return false;
+    _nodes[_numNodes++] = node;
+    return true;
+}
+
+void RHSimMedium::detach(RH_SimChannel* node)
+{
+    for (uint16_t i = 0; i < _numNodes; i++)
+    {
+	if (_nodes[i] == node)
+	{
+	    // Keep the order of the remaining nodes, so the results stay repeatable
+	    memmove(&_nodes[i], &_nodes[i + 1], (_numNodes - i - 1) * sizeof(_nodes[0]));
+	    _numNodes--;
+	    return;
+	}
+    }
+}
+
+bool RHSimMedium::willDeliver(uint8_t from, uint8_t to)
+{
+    float probability = _probability[from][to];
+    if (probability >= 1.0)
+	return true;
+    // xorshift64*
+    _random ^= _random >> 12;
+    _random ^= _random << 25;
+    _random ^= _random >> 27;
+    uint64_t r = _random * 0x2545f4914f6cdd1dULL;
+    // Top 24 bits give a uniform float in [0.0, 1.0)
+    if ((float)(r >> 40) / (float)(1UL << 24) < probability)
+	return true;
+    _lost++;
+    return false;
+}
+
+void RHSimMedium::transmit(RH_SimChannel* from, uint64_t start, uint64_t end, const uint8_t* headers, const uint8_t* data, uint8_t len)
+{
+    uint8_t  fromAddress = from->_thisAddress;
+    _transmitted++;
+    _airtimeUsed += end - start;
+    for (uint16_t i = 0; i < _numNodes; i++)
+    {
+	RH_SimChannel* to = _nodes[i];
+	if (to == from)
+	    continue; // Dont deliver back to the same node
+	if (_probability[fromAddress][to->_thisAddress] <= 0.0)
+	    continue; // Out of range, cant hear it at all
+	to->receive(start, end, headers, data, len, !willDeliver(fromAddress, to->_thisAddress));
+    }
+}
+
+#endif
@@ -0,0 +1,259 @@
+// RHSimMedium.h
+// Author: Mike McCauley (mikem@airspayce.com)
+// Copyright (C) 2014 Mike McCauley
+// $Id: RHSimMedium.h $
+#ifndef RHSimMedium_h
+#define RHSimMedium_h
+
+#include <RadioHead.h>
+
+#if (RH_PLATFORM == RH_PLATFORM_UNIX)
+
+#include <RHSimClock.h>
+
+// Maximum number of RH_SimChannel nodes that can be attached to one RHSimMedium
+#ifndef RH_SIM_MEDIUM_MAX_NODES
+ #define RH_SIM_MEDIUM_MAX_NODES 256
+#endif
+
+// Default simulated bit rate in bits per second. Same as etherSimulator.pl
+#ifndef RH_SIM_MEDIUM_DEFAULT_BITRATE
+ #define RH_SIM_MEDIUM_DEFAULT_BITRATE 10000
+#endif
+
+// Default time in microseconds between a node calling send() and its message starting on the air
+#ifndef RH_SIM_MEDIUM_DEFAULT_TURNAROUND
+ #define RH_SIM_MEDIUM_DEFAULT_TURNAROUND 0
+#endif
+
+// Number of octets of header sent over the air with each message: TO, FROM, ID and FLAGS
+#define RH_SIM_MEDIUM_HEADER_LEN 4
+
+// Value returned by RHSimMedium::nextEventTime() when nothing is in flight
+#define RH_SIM_MEDIUM_NO_EVENT RH_SIM_CLOCK_NO_EVENT
+
+class RH_SimChannel;
+
+/////////////////////////////////////////////////////////////////////
+/// \class RHSimMedium RHSimMedium.h <RHutil/RHSimMedium.h>
+/// \brief Shared virtual radio medium connecting RH_SimChannel nodes in one process
+///
+/// An RHSimMedium is the in-process equivalent of the tools/etherSimulator.pl server. Any number of
+/// RH_SimChannel driver instances (up to RH_SIM_MEDIUM_MAX_NODES) can be attached to one medium, and every
+/// message sent by one of them is heard by all the others in range, subject to:
+/// \li the probability of successful delivery over each link, which can be read from a
+/// configuration file in the same format as tools/chain.conf, or set with setProbability().
+/// Links that are not configured always deliver. Nodes with a probability of 0.0 are out of range,
+/// and do not hear the message at all. Within range, a message that is lost still occupies the
+/// receiver's channel, so it can collide with other messages and is seen by Channel Activity Detection.
+/// \li the airtime of the message: a message is not available at a receiver until
+/// (4 + length) * 8 / bitrate seconds after the transmission starts.
+/// \li the turnaround time: the time a real radio takes to switch from receive to transmit and 
+/// send its preamble. A message starts on the air this long after send() is called, and the sender
+/// cannot receive in the meantime. 0 unless set with setTurnaround().
+/// \li collisions: if 2 or more messages overlap in time at a receiver, none of them is received.
+/// A node that is transmitting cannot receive either.
+/// The receiver counts them in rxBad(), and the medium counts them in collisions().
+///
+/// Since each receiver only hears the nodes within its own range, hidden terminals are modelled:
+/// 2 nodes that cannot hear each other can still collide at a node between them.
+/// transmitted(), collisions(), lost() and airtimeUsed() can be used to measure the
+/// capacity of a network and to tune the CAD backoff (see RHGenericDriver::setCADTimeout()).
+///
+/// By default the medium runs on its own RHSimVirtualClock, measured in microseconds, which only moves
+/// when the program calls advance() or advanceTo(). Nothing happens in between: simulated messages are
+/// only delivered when a node's available() notices that the virtual time has passed the end of the
+/// transmission. Since there are no sockets, timers or threads involved, a simulation runs as fast
+/// as the CPU allows, and the same program with the same random seed always produces the same results.
+/// With its own clock, sketches must poll: call available() or the managers' non-blocking functions,
+/// then advance the clock.
+///
+/// Alternatively, setClock() puts the medium on another clock, usually the simulator clock that also
+/// drives millis(), delay() and YIELD (see RHSimClock). If that is an RHSimVirtualClock, the
+/// medium's transmissions and the sketches' timeouts all run on the same virtual time, and
+/// every wait loop moves the clock straight to the next arrival on the medium.
+///
+/// \par Example
+///
+/// \code
+/// RHSimMedium medium;
+/// RH_SimChannel driver1(medium), driver2(medium);
+/// medium.loadConfig("tools/chain.conf");
+/// driver1.init(); driver1.setThisAddress(1);
+/// driver2.init(); driver2.setThisAddress(2);
+/// driver1.send(data, sizeof(data));
+/// medium.advanceTo(medium.nextEventTime());
+/// if (driver2.available())
+///    ...
+/// \endcode
+///
+/// The medium holds a link table for every possible pair of addresses, so it is quite large:
+/// allocate it statically or on the heap rather than on the stack.
+///
+/// See the example simulator_sim_channel.pde
+class RHSimMedium
+{
+public:
+    /// Constructor. All links deliver with certainty, the bit rate is RH_SIM_MEDIUM_DEFAULT_BITRATE,
+    /// the random seed is 1 and the virtual clock starts at 0.
+    RHSimMedium();
+
+    /// Destructor
+    ~RHSimMedium();
+
+    /// Puts the medium on a different clock. Should be called before any nodes send.
+    /// \param[in] clock The new clock, usually simulatorClock(). Must outlive the medium
+    void setClock(RHSimClock& clock);
+
+    /// Reads the probability of successful delivery between pairs of nodes from a file in the same
+    /// format as tools/chain.conf. Each line like
+    /// \code
+    /// probability:10:2:0.5
+    /// \endcode
+    /// sets the probability that a message sent by node 10 is received by node 2, and vice versa.
+    /// Other lines are ignored. Links not mentioned in the file are unchanged.
+    /// \param[in] filename Name of the file to read
+    /// \return true if the file could be read
+    bool loadConfig(const char* filename);
+
+    /// Sets the probability of successful delivery between 2 node addresses
+    /// \param[in] from Address of the transmitting node
+    /// \param[in] to Address of the receiving node
+    /// \param[in] probability 0.0 (never delivered) to 1.0 (always delivered)
+    /// \param[in] bidirectional If true, also sets the probability for messages from to to from
+    void setProbability(uint8_t from, uint8_t to, float probability, bool bidirectional = true);
+
+    /// Returns the probability of successful delivery between 2 node addresses
+    /// \param[in] from Address of the transmitting node
+    /// \param[in] to Address of the receiving node
+    /// \return The probability, 0.0 to 1.0
+    float probability(uint8_t from, uint8_t to);
+
+    /// Sets the simulated bit rate, which determines the airtime of each message
+    /// \param[in] bitRate Bits per second. Must be > 0
+    void setBitRate(uint32_t bitRate);
+
+    /// Sets the simulated turnaround time, which is added to the start of every transmission
+    /// \param[in] us Microseconds between send() and the start of the transmission
+    void setTurnaround(uint32_t us);
+
+    /// Returns the simulated turnaround time
+    /// \return The turnaround time in microseconds
+    uint32_t turnaround();
+
+    /// Seeds the random number generator used to decide whether a message is lost on a link.
+    /// \param[in] seed Any value. The same seed gives the same sequence of losses.
+    void setSeed(uint64_t seed);
+
+    /// Returns the current virtual time
+    /// \return Microseconds since the medium was constructed
+    uint64_t now();
+
+    /// Moves the virtual clock forward. Does nothing if the medium is on a clock that
+    /// cannot be moved, such as an RHSimRealClock
+    /// \param[in] us Number of microseconds to advance by
+    void advance(uint64_t us);
+
+    /// Moves the virtual clock forward to the given time. Does nothing if it is already
+    /// at or past that time, or if the clock cannot be moved.
+    /// \param[in] time The new virtual time in microseconds
+    void advanceTo(uint64_t time);
+
+    /// Waits on the medium's clock until the given time. On the harness or on a virtual simulator clock,
+    /// other simulated nodes run meanwhile. On the medium's own clock, the clock is simply moved forward.
+    /// Does nothing if the time has already passed.
+    /// \param[in] time The virtual time to wait for, in microseconds
+    void waitUntil(uint64_t time);
+
+    /// Returns the time at which the next message still in flight finishes arriving at any node, or
+    /// finishes being transmitted by any node.
+    /// Advancing to this time and polling all the nodes processes the next event on the medium.
+    /// \return The virtual time of the next event in microseconds, or RH_SIM_MEDIUM_NO_EVENT
+    /// if nothing is in flight
+    uint64_t nextEventTime();
+
+    /// Returns the airtime of a message on this medium
+    /// \param[in] len Length of the message payload, not including the headers
+    /// \return The airtime in microseconds
+    uint32_t airtime(uint8_t len);
+
+    /// Number of receptions that were randomly lost on links with a probability of delivery
+    /// between 0.0 and 1.0 since construction or resetStats()
+    uint32_t lost();
+
+    /// Number of messages transmitted by all nodes since construction or resetStats()
+    uint32_t transmitted();
+
+    /// Number of receptions ruined by overlapping with another message, or with the
+    /// receiver's own transmission, since construction or resetStats()
+    uint32_t collisions();
+
+    /// Total airtime of all the messages transmitted since construction or resetStats().
+    /// Divided by the elapsed virtual time, this gives the offered load on the medium
+    /// \return The airtime in microseconds
+    uint64_t airtimeUsed();
+
+    /// Sets all the statistics counters to 0
+    void resetStats();
+
+protected:
+    friend class RH_SimChannel;
+
+    /// Attaches a node to this medium. Called by RH_SimChannel::init()
+    /// \param[in] node The node to attach
+    /// \return true if successful, false if there is no room
+    bool attach(RH_SimChannel* node);
+
+    /// Detaches a node from this medium. Called by the RH_SimChannel destructor
+    /// \param[in] node The node to detach
+    void detach(RH_SimChannel* node);
+
+    /// Transmits a message from a node to all the other attached nodes in range.
+    /// \param[in] from The transmitting node
+    /// \param[in] start Virtual time at which the transmission starts
+    /// \param[in] end Virtual time at which the transmission ends
+    /// \param[in] headers The 4 octets of TO, FROM, ID and FLAGS
+    /// \param[in] data The message payload
+    /// \param[in] len Length of the payload
+    void transmit(RH_SimChannel* from, uint64_t start, uint64_t end, const uint8_t* headers, const uint8_t* data, uint8_t len);
+
+    /// Decides whether a message survives the link between 2 addresses in range
+    /// \return true if it is delivered
+    bool willDeliver(uint8_t from, uint8_t to);
+
+    /// Event source callback for the clock
+    static uint64_t nextEventFn(void* arg);
+
+private:
+    /// The attached nodes
+    RH_SimChannel*  _nodes[RH_SIM_MEDIUM_MAX_NODES];
+    uint16_t        _numNodes;
+
+    /// Probability of successful delivery, indexed by from and to address
+    float           _probability[256][256];
+
+    /// Bits per second
+    uint32_t        _bitRate;
+
+    /// Microseconds between send() and the start of a transmission
+    uint32_t        _turnaround;
+
+    /// Our own clock, used unless setClock() is called
+    RHSimVirtualClock _ownClock;
+
+    /// The clock we are running on
+    RHSimClock*     _clock;
+
+    /// State of the xorshift random number generator
+    uint64_t        _random;
+
+    /// Statistics
+    uint32_t        _lost;
+    uint32_t        _transmitted;
+    uint32_t        _collisions;
+    uint64_t        _airtimeUsed;
+};
+
+#endif
+
+#endif
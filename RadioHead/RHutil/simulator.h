@@ -21,9 +21,27 @@ extern char** _simulator_argv;
 // Definitions for various Arduino functions
 extern void delay(unsigned long ms);
 extern unsigned long millis();
+extern unsigned long micros();
+extern void yield();
 extern long random(long to);
 extern long random(long from, long to);
 
+// The clock that implements delay(), millis(), micros() and yield(). Defaults to real time.
+// See RHSimClock. Passing NULL restores the default
+class RHSimClock;
+extern void setSimulatorClock(RHSimClock* clock);
+extern RHSimClock& simulatorClock();
+
+// The simulator has no pins: writes are ignored and reads always return LOW.
+// Enough to build pin driven drivers such as RH_ASK, eg for tools/RHBench
+#define LOW    0x0
+#define HIGH   0x1
+#define INPUT  0x0
+#define OUTPUT 0x1
+extern void pinMode(uint8_t pin, uint8_t mode);
+extern void digitalWrite(uint8_t pin, uint8_t val);
+extern int  digitalRead(uint8_t pin);
+
 // Equavalent to HardwareSerial in Arduino
 // but outputs to stdout
 class SerialSimulator
@@ -161,6 +161,14 @@ intermediate nodes, with manual routing.
 - RHMesh
 Multi-hop delivery of RHReliableDatagrams with automatic route discovery and rediscovery.
 
+- RHFragmenter
+Sends application messages of up to a few KB, much larger than one frame, over RHReliableDatagram, RHRouter
+or RHMesh, by splitting them into fragments and reassembling them at the destination.
+
+- RHBulkTransfer
+Streams large objects such as firmware images over RHReliableDatagram, with selective repeat of lost
+blocks and resumable transfers, reading and writing the data a block at a time.
+
 Any Manager may be used with any Driver.
 
 \par Platforms
@@ -1301,6 +1309,16 @@ these examples and explanations and extend them to suit your needs.
  #define ATOMIC_BLOCK_END
 #endif
 
+////////////////////////////////////////////////////
+// Memory barrier for sharing data between an interrupt handler (or another thread) and the
+// main program without disabling interrupts, eg in a single producer, single consumer ring.
+// On single core processors it is enough to stop the compiler reordering memory accesses.
+#if (RH_PLATFORM == RH_PLATFORM_UNIX) || (RH_PLATFORM == RH_PLATFORM_RASPI)
+ #define RH_MEMORY_BARRIER __sync_synchronize()
+#else
+ #define RH_MEMORY_BARRIER __asm__ __volatile__ ("" ::: "memory")
+#endif
+
 ////////////////////////////////////////////////////
 // Try to be compatible with systems that support yield() and multitasking
 // instead of spin-loops
@@ -1310,6 +1328,9 @@ these examples and explanations and extend them to suit your needs.
 #elif (RH_PLATFORM == RH_PLATFORM_ESP8266)
 // ESP8266 also has it
  #define YIELD yield();
+#elif (RH_PLATFORM == RH_PLATFORM_UNIX)
+// The simulator needs it to let time pass on its virtual clock (see RHSimClock)
+ #define YIELD yield();
 #else
  #define YIELD
 #endif
@@ -0,0 +1,158 @@
+// simulator_fragmenter.pde
+// -*- mode: C++ -*-
+// Example sketch showing how to send messages much larger than one frame through a mesh network
+// with the RHFragmenter class. The network is simulated in one process with RHSimHarness, as in
+// simulator_sim_harness.pde, with the nodes in a line where each node can only hear its immediate neighbours.
+// Each fragment carries only 20 octets of the message, as it would with a small packet radio such as the nRF24.
+// The first node sends a 1000 octet message to the last node every few seconds, and the last node checks it
+// and replies with a 300 octet message.
+// Tested on Linux
+// Build with
+// cd whatever/RadioHead
+// tools/simBuild examples/simulator/simulator_fragmenter/simulator_fragmenter.pde
+// Run with ./simulator_fragmenter [numnodes [seconds]]
+
+#include <RHMesh.h>
+#include <RHFragmenter.h>
+#include <RH_SimChannel.h>
+#include <RHSimHarness.h>
+#include <stdlib.h>
+
+// Maximum number of nodes in the line
+#define MAX_NODES 50
+
+// Octets of the message in each fragment
+#define FRAGMENT_LEN 20
+
+#define REQUEST_LEN 1000
+#define REPLY_LEN 300
+
+// Runs the nodes and provides the simulator clock
+RHSimHarness harness;
+
+// The medium shared by all the nodes
+RHSimMedium medium;
+
+// Everything belonging to one node
+typedef struct
+{
+  RH_SimChannel*          driver;
+  RHMesh*                 manager;
+  RHFragmenter<RHMesh>*   fragmenter;
+  uint8_t                 address;
+  uint16_t                sent;
+  uint16_t                replies;
+  uint16_t                bad;
+} Node;
+
+Node    nodes[MAX_NODES];
+uint8_t numNodes = 5;
+
+// Fills buf with a pattern that depends on seq, so the receiver can check it
+void fill(uint8_t* buf, uint16_t len, uint8_t seq)
+{
+  for (uint16_t i = 0; i < len; i++)
+    buf[i] = (uint8_t)(i * 7 + seq);
+}
+
+bool check(uint8_t* buf, uint16_t len, uint8_t seq)
+{
+  for (uint16_t i = 0; i < len; i++)
+    if (buf[i] != (uint8_t)(i * 7 + seq))
+      return false;
+  return true;
+}
+
+void nodeSetup(void* arg)
+{
+  Node* node = (Node*)arg;
+  if (!node->manager->init())
+    Serial.println("init failed");
+}
+
+// The first node sends a large request to the last node and waits for the reply
+void clientLoop(void* arg)
+{
+  Node* node = (Node*)arg;
+  uint8_t buf[REQUEST_LEN];
+  uint16_t len;
+  uint8_t from;
+
+  node->sent++;
+  fill(buf, REQUEST_LEN, node->sent);
+  len = sizeof(buf);
+  if (node->fragmenter->sendtoWait(buf, REQUEST_LEN, numNodes)
+      && node->fragmenter->recvfromAckTimeout(buf, &len, 10000, &from))
+  {
+    if (len == REPLY_LEN && check(buf, len, buf[0]))
+      node->replies++;
+    else
+      node->bad++;
+  }
+  delay(2000);
+}
+
+// All the other nodes relay fragments, and the last one checks the requests and replies
+void serverLoop(void* arg)
+{
+  Node* node = (Node*)arg;
+  uint8_t buf[REQUEST_LEN];
+  uint16_t len = sizeof(buf);
+  uint8_t from;
+
+  if (node->fragmenter->recvfromAck(buf, &len, &from))
+  {
+    if (len != REQUEST_LEN || !check(buf, len, buf[0]))
+    {
+      node->bad++;
+      return;
+    }
+    fill(buf, REPLY_LEN, buf[0]);
+    node->fragmenter->sendtoWait(buf, REPLY_LEN, from);
+  }
+}
+
+void setup()
+{
+  Serial.begin(9600);
+  uint32_t seconds = 60;
+  if (_simulator_argc > 1)
+    numNodes = atoi(_simulator_argv[1]);
+  if (numNodes < 2 || numNodes > MAX_NODES)
+    numNodes = 5;
+  if (_simulator_argc > 2)
+    seconds = atoi(_simulator_argv[2]);
+
+  // Make the managers' random timeouts repeatable too
+  srandom(1);
+  // Everything runs on the harness's virtual time
+  setSimulatorClock(&harness);
+  medium.setClock(harness);
+
+  // Node addresses are 1 to numNodes. Only neighbours can hear each other
+  for (uint16_t from = 1; from <= numNodes; from++)
+    for (uint16_t to = 1; to <= numNodes; to++)
+      medium.setProbability(from, to, (to + 1 == from || from + 1 == to) ? 1.0 : 0.0, false);
+
+  for (uint8_t i = 0; i < numNodes; i++)
+  {
+    nodes[i].address    = i + 1;
+    nodes[i].driver     = new RH_SimChannel(medium);
+    nodes[i].manager    = new RHMesh(*nodes[i].driver, nodes[i].address);
+    nodes[i].fragmenter = new RHFragmenter<RHMesh>(*nodes[i].manager, FRAGMENT_LEN);
+    harness.addNode(nodeSetup, i == 0 ? clientLoop : serverLoop, &nodes[i]);
+  }
+
+  harness.run(seconds * 1000000ULL);
+
+  printf("%d nodes, %lu seconds of virtual time: %d requests of %d octets, %d replies, %d bad, %lu incomplete\n",
+         numNodes, millis() / 1000, nodes[0].sent, REQUEST_LEN, nodes[0].replies,
+         nodes[0].bad + nodes[numNodes - 1].bad,
+         (unsigned long)nodes[numNodes - 1].fragmenter->dropped());
+  exit(0);
+}
+
+void loop()
+{
+}
+
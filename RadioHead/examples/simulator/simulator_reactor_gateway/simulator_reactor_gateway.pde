@@ -0,0 +1,110 @@
+// simulator_reactor_gateway.pde
+// -*- mode: C++ -*-
+// Example sketch showing how to build a gateway that bridges several radio networks
+// with the RHReactor class, serving many RH_TCP drivers from a single thread with epoll.
+// Every message received on one network is retransmitted unchanged (including its headers)
+// on all the other networks, so nodes on different networks can talk to each other as if
+// they were on the same one.
+// Tested on Linux
+// Build with
+// cd whatever/RadioHead
+// tools/simBuild examples/simulator/simulator_reactor_gateway/simulator_reactor_gateway.pde
+// Run with ./simulator_reactor_gateway localhost:4000 localhost:4001 [...]
+// (defaults to localhost:4000 and localhost:4001)
+// Make sure you also have one 'Luminiferous Ether' simulator tools/etherSimulator.pl running for each network,
+// eg tools/etherSimulator.pl -p 4000 and tools/etherSimulator.pl -p 4001
+// Then you can run simulator_reliable_datagram_client on one network and
+// simulator_reliable_datagram_server on the other
+
+#include <RH_TCP.h>
+#include <RHReactor.h>
+
+// Maximum number of networks we can bridge
+#define MAX_NETWORKS 8
+
+// The radio drivers, one per network
+RH_TCP* drivers[MAX_NETWORKS];
+uint8_t numDrivers = 0;
+
+// Serves all the drivers
+RHReactor reactor;
+
+// Dont put this on the stack:
+uint8_t buf[RH_TCP_MAX_MESSAGE_LEN];
+
+// Called by the reactor whenever a driver has a message available
+void relay(RHGenericDriver& from, void* arg)
+{
+  (void)arg; // Not used
+  uint8_t len = sizeof(buf);
+  // Get the headers before recv() clears them
+  uint8_t to    = from.headerTo();
+  uint8_t source = from.headerFrom();
+  uint8_t id    = from.headerId();
+  uint8_t flags = from.headerFlags();
+  if (!from.recv(buf, &len))
+    return;
+
+  for (uint8_t i = 0; i < numDrivers; i++)
+  {
+    if (drivers[i] == &from)
+      continue; // Dont echo back to the network it came from
+    drivers[i]->setHeaderTo(to);
+    drivers[i]->setHeaderFrom(source);
+    drivers[i]->setHeaderId(id);
+    drivers[i]->setHeaderFlags(flags, 0xff);
+    drivers[i]->send(buf, len);
+  }
+}
+
+void addNetwork(const char* server)
+{
+  if (numDrivers >= MAX_NETWORKS)
+  {
+    Serial.println("too many networks");
+    return;
+  }
+  RH_TCP* driver = new RH_TCP(server);
+  if (!driver->init())
+  {
+    Serial.print("init failed: ");
+    Serial.println(server);
+    delete driver;
+    return;
+  }
+  // Hear all messages, whoever they are addressed to
+  driver->setPromiscuous(true);
+  if (!reactor.addDriver(*driver, relay))
+  {
+    Serial.print("addDriver failed: ");
+    Serial.println(server);
+    delete driver;
+    return;
+  }
+  drivers[numDrivers++] = driver;
+}
+
+void setup()
+{
+  Serial.begin(9600);
+  if (!reactor.init())
+    Serial.println("reactor init failed");
+
+  if (_simulator_argc > 1)
+  {
+    for (int i = 1; i < _simulator_argc; i++)
+      addNetwork(_simulator_argv[i]);
+  }
+  else
+  {
+    addNetwork("localhost:4000");
+    addNetwork("localhost:4001");
+  }
+}
+
+void loop()
+{
+  // Wait for messages on any of the networks and relay them
+  reactor.runOnce(1000);
+}
+
@@ -0,0 +1,148 @@
+// simulator_router_forward.pde
+// -*- mode: C++ -*-
+// Example sketch that checks that RHRouter forwards messages intact when it forwards them straight
+// from the driver's receive buffer, while other messages keep arriving at the forwarding node.
+// The network is simulated in one process with RHSimHarness, as in simulator_sim_harness.pde.
+// Node 2 is in the middle, and nodes 1, 3 and 4 can only hear node 2.
+// Node 1 sends a stream of messages to node 3, which node 2 forwards, while node 4 sends its own stream
+// of messages to node 2. The medium has a turnaround time, so node 2 is still holding each message from
+// node 1 in its receive buffer while it waits to transmit it, and frames from node 4 arrive meanwhile.
+// Every message carries a pattern that depends on its sequence number, and nodes 2 and 3 check each one.
+// At the end it prints the number of messages sent, acknowledged (by the next hop) and received on each stream,
+// and how many were corrupted. It exits with status 1 if any message was corrupted, or if node 2 acknowledged
+// any message from node 4 that it did not receive.
+// Tested on Linux
+// Build with
+// cd whatever/RadioHead
+// tools/simBuild examples/simulator/simulator_router_forward/simulator_router_forward.pde
+// Run with ./simulator_router_forward [seconds]
+
+#include <RHRouter.h>
+#include <RH_SimChannel.h>
+#include <RHSimHarness.h>
+#include <stdlib.h>
+
+#define MESSAGE_LEN 40
+
+// Runs the nodes and provides the simulator clock
+RHSimHarness harness;
+
+// The medium shared by all the nodes
+RHSimMedium medium;
+
+// Everything belonging to one node
+typedef struct
+{
+  RH_SimChannel* driver;
+  RHRouter*      manager;
+  uint8_t        address;
+  uint8_t        dest;       // Where this node sends its stream, 0 for none
+  uint16_t       sent;
+  uint16_t       acked;
+  uint16_t       received;
+  uint16_t       bad;
+} Node;
+
+#define NUM_NODES 4
+Node nodes[NUM_NODES];
+
+// Fills buf with a pattern that depends on seq, so the receiver can check it
+void fill(uint8_t* buf, uint8_t len, uint8_t seq)
+{
+  for (uint8_t i = 0; i < len; i++)
+    buf[i] = (uint8_t)(i * 7 + seq);
+}
+
+bool check(uint8_t* buf, uint8_t len)
+{
+  if (len != MESSAGE_LEN)
+    return false;
+  for (uint8_t i = 0; i < len; i++)
+    if (buf[i] != (uint8_t)(i * 7 + buf[0]))
+      return false;
+  return true;
+}
+
+void nodeSetup(void* arg)
+{
+  Node* node = (Node*)arg;
+  if (!node->manager->init())
+    Serial.println("init failed");
+}
+
+// Sends messages back to back, and checks any that arrive (which also forwards those for other nodes)
+void nodeLoop(void* arg)
+{
+  Node* node = (Node*)arg;
+  uint8_t buf[RH_ROUTER_MAX_MESSAGE_LEN];
+  uint8_t len = sizeof(buf);
+
+  if (node->dest)
+  {
+    fill(buf, MESSAGE_LEN, node->sent++);
+    if (node->manager->sendtoWait(buf, MESSAGE_LEN, node->dest) == RH_ROUTER_ERROR_NONE)
+      node->acked++;
+  }
+  else if (node->manager->recvfromAckTimeout(buf, &len, 100))
+  {
+    if (check(buf, len))
+      node->received++;
+    else
+      node->bad++;
+  }
+}
+
+void setup()
+{
+  Serial.begin(9600);
+  uint32_t seconds = 60;
+  if (_simulator_argc > 1)
+    seconds = atoi(_simulator_argv[1]);
+
+  // Make the managers' random timeouts repeatable too
+  srandom(1);
+  // Everything runs on the harness's virtual time
+  setSimulatorClock(&harness);
+  medium.setClock(harness);
+  // Radios take a while to start transmitting
+  medium.setTurnaround(5000);
+
+  // Only node 2 can hear, and be heard by, the others
+  for (uint8_t from = 1; from <= NUM_NODES; from++)
+    for (uint8_t to = 1; to <= NUM_NODES; to++)
+      medium.setProbability(from, to, (from == 2 || to == 2) ? 1.0 : 0.0, false);
+
+  for (uint8_t i = 0; i < NUM_NODES; i++)
+  {
+    nodes[i].address = i + 1;
+    nodes[i].driver  = new RH_SimChannel(medium);
+    nodes[i].manager = new RHRouter(*nodes[i].driver, nodes[i].address);
+  }
+  // Node 1 streams to node 3 through node 2, and node 4 streams to node 2
+  nodes[0].dest = 3;
+  nodes[0].manager->addRouteTo(3, 2);
+  nodes[1].manager->addRouteTo(1, 1);
+  nodes[1].manager->addRouteTo(3, 3);
+  nodes[1].manager->addRouteTo(4, 4);
+  nodes[2].manager->addRouteTo(1, 2);
+  nodes[3].dest = 2;
+  nodes[3].manager->addRouteTo(2, 2);
+  for (uint8_t i = 0; i < NUM_NODES; i++)
+    harness.addNode(nodeSetup, nodeLoop, &nodes[i]);
+
+  harness.run(seconds * 1000000ULL);
+
+  printf("%lu seconds of virtual time\n", millis() / 1000);
+  printf("forwarded by node 2: %d sent by node 1, %d acknowledged, %d received by node 3, %d bad\n",
+         nodes[0].sent, nodes[0].acked, nodes[2].received, nodes[2].bad);
+  printf("sent to node 2:      %d sent by node 4, %d acknowledged, %d received by node 2, %d bad\n",
+         nodes[3].sent, nodes[3].acked, nodes[1].received, nodes[1].bad);
+  // A message can be received but not acknowledged, if all the ACKs are lost, but not the other way round.
+  // Node 1 only hears from node 2, which may still fail to forward a message to node 3
+  exit(nodes[1].bad || nodes[2].bad || nodes[1].received < nodes[3].acked);
+}
+
+void loop()
+{
+}
+
@@ -0,0 +1,100 @@
+// simulator_sim_channel.pde
+// -*- mode: C++ -*-
+// Example sketch showing how to simulate a whole network of nodes within one process
+// with the RH_SimChannel driver and a shared RHSimMedium, without needing tools/etherSimulator.pl.
+// The nodes are placed in a line, where each node can only hear its immediate neighbours
+// (unless a chain.conf style config file is given, in which case its links are used instead).
+// The first node broadcasts a message, and every node that receives it for the first time
+// rebroadcasts it, so it floods down the line one hop at a time.
+// The virtual clock is advanced from one event on the medium to the next, so the whole simulation
+// runs much faster than real time, and gives the same results every time.
+// Tested on Linux
+// Build with
+// cd whatever/RadioHead
+// tools/simBuild examples/simulator/simulator_sim_channel/simulator_sim_channel.pde
+// Run with ./simulator_sim_channel [numnodes [configfile]]
+
+#include <RHDatagram.h>
+#include <RH_SimChannel.h>
+#include <stdlib.h>
+
+// Maximum number of nodes in the line
+#define MAX_NODES 200
+
+// The medium shared by all the nodes. Its quite big, so dont put it on the stack
+RHSimMedium medium;
+
+// The radio drivers and the managers, one per node
+RH_SimChannel* drivers[MAX_NODES];
+RHDatagram*    managers[MAX_NODES];
+uint8_t        numNodes = 10;
+
+// Whether each node has already received (and rebroadcast) the message
+bool           received[MAX_NODES];
+
+// Dont put this on the stack:
+uint8_t buf[RH_SIM_CHANNEL_MAX_MESSAGE_LEN];
+
+void setup()
+{
+  Serial.begin(9600);
+  if (_simulator_argc > 1)
+    numNodes = atoi(_simulator_argv[1]);
+  if (numNodes < 2 || numNodes > MAX_NODES)
+    numNodes = 10;
+
+  // Node addresses are 1 to numNodes. By default only neighbours can hear each other
+  for (uint16_t from = 1; from <= numNodes; from++)
+    for (uint16_t to = 1; to <= numNodes; to++)
+      medium.setProbability(from, to, (to + 1 == from || from + 1 == to) ? 1.0 : 0.0, false);
+  if (_simulator_argc > 2 && !medium.loadConfig(_simulator_argv[2]))
+    exit(1);
+
+  for (uint8_t i = 0; i < numNodes; i++)
+  {
+    drivers[i] = new RH_SimChannel(medium);
+    managers[i] = new RHDatagram(*drivers[i], i + 1);
+    if (!managers[i]->init())
+      Serial.println("init failed");
+  }
+
+  // Start the flood
+  received[0] = true;
+  managers[0]->sendto((uint8_t*)"Hello World!", 13, RH_BROADCAST_ADDRESS);
+}
+
+void loop()
+{
+  uint64_t next = medium.nextEventTime();
+  if (next == RH_SIM_MEDIUM_NO_EVENT)
+  {
+    // Nothing left in flight: the flood has finished
+    uint8_t reached = 0;
+    for (uint8_t i = 0; i < numNodes; i++)
+      if (received[i])
+        reached++;
+    printf("flood reached %d of %d nodes in %llu us of virtual time, %u transmissions, %u lost, %u collisions\n",
+           reached, numNodes, (unsigned long long)medium.now(), medium.transmitted(), medium.lost(), medium.collisions());
+    exit(0);
+  }
+  medium.advanceTo(next);
+
+  // Poll all the nodes to see what has arrived by now
+  for (uint8_t i = 0; i < numNodes; i++)
+  {
+    uint8_t len = sizeof(buf);
+    uint8_t from;
+    while (managers[i]->recvfrom(buf, &len, &from))
+    {
+      if (!received[i])
+      {
+        printf("node %d got '%s' from %d at %llu us\n", i + 1, (char*)buf, from,
+               (unsigned long long)medium.now());
+        received[i] = true;
+        managers[i]->sendto(buf, len, RH_BROADCAST_ADDRESS);
+      }
+      len = sizeof(buf);
+    }
+  }
+}
+
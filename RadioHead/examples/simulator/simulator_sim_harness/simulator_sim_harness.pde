@@ -0,0 +1,118 @@
+// simulator_sim_harness.pde
+// -*- mode: C++ -*-
+// Example sketch showing how to simulate a whole mesh network in one process with the
+// RHSimHarness class. Each node has its own RH_SimChannel driver and RHMesh manager, and its own
+// loop function, which uses the ordinary blocking RHMesh functions just like a sketch running on a
+// real radio. The harness runs the nodes as coroutines on a virtual clock, so the whole network runs
+// much faster than real time, and gives the same results every time.
+// The nodes are placed in a line, where each node can only hear its immediate neighbours.
+// The first node sends a message to the last node every second, and the last node replies,
+// so every message is routed through all the nodes in between.
+// Tested on Linux
+// Build with
+// cd whatever/RadioHead
+// tools/simBuild examples/simulator/simulator_sim_harness/simulator_sim_harness.pde
+// Run with ./simulator_sim_harness [numnodes [seconds]]
+
+#include <RHMesh.h>
+#include <RH_SimChannel.h>
+#include <RHSimHarness.h>
+#include <stdlib.h>
+
+// Maximum number of nodes in the line
+#define MAX_NODES 200
+
+// Runs the nodes and provides the simulator clock
+RHSimHarness harness;
+
+// The medium shared by all the nodes
+RHSimMedium medium;
+
+// Everything belonging to one node
+typedef struct
+{
+  RH_SimChannel* driver;
+  RHMesh*        manager;
+  uint8_t        address;
+  uint16_t       sent;
+  uint16_t       replies;
+} Node;
+
+Node    nodes[MAX_NODES];
+uint8_t numNodes = 10;
+
+void nodeSetup(void* arg)
+{
+  Node* node = (Node*)arg;
+  if (!node->manager->init())
+    Serial.println("init failed");
+}
+
+// The first node sends a request to the last node every second and waits for the reply
+void clientLoop(void* arg)
+{
+  Node* node = (Node*)arg;
+  uint8_t buf[RH_MESH_MAX_MESSAGE_LEN];
+  uint8_t len = sizeof(buf);
+  uint8_t from;
+
+  node->sent++;
+  if (node->manager->sendtoWait((uint8_t*)"Hello World!", 13, numNodes) == RH_ROUTER_ERROR_NONE
+      && node->manager->recvfromAckTimeout(buf, &len, 3000, &from))
+    node->replies++;
+  delay(1000);
+}
+
+// All the other nodes relay messages, and the last one replies to requests
+void serverLoop(void* arg)
+{
+  Node* node = (Node*)arg;
+  uint8_t buf[RH_MESH_MAX_MESSAGE_LEN];
+  uint8_t len = sizeof(buf);
+  uint8_t from;
+
+  if (node->manager->recvfromAck(buf, &len, &from))
+    node->manager->sendtoWait((uint8_t*)"And hello back to you", 22, from);
+}
+
+void setup()
+{
+  Serial.begin(9600);
+  uint32_t seconds = 60;
+  if (_simulator_argc > 1)
+    numNodes = atoi(_simulator_argv[1]);
+  if (numNodes < 2 || numNodes > MAX_NODES)
+    numNodes = 10;
+  if (_simulator_argc > 2)
+    seconds = atoi(_simulator_argv[2]);
+
+  // Make the managers' random timeouts repeatable too
+  srandom(1);
+  // Everything runs on the harness's virtual time
+  setSimulatorClock(&harness);
+  medium.setClock(harness);
+
+  // Node addresses are 1 to numNodes. Only neighbours can hear each other
+  for (uint16_t from = 1; from <= numNodes; from++)
+    for (uint16_t to = 1; to <= numNodes; to++)
+      medium.setProbability(from, to, (to + 1 == from || from + 1 == to) ? 1.0 : 0.0, false);
+
+  for (uint8_t i = 0; i < numNodes; i++)
+  {
+    nodes[i].address = i + 1;
+    nodes[i].driver  = new RH_SimChannel(medium);
+    nodes[i].manager = new RHMesh(*nodes[i].driver, nodes[i].address);
+    harness.addNode(nodeSetup, i == 0 ? clientLoop : serverLoop, &nodes[i]);
+  }
+
+  harness.run(seconds * 1000000ULL);
+
+  printf("%d nodes, %lu seconds of virtual time: %d requests, %d replies\n",
+         numNodes, millis() / 1000, nodes[0].sent, nodes[0].replies);
+  exit(0);
+}
+
+void loop()
+{
+}
+
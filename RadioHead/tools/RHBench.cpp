@@ -0,0 +1,418 @@
+// RHBench.cpp
+// Microbenchmarks for the host side hot paths of the RadioHead protocol stack
+// Copyright (C) 2014 Mike McCauley
+// $Id: RHBench.cpp $
+//
+// Build with
+// cd whatever/RadioHead
+// tools/benchBuild
+// Run with ./RHBench [filter]
+// where filter, if given, runs only the benchmarks whose names contain it.
+// Each line reports the benchmark name, the number of operations timed, the time per
+// operation and, where it makes sense, the throughput in MB/s (millions of bytes per second).
+// Build it with the same compiler and options each time you compare results.
+
+#include <RadioHead.h>
+#if (RH_PLATFORM == RH_PLATFORM_UNIX)
+
+#include <RHCRC.h>
+#include <RH_ASK.h>
+#include <RH_Serial.h>
+#include <RHRouter.h>
+#include <RHMesh.h>
+#include <RHEncryptedDriver.h>
+#include <HardwareSerial.h>
+#include <time.h>
+#ifdef RH_ENABLE_ENCRYPTION_MODULE
+ #include <Speck.h>
+#endif
+
+// Each benchmark is run repeatedly until it has taken at least this long
+#define RH_BENCH_MIN_NS 200000000ULL
+
+// Results are accumulated here so the compiler cant optimise the work away
+volatile uint32_t sink;
+
+// Only run benchmarks whose names contain this
+const char* filter = NULL;
+
+static uint64_t nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Times fn and prints the results. bytes is the number of payload bytes processed
+// by each call, or 0 if throughput is not meaningful
+static void bench(const char* name, void (*fn)(), size_t bytes)
+{
+    if (filter && !strstr(name, filter))
+	return;
+
+    fn(); // Warm up caches and build any tables
+    uint64_t iterations = 1;
+    uint64_t elapsed;
+    while (1)
+    {
+	uint64_t start = nowNs();
+	for (uint64_t i = 0; i < iterations; i++)
+	    fn();
+	elapsed = nowNs() - start;
+	if (elapsed >= RH_BENCH_MIN_NS)
+	    break;
+	iterations *= 2;
+    }
+    double ns = (double)elapsed / iterations;
+    printf("%-32s %12llu %12.1f ns/op", name, (unsigned long long)iterations, ns);
+    if (bytes)
+	printf(" %10.2f MB/s", bytes * 1000.0 / ns);
+    printf("\n");
+}
+
+/////////////////////////////////////////////////////////////////////
+// A driver that delivers a preloaded message every time it is asked, and discards whatever is sent.
+// Lets the manager classes be benchmarked without any IO
+class BenchDriver : public RHGenericDriver
+{
+public:
+    BenchDriver() : _rxLen(0), _rxValid(false), _txCount(0) {}
+
+    // Set the message to be received next
+    void setRx(uint8_t to, uint8_t from, uint8_t id, uint8_t flags, const uint8_t* data, uint8_t len)
+    {
+	_rxHeaderTo    = to;
+	_rxHeaderFrom  = from;
+	_rxHeaderId    = id;
+	_rxHeaderFlags = flags;
+	memcpy(_rxBuf, data, len);
+	_rxLen = len;
+	_rxValid = true;
+    }
+
+    // Set the message to be received next to the last one sent
+    void loopback()
+    {
+	setRx(_txHeaderTo, _txHeaderFrom, _txHeaderId, _txHeaderFlags, _txBuf, _txLen);
+    }
+
+    virtual bool available()
+    {
+	return _rxValid;
+    }
+
+    virtual bool recv(uint8_t* buf, uint8_t* len)
+    {
+	if (!_rxValid)
+	    return false;
+	if (*len > _rxLen)
+	    *len = _rxLen;
+	memcpy(buf, _rxBuf, *len);
+	_rxValid = false;
+	return true;
+    }
+
+    virtual bool send(const uint8_t* data, uint8_t len)
+    {
+	memcpy(_txBuf, data, len);
+	_txLen = len;
+	_txCount++;
+	return true;
+    }
+
+    virtual uint8_t maxMessageLength()
+    {
+	return RH_MAX_MESSAGE_LEN;
+    }
+
+    uint8_t  _rxBuf[RH_MAX_MESSAGE_LEN];
+    uint8_t  _rxLen;
+    bool     _rxValid;
+    uint8_t  _txBuf[RH_MAX_MESSAGE_LEN];
+    uint8_t  _txLen;
+    uint32_t _txCount;
+};
+
+// Test data
+uint8_t data[256];
+
+/////////////////////////////////////////////////////////////////////
+// CRCs
+static void crc16_update_255()
+{
+    uint16_t crc = 0xffff;
+    for (uint16_t i = 0; i < 255; i++)
+	crc = RHcrc16_update(crc, data[i]);
+    sink += crc;
+}
+
+static void crc16_255()
+{
+    sink += RHcrc16(data, 255, 0xffff);
+}
+
+static void crc_xmodem_update_255()
+{
+    uint16_t crc = 0;
+    for (uint16_t i = 0; i < 255; i++)
+	crc = RHcrc_xmodem_update(crc, data[i]);
+    sink += crc;
+}
+
+static void crc_xmodem_255()
+{
+    sink += RHcrc_xmodem(data, 255, 0);
+}
+
+static void crc_ccitt_update_255()
+{
+    uint16_t crc = 0xffff;
+    for (uint16_t i = 0; i < 255; i++)
+	crc = RHcrc_ccitt_update(crc, data[i]);
+    sink += crc;
+}
+
+static void crc_ccitt_255()
+{
+    sink += RHcrc_ccitt(data, 255, 0xffff);
+}
+
+static void crc_ccitt_16()
+{
+    sink += RHcrc_ccitt(data, 16, 0xffff);
+}
+
+static void crc_ibutton_update_255()
+{
+    uint8_t crc = 0;
+    for (uint16_t i = 0; i < 255; i++)
+	crc = RHcrc_ibutton_update(crc, data[i]);
+    sink += crc;
+}
+
+static void crc_ibutton_255()
+{
+    sink += RHcrc_ibutton(data, 255, 0);
+}
+
+/////////////////////////////////////////////////////////////////////
+// RH_ASK symbol encoding and decoding
+class BenchASK : public RH_ASK
+{
+public:
+    // Decode the symbols in the transmit buffer into the receive buffer, as the
+    // receiver would after demodulation, and check the FCS
+    bool decode()
+    {
+	uint8_t* p = _txBuf + RH_ASK_PREAMBLE_LEN;
+	uint8_t  count = _txBufLen - RH_ASK_PREAMBLE_LEN;
+	_rxBufLen = 0;
+	for (uint8_t i = 0; i < count; i += 2)
+	    _rxBuf[_rxBufLen++] = (symbol_6to4(p[i]) << 4) | symbol_6to4(p[i + 1]);
+	validateRxBuf();
+	bool ret = _rxBufValid;
+	_rxBufValid = false;
+	return ret;
+    }
+};
+
+BenchASK ask;
+
+static void ask_encode()
+{
+    ask.send(data, RH_ASK_MAX_MESSAGE_LEN);
+    ask.setModeIdle(); // No interrupts to send it
+}
+
+static void ask_decode()
+{
+    sink += ask.decode();
+}
+
+/////////////////////////////////////////////////////////////////////
+// RH_Serial framing and deframing
+class BenchSerial : public RH_Serial
+{
+public:
+    BenchSerial(HardwareSerial& serial) : RH_Serial(serial) {}
+
+    uint8_t frame(const uint8_t* payload, uint8_t len)
+    {
+	return _frameLen = buildFrame(_frame, payload, len);
+    }
+
+    // Parse the last frame, in one chunk or octet by octet
+    bool deframe(bool chunk)
+    {
+	if (chunk)
+	    handleRx(_frame, _frameLen);
+	else
+	    for (uint8_t i = 0; i < _frameLen; i++)
+		handleRx(_frame[i]);
+#if RH_SERIAL_RX_QUEUE_LEN
+	// Valid frames are queued. Not available(), which would read the port
+	bool ret = !_rxQueue.empty();
+	_rxQueue.clear();
+#else
+	bool ret = _rxBufValid;
+#endif
+	clearRxBuf();
+	return ret;
+    }
+
+    uint8_t _frame[RH_SERIAL_MAX_FRAME_LEN];
+    uint8_t _frameLen;
+};
+
+HardwareSerial benchPort("/dev/null"); // Never opened
+BenchSerial    serial(benchPort);
+
+static void serial_frame()
+{
+    sink += serial.frame(data, RH_SERIAL_MAX_MESSAGE_LEN);
+}
+
+static void serial_deframe_chunk()
+{
+    sink += serial.deframe(true);
+}
+
+static void serial_deframe_octets()
+{
+    sink += serial.deframe(false);
+}
+
+/////////////////////////////////////////////////////////////////////
+// RHEncryptedDriver
+#ifdef RH_ENABLE_ENCRYPTION_MODULE
+BenchDriver       cipherDriver;
+Speck             cipher;
+RHEncryptedDriver encrypted(cipherDriver, cipher);
+
+static void encrypted_send_recv()
+{
+    uint8_t buf[RH_MAX_MESSAGE_LEN];
+    uint8_t len = sizeof(buf);
+    encrypted.send(data, 48);
+    cipherDriver.loopback();
+    sink += encrypted.recv(buf, &len);
+}
+#endif
+
+/////////////////////////////////////////////////////////////////////
+// RHRouter routing table
+BenchDriver routerDriver;
+RHRouter    router(routerDriver, 1);
+uint8_t     routerNext = 0;
+
+static void router_lookup_hit()
+{
+    sink += router.getRouteTo(2 + (routerNext++ % 200)) != NULL;
+}
+
+static void router_lookup_miss()
+{
+    sink += router.getRouteTo(220 + (routerNext++ % 30)) != NULL;
+}
+
+static void router_add_delete()
+{
+    uint8_t dest = 220 + (routerNext++ % 30);
+    router.addRouteTo(dest, 2);
+    router.deleteRouteTo(dest);
+}
+
+/////////////////////////////////////////////////////////////////////
+// RHMesh route discovery request handling
+BenchDriver meshDriver;
+RHMesh      mesh(meshDriver, 1);
+uint8_t     meshId = 0;
+
+// Deliver a route discovery request for a node we dont know from source, via a neighbour
+static void meshDiscoveryRequest(uint8_t source, uint8_t id)
+{
+    uint8_t request[] = { RH_BROADCAST_ADDRESS, source, 1, id, 0, // RoutedMessageHeader
+			  RH_MESH_MESSAGE_TYPE_ROUTE_DISCOVERY_REQUEST, 1, 250, // Looking for node 250
+			  source }; // Route so far
+    meshDriver.setRx(RH_BROADCAST_ADDRESS, 2 + (id % 8), id, 0, request, sizeof(request));
+    uint8_t buf[RH_MESH_MAX_MESSAGE_LEN];
+    uint8_t len = sizeof(buf);
+    mesh.recvfromAck(buf, &len);
+}
+
+// A new request: learn the routes and rebroadcast it
+static void mesh_discovery_relay()
+{
+    meshId++;
+    meshDiscoveryRequest(100 + (meshId % 100), meshId);
+}
+
+// The same request again, via another neighbour
+static void mesh_discovery_duplicate()
+{
+    meshDiscoveryRequest(100, 0);
+}
+
+/////////////////////////////////////////////////////////////////////
+void setup()
+{
+    if (_simulator_argc > 1)
+	filter = _simulator_argv[1];
+    for (uint16_t i = 0; i < sizeof(data); i++)
+	data[i] = i * 7; // Includes some DLEs for RH_Serial
+
+    printf("%-32s %12s %15s %13s\n", "benchmark", "ops", "time", "throughput");
+    bench("crc16_update_255",          crc16_update_255, 255);
+    bench("crc16_255",                 crc16_255, 255);
+    bench("crc_xmodem_update_255",     crc_xmodem_update_255, 255);
+    bench("crc_xmodem_255",            crc_xmodem_255, 255);
+    bench("crc_ccitt_update_255",      crc_ccitt_update_255, 255);
+    bench("crc_ccitt_255",             crc_ccitt_255, 255);
+    bench("crc_ccitt_16",              crc_ccitt_16, 16);
+    bench("crc_ibutton_update_255",    crc_ibutton_update_255, 255);
+    bench("crc_ibutton_255",           crc_ibutton_255, 255);
+
+    ask.init();
+    bench("ask_encode",                ask_encode, RH_ASK_MAX_MESSAGE_LEN);
+    ask_encode();
+    if (!ask.decode())
+	printf("ask_decode: FCS check failed\n");
+    bench("ask_decode",                ask_decode, RH_ASK_MAX_MESSAGE_LEN);
+
+    serial.init();
+    bench("serial_frame",              serial_frame, RH_SERIAL_MAX_MESSAGE_LEN);
+    serial_frame();
+    if (!serial.deframe(true))
+	printf("serial_deframe: FCS check failed\n");
+    bench("serial_deframe_chunk",      serial_deframe_chunk, RH_SERIAL_MAX_MESSAGE_LEN);
+    bench("serial_deframe_octets",     serial_deframe_octets, RH_SERIAL_MAX_MESSAGE_LEN);
+
+#ifdef RH_ENABLE_ENCRYPTION_MODULE
+    uint8_t key[16] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
+    cipher.setKey(key, sizeof(key));
+    encrypted.init();
+    bench("encrypted_send_recv",       encrypted_send_recv, 48);
+#endif
+
+    router.init();
+    for (uint16_t dest = 2; dest < 202; dest++)
+	router.addRouteTo(dest, 2 + (dest % 8));
+    bench("router_lookup_hit",         router_lookup_hit, 0);
+    bench("router_lookup_miss",        router_lookup_miss, 0);
+    bench("router_add_delete",         router_add_delete, 0);
+
+    mesh.init();
+    bench("mesh_discovery_relay",      mesh_discovery_relay, 0);
+    mesh_discovery_relay();
+    if (meshDriver._txCount == 0)
+	printf("mesh_discovery_relay: nothing rebroadcast\n");
+    bench("mesh_discovery_duplicate",  mesh_discovery_duplicate, 0);
+
+    exit(0);
+}
+
+void loop()
+{
+}
+
+#endif
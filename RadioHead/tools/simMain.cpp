@@ -8,54 +8,73 @@
 
 #include <stdio.h>
 #include <RHutil/simulator.h>
-#include <sys/time.h>
+#include <RHutil/RHSimClock.h>
 #include <unistd.h>
 #include <time.h>
 
 SerialSimulator Serial;
 
+// The default clock runs in real time, from the start of the process
+static RHSimRealClock realClock;
+
+// The clock that implements millis(), delay() and yield()
+static RHSimClock* simClock = &realClock;
+
 // Functions we expect to find in the sketch
 extern void setup();
 extern void loop();
 
-// Millis at the start of the process
-unsigned long start_millis;
-
 int    _simulator_argc;
 char** _simulator_argv;
 
-// Returns milliseconds since beginning of day
-unsigned long time_in_millis()
-{    
-    struct timeval te; 
-    gettimeofday(&te, NULL); // get current time
-    unsigned long milliseconds = te.tv_sec*1000LL + te.tv_usec/1000; // caclulate milliseconds
-    return milliseconds;
-}
-
 // Run the Arduino standard functions in the main loop
 int main(int argc, char** argv)
 {
     // Let simulated program have access to argc and argv
     _simulator_argc = argc;
     _simulator_argv = argv;
-    start_millis = time_in_millis();
     // Seed the random number generator
     srand(getpid() ^ (unsigned) time(NULL)/2);
     setup();
     while (1)
+    {
 	loop();
+	// Returning from loop() is the sketch's way of waiting for something to happen
+	yield();
+    }
+}
+
+void setSimulatorClock(RHSimClock* newClock)
+{
+    simClock = newClock ? newClock : &realClock;
+}
+
+RHSimClock& simulatorClock()
+{
+    return *simClock;
 }
 
 void delay(unsigned long ms)
 {
-    usleep(ms * 1000);
+    simClock->delay(ms * 1000ULL);
 }
 
 // Arduino equivalent, milliseconds since process start
 unsigned long millis()
 {
-    return time_in_millis() - start_millis;
+    return simClock->micros() / 1000;
+}
+
+// Arduino equivalent, microseconds since process start
+unsigned long micros()
+{
+    return simClock->micros();
+}
+
+// Arduino equivalent, called by YIELD in wait loops
+void yield()
+{
+    simClock->yield();
 }
 
 long random(long from, long to)
@@ -68,4 +87,22 @@ long random(long to)
     return random(0, to);
 }
 
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    (void)pin; // Not used
+    (void)mode; // Not used
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+    (void)pin; // Not used
+    (void)val; // Not used
+}
+
+int digitalRead(uint8_t pin)
+{
+    (void)pin; // Not used
+    return LOW;
+}
+
 #endif